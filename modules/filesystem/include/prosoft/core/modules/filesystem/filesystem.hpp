@@ -373,12 +373,138 @@ void create_directory_symlink(const path&, const path& link, error_code&);
 bool equivalent(const path&, const path&);
 bool equivalent(const path&, const path&, error_code&) noexcept;
 
+// Extension: the identity used by equivalent(). symlink_file_id() does not follow a final symlink.
+file_id_type file_id(const path&);
+file_id_type file_id(const path&, error_code&) noexcept;
+file_id_type symlink_file_id(const path&);
+file_id_type symlink_file_id(const path&, error_code&) noexcept;
+
 bool remove(const path&);
 bool remove(const path&, error_code&) noexcept;
 
+// Extension
+enum class remove_options {
+    none,
+    // Give the owner full access to a directory that can't be read or whose entries can't be removed, then retry.
+    // On Windows the read-only attribute is cleared instead.
+    make_writable = 0x1,
+    // Leave entries that can't be removed because of permissions in place, along with their ancestors, instead of failing.
+    skip_permission_denied = 0x2,
+};
+PS_ENUM_BITMASK_OPS(remove_options);
+
+// Extension
+struct remove_config {
+    using count_type = std::size_t;
+    remove_options options;
+    // Workers removing subtrees, 0 uses std::thread::hardware_concurrency().
+    count_type threads;
+    
+    explicit remove_config(remove_options o = remove_options::none, count_type t = 0)
+        : options(o)
+        , threads(t) {}
+    ~remove_config() = default;
+    PS_DEFAULT_COPY(remove_config);
+    PS_DEFAULT_MOVE(remove_config);
+};
+
+// Returns the number of entries removed, 0 if the path does not exist. A final symlink is removed, not followed.
+// Directories are read and their entries removed relative to the directory's descriptor, with subtrees spread over a pool of workers.
+// The error_code overloads return static_cast<std::uintmax_t>(-1) on error.
+std::uintmax_t remove_all(const path&);
+std::uintmax_t remove_all(const path&, error_code&);
+// Extension
+std::uintmax_t remove_all(const path&, const remove_config&);
+std::uintmax_t remove_all(const path&, const remove_config&, error_code&);
+
 void rename(const path&, const path&);
 void rename(const path&, const path&, error_code&) noexcept;
 
+// Extension: how copy_file() moved the data, strongest first.
+enum class copy_strategy {
+    none, // no data
+    clone, // reflink (FICLONE), the data is shared with the source until either is modified
+    copy_range, // copy_file_range, the filesystem may still share or offload the data
+    sendfile,
+    read_write,
+};
+
+// Extension
+struct copy_file_result {
+    file_size_type bytes_cloned; // shared with the source, nothing was written
+    file_size_type bytes_copied;
+    file_size_type bytes_skipped; // source holes that were left as holes in the target
+    copy_strategy strategy; // the weakest strategy that was needed
+    
+    constexpr copy_file_result() noexcept
+        : bytes_cloned()
+        , bytes_copied()
+        , bytes_skipped()
+        , strategy(copy_strategy::none) {}
+};
+
+// Returns false if the target was skipped (copy_options::skip_existing or update_existing).
+bool copy_file(const path& from, const path& to, copy_options);
+bool copy_file(const path& from, const path& to, copy_options, error_code&) noexcept;
+inline bool copy_file(const path& from, const path& to) {
+    return copy_file(from, to, copy_options::none);
+}
+inline bool copy_file(const path& from, const path& to, error_code& ec) noexcept {
+    return copy_file(from, to, copy_options::none, ec);
+}
+// Extension
+bool copy_file(const path& from, const path& to, copy_options, copy_file_result&);
+bool copy_file(const path& from, const path& to, copy_options, copy_file_result&, error_code&) noexcept;
+
+// Extension
+struct copy_config {
+    using count_type = std::size_t;
+    // Workers copying files, 0 uses std::thread::hardware_concurrency().
+    count_type threads;
+    
+    explicit copy_config(count_type t = 0)
+        : threads(t) {}
+    ~copy_config() = default;
+    PS_DEFAULT_COPY(copy_config);
+    PS_DEFAULT_MOVE(copy_config);
+};
+
+// Extension
+struct copy_result {
+    using count_type = std::size_t;
+    count_type files;
+    count_type directories;
+    count_type symlinks;
+    count_type hardlinks; // reproduced with a link instead of a second copy
+    count_type skipped; // existing targets
+    file_size_type bytes_cloned;
+    file_size_type bytes_copied;
+    
+    constexpr copy_result() noexcept
+        : files()
+        , directories()
+        , symlinks()
+        , hardlinks()
+        , skipped()
+        , bytes_cloned()
+        , bytes_copied() {}
+};
+
+// A recursive copy runs files through a pool of workers. Directories are created relative to their parent's descriptor
+// and their metadata (mode, owner, times and ACL) is applied once all of their entries exist.
+// Owners are only changed if permitted.
+void copy(const path& from, const path& to, copy_options);
+void copy(const path& from, const path& to, copy_options, error_code&);
+inline void copy(const path& from, const path& to) {
+    copy(from, to, copy_options::none);
+}
+inline void copy(const path& from, const path& to, error_code& ec) {
+    copy(from, to, copy_options::none, ec);
+}
+// Extension
+void copy(const path& from, const path& to, copy_options, const copy_config&, copy_result&);
+void copy(const path& from, const path& to, copy_options, const copy_config&, copy_result&, error_code&);
+
 enum class status_info {
     basic = 0,
     perms = 0x1,
@@ -386,6 +512,9 @@ enum class status_info {
     size = 0x4,
     
     all = basic|perms|times|size,
+    
+    // Modifier: cached attributes are acceptable (AT_STATX_DONT_SYNC on Linux). May avoid a server round trip on network filesystems. Ignored where unsupported.
+    cached = 0x100,
 };
 PS_ENUM_BITMASK_OPS(status_info);
 
@@ -0,0 +1,149 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Spec extension
+
+#ifndef PS_CORE_FILESYSTEM_ATOMIC_FILE_HPP
+#define PS_CORE_FILESYSTEM_ATOMIC_FILE_HPP
+
+#include <string>
+#include <vector>
+
+#include "filesystem.hpp"
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+enum class publish_options {
+    none, // an existing target is replaced
+    no_replace = 0x1, // fail with EEXIST if the target exists
+    exchange = 0x2, // the target must exist, it's swapped with the new content in a single step and the old content removed
+};
+PS_ENUM_BITMASK_OPS(publish_options);
+
+class durability_group;
+
+// New content for a file that readers only ever see complete.
+// It's written to an unnamed file (Linux O_TMPFILE) or a hidden temporary in the target's directory and takes the target's name on commit.
+// The mode of an existing target is kept. Content that is not committed is discarded by the destructor.
+class atomic_file {
+public:
+#if !_WIN32
+    using native_handle_type = int;
+#else
+    using native_handle_type = void*;
+#endif
+    
+    explicit atomic_file(const path& target, publish_options = publish_options::none);
+    atomic_file(const path& target, publish_options, error_code&);
+    atomic_file(atomic_file&&) noexcept;
+    atomic_file& operator=(atomic_file&&) noexcept;
+    ~atomic_file();
+    PS_DISABLE_COPY(atomic_file);
+    
+    void write(const void*, std::size_t);
+    void write(const void*, std::size_t, error_code&) noexcept;
+    void write(const std::string& s) {
+        write(s.data(), s.size());
+    }
+    
+    // The content is synced, published and its directory synced before this returns.
+    void commit();
+    void commit(error_code&);
+    
+    // The target is untouched.
+    void discard() noexcept;
+    
+    const path& target() const noexcept {
+        return m_target;
+    }
+    
+    bool is_open() const noexcept;
+    
+    // For writers of their own (e.g. mmap), the file position is not tracked.
+    native_handle_type native_handle() const noexcept {
+        return m_handle;
+    }
+    
+private:
+    friend class durability_group;
+    void open(error_code&);
+    void sync(error_code&) noexcept;
+    void publish(error_code&);
+    
+    path m_target;
+    path m_temp; // empty for an unnamed file
+    native_handle_type m_handle;
+    publish_options m_opts;
+};
+
+// Commits many files with far fewer sync calls than committing each one:
+// all content is synced first, then every file is published and finally each directory is synced once.
+// Files are published in the order they were added. After an error the files that were not yet published are discarded.
+class durability_group {
+public:
+    enum class sync_mode {
+        automatic, // per_filesystem for groups of at least default_syncfs_threshold() files if syncfs() reports write errors (Linux 5.8), per_file otherwise
+        per_file, // fdatasync() each file, then fsync() each directory
+        per_filesystem, // Linux: syncfs() each filesystem before and after publishing. Also writes unrelated dirty data. Same as per_file elsewhere.
+                        // Before Linux 5.8 syncfs() doesn't report writeback errors, so a failed write may go unnoticed.
+    };
+    using size_type = std::size_t;
+    
+    static constexpr size_type default_syncfs_threshold() { return size_type{64}; }
+    
+    explicit durability_group(sync_mode m = sync_mode::automatic)
+        : m_files()
+        , m_mode(m) {}
+    ~durability_group() = default;
+    PS_DISABLE_COPY(durability_group);
+    PS_DEFAULT_MOVE(durability_group);
+    
+    void add(atomic_file&& f) {
+        m_files.push_back(std::move(f));
+    }
+    
+    size_type size() const noexcept {
+        return m_files.size();
+    }
+    
+    bool empty() const noexcept {
+        return m_files.empty();
+    }
+    
+    void commit();
+    void commit(error_code&);
+    
+private:
+    std::vector<atomic_file> m_files;
+    sync_mode m_mode;
+};
+
+} // v1
+} // filesystem
+} // prosoft
+
+#endif // PS_CORE_FILESYSTEM_ATOMIC_FILE_HPP
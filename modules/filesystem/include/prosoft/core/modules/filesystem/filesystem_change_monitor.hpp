@@ -38,6 +38,7 @@
 #if PS_HAVE_FILESYSTEM_CHANGE_MONITOR
 
 #include <chrono>
+#include <cstddef>
 #include <cstdint>
 #include <deque>
 #include <iostream>
@@ -72,6 +73,8 @@ enum class change_event : unsigned {
     // A full rescan of the tree is suggested.
     // This may be set in conjuction with canceled due to an error (in which case the rescan is required),
     // or it may be a standalone event that contains a path in the tree that has been hidden or exposed due to a volume mount/unmount.
+    // A standalone event is also used for a directory whose descendant events were folded (see change_config::subtree_threshold),
+    // and for the root when change_config::memory_limit was exceeded.
     rescan = 1<<29,
     
     // Special flag indicating the event (created or removed) was a side effect of change made outside of the watched tree.
@@ -310,12 +313,49 @@ struct change_config {
     latency_type notification_latency; // how often to post notifications, a larger # allows notifications to be coalesced into fewer callbacks
     change_event events;
     unsigned reserved_flags;
-    
-    constexpr change_config() noexcept
+    // Events for the same path within a callback are always merged.
+    // When more than this many events are below a single directory (other than the root) they are folded into one rescan event for the directory.
+    // 0 disables folding.
+    std::size_t subtree_threshold;
+    // Approximate size in bytes of pending notifications. When exceeded the pending notifications are replaced by a rescan event for the root
+    // and the monitor keeps running. 0 is unlimited.
+    std::size_t memory_limit;
+    // Linux: optional file that notifications are journaled to, so a serialized state can be replayed after a restart.
+    // The first monitor to open a journal writes it and any other monitor (in any process) only replays from it.
+    // A journal is continuous only while its writer runs, so replaying across a restart of the writer results in rescan_required.
+    // Only the writer's tree is journaled, a monitor whose root isn't within it also gets rescan_required.
+    // Empty for none. A thawed state remembers the journal it was serialized with.
+    path journal;
+    // Size in bytes of a new journal. When full, the oldest half is discarded.
+    std::size_t journal_size;
+    // When non-zero the tree is polled instead of using system notifications, for filesystems where those are unavailable or unreliable (NFS, SMB, FUSE).
+    // This is how often a directory that keeps changing is checked, directories without changes back off to max_poll_interval.
+    // A directory is only read again when its own modification or change time differs, or when it was modified within 2 seconds (FAT's timestamp granularity)
+    // of the last read. Renames are only detected within a single poll.
+    latency_type poll_interval;
+    latency_type max_poll_interval;
+    // Limits the directories checked by a single poll to those whose expected calls (two, plus a stat per known entry) fit within this many, 0 is unlimited.
+    // Directories that don't fit are checked by the next poll. This bounds directories, not calls: a directory is always read in full,
+    // one stat per entry, so a poll whose first directory is larger than the limit exceeds it.
+    std::size_t poll_syscall_limit;
+    
+    static constexpr latency_type default_notification_latency() { return latency_type{1000}; }
+    static constexpr std::size_t default_memory_limit() { return 64UL * 1024UL * 1024UL; }
+    static constexpr std::size_t default_journal_size() { return 16UL * 1024UL * 1024UL; }
+    static constexpr std::size_t default_poll_syscall_limit() { return 4096; }
+    
+    change_config() noexcept
         : state()
-        , notification_latency(1000)
+        , notification_latency(default_notification_latency())
         , events(change_event::all)
-        , reserved_flags() {}
+        , reserved_flags()
+        , subtree_threshold()
+        , memory_limit(default_memory_limit())
+        , journal()
+        , journal_size(default_journal_size())
+        , poll_interval()
+        , max_poll_interval(30000)
+        , poll_syscall_limit(default_poll_syscall_limit()) {}
     ~change_config() = default;
     PS_DEFAULT_COPY(change_config);
     PS_DEFAULT_MOVE(change_config);
@@ -0,0 +1,101 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Spec extension
+
+#ifndef PS_CORE_FILESYSTEM_DIFF_HPP
+#define PS_CORE_FILESYSTEM_DIFF_HPP
+
+#include <functional>
+
+#include "filesystem.hpp"
+#include "filesystem_manifest.hpp"
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+enum class diff_kind {
+    added,
+    removed,
+    modified,
+    renamed,
+};
+
+enum class diff_options : unsigned {
+    none,
+    // Removed and added entries with the same id are reported as renamed. These are held until both sides are walked,
+    // then reported by path, all other records are delivered as they're found. Ids are only meaningful on the same volume.
+    detect_renames = 0x1,
+    // Permissions and metadata modified times (ctime) are compared too.
+    compare_metadata = 0x2,
+    // Directories with the same id and modified/metadata modified times are not descended.
+    // Those times only change when entries are added, removed or renamed, so a file modified in place below such a directory is not found.
+    prune_unchanged_directories = 0x4,
+    // Unreadable directories are compared without their descendants.
+    skip_permission_denied = 0x8,
+};
+PS_ENUM_BITMASK_OPS(diff_options);
+
+struct diff_config {
+    using count_type = std::size_t;
+    diff_options options;
+    // Subtrees down to a few levels below the roots are compared in parallel. 0 uses std::thread::hardware_concurrency().
+    count_type threads;
+    
+    explicit diff_config(diff_options opts = diff_options::detect_renames, count_type t = 0)
+        : options(opts)
+        , threads(t) {}
+    ~diff_config() = default;
+    PS_DEFAULT_COPY(diff_config);
+    PS_DEFAULT_MOVE(diff_config);
+};
+
+struct diff_record {
+    diff_kind kind;
+    filesystem::path path; // relative to the roots, the new path when renamed
+    filesystem::path old_path; // renamed
+    manifest_record before; // type is none when added
+    manifest_record after; // type is none when removed
+};
+
+// Called from the walkers, one record at a time, in no particular order.
+// An exception from the visitor, or from a walker, stops the comparison and is rethrown once all walkers have finished.
+using diff_visitor = std::function<void (diff_record&)>;
+
+// Both sides are walked in lockstep in sorted order, so no side is held in memory.
+// Regular files and symlinks are modified when their size or modified time differ, directories when their modified time does.
+// A change of type is reported as modified, followed by the descendants of either side.
+// The manifest must be sorted (manifest_writer::append_tree()).
+void diff(const manifest& before, const path& after, const diff_config&, diff_visitor);
+void diff(const manifest& before, const path& after, const diff_config&, diff_visitor, error_code&);
+void diff(const path& before, const path& after, const diff_config&, diff_visitor);
+void diff(const path& before, const path& after, const diff_config&, diff_visitor, error_code&);
+
+} // v1
+} // filesystem
+} // prosoft
+
+#endif // PS_CORE_FILESYSTEM_DIFF_HPP
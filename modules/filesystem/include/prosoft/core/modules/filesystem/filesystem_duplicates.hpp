@@ -0,0 +1,142 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Spec extension
+
+#ifndef PS_CORE_FILESYSTEM_DUPLICATES_HPP
+#define PS_CORE_FILESYSTEM_DUPLICATES_HPP
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "filesystem.hpp"
+#include "filesystem_hash.hpp"
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+namespace ifilesystem {
+class duplicate_finder_state;
+}
+
+enum class duplicate_options : unsigned {
+    none,
+    // Confirm candidates by comparing their bytes instead of a full hash. Rules out hash collisions,
+    // but every candidate is read once per distinct file of its size.
+    byte_compare = 0x1,
+};
+PS_ENUM_BITMASK_OPS(duplicate_options);
+
+struct duplicate_config {
+    using count_type = std::size_t;
+    duplicate_options options;
+    // Confirms the candidates. A collision reports different files as duplicates, so the default is cryptographic.
+    hash_algorithm algorithm;
+    // Only narrows down the candidates, a collision costs a full read but never a wrong group.
+    hash_algorithm edge_algorithm;
+    // Each device is read by its own workers.
+    count_type threads_per_device;
+    // Smaller files are ignored. The default skips empty files, which are all equal.
+    file_size_type min_size;
+    // Files of the same size are first compared by a hash of this many bytes at the start and at the end.
+    file_size_type edge_size;
+    
+    static constexpr file_size_type default_edge_size() { return file_size_type{4096}; }
+    
+    explicit duplicate_config(duplicate_options opts = duplicate_options::none, hash_algorithm a = hash_algorithm::sha256)
+        : options(opts)
+        , algorithm(a)
+        , edge_algorithm(hash_algorithm::xxh64)
+        , threads_per_device(2)
+        , min_size(1)
+        , edge_size(default_edge_size()) {}
+    ~duplicate_config() = default;
+    PS_DEFAULT_COPY(duplicate_config);
+    PS_DEFAULT_MOVE(duplicate_config);
+};
+
+struct duplicate_group {
+    file_size_type size;
+    file_digest digest; // empty with byte_compare
+    std::vector<path> paths; // at least 2, each a different file
+};
+
+struct duplicate_statistics {
+    using count_type = std::size_t;
+    count_type files; // regular files of at least min_size
+    count_type hardlinks; // files skipped as another link to a file already found
+    count_type edge_hashed;
+    count_type confirmed; // files fully hashed or compared
+    file_size_type bytes_read;
+    count_type groups;
+    
+    duplicate_statistics()
+        : files()
+        , hardlinks()
+        , edge_hashed()
+        , confirmed()
+        , bytes_read()
+        , groups() {}
+};
+
+// Called from the workers, one group at a time.
+using duplicate_visitor = std::function<void (duplicate_group&)>;
+
+// Finds files with the same contents in three stages, each reading only the files left by the previous one:
+// files are grouped by size, then by a hash of their edges, then confirmed by a full hash (or a byte compare).
+// Sizes and ids come from the entry cache when the iterator filled it. Symlinks are not followed.
+class duplicate_finder {
+public:
+    duplicate_finder(const duplicate_config&, duplicate_visitor);
+    ~duplicate_finder();
+    PS_DISABLE_COPY(duplicate_finder);
+    PS_DISABLE_MOVE(duplicate_finder);
+    
+    // Other types and files that can't be stat'd are ignored.
+    void push(const directory_entry&);
+    
+    // Reads the candidates and delivers each group as soon as it is confirmed.
+    // Read errors drop the file from its group. An exception from the visitor stops the workers and is rethrown here.
+    void finish();
+    
+    // Valid after finish().
+    const duplicate_statistics& statistics() const;
+    
+private:
+    std::unique_ptr<ifilesystem::duplicate_finder_state> m_state;
+};
+
+// Searches root recursively, skipping directories that can't be read.
+std::vector<duplicate_group> find_duplicates(const path& root, const duplicate_config& = duplicate_config{});
+std::vector<duplicate_group> find_duplicates(const path& root, const duplicate_config&, error_code&);
+
+} // v1
+} // filesystem
+} // prosoft
+
+#endif // PS_CORE_FILESYSTEM_DUPLICATES_HPP
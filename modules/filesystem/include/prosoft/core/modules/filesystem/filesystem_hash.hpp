@@ -0,0 +1,216 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Spec extension
+
+#ifndef PS_CORE_FILESYSTEM_HASH_HPP
+#define PS_CORE_FILESYSTEM_HASH_HPP
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "filesystem.hpp"
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+namespace ifilesystem {
+class hash_pipeline_state;
+}
+
+enum class hash_algorithm : std::uint8_t {
+    xxh64, // 64 bit, not cryptographic
+    murmur3_128, // MurmurHash3 x64 128 bit, not cryptographic
+    sha256,
+};
+
+class file_digest {
+public:
+    using value_type = std::uint8_t;
+    using size_type = std::size_t;
+    static constexpr size_type max_size = 32;
+    
+    file_digest() noexcept
+        : m_bytes()
+        , m_size()
+        , m_algorithm() {}
+    file_digest(hash_algorithm, const value_type*, size_type);
+    ~file_digest() = default;
+    PS_DEFAULT_COPY(file_digest);
+    PS_DEFAULT_MOVE(file_digest);
+    
+    hash_algorithm algorithm() const noexcept {
+        return m_algorithm;
+    }
+    
+    const value_type* data() const noexcept {
+        return m_bytes.data();
+    }
+    
+    size_type size() const noexcept {
+        return m_size;
+    }
+    
+    bool empty() const noexcept {
+        return m_size == 0;
+    }
+    
+    // Lower case hex.
+    std::string to_string() const;
+    
+    bool operator==(const file_digest& other) const noexcept {
+        return m_algorithm == other.m_algorithm && m_size == other.m_size && m_bytes == other.m_bytes;
+    }
+    
+    bool operator!=(const file_digest& other) const noexcept {
+        return !operator==(other);
+    }
+    
+    bool operator<(const file_digest& other) const noexcept {
+        return m_algorithm < other.m_algorithm || (m_algorithm == other.m_algorithm && m_bytes < other.m_bytes);
+    }
+    
+private:
+    std::array<value_type, max_size> m_bytes;
+    std::uint8_t m_size;
+    hash_algorithm m_algorithm;
+};
+
+struct hash_config {
+    using count_type = std::size_t;
+    using size_type = std::size_t;
+    hash_algorithm algorithm;
+    // 0 uses std::thread::hardware_concurrency().
+    count_type threads;
+    // Files larger than this are hashed as a tree: every chunk is hashed on its own, in parallel, and the digest is the hash
+    // of the file size, chunk size and chunk digests. The digest depends on the chunk size but never on the number of threads.
+    // 0 hashes every file as a single stream.
+    size_type chunk_size;
+    // Reads are this size, in a page aligned buffer per worker.
+    size_type buffer_size;
+    // POSIX: files of at least this size are mapped instead of read. 0 never maps.
+    size_type mmap_threshold;
+    
+    static constexpr size_type default_chunk_size() { return size_type{16U * 1024U * 1024U}; }
+    static constexpr size_type default_buffer_size() { return size_type{1024U * 1024U}; }
+    
+    explicit hash_config(hash_algorithm a = hash_algorithm::xxh64, count_type t = 0)
+        : algorithm(a)
+        , threads(t)
+        , chunk_size(default_chunk_size())
+        , buffer_size(default_buffer_size())
+        , mmap_threshold() {}
+    ~hash_config() = default;
+    PS_DEFAULT_COPY(hash_config);
+    PS_DEFAULT_MOVE(hash_config);
+};
+
+struct hash_statistics {
+    using duration_type = std::chrono::nanoseconds;
+    
+    struct worker {
+        file_size_type bytes;
+        duration_type busy; // reading and hashing
+        
+        worker() noexcept
+            : bytes()
+            , busy() {}
+        
+        // MB is 10^6 bytes.
+        double mb_per_second() const noexcept {
+            return busy.count() > 0 ? double(bytes) * 1000.0 / double(busy.count()) : 0.0;
+        }
+    };
+    
+    std::vector<worker> workers;
+    duration_type elapsed;
+    
+    hash_statistics()
+        : workers()
+        , elapsed() {}
+    
+    file_size_type bytes() const noexcept {
+        file_size_type n = 0;
+        for (const auto& w : workers) {
+            n += w.bytes;
+        }
+        return n;
+    }
+    
+    // All workers over the elapsed time.
+    double mb_per_second() const noexcept {
+        return elapsed.count() > 0 ? double(bytes()) * 1000.0 / double(elapsed.count()) : 0.0;
+    }
+};
+
+// Large files are split into chunks that are hashed across config.threads workers.
+file_digest hash_file(const path&, const hash_config& = hash_config{});
+file_digest hash_file(const path&, const hash_config&, error_code&);
+file_digest hash_file(const path&, const hash_config&, hash_statistics&, error_code&);
+
+struct hash_record {
+    filesystem::path path;
+    file_size_type size; // bytes hashed
+    file_time_type last_write;
+    file_digest digest;
+    error_code error; // the file could not be read, the digest is empty
+};
+
+// Called from the workers, one record at a time.
+using hash_visitor = std::function<void (hash_record&)>;
+
+// Hashes the regular files pushed to it (e.g. from a recursive_directory_iterator) on a pool of workers,
+// large files are hashed as a tree in a single worker. Records are delivered in completion order.
+class hash_pipeline {
+public:
+    hash_pipeline(const hash_config&, hash_visitor);
+    ~hash_pipeline();
+    PS_DISABLE_COPY(hash_pipeline);
+    PS_DISABLE_MOVE(hash_pipeline);
+    
+    // Other types are ignored. Blocks while the workers are behind.
+    void push(const directory_entry&);
+    
+    // Waits for all records to be delivered. An exception from the visitor stops the workers and is rethrown here.
+    void finish();
+    
+    // Valid after finish().
+    const hash_statistics& statistics() const;
+    
+private:
+    std::unique_ptr<ifilesystem::hash_pipeline_state> m_state;
+};
+
+} // v1
+} // filesystem
+} // prosoft
+
+#endif // PS_CORE_FILESYSTEM_HASH_HPP
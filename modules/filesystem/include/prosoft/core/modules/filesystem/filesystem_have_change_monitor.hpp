@@ -26,7 +26,7 @@
 #ifndef PS_HAVE_FILESYSTEM_CHANGE_MONITOR_HPP
 #define PS_HAVE_FILESYSTEM_CHANGE_MONITOR_HPP
 
-#define PS_HAVE_FILESYSTEM_CHANGE_MONITOR __APPLE__
-#define PS_HAVE_RECURISIVE_FILESYSTEM_CHANGE_MONITOR __APPLE__
+#define PS_HAVE_FILESYSTEM_CHANGE_MONITOR (__APPLE__ || __linux__)
+#define PS_HAVE_RECURISIVE_FILESYSTEM_CHANGE_MONITOR (__APPLE__ || __linux__)
 
 #endif // PS_HAVE_FILESYSTEM_CHANGE_MONITOR_HPP
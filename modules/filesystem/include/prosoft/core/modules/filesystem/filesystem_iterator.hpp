@@ -27,10 +27,14 @@
 #define PS_CORE_FILESYSTEM_ITERATOR_HPP
 
 #include <atomic>
+#include <cstddef>
+#include <functional>
 #include <iterator>
 #include <limits>
 #include <memory>
+#include <string>
 #include <type_traits>
+#include <vector>
 
 #include "filesystem_primatives.hpp"
 
@@ -40,8 +44,11 @@ inline namespace v1 {
 
 class file_status;
 
+template <class Traits>
+class basic_iterator;
+
 namespace ifilesystem {
-class iterator_state;
+struct cache_info;
 }
 
 // define and not constexpr as not all libraries implement time_since_epoch as constexpr
@@ -61,14 +68,18 @@ public:
         : m_path()
         , m_type(file_type::none)
         , m_size(unknown_size)
-        , m_last_write(PS_FS_ENTRY_INVALID_TIME_VALUE) {
+        , m_last_write(PS_FS_ENTRY_INVALID_TIME_VALUE)
+        , m_dev()
+        , m_ino() {
     }
     
     explicit directory_entry(const path_type& p)
         : m_path(p)
         , m_type(file_type::none)
         , m_size(unknown_size)
-        , m_last_write(PS_FS_ENTRY_INVALID_TIME_VALUE) {
+        , m_last_write(PS_FS_ENTRY_INVALID_TIME_VALUE)
+        , m_dev()
+        , m_ino() {
     }
     
     ~directory_entry() = default;
@@ -77,14 +88,18 @@ public:
         : m_path(other.m_path)
         , m_type(other.m_type.load())
         , m_size(other.m_size.load())
-        , m_last_write(other.m_last_write.load()) {
+        , m_last_write(other.m_last_write.load())
+        , m_dev(other.m_dev.load())
+        , m_ino(other.m_ino.load()) {
     }
     
     directory_entry(directory_entry&& other) noexcept(std::is_nothrow_move_constructible<path_type>::value)
         : m_path(std::move(other.m_path))
         , m_type(other.m_type.load())
         , m_size(other.m_size.load())
-        , m_last_write(other.m_last_write.load()) {
+        , m_last_write(other.m_last_write.load())
+        , m_dev(other.m_dev.load())
+        , m_ino(other.m_ino.load()) {
     }
     
     directory_entry& operator=(const directory_entry& other) {
@@ -92,6 +107,8 @@ public:
         m_type = other.m_type.load();
         m_size = other.m_size.load();
         m_last_write = other.m_last_write.load();
+        m_dev = other.m_dev.load();
+        m_ino = other.m_ino.load();
         return *this;
     }
     
@@ -100,6 +117,8 @@ public:
         m_type = other.m_type.load();
         m_size = other.m_size.load();
         m_last_write = other.m_last_write.load();
+        m_dev = other.m_dev.load();
+        m_ino = other.m_ino.load();
         return *this;
     }
     
@@ -108,7 +127,9 @@ public:
         : m_path(std::move(p))
         , m_type(file_type::none)
         , m_size(unknown_size)
-        , m_last_write(PS_FS_ENTRY_INVALID_TIME_VALUE) {
+        , m_last_write(PS_FS_ENTRY_INVALID_TIME_VALUE)
+        , m_dev()
+        , m_ino() {
     }
     
     void assign(path_type&& p) {
@@ -195,6 +216,13 @@ public:
     file_time_type last_write_time() const;
     file_time_type last_write_time(error_code& ec) const noexcept;
     
+    // Extension: the entry's own id (a final symlink is not followed).
+    // On POSIX, iterators cache it from the directory entry (d_ino) and the dir's device, so no stat is needed.
+    // For a mount point that id is the covered directory, and some filesystems (e.g. overlayfs without xino) report a d_ino
+    // that differs from st_ino. refresh() drops the cached value so the next call uses symlink_file_id().
+    file_id_type file_id() const;
+    file_id_type file_id(error_code&) const noexcept;
+    
     // testing
     file_type cached_type() const {
         return m_type.load();
@@ -205,11 +233,16 @@ public:
     file_time_type::duration::rep cached_write_time() const {
         return m_last_write.load();
     }
+    file_id_type cached_file_id() const {
+        return file_id_type{m_dev.load(), m_ino.load()};
+    }
     directory_entry(file_type ft, file_size_type fsz, file_time_type::duration ftime) // no path -- testing only
         : m_path()
         , m_type(ft)
         , m_size(fsz)
-        , m_last_write(ftime.count()) {
+        , m_last_write(ftime.count())
+        , m_dev()
+        , m_ino() {
     }
     void assign_no_refresh(const path_type& p) {
         m_path = p;
@@ -218,10 +251,12 @@ public:
     
 private:
     // Cache
-    friend ifilesystem::iterator_state;
+    friend ifilesystem::cache_info;
     std::atomic<file_type> mutable m_type;
     std::atomic<file_size_type> mutable m_size;
     std::atomic<file_time_type::duration::rep> mutable m_last_write;
+    std::atomic<file_id_type::device_type> mutable m_dev;
+    std::atomic<file_id_type::inode_type> mutable m_ino;
 
     template <typename T>
     T load(std::atomic<T>& aval, T badVal) const {
@@ -273,6 +308,8 @@ private:
         m_type = file_type::none;
         m_size = unknown_size;
         m_last_write = PS_FS_ENTRY_INVALID_TIME_VALUE;
+        m_dev = 0;
+        m_ino = 0;
     }
 };
 
@@ -296,6 +333,7 @@ enum class directory_options : unsigned {
     include_apple_double_files = 1U<<25, // macOS
 
     // Internal state
+    reserved_state_visited = 1U<<28,
     reserved_state_will_recurse = 1U<<29,
     reserved_state_skip_descendants = 1U<<30,
     reserved_state_postorder = 1U<<31,
@@ -312,18 +350,33 @@ using iterator_depth_type = int;
 namespace ifilesystem {
 struct cache_info {
     file_type ftype;
-#if _WIN32
-    file_size_type fsize;
+    file_id_type fid;
+    file_size_type fsize; // Windows and manifests
     file_time_type fwrite_time;
-#endif
+    
     cache_info()
         : ftype(file_type::none)
-#if _WIN32
+        , fid()
         , fsize(directory_entry::unknown_size)
         , fwrite_time(times::make_invalid())
-#endif
     {
     }
+    
+    void apply(directory_entry& e) const {
+        if (ftype != file_type::unknown) {
+            e.m_type = ftype;
+        }
+        if (fid.valid()) {
+            e.m_dev = fid.device();
+            e.m_ino = fid.inode();
+        }
+        if (fsize != directory_entry::unknown_size) {
+            e.m_size = fsize;
+        }
+        if (fwrite_time != times::make_invalid()) {
+            e.m_last_write = fwrite_time.time_since_epoch().count();
+        }
+    }
 };
 
 class iterator_state {
@@ -365,17 +418,7 @@ public:
     void increment(error_code& ec) {
         cache_info cinfo;
         m_current = directory_entry{next(cinfo, ec)};
-        if (cinfo.ftype != file_type::unknown) {
-            m_current.m_type = cinfo.ftype;
-        }
-#if _WIN32
-        if (cinfo.fsize != directory_entry::unknown_size) {
-            m_current.m_size = cinfo.fsize;
-        }
-        if (cinfo.fwrite_time != times::make_invalid()) {
-            m_current.m_last_write = cinfo.fwrite_time.time_since_epoch().count();
-        }
-#endif
+        cinfo.apply(m_current);
     }
     
     PS_WARN_UNUSED_RESULT directory_entry extract() noexcept(std::is_nothrow_move_constructible<directory_entry>::value) {
@@ -393,17 +436,148 @@ public:
     virtual bool at_end() const {
         return is_current_empty();
     }
+    
+    // See iterator_config::serialize_data. Empty if the position can't be saved.
+    virtual std::string checkpoint() const {
+        return std::string{};
+    }
 };
 
 using iterator_state_ptr = std::shared_ptr<ifilesystem::iterator_state>;
 
-struct iterator_config {};
+// Matches a raw directory entry name. Names are compared as stored by the filesystem (no UTF-8 validation or normalization),
+// so '?' matches a single byte on POSIX and a single UTF-16 unit on Windows.
+class name_filter {
+public:
+    using char_type = path::encoding_value_type;
+    using string_type = std::basic_string<char_type>;
+    using size_type = std::size_t;
+    // For matchers other than globs, e.g. a prosoft::regex search over the name.
+    using predicate_type = std::function<bool (const char_type*, size_type)>;
+    
+    // '*' matches any run of characters, '?' any single character, "[a-z]" or "[!a-z]" a set and '\\' escapes the next character.
+    // Simple patterns ("name", "name*", "*.ext", "*part*") are compiled to a direct comparison.
+    explicit name_filter(const string_type& glob);
+    explicit name_filter(predicate_type);
+    ~name_filter() = default;
+    PS_DEFAULT_COPY(name_filter);
+    PS_DEFAULT_MOVE(name_filter);
+    
+    bool operator()(const char_type* name, size_type len) const;
+    
+    bool operator()(const string_type& name) const {
+        return operator()(name.data(), name.size());
+    }
+    
+private:
+    enum class match_type : unsigned char {
+        exact,
+        prefix,
+        suffix,
+        contains,
+        any,
+        glob,
+        predicate,
+    };
+    
+    string_type m_pattern; // literal part for the simple types
+    predicate_type m_predicate;
+    match_type m_type;
+};
+
+struct iterator_config {
+    // Linux: when non-zero, directories are read in bulk with getdents64() into a buffer of this many bytes
+    // instead of one entry at a time with readdir(). Each open directory level owns one buffer.
+    // Ignored on other platforms.
+    using buffer_size_type = std::size_t;
+    buffer_size_type bulk_read_size;
+    // POSIX: open subdirectories relative to their parent's descriptor (openat) and check entries with fstatat()
+    // on the leaf name, so the kernel does not resolve the full path again for every entry.
+    // A subdirectory that is replaced by a symlink after it was read will fail to open instead of being followed.
+    // A followed directory symlink is opened through its parent's descriptor, so its descendants keep the link's path instead of the canonical one.
+    bool relative_traversal;
+    // When non-zero, the maximum number of directories a recursive iterator holds open at once.
+    // Once reached, the remaining entries of the outermost open directory are read into memory and it is closed.
+    // Iteration order, postorder events and skipping descendants are unchanged.
+    using count_type = std::size_t;
+    count_type max_open_dirs;
+    
+    struct statistics_type {
+        count_type open_dirs_peak;
+        count_type drained_dirs;
+        count_type visited_dirs_skipped;
+        count_type sorted_runs_spilled;
+        
+        statistics_type() noexcept
+            : open_dirs_peak()
+            , drained_dirs()
+            , visited_dirs_skipped()
+            , sorted_runs_spilled() {}
+    };
+    // Optional. Updated as the iteration runs and remains valid after the iterator is destroyed.
+    std::shared_ptr<statistics_type> statistics;
+    
+    // POSIX: record the device and inode of every directory entered. A directory that was already entered (e.g. through a followed link)
+    // is returned but not descended, and is_visited_directory() is true for it. This stops symlink loops at no extra syscall cost.
+    // Links are opened directly (by fd with relative_traversal) instead of through canonical(), so descendants keep the link's path.
+    // Memory grows with the number of directories entered.
+    bool skip_visited_directories;
+    
+    // Checked against the entry name before a path is created, so filtered entries cost no allocation.
+    // An entry matching any exclude filter is skipped, and an excluded directory is never opened.
+    // If include filters are set, all other entries must match one of them. Directories are exempt so recursion still reaches matching files.
+    using filters_type = std::vector<name_filter>;
+    filters_type include;
+    filters_type exclude;
+    
+    // A position from serialize() to continue an earlier iteration of the same root from. Entries returned before
+    // the position was saved are skipped: POSIX dirs are resumed with their readdir offset (Linux) or by reading
+    // up to the last entry seen. If that entry was removed the dir is listed again, so entries may repeat but are not lost.
+    // Visited directories (skip_visited_directories) are only known for the dirs that were open.
+    // Sorted dirs are resumed after the last name returned, so the position must be resumed with sorted set too.
+    using serialize_type = std::string;
+    serialize_type serialize_data;
+    
+    // Each dir's entries are returned in byte order of their normalized UTF-8 names rather than in the filesystem's order,
+    // and a dir's descendants follow it before its next sibling. Listings of the same tree are therefore always in the same order
+    // and two trees can be compared with a single merge pass. A dir is read in full when it's entered.
+    bool sorted;
+    // With sorted, the bytes of names a dir buffers before the sorted names are spilled to a temporary file as a run.
+    // Runs are merged as the dir is read, so memory stays bounded for very large dirs. 0 is default_sort_buffer_size().
+    // The bound applies per level: the dir being read may hold the full buffer and up to 64 runs, and once a subdirectory
+    // is entered each ancestor keeps at most 1/16 of the buffer or a single run. Open runs count against max_open_dirs,
+    // but as a drained dir still needs its run, a deep tree of large dirs can exceed the limit by one file per level.
+    buffer_size_type sort_buffer_size;
+    // Where runs are created as unnamed files. Empty is temp_directory_path(), which may be memory backed (tmpfs).
+    path sort_directory;
+
+    static constexpr buffer_size_type default_bulk_read_size() { return buffer_size_type{64U * 1024U}; }
+    static constexpr buffer_size_type default_sort_buffer_size() { return buffer_size_type{16U * 1024U * 1024U}; }
+
+    iterator_config() noexcept
+        : bulk_read_size()
+        , relative_traversal()
+        , max_open_dirs()
+        , statistics()
+        , skip_visited_directories()
+        , include()
+        , exclude()
+        , serialize_data()
+        , sorted()
+        , sort_buffer_size()
+        , sort_directory() {}
+    ~iterator_config() = default;
+    PS_DEFAULT_COPY(iterator_config);
+    PS_DEFAULT_MOVE(iterator_config);
+};
 
 struct iterator_traits {
     static constexpr directory_options required = directory_options::skip_subdirectory_descendants;
     static constexpr directory_options not_supported = directory_options::include_postorder_directories;
     static constexpr directory_options defaults = required;
     using configuration_type = iterator_config;
+    using serialize_type = typename iterator_config::serialize_type;
+    static serialize_type serialize(const basic_iterator<iterator_traits>&);
 };
 
 struct recursive_iterator_traits {
@@ -411,6 +585,8 @@ struct recursive_iterator_traits {
     static constexpr directory_options not_supported = directory_options::skip_subdirectory_descendants;
     static constexpr directory_options defaults = required;
     using configuration_type = iterator_config;
+    using serialize_type = typename iterator_config::serialize_type;
+    static serialize_type serialize(const basic_iterator<recursive_iterator_traits>&);
 };
 
 template <class Traits>
@@ -515,10 +691,16 @@ public:
     
     // Extensions
     template <typename Recurse = void>
-    bool is_postorder(recurse_only_t<Recurse>* = 0) {
+    bool is_postorder(recurse_only_t<Recurse>* = 0) const {
         return m_i && is_set(m_i->options() & directory_options::reserved_state_postorder);
     }
     
+    // The current entry was not descended because the directory was already entered (iterator_config::skip_visited_directories).
+    template <typename Recurse = void>
+    bool is_visited_directory(recurse_only_t<Recurse>* = 0) const {
+        return m_i && is_set(m_i->options() & directory_options::reserved_state_visited);
+    }
+    
     basic_iterator& operator++(int);
     
     // moves current entry out -- be careful
@@ -657,6 +839,16 @@ directory_entry basic_iterator<Traits>::extract() noexcept(std::is_nothrow_move_
     return m_i ? m_i->extract() : directory_entry{};
 }
 
+// The position after the current entry, to resume from with iterator_config::serialize_data.
+// The end iterator has no position (empty) as there is nothing left to resume.
+inline ifilesystem::iterator_traits::serialize_type serialize(const basic_iterator<ifilesystem::iterator_traits>& i) {
+    return ifilesystem::iterator_traits::serialize(i);
+}
+
+inline ifilesystem::recursive_iterator_traits::serialize_type serialize(const basic_iterator<ifilesystem::recursive_iterator_traits>& i) {
+    return ifilesystem::recursive_iterator_traits::serialize(i);
+}
+
 } // v1
 } // filesystem
 } // prosoft
@@ -0,0 +1,294 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Spec extension
+
+#ifndef PS_CORE_FILESYSTEM_MANIFEST_HPP
+#define PS_CORE_FILESYSTEM_MANIFEST_HPP
+
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "filesystem.hpp"
+#include "filesystem_atomic_file.hpp"
+#include "filesystem_hash.hpp"
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+namespace ifilesystem {
+class manifest_block;
+}
+
+// A listing of a tree in a compact binary file.
+// Entries are stored in iteration order, in blocks of columns (sizes, times, ids, ...), with each name relative to its parent
+// and front-coded against the previous name. The file is read in place from a mapping, only the current entry's path is built.
+// A manifest is sorted when all siblings are in byte order of their UTF-8 names (see manifest_writer::append_tree()).
+// All values are little endian.
+
+enum class manifest_options : unsigned {
+    none,
+    digests = 0x1, // entries appended from the tree store the digest of regular files
+};
+PS_ENUM_BITMASK_OPS(manifest_options);
+
+struct manifest_config {
+    using count_type = std::uint32_t;
+    manifest_options options;
+    hash_config hash; // with digests
+    count_type block_entries;
+    
+    static constexpr count_type default_block_entries() { return count_type{4096}; }
+    
+    explicit manifest_config(manifest_options opts = manifest_options::none)
+        : options(opts)
+        , hash(hash_algorithm::xxh64)
+        , block_entries(default_block_entries()) {}
+    ~manifest_config() = default;
+    PS_DEFAULT_COPY(manifest_config);
+    PS_DEFAULT_MOVE(manifest_config);
+};
+
+struct manifest_record {
+    filesystem::path name; // filename only
+    iterator_depth_type depth; // 0 for the children of the root
+    file_type type;
+    perms permissions;
+    file_size_type size;
+    file_time_type modified;
+    file_time_type metadata_modified; // ctime on POSIX
+    file_id_type id;
+    file_digest digest; // may be empty
+    
+    manifest_record()
+        : name()
+        , depth()
+        , type(file_type::none)
+        , permissions(perms::unknown)
+        , size()
+        , modified(times::make_invalid())
+        , metadata_modified(times::make_invalid())
+        , id()
+        , digest() {}
+};
+
+// Streams a listing to a new file that replaces the target on commit.
+class manifest_writer {
+public:
+    using size_type = std::uint64_t;
+    
+    // root is stored in the file and prefixes the paths read back.
+    manifest_writer(const path& file, const path& root, const manifest_config& = manifest_config{});
+    manifest_writer(const path& file, const path& root, const manifest_config&, error_code&);
+    manifest_writer(manifest_writer&&) noexcept;
+    manifest_writer& operator=(manifest_writer&&) noexcept;
+    ~manifest_writer();
+    PS_DISABLE_COPY(manifest_writer);
+    
+    // The depth must be at most one more than the previous record's.
+    void append(const manifest_record&);
+    void append(const manifest_record&, error_code&);
+    
+    // Stats the entry (without following a symlink). Postorder visits are skipped.
+    void append(const recursive_directory_iterator&);
+    void append(const recursive_directory_iterator&, error_code&);
+    void append(const directory_entry&, iterator_depth_type);
+    void append(const directory_entry&, iterator_depth_type, error_code&);
+    
+    // Appends everything below dir, at depth 0 for its children, in sorted order.
+    // An unreadable directory is an error unless skip_permission_denied is set, then it's appended without its children.
+    void append_tree(const path& dir, directory_options = directory_options::none);
+    void append_tree(const path& dir, directory_options, error_code&);
+    
+    size_type size() const noexcept {
+        return m_entries;
+    }
+    
+    // All siblings appended so far are in order.
+    bool sorted() const noexcept {
+        return m_sorted;
+    }
+    
+    // Writes the index and publishes the file. Uncommitted files are discarded by the destructor.
+    void commit();
+    void commit(error_code&);
+    
+private:
+    void open(const path& root, error_code&);
+    void flush(error_code&);
+    
+    atomic_file m_file;
+    manifest_config m_cfg;
+    std::unique_ptr<ifilesystem::manifest_block> m_block;
+    std::vector<std::uint64_t> m_index; // block offsets
+    std::uint64_t m_offset;
+    size_type m_entries;
+    std::vector<std::string> m_siblings; // the last name at each depth
+    bool m_sorted;
+};
+
+class manifest_iterator;
+
+// A mapped manifest. The file must not be truncated while it's mapped.
+class manifest {
+public:
+    using size_type = std::uint64_t;
+    
+    manifest() noexcept;
+    explicit manifest(const path&);
+    manifest(const path&, error_code&);
+    manifest(manifest&&) noexcept;
+    manifest& operator=(manifest&&) noexcept;
+    ~manifest();
+    PS_DISABLE_COPY(manifest);
+    
+    const path& root() const noexcept {
+        return m_root;
+    }
+    
+    size_type size() const noexcept {
+        return m_entries;
+    }
+    
+    bool empty() const noexcept {
+        return m_entries == 0;
+    }
+    
+    bool has_digests() const noexcept {
+        return m_digest_size > 0;
+    }
+    
+    bool sorted() const noexcept {
+        return m_sorted;
+    }
+    
+    hash_algorithm digest_algorithm() const noexcept {
+        return m_digest_algorithm;
+    }
+    
+private:
+    friend class manifest_iterator;
+    void open(const path&, error_code&);
+    void parse(error_code&);
+    void close() noexcept;
+    
+    const std::uint8_t* m_data;
+    std::size_t m_size;
+    path m_file;
+    path m_root;
+    size_type m_entries;
+    size_type m_blocks;
+    std::uint64_t m_index;
+    std::uint32_t m_block_entries;
+    std::uint8_t m_digest_size;
+    hash_algorithm m_digest_algorithm;
+    bool m_sorted;
+};
+
+// Entries have their type, size, modified time and id cached, so these queries don't access the filesystem.
+class manifest_iterator {
+public:
+    using value_type = directory_entry;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const value_type*;
+    using reference = const value_type&;
+    using iterator_category = std::input_iterator_tag;
+    
+    manifest_iterator() noexcept;
+    explicit manifest_iterator(const manifest&);
+    manifest_iterator(const manifest&, error_code&);
+    ~manifest_iterator() = default;
+    PS_DEFAULT_COPY(manifest_iterator);
+    PS_DEFAULT_MOVE(manifest_iterator);
+    
+    const directory_entry& operator*() const noexcept {
+        return m_entry;
+    }
+    
+    const directory_entry* operator->() const noexcept {
+        return &m_entry;
+    }
+    
+    manifest_iterator& operator++();
+    manifest_iterator& increment(error_code&);
+    
+    // Moves to the next entry that isn't a descendant of the current one. Only the depths of the skipped entries are read,
+    // and their names only up to the next entry's position in its block.
+    manifest_iterator& skip_descendants();
+    manifest_iterator& skip_descendants(error_code&);
+    
+    bool operator==(const manifest_iterator& other) const noexcept {
+        return m_manifest == other.m_manifest && m_next == other.m_next;
+    }
+    
+    bool operator!=(const manifest_iterator& other) const noexcept {
+        return !operator==(other);
+    }
+    
+    iterator_depth_type depth() const noexcept {
+        return m_record.depth;
+    }
+    
+    // All stored values of the current entry.
+    const manifest_record& record() const noexcept {
+        return m_record;
+    }
+    
+private:
+    void load_block(error_code&);
+    bool read_name();
+    void read(error_code&);
+    
+    const manifest* m_manifest;
+    std::uint64_t m_next; // entries read
+    std::uint64_t m_block_index;
+    const std::uint8_t* m_block;
+    const std::uint8_t* m_names;
+    const std::uint8_t* m_names_end;
+    std::uint32_t m_block_count;
+    std::uint32_t m_block_pos;
+    std::string m_name; // front coding state
+    std::vector<path> m_parents; // the path at each depth
+    manifest_record m_record;
+    directory_entry m_entry;
+};
+
+inline manifest_iterator begin(manifest_iterator i) {
+    return i;
+}
+
+inline manifest_iterator end(const manifest_iterator&) {
+    return manifest_iterator{};
+}
+
+} // v1
+} // filesystem
+} // prosoft
+
+#endif // PS_CORE_FILESYSTEM_MANIFEST_HPP
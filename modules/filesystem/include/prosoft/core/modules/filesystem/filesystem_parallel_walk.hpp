@@ -0,0 +1,210 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Spec extension
+
+#ifndef PS_CORE_FILESYSTEM_PARALLEL_WALK_HPP
+#define PS_CORE_FILESYSTEM_PARALLEL_WALK_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "filesystem.hpp"
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+namespace ifilesystem {
+class walker;
+}
+
+struct walk_config {
+    using count_type = std::size_t;
+    // 0 uses std::thread::hardware_concurrency().
+    count_type threads;
+    // Large directories are delivered in several batches of at most this many entries.
+    count_type batch_size;
+    
+    static constexpr count_type default_batch_size() { return count_type{1024}; }
+    
+    explicit walk_config(count_type t = 0, count_type bsz = default_batch_size())
+        : threads(t)
+        , batch_size(bsz) {}
+    ~walk_config() = default;
+    PS_DEFAULT_COPY(walk_config);
+    PS_DEFAULT_MOVE(walk_config);
+};
+
+// Entries from a single directory. Entry order within a directory is unspecified,
+// but every entry of the tree is delivered exactly once.
+class walk_batch {
+    struct subdir {
+        std::size_t index;
+        bool recurse;
+    };
+    path m_dir;
+    std::vector<directory_entry> m_entries;
+    std::vector<subdir> m_subdirs;
+    std::vector<path> m_subdir_paths;
+    error_code m_error;
+    iterator_depth_type m_depth;
+    bool m_stop;
+    
+    friend class ifilesystem::walker;
+    friend class walk_queue;
+    
+    // target is the path to recurse into if it differs from the entry (links).
+    void add(directory_entry&& e, bool recurse, path&& target) {
+        if (recurse) {
+            m_subdirs.push_back(subdir{m_entries.size(), true});
+            m_subdir_paths.push_back(target.empty() ? e.path() : std::move(target));
+        }
+        m_entries.push_back(std::move(e));
+    }
+    
+    void clear() {
+        m_entries.clear();
+        m_subdirs.clear();
+        m_subdir_paths.clear();
+        m_error.clear();
+    }
+    
+    subdir* find(std::size_t i) {
+        for (auto& sd : m_subdirs) {
+            if (sd.index == i) {
+                return &sd;
+            }
+        }
+        return nullptr;
+    }
+    
+public:
+    walk_batch()
+        : m_dir()
+        , m_depth()
+        , m_stop() {}
+    walk_batch(const path& p, iterator_depth_type depth)
+        : m_dir(p)
+        , m_depth(depth)
+        , m_stop() {}
+    ~walk_batch() = default;
+    PS_DEFAULT_MOVE(walk_batch);
+    PS_DISABLE_COPY(walk_batch);
+    
+    // The parent of all entries.
+    const path& directory() const noexcept {
+        return m_dir;
+    }
+    
+    // Same as recursive_directory_iterator::depth() for the entries.
+    iterator_depth_type depth() const noexcept {
+        return m_depth;
+    }
+    
+    // Entries may be moved out, pruning still works by index.
+    std::vector<directory_entry>& entries() noexcept {
+        return m_entries;
+    }
+    
+    const std::vector<directory_entry>& entries() const noexcept {
+        return m_entries;
+    }
+    
+    // Failure to open or read the directory. skip_permission_denied is honored.
+    const error_code& error() const noexcept {
+        return m_error;
+    }
+    
+    bool recursion_pending(std::size_t i) const {
+        auto sd = const_cast<walk_batch*>(this)->find(i);
+        return sd && sd->recurse;
+    }
+    
+    // Per-directory pruning, only has an effect from within a visitor.
+    void disable_recursion_pending(std::size_t i) {
+        if (auto sd = find(i)) {
+            sd->recurse = false;
+        }
+    }
+    
+    // Ends the walk as soon as possible. Batches already in progress are still delivered.
+    void stop() noexcept {
+        m_stop = true;
+    }
+};
+
+// Called concurrently from all worker threads.
+using walk_visitor = std::function<void (walk_batch&)>;
+
+// Supported options: skip_permission_denied, follow_directory_symlink, skip_hidden_descendants, follow_mountpoints,
+// skip_subdirectory_descendants, skip_package_content_descendants and include_apple_double_files.
+// Returns when the whole tree has been visited. An exception from the visitor stops the walk and is rethrown.
+void parallel_walk(const path&, directory_options, const walk_config&, const walk_visitor&);
+void parallel_walk(const path&, directory_options, const walk_config&, const walk_visitor&, error_code&);
+
+// Bounded output queue for consumers that want to pull batches instead of being called back.
+// The walk runs in the background and blocks while the queue is full.
+class walk_queue {
+    std::deque<walk_batch> m_batches;
+    std::mutex m_lock;
+    std::condition_variable m_cond;
+    std::thread m_thread;
+    error_code m_error;
+    std::exception_ptr m_exception;
+    std::size_t m_capacity;
+    bool m_done;
+    bool m_canceled;
+    
+    void push(walk_batch&);
+    
+public:
+    static constexpr std::size_t default_capacity() { return std::size_t{64}; }
+    
+    walk_queue(const path&, directory_options, const walk_config&, std::size_t capacity = default_capacity());
+    ~walk_queue(); // cancels an unfinished walk
+    PS_DISABLE_COPY(walk_queue);
+    PS_DISABLE_MOVE(walk_queue);
+    
+    // Blocks until a batch is available. Returns false once all batches have been consumed.
+    // An exception that ended the walk (e.g. std::bad_alloc) is rethrown instead, once the batches before it are consumed.
+    bool pop(walk_batch&);
+    
+    // Valid once pop() returns false.
+    const error_code& error() const noexcept {
+        return m_error;
+    }
+};
+
+} // v1
+} // filesystem
+} // prosoft
+
+#endif // PS_CORE_FILESYSTEM_PARALLEL_WALK_HPP
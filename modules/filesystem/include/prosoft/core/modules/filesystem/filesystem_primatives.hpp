@@ -27,7 +27,9 @@
 #define PS_CORE_FILESYSTEM_PRIMATIVES_HPP
 
 #include <chrono>
+#include <cstddef>
 #include <cstdint>
+#include <functional>
 
 namespace prosoft {
 namespace filesystem {
@@ -82,6 +84,25 @@ enum class perms {
 
 PS_ENUM_BITMASK_OPS(perms);
 
+enum class copy_options {
+    none = 0,
+    // existing target
+    skip_existing = 0x1,
+    overwrite_existing = 0x2,
+    update_existing = 0x4,
+    // sub-directories
+    recursive = 0x8,
+    // symlinks
+    copy_symlinks = 0x10,
+    skip_symlinks = 0x20,
+    // form of the copy
+    directories_only = 0x40,
+    create_symlinks = 0x80,
+    create_hard_links = 0x100,
+};
+
+PS_ENUM_BITMASK_OPS(copy_options);
+
 class times {
     file_time_type m_modifyTime;
     file_time_type m_changeTime;
@@ -152,9 +173,65 @@ public:
     }
 };
 
+// Identifies a file on a running system: st_dev/st_ino on POSIX and the volume serial number/file index on Windows.
+// Ids may be reused once a file is deleted, and are not stable across reboots for some filesystems.
+class file_id_type {
+public:
+    using device_type = std::uint64_t;
+    using inode_type = std::uint64_t;
+    
+    constexpr file_id_type() noexcept
+        : m_device()
+        , m_inode() {}
+    constexpr file_id_type(device_type dev, inode_type ino) noexcept
+        : m_device(dev)
+        , m_inode(ino) {}
+    
+    constexpr device_type device() const noexcept {
+        return m_device;
+    }
+    
+    constexpr inode_type inode() const noexcept {
+        return m_inode;
+    }
+    
+    constexpr bool valid() const noexcept {
+        return m_device != 0 || m_inode != 0;
+    }
+    
+    constexpr bool operator==(const file_id_type& other) const noexcept {
+        return m_device == other.m_device && m_inode == other.m_inode;
+    }
+    
+    constexpr bool operator!=(const file_id_type& other) const noexcept {
+        return !operator==(other);
+    }
+    
+    constexpr bool operator<(const file_id_type& other) const noexcept {
+        return m_device < other.m_device || (m_device == other.m_device && m_inode < other.m_inode);
+    }
+    
+private:
+    device_type m_device;
+    inode_type m_inode;
+};
+
 } // v1
 } // filesystem
 } // prosoft
 
+// std specializations
+namespace std {
+template <>
+struct hash<prosoft::filesystem::file_id_type> {
+    typedef prosoft::filesystem::file_id_type argument_type;
+    typedef std::size_t result_type;
+    result_type operator()(const argument_type& fid) const noexcept {
+        // Inodes are dense within a device, so mix the device into the high bits.
+        return hash<argument_type::inode_type>{}(fid.inode() ^ (fid.device() * 0x9e3779b97f4a7c15ULL));
+    }
+};
+}
+
 #endif // PS_CORE_FILESYSTEM_PRIMATIVES_HPP
 
@@ -28,7 +28,15 @@
 
 // XXX: Windows snapshots require a 32bit OS for 32bit apps. WOW64 is not supported.
 // Mingw spits out warnings that the VSS COM API "has not been verified". In addition, ATL is not available.
-#define PS_HAVE_FILESYSTEM_SNAPSHOT (MAC_OS_X_VERSION_MIN_REQUIRED > 0 || (_WIN32 && !__MINGW32__))
+// Linux has no volume snapshots. A snapshot is a copy of a directory tree kept in a hidden ".ps_snapshots" directory at the root
+// of the tree's filesystem, or beside the tree if the root isn't writable. Files are reflinked if the filesystem supports it,
+// otherwise they are hard linked and a file written in place after the snapshot was taken changes the snapshot too (see snapshot_file()).
+// Linking also changes the live files: their link count goes up and their change time (ctime) moves, both when the snapshot is
+// created and when it's deleted. Tools that check ctime (backups, build tools, a polling change monitor) see those files as changed.
+// A file that can't be linked is copied. Mount points below the tree are kept as empty directories.
+// Each file is captured atomically, but not the tree as a whole. The snapshot is attached with a read-only bind mount if permitted,
+// otherwise the mount path is a symlink to it.
+#define PS_HAVE_FILESYSTEM_SNAPSHOT (MAC_OS_X_VERSION_MIN_REQUIRED > 0 || (_WIN32 && !__MINGW32__) || __linux__)
 
 #include <memory>
 #include <system_error>
@@ -176,6 +184,16 @@ void detach_snapshot(snapshot&, std::error_code&);
 void delete_snapshot(snapshot&);
 void delete_snapshot(snapshot&, std::error_code&);
 
+#if __linux__
+// Returns the path to read a file from, given its path relative to the snapshot's source.
+// A file hard linked with the original is first replaced by a private copy, so it remains stable while it's read.
+// Fails with ESTALE if the original may have been modified since the snapshot was taken: its modification time is later, or its change
+// time differs from when it was linked. The change time also moves for metadata changes (including another snapshot linking it), which
+// are reported too. A write between the link and recording its change time, with the modification time restored, is not detected.
+path snapshot_file(const snapshot&, const path&);
+path snapshot_file(const snapshot&, const path&, std::error_code&);
+#endif
+
 } // v1
 } // filesystem
 } // prosoft
@@ -0,0 +1,554 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <prosoft/core/config/config.h>
+#include "fsconfig.h"
+
+#if !_WIN32
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if __linux__
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#endif
+#else
+#include <windows.h>
+#endif
+
+#include <algorithm>
+#include <cinttypes>
+#include <random>
+
+#include <prosoft/core/modules/filesystem/filesystem_atomic_file.hpp>
+#include "filesystem_private.hpp"
+
+#if __linux__
+#ifndef RENAME_NOREPLACE
+#define RENAME_NOREPLACE (1 << 0)
+#endif
+#ifndef RENAME_EXCHANGE
+#define RENAME_EXCHANGE (1 << 1)
+#endif
+#endif
+
+namespace {
+
+using namespace prosoft::filesystem;
+
+#if !_WIN32
+constexpr atomic_file::native_handle_type invalid_handle = -1;
+#else
+const atomic_file::native_handle_type invalid_handle = INVALID_HANDLE_VALUE;
+#endif
+
+constexpr int max_temp_attempts = 100;
+
+path directory_of(const path& p) {
+    auto dir = p.parent_path();
+    return dir.empty() ? path{PS_TEXT(".")} : dir;
+}
+
+std::uint64_t random_seed() {
+    std::random_device rd;
+    return (static_cast<std::uint64_t>(rd()) << 32) | rd();
+}
+
+// A hidden sibling of the target, so the final rename never crosses filesystems.
+path temp_name(const path& target) {
+    // Per thread, concurrent calls on a shared random_device or engine are a data race.
+    thread_local std::mt19937_64 engine{random_seed()};
+    const std::uint64_t r = engine();
+    char suffix[24];
+    std::snprintf(suffix, sizeof(suffix), ".%016" PRIx64, r);
+    auto name = path{PS_TEXT(".")};
+    name += target.filename();
+    name += suffix;
+    return directory_of(target) / name;
+}
+
+#if !_WIN32
+
+inline bool tmpfile_unsupported(int err) noexcept {
+    return err == EOPNOTSUPP || err == EISDIR || err == EINVAL;
+}
+
+int rename_noreplace(const char* from, const char* to) noexcept {
+#if __linux__ && defined(SYS_renameat2)
+    if (0 == ::syscall(SYS_renameat2, AT_FDCWD, from, AT_FDCWD, to, RENAME_NOREPLACE)) {
+        return 0;
+    }
+    if (errno != ENOSYS && errno != EINVAL) {
+        return -1;
+    }
+#elif __APPLE__
+    return ::renamex_np(from, to, RENAME_EXCL);
+#endif
+    // Unlike rename(), link() fails if the target exists.
+    if (0 != ::link(from, to)) {
+        return -1;
+    }
+    (void)::unlink(from);
+    return 0;
+}
+
+int rename_exchange(const char* from, const char* to) noexcept {
+#if __linux__ && defined(SYS_renameat2)
+    return static_cast<int>(::syscall(SYS_renameat2, AT_FDCWD, from, AT_FDCWD, to, RENAME_EXCHANGE));
+#elif __APPLE__
+    return ::renamex_np(from, to, RENAME_SWAP);
+#else
+    (void)from;
+    (void)to;
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+int data_sync(int fd) noexcept {
+#if __APPLE__
+    // fsync() only reaches the drive's cache.
+    if (0 == ::fcntl(fd, F_FULLFSYNC)) {
+        return 0;
+    }
+    return ::fsync(fd);
+#else
+    return ::fdatasync(fd);
+#endif
+}
+
+#if __linux__
+// Before 5.8 syncfs() returns 0 even if writing back some of the data failed.
+bool syncfs_reports_errors() noexcept {
+    static const bool reports = []() {
+        struct utsname u;
+        int major = 0, minor = 0;
+        return 0 == ::uname(&u) && 2 == std::sscanf(u.release, "%d.%d", &major, &minor) && (major > 5 || (major == 5 && minor >= 8));
+    }();
+    return reports;
+}
+#endif
+
+void sync_directory(const path& dir, error_code& ec) noexcept {
+    ifilesystem::unique_fd fd{::open(dir.c_str(), O_RDONLY|O_DIRECTORY|O_CLOEXEC)};
+    if (!fd || 0 != ::fsync(fd.get())) {
+        ifilesystem::system_error(ec);
+    }
+}
+
+#endif // !_WIN32
+
+} // anon
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+atomic_file::atomic_file(const path& target, publish_options opts)
+    : m_target(target)
+    , m_temp()
+    , m_handle(invalid_handle)
+    , m_opts(opts) {
+    error_code ec;
+    open(ec);
+    PS_THROW_IF(ec.value() != 0, filesystem_error("Could not create file", target, ec));
+}
+
+atomic_file::atomic_file(const path& target, publish_options opts, error_code& ec)
+    : m_target(target)
+    , m_temp()
+    , m_handle(invalid_handle)
+    , m_opts(opts) {
+    open(ec);
+}
+
+atomic_file::atomic_file(atomic_file&& other) noexcept
+    : m_target(std::move(other.m_target))
+    , m_temp(std::move(other.m_temp))
+    , m_handle(other.m_handle)
+    , m_opts(other.m_opts) {
+    other.m_temp.clear();
+    other.m_handle = invalid_handle;
+}
+
+atomic_file& atomic_file::operator=(atomic_file&& other) noexcept {
+    if (this != &other) {
+        discard();
+        m_target = std::move(other.m_target);
+        m_temp = std::move(other.m_temp);
+        m_handle = other.m_handle;
+        m_opts = other.m_opts;
+        other.m_temp.clear();
+        other.m_handle = invalid_handle;
+    }
+    return *this;
+}
+
+atomic_file::~atomic_file() {
+    discard();
+}
+
+bool atomic_file::is_open() const noexcept {
+    return m_handle != invalid_handle;
+}
+
+void atomic_file::write(const void* buf, std::size_t size) {
+    error_code ec;
+    write(buf, size, ec);
+    PS_THROW_IF(ec.value() != 0, filesystem_error("Could not write file", m_target, ec));
+}
+
+void atomic_file::commit() {
+    error_code ec;
+    commit(ec);
+    PS_THROW_IF(ec.value() != 0, filesystem_error("Could not commit file", m_target, ec));
+}
+
+void atomic_file::commit(error_code& ec) {
+    ec.clear();
+    sync(ec);
+    if (!ec) {
+        publish(ec);
+    }
+#if !_WIN32
+    if (!ec) {
+        sync_directory(directory_of(m_target), ec);
+    }
+#endif
+    if (ec) {
+        discard();
+    }
+}
+
+#if !_WIN32
+
+void atomic_file::open(error_code& ec) {
+    ec.clear();
+    struct stat sb;
+    const bool exists = 0 == ::stat(m_target.c_str(), &sb);
+    if (!exists && errno != ENOENT) {
+        ifilesystem::system_error(ec);
+        return;
+    }
+    if (exists && !S_ISREG(sb.st_mode)) {
+        ec.assign(S_ISDIR(sb.st_mode) ? EISDIR : EINVAL, std::system_category());
+        return;
+    }
+    // Checked again when publishing, but there's no point in writing content that can't be used.
+    if (exists && is_set(m_opts & publish_options::no_replace)) {
+        ec.assign(EEXIST, std::system_category());
+        return;
+    }
+    if (!exists && is_set(m_opts & publish_options::exchange)) {
+        ec.assign(ENOENT, std::system_category());
+        return;
+    }
+    
+#if __linux__ && defined(O_TMPFILE)
+    m_handle = ::open(directory_of(m_target).c_str(), O_TMPFILE|O_WRONLY|O_CLOEXEC, 0666);
+    if (m_handle < 0 && !tmpfile_unsupported(errno)) {
+        ifilesystem::system_error(ec);
+        return;
+    }
+#endif
+    for (int i = 0; m_handle < 0 && i < max_temp_attempts; ++i) {
+        m_temp = temp_name(m_target);
+        m_handle = ::open(m_temp.c_str(), O_WRONLY|O_CREAT|O_EXCL|O_CLOEXEC, 0666);
+        if (m_handle < 0 && errno != EEXIST) {
+            break;
+        }
+    }
+    if (m_handle < 0) {
+        ifilesystem::system_error(ec);
+        m_temp.clear();
+        return;
+    }
+    if (exists) {
+        (void)::fchmod(m_handle, sb.st_mode & 07777);
+    }
+}
+
+void atomic_file::write(const void* buf, std::size_t size, error_code& ec) noexcept {
+    ec.clear();
+    auto p = static_cast<const char*>(buf);
+    while (size > 0) {
+        const auto n = ::write(m_handle, p, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ifilesystem::system_error(ec);
+            return;
+        }
+        p += n;
+        size -= static_cast<std::size_t>(n);
+    }
+}
+
+void atomic_file::sync(error_code& ec) noexcept {
+    if (!is_open()) {
+        ec.assign(EBADF, std::system_category());
+    } else if (0 != data_sync(m_handle)) {
+        ifilesystem::system_error(ec);
+    }
+}
+
+void atomic_file::publish(error_code& ec) {
+#if __linux__
+    if (m_temp.empty()) {
+        char proc[32];
+        std::snprintf(proc, sizeof(proc), "/proc/self/fd/%d", m_handle);
+        if (is_set(m_opts & publish_options::no_replace)) {
+            if (0 != ::linkat(AT_FDCWD, proc, AT_FDCWD, m_target.c_str(), AT_SYMLINK_FOLLOW)) {
+                ifilesystem::system_error(ec);
+                return;
+            }
+        } else {
+            // rename() needs a name to replace the target with.
+            for (int i = 0; m_temp.empty() && i < max_temp_attempts; ++i) {
+                auto temp = temp_name(m_target);
+                if (0 == ::linkat(AT_FDCWD, proc, AT_FDCWD, temp.c_str(), AT_SYMLINK_FOLLOW)) {
+                    m_temp = std::move(temp);
+                } else if (errno != EEXIST) {
+                    break;
+                }
+            }
+            if (m_temp.empty()) {
+                ifilesystem::system_error(ec);
+                return;
+            }
+        }
+    }
+#endif
+    if (!m_temp.empty()) {
+        int rc;
+        if (is_set(m_opts & publish_options::no_replace)) {
+            rc = rename_noreplace(m_temp.c_str(), m_target.c_str());
+        } else if (is_set(m_opts & publish_options::exchange)) {
+            rc = rename_exchange(m_temp.c_str(), m_target.c_str());
+            if (0 == rc) {
+                (void)::unlink(m_temp.c_str()); // the previous content
+            }
+        } else {
+            rc = ::rename(m_temp.c_str(), m_target.c_str());
+        }
+        if (0 != rc) {
+            ifilesystem::system_error(ec);
+            return;
+        }
+        m_temp.clear();
+    }
+    // Deferred write errors were reported by the sync.
+    (void)::close(m_handle);
+    m_handle = invalid_handle;
+}
+
+void atomic_file::discard() noexcept {
+    if (is_open()) {
+        (void)::close(m_handle);
+        m_handle = invalid_handle;
+    }
+    if (!m_temp.empty()) {
+        (void)::unlink(m_temp.c_str());
+        m_temp.clear();
+    }
+}
+
+#else // _WIN32
+
+void atomic_file::open(error_code& ec) {
+    ec.clear();
+    const auto attrs = ::GetFileAttributesW(m_target.c_str());
+    const bool exists = attrs != INVALID_FILE_ATTRIBUTES;
+    if (exists && (attrs & FILE_ATTRIBUTE_DIRECTORY)) {
+        ec.assign(ERROR_DIRECTORY, std::system_category());
+        return;
+    }
+    if (exists && is_set(m_opts & publish_options::no_replace)) {
+        ec.assign(ERROR_FILE_EXISTS, std::system_category());
+        return;
+    }
+    if (!exists && is_set(m_opts & publish_options::exchange)) {
+        ec.assign(ERROR_FILE_NOT_FOUND, std::system_category());
+        return;
+    }
+    for (int i = 0; m_handle == invalid_handle && i < max_temp_attempts; ++i) {
+        m_temp = temp_name(m_target);
+        m_handle = ::CreateFileW(m_temp.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_NEW, FILE_ATTRIBUTE_HIDDEN, nullptr);
+        if (m_handle == invalid_handle && ::GetLastError() != ERROR_FILE_EXISTS) {
+            break;
+        }
+    }
+    if (m_handle == invalid_handle) {
+        ifilesystem::system_error(ec);
+        m_temp.clear();
+    }
+}
+
+void atomic_file::write(const void* buf, std::size_t size, error_code& ec) noexcept {
+    ec.clear();
+    auto p = static_cast<const char*>(buf);
+    while (size > 0) {
+        DWORD n = 0;
+        const auto len = static_cast<DWORD>(std::min<std::size_t>(size, 1U << 30));
+        if (!::WriteFile(m_handle, p, len, &n, nullptr)) {
+            ifilesystem::system_error(ec);
+            return;
+        }
+        p += n;
+        size -= n;
+    }
+}
+
+void atomic_file::sync(error_code& ec) noexcept {
+    if (!is_open()) {
+        ec.assign(ERROR_INVALID_HANDLE, std::system_category());
+    } else if (!::FlushFileBuffers(m_handle)) {
+        ifilesystem::system_error(ec);
+    }
+}
+
+void atomic_file::publish(error_code& ec) {
+    ::CloseHandle(m_handle);
+    m_handle = invalid_handle;
+    BOOL ok;
+    if (is_set(m_opts & publish_options::exchange)) {
+        ok = ::ReplaceFileW(m_target.c_str(), m_temp.c_str(), nullptr, REPLACEFILE_IGNORE_MERGE_ERRORS, nullptr, nullptr);
+    } else {
+        const DWORD flags = MOVEFILE_WRITE_THROUGH | (is_set(m_opts & publish_options::no_replace) ? 0 : MOVEFILE_REPLACE_EXISTING);
+        ok = ::MoveFileExW(m_temp.c_str(), m_target.c_str(), flags);
+    }
+    if (!ok) {
+        ifilesystem::system_error(ec);
+        return;
+    }
+    // The new content takes the target's attributes.
+    (void)::SetFileAttributesW(m_target.c_str(), ::GetFileAttributesW(m_target.c_str()) & ~FILE_ATTRIBUTE_HIDDEN);
+    m_temp.clear();
+}
+
+void atomic_file::discard() noexcept {
+    if (is_open()) {
+        ::CloseHandle(m_handle);
+        m_handle = invalid_handle;
+    }
+    if (!m_temp.empty()) {
+        (void)::DeleteFileW(m_temp.c_str());
+        m_temp.clear();
+    }
+}
+
+#endif // _WIN32
+
+void durability_group::commit() {
+    error_code ec;
+    commit(ec);
+    PS_THROW_IF(ec.value() != 0, filesystem_error("Could not commit files", ec));
+}
+
+void durability_group::commit(error_code& ec) {
+    ec.clear();
+    auto files = std::move(m_files); // the rest are discarded on error
+    m_files.clear();
+    
+#if !_WIN32
+    // One descriptor per directory (or per filesystem for syncfs) is enough to make the new names durable.
+    std::vector<ifilesystem::unique_fd> dirs;
+    std::vector<file_id_type> ids;
+#if __linux__
+    const bool per_fs = m_mode == sync_mode::per_filesystem
+        || (m_mode == sync_mode::automatic && files.size() >= default_syncfs_threshold() && syncfs_reports_errors());
+#else
+    constexpr bool per_fs = false;
+#endif
+    for (const auto& f : files) {
+        ifilesystem::unique_fd fd{::open(directory_of(f.target()).c_str(), O_RDONLY|O_DIRECTORY|O_CLOEXEC)};
+        struct stat sb;
+        if (!fd || 0 != ::fstat(fd.get(), &sb)) {
+            ifilesystem::system_error(ec);
+            return;
+        }
+        const file_id_type id{file_id_type::device_type(sb.st_dev), file_id_type::inode_type(per_fs ? 0 : sb.st_ino)};
+        if (std::find(ids.begin(), ids.end(), id) == ids.end()) {
+            ids.push_back(id);
+            dirs.push_back(std::move(fd));
+        }
+    }
+    
+    auto sync_dirs = [&]() {
+        for (const auto& d : dirs) {
+#if __linux__
+            const int rc = per_fs ? ::syncfs(d.get()) : ::fsync(d.get());
+#else
+            const int rc = ::fsync(d.get());
+#endif
+            if (0 != rc) {
+                ifilesystem::system_error(ec);
+                return false;
+            }
+        }
+        return true;
+    };
+    
+    if (per_fs) {
+        if (!sync_dirs()) {
+            return;
+        }
+    } else {
+        for (auto& f : files) {
+            f.sync(ec);
+            if (ec) {
+                return;
+            }
+        }
+    }
+    for (auto& f : files) {
+        f.publish(ec);
+        if (ec) {
+            return;
+        }
+    }
+    (void)sync_dirs();
+#else
+    (void)m_mode;
+    for (auto& f : files) {
+        f.sync(ec);
+        if (ec) {
+            return;
+        }
+    }
+    for (auto& f : files) {
+        f.publish(ec);
+        if (ec) {
+            return;
+        }
+    }
+#endif
+}
+
+} // v1
+} // filesystem
+} // prosoft
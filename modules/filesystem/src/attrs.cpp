@@ -27,6 +27,7 @@
 #include "fsconfig.h"
 
 #if !_WIN32
+#include <fcntl.h>
 #include <sys/errno.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -44,6 +45,9 @@
 #if PS_FS_HAVE_MNTENT_H
 #include <mntent.h>
 #endif
+#if PS_FS_HAVE_MOUNTINFO
+#include "mount_table_linux_internal.hpp"
+#endif
 
 #include <limits>
 
@@ -186,6 +190,39 @@ bool is_mountpoint(const path& p) {
 
 bool is_mountpoint(const path& p, error_code& ec) {
     ec.clear();
+#if PS_FS_HAVE_MOUNTINFO
+#if PS_FS_HAVE_STATX && defined(STATX_ATTR_MOUNT_ROOT)
+    // Linux 5.8+ flags the root of every mount, including a bind mount of a dir on the same device.
+    struct ::statx sx;
+    if (0 == ::statx(AT_FDCWD, p.c_str(), AT_SYMLINK_NOFOLLOW, STATX_TYPE, &sx) && (sx.stx_attributes_mask & STATX_ATTR_MOUNT_ROOT)) {
+        return S_ISDIR(sx.stx_mode) && (sx.stx_attributes & STATX_ATTR_MOUNT_ROOT);
+    }
+#endif
+    struct stat sb;
+    if (0 != ::lstat(p.c_str(), &sb)) {
+        ifilesystem::system_error(ec);
+        return false;
+    }
+    if (!S_ISDIR(sb.st_mode)) {
+        return false;
+    }
+    // A device that differs from the parent's is only a mount if it's in the mount table, as a btrfs subvolume has its own device
+    // without being mounted. Otherwise it's either the root of the namespace or a bind mount.
+    // Without STATX_ATTR_MOUNT_ROOT only the device's first mount is found, so other bind mounts of it are missed.
+    auto& table = ifilesystem::mount_table::shared();
+    if (table.valid()) {
+        struct stat psb;
+        const bool other_dev = 0 == ::stat((p / "..").c_str(), &psb) && psb.st_dev != sb.st_dev;
+        const auto mp = table.mount_path(sb.st_dev, ec);
+        if (mp.empty()) {
+            if (ec.value() == ENOENT) {
+                ec.clear();
+            }
+            return false;
+        }
+        return other_dev || equivalent(p, mp, ec);
+    }
+#endif
     const auto isdir = is_directory(symlink_status(p, ec));
     const auto match = isdir && equivalent(p, mount_path(p, ec));
 #if !_WIN32
@@ -227,6 +264,12 @@ path mount_path(const path& p, error_code& ec) {
     #endif
     struct stat sb;
     if (0 == ::stat(p.c_str(), &sb)) {
+#if PS_FS_HAVE_MOUNTINFO
+        auto& table = ifilesystem::mount_table::shared();
+        if (table.valid()) {
+            return table.mount_path(sb.st_dev, ec);
+        }
+#endif
         if (auto mt = unique_file{::setmntent(mtab, "r")}) {
             constexpr size_t bufSize = 4096;
             auto buf = make_malloc_throw<char>(bufSize);
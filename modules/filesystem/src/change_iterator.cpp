@@ -48,9 +48,7 @@ state::state(const fs::path& p, fs::directory_options opts, fs::change_iterator_
         cfg.state = state.get();
         cfg.notification_latency = std::chrono::duration_cast<change_config::latency_type>(c.latency);
         m_reg = recursive_monitor(p, cfg, [this, events](change_notifications&& notes) {
-            for (auto& n : notes) {
-                add(filter(filter(n, events)));
-            }
+            add(notes, events);
         }, ec);
     }
 }
@@ -59,25 +57,54 @@ state::~state() {
     abort();
 }
 
-void state::add(notification_ptr np) {
+void state::add(fs::change_notifications& notes, fs::change_event events) {
     using namespace fs;
-    if (np) {
-        auto& n = *np;
-        if (rescan(n) || canceled(n)) {
-            m_done = true;
-            abort();
-            notify();
-            return;
-        }
-        
-        {
-            lock_guard lg{m_lock};
-            m_entries.emplace(n.extract_path());
+    extraction_type paths;
+    paths.reserve(notes.size());
+    bool done = false;
+    for (auto& n : notes) {
+        if (auto np = filter(filter(n, events))) {
+            if (rescan(*np) || canceled(*np)) {
+                done = true;
+                break;
+            }
+            paths.emplace_back(np->extract_path());
         }
+    }
+    
+    const bool added = !paths.empty();
+    if (added) {
+        m_batches.push(std::move(paths));
+    }
+    if (done) {
+        m_done = true;
+        abort();
+    }
+    if (added || done) {
         notify();
     }
 }
 
+void state::claim() {
+    m_batches.consume([this](extraction_type&& paths) {
+        if (m_entries.empty()) {
+            m_entries.reserve(paths.size());
+        }
+        for (auto& p : paths) {
+            m_entries.emplace_back(std::move(p));
+            if (!m_pending.insert(m_entries.size() - 1).second) {
+                m_entries.pop_back();
+            }
+        }
+    });
+}
+
+void state::reset() noexcept {
+    m_entries.clear();
+    m_pending.clear();
+    m_next = 0;
+}
+
 void state::abort() noexcept {
     fs::unique_change_registration u{std::move(m_reg)};
 }
@@ -89,36 +116,31 @@ void state::notify() noexcept {
 }
 
 extraction_type state::extract() {
-    extraction_type paths;
-    lock_guard lg{m_lock};
-    for (auto& e : m_entries) {
-        paths.emplace_back(e.extract());
+    claim();
+    if (m_next > 0) {
+        m_entries.erase(m_entries.begin(), m_entries.begin() + static_cast<extraction_type::difference_type>(m_next));
     }
-    m_entries.clear();
+    extraction_type paths;
+    paths.swap(m_entries);
+    reset();
     return paths;
 }
 
 fs::path state::next(fsiterator_cache&, prosoft::system::error_code&) {
-    {
-        lock_guard lg{m_lock};
-        if (!m_entries.empty()) {
-            auto i = m_entries.begin();
-            fs::path p{i->extract()};
-            m_entries.erase(i);
-            return p;
-        }
+    if (m_next == m_entries.size()) {
+        reset();
+        claim();
+    }
+    if (m_next < m_entries.size()) {
+        m_pending.erase(m_next);
+        return fs::path{std::move(m_entries[m_next++])};
     }
     return fs::path{};
 }
 
 bool state::at_end() const {
-    const bool empty = is_current_empty();
-    if (empty && m_done) {
-        lock_guard lg{m_lock};
-        return m_entries.empty();
-    } else {
-        return false;
-    }
+    // m_done is set after the last batch is published
+    return is_current_empty() && m_done && m_batches.empty() && m_next == m_entries.size();
 }
 
 constexpr auto make_opts_required = fs::directory_options::include_created_events|fs::directory_options::include_modified_events;
@@ -29,8 +29,6 @@
 #include <atomic>
 #include <unordered_set>
 
-#include <prosoft/core/include/stable_hash_wrapper.hpp>
-
 #include <prosoft/core/modules/filesystem/filesystem.hpp>   // error_code
 #include <prosoft/core/modules/filesystem/filesystem_path.hpp>  // path
 #include <prosoft/core/modules/filesystem/filesystem_change_monitor.hpp>    // change_registration
@@ -78,19 +76,79 @@ inline notification_ptr call(const fs::change_iterator_config::filters_type& fl,
     return p;
 }
 
+// Lock free multi-producer/single-consumer hand-off of whole batches.
+// Producers push a batch at a time and the consumer claims everything published so far with a single exchange.
+class batch_queue {
+    struct node {
+        extraction_type paths;
+        node* next;
+    };
+    std::atomic<node*> m_head{nullptr};
+    
+public:
+    batch_queue() = default;
+    ~batch_queue() {
+        consume([](extraction_type&&) {});
+    }
+    PS_DISABLE_COPY(batch_queue);
+    PS_DISABLE_MOVE(batch_queue);
+    
+    void push(extraction_type&& paths) {
+        auto n = new node{std::move(paths), m_head.load(std::memory_order_relaxed)};
+        while (!m_head.compare_exchange_weak(n->next, n, std::memory_order_release, std::memory_order_relaxed)) {
+        }
+    }
+    
+    // Batches are passed to the function in the order they were published.
+    template <class Function>
+    void consume(Function&& f) {
+        node* fifo = nullptr;
+        for (auto n = m_head.exchange(nullptr, std::memory_order_acquire); n;) {
+            auto next = n->next;
+            n->next = fifo;
+            fifo = n;
+            n = next;
+        }
+        while (fifo) {
+            std::unique_ptr<node> n{fifo};
+            fifo = n->next;
+            f(std::move(n->paths));
+        }
+    }
+    
+    bool empty() const noexcept {
+        return m_head.load(std::memory_order_acquire) == nullptr;
+    }
+};
+
 using fsiterator_state = fs::ifilesystem::iterator_state;
 using fsiterator_cache = fs::ifilesystem::cache_info;
 
 struct test_state; // for testing
 
 class state : public fsiterator_state {
-    using lock_type = std::mutex;
-    using lock_guard = std::lock_guard<lock_type>;
     using callback_type = decltype(fs::change_iterator_config::callback);
     
+    // Entries are deduplicated by index so the consumer buffer can be handed off as is.
+    struct entry_hash {
+        const extraction_type* entries;
+        size_t operator()(size_t i) const {
+            return std::hash<fs::path>{}((*entries)[i]);
+        }
+    };
+    struct entry_equal {
+        const extraction_type* entries;
+        bool operator()(size_t lhs, size_t rhs) const {
+            return (*entries)[lhs] == (*entries)[rhs];
+        }
+    };
+    using entry_set = std::unordered_set<size_t, entry_hash, entry_equal>;
+    
     fs::change_registration m_reg;
-    lock_type mutable m_lock;
-    std::unordered_set<prosoft::stable_hash_wrapper<fs::path>> m_entries;
+    batch_queue m_batches; // producer (monitor) side
+    extraction_type m_entries; // consumer side
+    entry_set m_pending{0, entry_hash{&m_entries}, entry_equal{&m_entries}}; // m_entries not yet consumed
+    size_t m_next{};
     std::atomic_bool m_done{false}; // no more events will be received
     callback_type m_callback;
     fs::change_iterator_config::filters_type m_filters;
@@ -104,7 +162,11 @@ class state : public fsiterator_state {
         return call(m_filters, p);
     }
     
-    void add(notification_ptr);
+    void add(fs::change_notifications&, fs::change_event);
+    
+    void claim();
+    
+    void reset() noexcept;
     
     void abort() noexcept;
     
@@ -0,0 +1,403 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "change_journal_linux_internal.hpp"
+#include "filesystem_private.hpp"
+#include "fsmonitor_private.hpp"
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+namespace ifilesystem {
+
+struct change_journal::header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t header_size;
+    std::uint64_t capacity; // of the record area that follows the header
+    std::uint64_t generation; // odd while the records are moved or reset
+    std::uint64_t end; // of the last complete record
+    std::uint64_t first_id;
+    std::uint64_t last_id;
+    char uuid[128];
+    char root[PATH_MAX]; // of the writer, events outside of it are not journaled
+};
+
+namespace {
+
+constexpr char journal_magic[8] = {'P', 'S', 'C', 'J', 'R', 'N', 'L', '\0'};
+constexpr std::uint32_t journal_version = 2;
+
+enum record_kind : std::uint8_t {
+    event_record,
+    session_record,
+    gap_record, // an event that couldn't be journaled
+};
+
+struct record {
+    std::uint32_t size; // including the path bytes and padding
+    std::uint32_t event;
+    std::uint64_t evid;
+    std::uint32_t pathlen;
+    std::uint32_t newpathlen;
+    std::uint8_t kind;
+    std::int8_t type;
+    std::uint8_t reserved[6];
+};
+
+static_assert(sizeof(change_journal::header) % 8 == 0, "records must be aligned");
+static_assert(sizeof(record) == 32, "unexpected padding");
+
+template <typename T>
+inline T load(const T& v, int order = __ATOMIC_ACQUIRE) noexcept {
+    return __atomic_load_n(&v, order);
+}
+
+template <typename T>
+inline void store(T& v, T n, int order = __ATOMIC_RELEASE) noexcept {
+    __atomic_store_n(&v, n, order);
+}
+
+inline std::size_t align(std::size_t n) noexcept {
+    return (n + 7) & ~std::size_t{7};
+}
+
+inline char* records(change_journal::header* h) noexcept {
+    return reinterpret_cast<char*>(h) + sizeof(change_journal::header);
+}
+
+inline const char* records(const change_journal::header* h) noexcept {
+    return reinterpret_cast<const char*>(h) + sizeof(change_journal::header);
+}
+
+// True if s names root or a path below it.
+inline bool within(const char* s, std::size_t n, const std::string& root) noexcept {
+    if (n < root.size() || 0 != root.compare(0, root.size(), s, root.size())) {
+        return false;
+    }
+    return n == root.size() || s[root.size()] == '/' || (!root.empty() && root.back() == '/');
+}
+
+inline bool within(const std::string& s, const std::string& root) noexcept {
+    return within(s.data(), s.size(), root);
+}
+
+// Seqlock writer side, readers retry while the generation is odd or has changed.
+class generation_guard {
+    std::uint64_t& m_gen;
+public:
+    explicit generation_guard(std::uint64_t& gen) noexcept
+        : m_gen(gen) {
+        store(m_gen, m_gen + 1, __ATOMIC_RELAXED);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+    ~generation_guard() {
+        store(m_gen, m_gen + 1);
+    }
+    PS_DISABLE_COPY(generation_guard);
+    PS_DISABLE_MOVE(generation_guard);
+};
+
+} // anon
+
+constexpr std::size_t change_journal::min_size;
+
+change_journal::change_journal() noexcept
+    : m_path()
+    , m_map(nullptr)
+    , m_size(0)
+    , m_fd(-1)
+    , m_writer(false) {
+}
+
+change_journal::~change_journal() {
+    close();
+}
+
+void change_journal::open(const path& p, const std::string& uuid, const path& root, std::size_t size, change_event_id start, error_code& ec) {
+    close();
+    if (uuid.size() >= sizeof(header::uuid) || root.native().size() >= sizeof(header::root)) {
+        ec.assign(ENAMETOOLONG, std::system_category());
+        return;
+    }
+    
+    m_fd = ::open(p.c_str(), O_RDWR|O_CREAT|O_CLOEXEC, 0600);
+    if (-1 == m_fd) {
+        system_error(ec);
+        return;
+    }
+    
+    if (0 == ::flock(m_fd, LOCK_EX|LOCK_NB)) {
+        m_writer = true;
+    } else if (errno != EWOULDBLOCK) {
+        system_error(ec);
+        close();
+        return;
+    }
+    
+    struct stat sb;
+    if (0 != ::fstat(m_fd, &sb)) {
+        system_error(ec);
+        close();
+        return;
+    }
+    
+    // A reader may still have the file mapped, so a writer only ever grows it.
+    auto fsize = static_cast<std::size_t>(sb.st_size);
+    const bool grow = m_writer && fsize < sizeof(header) + min_size;
+    if (grow) {
+        fsize = sizeof(header) + align(std::max(size, min_size));
+        if (0 != ::ftruncate(m_fd, static_cast<off_t>(fsize))) {
+            system_error(ec);
+            close();
+            return;
+        }
+    } else if (fsize < sizeof(header)) {
+        ec.assign(EINVAL, std::system_category()); // the writer hasn't initialized it
+        close();
+        return;
+    }
+    
+    const int prot = m_writer ? PROT_READ|PROT_WRITE : PROT_READ;
+    void* map = ::mmap(nullptr, fsize, prot, MAP_SHARED, m_fd, 0);
+    if (MAP_FAILED == map) {
+        system_error(ec);
+        close();
+        return;
+    }
+    m_map = static_cast<header*>(map);
+    m_size = fsize;
+    m_path = p;
+    
+    if (!valid(uuid) || (m_writer && 0 != std::strncmp(m_map->root, root.c_str(), sizeof(m_map->root)))) {
+        if (m_writer) {
+            reset(uuid, root, start);
+        } else {
+            ec.assign(EINVAL, std::system_category());
+            close();
+            return;
+        }
+    }
+    ec.clear();
+}
+
+void change_journal::close() noexcept {
+    if (m_map) {
+        (void)::munmap(m_map, m_size);
+        m_map = nullptr;
+        m_size = 0;
+    }
+    if (-1 != m_fd) {
+        (void)::close(m_fd); // releases the lock
+        m_fd = -1;
+    }
+    m_writer = false;
+    m_path.clear();
+}
+
+bool change_journal::valid(const std::string& uuid) const noexcept {
+    const auto h = m_map;
+    return 0 == std::memcmp(h->magic, journal_magic, sizeof(journal_magic))
+        && h->version == journal_version
+        && h->header_size == sizeof(header)
+        && h->capacity <= m_size - sizeof(header)
+        && load(h->end) <= h->capacity
+        && 0 == std::strncmp(h->uuid, uuid.c_str(), sizeof(h->uuid));
+}
+
+void change_journal::reset(const std::string& uuid, const path& root, change_event_id start) {
+    PSASSERT(m_writer, "Broken assumption");
+    generation_guard gg{m_map->generation};
+    std::memcpy(m_map->magic, journal_magic, sizeof(journal_magic));
+    m_map->version = journal_version;
+    m_map->header_size = sizeof(header);
+    m_map->capacity = m_size - sizeof(header);
+    store(m_map->end, std::uint64_t{0});
+    store(m_map->first_id, start);
+    store(m_map->last_id, start);
+    std::memset(m_map->uuid, 0, sizeof(m_map->uuid));
+    std::memcpy(m_map->uuid, uuid.data(), uuid.size());
+    std::memset(m_map->root, 0, sizeof(m_map->root));
+    std::memcpy(m_map->root, root.c_str(), root.native().size());
+}
+
+void change_journal::start_session(change_event_id evid) {
+    if (m_writer) {
+        append(session_record, evid, change_event::none, file_type::none, path{}, path{});
+    }
+}
+
+void change_journal::append(const change_notifications& notes) {
+    if (!m_writer) {
+        return;
+    }
+    for (const auto& n : notes) {
+        if (n.event_id() > 0) { // not a replay marker
+            append(event_record, n.event_id(), n.event(), n.type(), n.path(), n.renamed_to_path());
+        }
+    }
+}
+
+void change_journal::append(std::uint8_t kind, change_event_id evid, change_event ev, file_type ft, const path& p, const path& np) {
+    auto pathlen = std::strlen(p.c_str());
+    auto newpathlen = std::strlen(np.c_str());
+    auto size = align(sizeof(record) + pathlen + newpathlen);
+    const auto capacity = m_map->capacity;
+    if (size > capacity / 2) {
+        // Can't happen with min_size and PATH_MAX, but readers must still see that the event is missing.
+        kind = gap_record;
+        pathlen = newpathlen = 0;
+        size = sizeof(record);
+    }
+    
+    auto end = m_map->end;
+    if (end + size > capacity) {
+        compact(size);
+        end = m_map->end;
+    }
+    
+    record r{};
+    r.size = static_cast<std::uint32_t>(size);
+    r.event = static_cast<std::uint32_t>(ev);
+    r.evid = std::max<std::uint64_t>(evid, m_map->last_id);
+    r.pathlen = static_cast<std::uint32_t>(pathlen);
+    r.newpathlen = static_cast<std::uint32_t>(newpathlen);
+    r.kind = kind;
+    r.type = static_cast<std::int8_t>(ft);
+    
+    // Readers only look at complete records, so nothing is published until end is updated.
+    char* rp = records(m_map) + end;
+    std::memcpy(rp, &r, sizeof(r));
+    std::memcpy(rp + sizeof(r), p.c_str(), pathlen);
+    std::memcpy(rp + sizeof(r) + pathlen, np.c_str(), newpathlen);
+    store(m_map->last_id, r.evid);
+    store(m_map->end, end + size);
+}
+
+void change_journal::compact(std::size_t needed) {
+    // Keep the newest half so compaction is amortized over many appends.
+    const auto end = m_map->end;
+    const auto keep = m_map->capacity / 2 - needed;
+    const char* base = records(m_map);
+    std::uint64_t cut = 0;
+    std::uint64_t dropped = m_map->first_id;
+    while (end - cut > keep) {
+        record r;
+        std::memcpy(&r, base + cut, sizeof(r));
+        dropped = std::max<std::uint64_t>(dropped, r.evid);
+        cut += r.size;
+    }
+    
+    generation_guard gg{m_map->generation};
+    std::memmove(records(m_map), base + cut, end - cut);
+    store(m_map->end, end - cut);
+    store(m_map->first_id, dropped);
+}
+
+bool change_journal::replay(change_event_id after, change_event_id slack, const path& root, change_event mask, change_notifications& notes, const change_state* reg) const {
+    PSASSERT(is_open(), "Broken assumption");
+    std::vector<char> buf;
+    std::string wroot;
+    std::uint64_t first = 0;
+    for (;;) {
+        const auto gen = load(m_map->generation);
+        if ((gen & 1)) {
+            std::this_thread::yield();
+            continue;
+        }
+        first = load(m_map->first_id, __ATOMIC_RELAXED);
+        wroot.assign(m_map->root, strnlen(m_map->root, sizeof(m_map->root)));
+        // A writer may have grown the file since it was mapped.
+        const auto end = std::min<std::uint64_t>(load(m_map->end), m_size - sizeof(header));
+        buf.assign(records(m_map), records(m_map) + end);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (load(m_map->generation, __ATOMIC_RELAXED) == gen) {
+            break;
+        }
+    }
+    
+    const std::string rroot{root.c_str()};
+    if (after < first || !within(rroot, wroot)) {
+        return false; // the writer may not have seen all events for the root
+    }
+    
+    // Ids from other monitors are only loosely ordered with the writer's, so events just before the id are repeated.
+    const auto from = after > slack ? after - slack : 0;
+    const auto rescan_required = change_event::rescan_required;
+    const char* p = buf.data();
+    const auto size = buf.size();
+    for (std::size_t off = 0; off + sizeof(record) <= size;) {
+        record r;
+        std::memcpy(&r, p + off, sizeof(r));
+        if (r.size < sizeof(r) || off + r.size > size || sizeof(r) + r.pathlen + r.newpathlen > r.size) {
+            return false;
+        }
+        if (r.evid > after && r.kind != event_record) {
+            return false; // nothing was written while the journal was closed, or an event is missing
+        }
+        const auto ev = static_cast<change_event>(r.event);
+        const char* s = p + off + sizeof(r);
+        if (r.evid > after && is_set(ev & change_event::rescan)) {
+            if ((ev & rescan_required) == rescan_required || within(rroot, std::string{s, r.pathlen})) {
+                return false;
+            }
+        }
+        const bool keep = is_set(ev & (mask|change_event::rescan))
+            && (within(s, r.pathlen, rroot) || within(s + r.pathlen, r.newpathlen, rroot));
+        if (r.evid > from && r.kind == event_record && keep) {
+            path evp{std::string{s, r.pathlen}};
+            path np{std::string{s + r.pathlen, r.newpathlen}};
+            change_manager::emplace_back(notes, std::move(evp), std::move(np), reg, r.evid, ev, static_cast<file_type>(r.type));
+        }
+        off += r.size;
+    }
+    return true;
+}
+
+change_event_id change_journal::first_id() const noexcept {
+    return is_open() ? load(m_map->first_id) : 0;
+}
+
+change_event_id change_journal::last_id() const noexcept {
+    return is_open() ? load(m_map->last_id) : 0;
+}
+
+} // ifilesystem
+} // v1
+} // filesystem
+} // prosoft
@@ -0,0 +1,105 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef PS_CORE_CHANGE_JOURNAL_LINUX_INTERNAL_HPP
+#define PS_CORE_CHANGE_JOURNAL_LINUX_INTERNAL_HPP
+
+#include <cstdint>
+#include <string>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_change_monitor.hpp>
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+namespace ifilesystem {
+
+// A fixed size, memory mapped, append-only log of change notifications shared between processes.
+// The first process to open the file becomes the only writer (an exclusive flock held until close) and everybody else replays from it.
+// Every time a writer opens the journal it appends a session record, and events before a session are not continuous with events after it.
+// The writer's root is kept in the header, it only journals events below it.
+// When full, the oldest half of the log is discarded and the newest discarded id is kept as a low water mark.
+// Readers copy the log under a seqlock (an odd generation while compacting) so a writer never waits on them.
+class change_journal {
+public:
+    static constexpr std::size_t min_size = 64 * 1024; // room for at least a few records with two PATH_MAX paths
+    
+    change_journal() noexcept;
+    ~change_journal();
+    PS_DISABLE_COPY(change_journal);
+    PS_DISABLE_MOVE(change_journal);
+    
+    // The root and size are only used when the journal is created or reset by a writer.
+    // A writer resets a journal that is invalid or that belongs to another uuid or root.
+    void open(const path&, const std::string& uuid, const path& root, std::size_t size, change_event_id start, error_code&);
+    void close() noexcept;
+    
+    bool is_open() const noexcept {
+        return m_map != nullptr;
+    }
+    
+    bool writer() const noexcept {
+        return m_writer;
+    }
+    
+    const path& file() const noexcept {
+        return m_path;
+    }
+    
+    // Writer only, events before the session id are not continuous with later ones.
+    void start_session(change_event_id);
+    void append(const change_notifications&);
+    
+    // Adds notifications with an id greater than the given id (less the slack) for the root and events, up to the current end of the journal.
+    // Returns false if any event after the id may be missing: it was compacted, a session started after it, an event couldn't be journaled,
+    // the writer reported a rescan that covers the root or the root isn't within the writer's root.
+    bool replay(change_event_id after, change_event_id slack, const path& root, change_event, change_notifications&, const change_state* reg) const;
+    
+    // Events up to this id are no longer available.
+    change_event_id first_id() const noexcept;
+    change_event_id last_id() const noexcept;
+    
+    struct header;
+    
+private:
+    void append(std::uint8_t kind, change_event_id, change_event, file_type, const path&, const path&);
+    void compact(std::size_t needed);
+    void reset(const std::string& uuid, const path& root, change_event_id start);
+    bool valid(const std::string& uuid) const noexcept;
+    
+    path m_path;
+    header* m_map;
+    std::size_t m_size; // of the mapping
+    int m_fd;
+    bool m_writer;
+};
+
+} // ifilesystem
+} // v1
+} // filesystem
+} // prosoft
+
+#endif // PS_CORE_CHANGE_JOURNAL_LINUX_INTERNAL_HPP
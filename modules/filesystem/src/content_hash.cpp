@@ -0,0 +1,544 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <prosoft/core/config/config.h>
+#include "fsconfig.h"
+
+#if !_WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <windows.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#include <prosoft/core/modules/filesystem/filesystem_hash.hpp>
+#include "filesystem_private.hpp"
+#include "hash_internal.hpp"
+
+namespace {
+
+using namespace prosoft::filesystem;
+using clock_type = std::chrono::steady_clock;
+
+constexpr std::size_t buffer_alignment = 4096;
+#if !_WIN32
+constexpr file_size_type max_map_size = 256U * 1024U * 1024U; // bounds the address space of a worker
+#endif
+
+class aligned_buffer {
+    std::vector<std::uint8_t> m_storage;
+    std::uint8_t* m_data;
+    std::size_t m_size;
+public:
+    explicit aligned_buffer(std::size_t n)
+        : m_storage(std::max(n, buffer_alignment) + buffer_alignment)
+        , m_data()
+        , m_size(std::max(n, buffer_alignment)) {
+        const auto addr = reinterpret_cast<std::uintptr_t>(m_storage.data());
+        m_data = m_storage.data() + (buffer_alignment - addr % buffer_alignment) % buffer_alignment;
+    }
+    PS_DISABLE_COPY(aligned_buffer);
+    
+    std::uint8_t* data() noexcept {
+        return m_data;
+    }
+    
+    std::size_t size() const noexcept {
+        return m_size;
+    }
+};
+
+// Reads may run concurrently, the file position is never used.
+class reader {
+#if !_WIN32
+    ifilesystem::unique_fd m_fd;
+#else
+    windows::Handle m_handle;
+#endif
+    file_size_type m_size;
+    const hash_config& m_cfg;
+    
+public:
+    explicit reader(const hash_config& cfg)
+        : m_size()
+        , m_cfg(cfg) {}
+    PS_DISABLE_COPY(reader);
+    
+    file_size_type size() const noexcept {
+        return m_size;
+    }
+    
+    void open(const path&, error_code&);
+    void read(file_size_type off, file_size_type len, ifilesystem::hasher&, aligned_buffer&, error_code&) const;
+};
+
+#if !_WIN32
+
+void reader::open(const path& p, error_code& ec) {
+    ec.clear();
+    m_fd.reset(::open(p.c_str(), O_RDONLY|O_CLOEXEC));
+    struct stat sb;
+    if (!m_fd || 0 != ::fstat(m_fd.get(), &sb)) {
+        ifilesystem::system_error(ec);
+        return;
+    }
+    if (!S_ISREG(sb.st_mode)) {
+        ec = einval();
+        return;
+    }
+    m_size = static_cast<file_size_type>(sb.st_size);
+#if __linux__
+    (void)::posix_fadvise(m_fd.get(), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+}
+
+void reader::read(file_size_type off, file_size_type len, ifilesystem::hasher& h, aligned_buffer& buf, error_code& ec) const {
+    if (m_cfg.mmap_threshold > 0 && m_size >= m_cfg.mmap_threshold) {
+        static const auto page = static_cast<file_size_type>(::sysconf(_SC_PAGESIZE));
+        while (len > 0) {
+            const auto lead = off % page;
+            const auto n = std::min(len, max_map_size);
+            const auto mlen = static_cast<std::size_t>(n + lead);
+            auto m = ::mmap(nullptr, mlen, PROT_READ, MAP_PRIVATE, m_fd.get(), static_cast<off_t>(off - lead));
+            if (m == MAP_FAILED) {
+                ifilesystem::system_error(ec);
+                return;
+            }
+            (void)::madvise(m, mlen, MADV_SEQUENTIAL);
+            h.update(static_cast<const std::uint8_t*>(m) + lead, static_cast<std::size_t>(n));
+            (void)::munmap(m, mlen);
+            off += n;
+            len -= n;
+        }
+        return;
+    }
+    
+    while (len > 0) {
+        const auto want = static_cast<std::size_t>(std::min<file_size_type>(len, buf.size()));
+        const auto n = ::pread(m_fd.get(), buf.data(), want, static_cast<off_t>(off));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ifilesystem::system_error(ec);
+            return;
+        }
+        if (n == 0) { // truncated while hashing
+            ec = std::make_error_code(std::errc::io_error);
+            return;
+        }
+        h.update(buf.data(), static_cast<std::size_t>(n));
+        off += static_cast<file_size_type>(n);
+        len -= static_cast<file_size_type>(n);
+    }
+}
+
+#else // _WIN32
+
+void reader::open(const path& p, error_code& ec) {
+    m_handle = ifilesystem::open(p, GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_WRITE, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, ec);
+    if (ec) {
+        return;
+    }
+    LARGE_INTEGER sz;
+    if (!::GetFileSizeEx(m_handle.get(), &sz)) {
+        ifilesystem::system_error(ec);
+        return;
+    }
+    m_size = static_cast<file_size_type>(sz.QuadPart);
+}
+
+void reader::read(file_size_type off, file_size_type len, ifilesystem::hasher& h, aligned_buffer& buf, error_code& ec) const {
+    while (len > 0) {
+        OVERLAPPED o{};
+        o.Offset = static_cast<DWORD>(off);
+        o.OffsetHigh = static_cast<DWORD>(off >> 32);
+        DWORD n = 0;
+        const auto want = static_cast<DWORD>(std::min<file_size_type>(len, buf.size()));
+        if (!::ReadFile(m_handle.get(), buf.data(), want, &n, &o)) {
+            ifilesystem::system_error(ec);
+            return;
+        }
+        if (n == 0) {
+            ec = std::make_error_code(std::errc::io_error);
+            return;
+        }
+        h.update(buf.data(), n);
+        off += n;
+        len -= n;
+    }
+}
+
+#endif // _WIN32
+
+inline bool is_tree(const hash_config& cfg, file_size_type size) noexcept {
+    return cfg.chunk_size > 0 && size > cfg.chunk_size;
+}
+
+inline std::size_t worker_count(const hash_config& cfg) {
+    return cfg.threads > 0 ? cfg.threads : std::max(std::thread::hardware_concurrency(), 1U);
+}
+
+file_digest hash_range(const reader& r, file_size_type off, file_size_type len, hash_algorithm a, aligned_buffer& buf, hash_statistics::worker& stats, error_code& ec) {
+    const auto start = clock_type::now();
+    ifilesystem::hasher h{a};
+    r.read(off, len, h, buf, ec);
+    stats.busy += std::chrono::duration_cast<hash_statistics::duration_type>(clock_type::now() - start);
+    if (ec) {
+        return {};
+    }
+    stats.bytes += len;
+    return h.finish();
+}
+
+// The root is marked so it can't collide with a flat digest of the same bytes.
+file_digest hash_root(hash_algorithm a, file_size_type size, file_size_type chunk, const std::vector<file_digest>& leaves) {
+    std::uint8_t header[17] = {1};
+    for (int i = 0; i < 8; ++i) {
+        header[1 + i] = static_cast<std::uint8_t>(size >> (i * 8));
+        header[9 + i] = static_cast<std::uint8_t>(chunk >> (i * 8));
+    }
+    ifilesystem::hasher h{a};
+    h.update(header, sizeof(header));
+    for (const auto& d : leaves) {
+        h.update(d.data(), d.size());
+    }
+    return h.finish();
+}
+
+inline std::size_t chunk_count(file_size_type size, file_size_type chunk) noexcept {
+    return static_cast<std::size_t>((size + chunk - 1) / chunk);
+}
+
+// Single worker.
+file_digest hash_open_file(const reader& r, const hash_config& cfg, aligned_buffer& buf, hash_statistics::worker& stats, error_code& ec) {
+    const auto size = r.size();
+    if (!is_tree(cfg, size)) {
+        return hash_range(r, 0, size, cfg.algorithm, buf, stats, ec);
+    }
+    std::vector<file_digest> leaves(chunk_count(size, cfg.chunk_size));
+    for (std::size_t i = 0; i < leaves.size(); ++i) {
+        const auto off = file_size_type(i) * cfg.chunk_size;
+        leaves[i] = hash_range(r, off, std::min<file_size_type>(cfg.chunk_size, size - off), cfg.algorithm, buf, stats, ec);
+        if (ec) {
+            return {};
+        }
+    }
+    return hash_root(cfg.algorithm, size, cfg.chunk_size, leaves);
+}
+
+} // anon
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+constexpr file_digest::size_type file_digest::max_size;
+
+file_digest::file_digest(hash_algorithm a, const value_type* p, size_type n)
+    : m_bytes()
+    , m_size(static_cast<std::uint8_t>(std::min(n, max_size)))
+    , m_algorithm(a) {
+    std::copy(p, p + m_size, m_bytes.begin());
+}
+
+std::string file_digest::to_string() const {
+    static constexpr char hex[] = "0123456789abcdef";
+    std::string s;
+    s.reserve(m_size * 2);
+    for (size_type i = 0; i < m_size; ++i) {
+        s += hex[m_bytes[i] >> 4];
+        s += hex[m_bytes[i] & 0xf];
+    }
+    return s;
+}
+
+file_digest ifilesystem::hash_file_edges(const path& p, file_size_type edge, hash_algorithm a, file_size_type& size, error_code& ec) {
+    const hash_config cfg{a, 1};
+    reader r{cfg};
+    r.open(p, ec);
+    if (ec) {
+        return {};
+    }
+    size = r.size();
+    aligned_buffer buf{static_cast<std::size_t>(std::min<file_size_type>(edge, cfg.buffer_size))};
+    ifilesystem::hasher h{a};
+    if (size <= edge || size - edge <= edge) {
+        r.read(0, size, h, buf, ec);
+    } else {
+        r.read(0, edge, h, buf, ec);
+        if (!ec) {
+            r.read(size - edge, edge, h, buf, ec);
+        }
+    }
+    return ec ? file_digest{} : h.finish();
+}
+
+file_digest hash_file(const path& p, const hash_config& cfg) {
+    error_code ec;
+    auto d = hash_file(p, cfg, ec);
+    PS_THROW_IF(ec.value() != 0, filesystem_error("Could not hash file", p, ec));
+    return d;
+}
+
+file_digest hash_file(const path& p, const hash_config& cfg, error_code& ec) {
+    hash_statistics stats;
+    return hash_file(p, cfg, stats, ec);
+}
+
+file_digest hash_file(const path& p, const hash_config& cfg, hash_statistics& stats, error_code& ec) {
+    const auto start = clock_type::now();
+    stats = hash_statistics{};
+    reader r{cfg};
+    r.open(p, ec);
+    if (ec) {
+        return {};
+    }
+    
+    const auto size = r.size();
+    file_digest d;
+    if (!is_tree(cfg, size)) {
+        stats.workers.resize(1);
+        aligned_buffer buf{cfg.buffer_size};
+        d = hash_range(r, 0, size, cfg.algorithm, buf, stats.workers[0], ec);
+    } else {
+        std::vector<file_digest> leaves(chunk_count(size, cfg.chunk_size));
+        stats.workers.resize(std::min(worker_count(cfg), leaves.size()));
+        std::atomic<std::size_t> next{0};
+        std::atomic<bool> failed{false};
+        std::mutex error_lock;
+        
+        auto work = [&](std::size_t w) {
+            aligned_buffer buf{cfg.buffer_size};
+            for (std::size_t i; !failed && (i = next++) < leaves.size();) {
+                const auto off = file_size_type(i) * cfg.chunk_size;
+                error_code wec;
+                leaves[i] = hash_range(r, off, std::min<file_size_type>(cfg.chunk_size, size - off), cfg.algorithm, buf, stats.workers[w], wec);
+                if (wec) {
+                    std::lock_guard<std::mutex> l{error_lock};
+                    if (!ec) {
+                        ec = wec;
+                    }
+                    failed = true;
+                }
+            }
+        };
+        
+        std::vector<std::thread> threads;
+        try {
+            for (std::size_t w = 1; w < stats.workers.size(); ++w) {
+                threads.emplace_back(work, w);
+            }
+        } catch (const std::system_error&) {
+            // The remaining chunks go to the workers that did start.
+        }
+        work(0);
+        for (auto& t : threads) {
+            t.join();
+        }
+        if (!ec) {
+            d = hash_root(cfg.algorithm, size, cfg.chunk_size, leaves);
+        }
+    }
+    stats.elapsed = std::chrono::duration_cast<hash_statistics::duration_type>(clock_type::now() - start);
+    return ec ? file_digest{} : d;
+}
+
+class ifilesystem::hash_pipeline_state {
+    const hash_config m_cfg;
+    const hash_visitor m_visitor;
+    std::deque<directory_entry> m_queue;
+    std::mutex m_lock;
+    std::condition_variable m_cond;
+    std::size_t m_capacity;
+    bool m_done;
+    std::atomic<bool> m_stop;
+    std::mutex m_visit_lock;
+    std::exception_ptr m_exception;
+    std::vector<std::thread> m_workers;
+    hash_statistics m_stats;
+    clock_type::time_point m_start;
+    bool m_finished;
+    
+    static constexpr std::size_t entries_per_worker = 16;
+    
+    void process(const directory_entry& e, aligned_buffer& buf, hash_statistics::worker& stats) {
+        hash_record rec;
+        rec.path = e.path();
+        rec.size = 0;
+        reader r{m_cfg};
+        r.open(rec.path, rec.error);
+        if (!rec.error) {
+            rec.digest = hash_open_file(r, m_cfg, buf, stats, rec.error);
+            rec.size = r.size();
+        }
+        error_code ec;
+        rec.last_write = e.last_write_time(ec);
+        
+        std::lock_guard<std::mutex> l{m_visit_lock};
+        if (m_stop) {
+            return;
+        }
+        try {
+            m_visitor(rec);
+        } catch (...) {
+            m_exception = std::current_exception();
+            m_stop = true;
+        }
+    }
+    
+    void run(std::size_t w) {
+        aligned_buffer buf{m_cfg.buffer_size};
+        for (;;) {
+            directory_entry e;
+            {
+                std::unique_lock<std::mutex> l{m_lock};
+                m_cond.wait(l, [this]{ return !m_queue.empty() || m_done; });
+                if (m_queue.empty()) {
+                    return;
+                }
+                e = std::move(m_queue.front());
+                m_queue.pop_front();
+            }
+            m_cond.notify_all(); // room for the producer
+            if (!m_stop) {
+                process(e, buf, m_stats.workers[w]);
+            }
+        }
+    }
+    
+public:
+    hash_pipeline_state(const hash_config& cfg, hash_visitor&& v)
+        : m_cfg(cfg)
+        , m_visitor(std::move(v))
+        , m_queue()
+        , m_lock()
+        , m_cond()
+        , m_capacity()
+        , m_done()
+        , m_stop()
+        , m_visit_lock()
+        , m_exception()
+        , m_workers()
+        , m_stats()
+        , m_start(clock_type::now())
+        , m_finished() {
+        const auto n = worker_count(cfg);
+        m_stats.workers.resize(n);
+        try {
+            for (std::size_t w = 0; w < n; ++w) {
+                m_workers.emplace_back([this, w]{ run(w); });
+            }
+        } catch (const std::system_error&) {
+            // Entries are hashed by push() if no worker started.
+        }
+        m_capacity = std::max<std::size_t>(m_workers.size(), 1) * entries_per_worker;
+    }
+    
+    ~hash_pipeline_state() {
+        m_stop = true;
+        finish();
+    }
+    PS_DISABLE_COPY(hash_pipeline_state);
+    
+    void push(const directory_entry& e) {
+        if (m_stop) {
+            return;
+        }
+        if (m_workers.empty()) {
+            aligned_buffer buf{m_cfg.buffer_size};
+            process(e, buf, m_stats.workers[0]);
+            return;
+        }
+        std::unique_lock<std::mutex> l{m_lock};
+        m_cond.wait(l, [this]{ return m_queue.size() < m_capacity || m_stop; });
+        m_queue.push_back(e);
+        l.unlock();
+        m_cond.notify_all();
+    }
+    
+    void finish() {
+        if (m_finished) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> l{m_lock};
+            m_done = true;
+        }
+        m_cond.notify_all();
+        for (auto& t : m_workers) {
+            t.join();
+        }
+        m_finished = true;
+        m_stats.elapsed = std::chrono::duration_cast<hash_statistics::duration_type>(clock_type::now() - m_start);
+    }
+    
+    std::exception_ptr exception() const {
+        return m_exception;
+    }
+    
+    const hash_statistics& statistics() const noexcept {
+        return m_stats;
+    }
+};
+
+constexpr std::size_t ifilesystem::hash_pipeline_state::entries_per_worker;
+
+hash_pipeline::hash_pipeline(const hash_config& cfg, hash_visitor v)
+    : m_state(new ifilesystem::hash_pipeline_state{cfg, std::move(v)}) {}
+
+hash_pipeline::~hash_pipeline() = default;
+
+void hash_pipeline::push(const directory_entry& e) {
+    error_code ec;
+    if (e.is_regular_file(ec)) {
+        m_state->push(e);
+    }
+}
+
+void hash_pipeline::finish() {
+    m_state->finish();
+    if (auto e = m_state->exception()) {
+        std::rethrow_exception(e);
+    }
+}
+
+const hash_statistics& hash_pipeline::statistics() const {
+    return m_state->statistics();
+}
+
+} // v1
+} // filesystem
+} // prosoft
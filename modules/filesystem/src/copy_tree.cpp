@@ -0,0 +1,778 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <prosoft/core/config/config.h>
+#include "fsconfig.h"
+
+#if !_WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <windows.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include "copyops_internal.hpp"
+#include "filesystem_private.hpp"
+
+#if !_WIN32
+
+namespace {
+
+using namespace prosoft::filesystem;
+
+inline int nofollow(bool follow) noexcept {
+    return follow ? 0 : O_NOFOLLOW;
+}
+
+inline bool foreign_owner(const struct stat& sb) noexcept {
+    return sb.st_uid != ::geteuid() || sb.st_gid != ::getegid();
+}
+
+inline bool replace_existing(copy_options opts, const struct stat& src, const struct stat& dst) noexcept {
+    return is_set(opts & copy_options::overwrite_existing) || (is_set(opts & copy_options::update_existing) && ifilesystem::newer(src, dst));
+}
+
+// The owner is set first as it may clear set-id bits and the times last as every other change updates ctime only.
+// Changing the owner is best effort, it requires privileges for anything other than our own groups.
+void apply_metadata(int fd, const struct stat& sb, int src, error_code& ec) noexcept {
+    if (foreign_owner(sb) && 0 != ::fchown(fd, sb.st_uid, sb.st_gid) && errno != EPERM) {
+        ifilesystem::system_error(ec);
+        return;
+    }
+    if (0 != ::fchmod(fd, sb.st_mode & 07777)) {
+        ifilesystem::system_error(ec);
+        return;
+    }
+    ifilesystem::copy_acl(src, fd, ec);
+    if (ec.value() == ENOTSUP || ec.value() == EOPNOTSUPP) {
+        ec.clear();
+    } else if (ec) {
+        return;
+    }
+    const struct timespec times[2] = {ifilesystem::access_time(sb), ifilesystem::modify_time(sb)};
+    if (0 != ::futimens(fd, times)) {
+        ifilesystem::system_error(ec);
+    }
+}
+
+// Returns false if an existing target was kept.
+bool copy_symlink_at(int sdir, const char* sname, const struct stat& sb, int ddir, const char* dname, copy_options opts, error_code& ec) {
+    // st_size is 0 for some pseudo filesystems.
+    std::vector<char> target(std::max(static_cast<size_t>(sb.st_size), size_t{64}) + 1);
+    for (;;) {
+        const auto n = ::readlinkat(sdir, sname, target.data(), target.size());
+        if (n < 0) {
+            ifilesystem::system_error(ec);
+            return false;
+        }
+        if (static_cast<size_t>(n) < target.size()) {
+            target[static_cast<size_t>(n)] = 0;
+            break;
+        }
+        target.resize(target.size() * 2);
+    }
+    
+    while (0 != ::symlinkat(target.data(), ddir, dname)) {
+        struct stat ds;
+        if (errno != EEXIST || 0 != ::fstatat(ddir, dname, &ds, AT_SYMLINK_NOFOLLOW)) {
+            ifilesystem::system_error(ec);
+            return false;
+        }
+        if (is_set(opts & copy_options::skip_existing) || (is_set(opts & copy_options::update_existing) && !ifilesystem::newer(sb, ds))) {
+            return false;
+        }
+        if (!replace_existing(opts, sb, ds) || S_ISDIR(ds.st_mode)) {
+            ec.assign(EEXIST, std::system_category());
+            return false;
+        }
+        if (0 != ::unlinkat(ddir, dname, 0)) {
+            ifilesystem::system_error(ec);
+            return false;
+        }
+    }
+    
+    // Modes and ACLs do not apply to the link itself.
+    if (foreign_owner(sb) && 0 != ::fchownat(ddir, dname, sb.st_uid, sb.st_gid, AT_SYMLINK_NOFOLLOW) && errno != EPERM) {
+        ifilesystem::system_error(ec);
+        return false;
+    }
+    const struct timespec times[2] = {ifilesystem::access_time(sb), ifilesystem::modify_time(sb)};
+    if (0 != ::utimensat(ddir, dname, times, AT_SYMLINK_NOFOLLOW)) {
+        ifilesystem::system_error(ec);
+        return false;
+    }
+    return true;
+}
+
+// Same existing target rules as copy_file(), but the copy keeps the owner, times and ACL of the source.
+// Returns false if an existing target was kept.
+bool copy_file_at(int src, const struct stat& ss, int ddir, const char* dname, copy_options opts, copy_file_result& r, error_code& ec) {
+    // The final mode is set once the data is written, a read-only source must not stop us from writing the copy.
+    ifilesystem::unique_fd dst{::openat(ddir, dname, O_WRONLY|O_CREAT|O_EXCL|O_CLOEXEC, 0600)};
+    if (!dst) {
+        struct stat ds;
+        if (errno != EEXIST || 0 != ::fstatat(ddir, dname, &ds, 0)) {
+            ifilesystem::system_error(ec);
+            return false;
+        }
+        if ((ds.st_dev == ss.st_dev && ds.st_ino == ss.st_ino) || !S_ISREG(ds.st_mode)) {
+            ec.assign(S_ISREG(ds.st_mode) ? EEXIST : EINVAL, std::system_category());
+            return false;
+        }
+        if (is_set(opts & copy_options::skip_existing) || (is_set(opts & copy_options::update_existing) && !ifilesystem::newer(ss, ds))) {
+            return false;
+        }
+        if (!replace_existing(opts, ss, ds)) {
+            ec.assign(EEXIST, std::system_category());
+            return false;
+        }
+        dst.reset(::openat(ddir, dname, O_WRONLY|O_TRUNC|O_CLOEXEC));
+        if (!dst) {
+            ifilesystem::system_error(ec);
+            return false;
+        }
+    }
+#if __linux__
+    (void)::posix_fadvise(src, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    
+    ifilesystem::copy_data(src, dst.get(), static_cast<file_size_type>(ss.st_size), copy_strategy::clone, r, ec);
+    if (!ec) {
+        apply_metadata(dst.get(), ss, src, ec);
+    }
+    if (0 != ::close(dst.release()) && !ec) {
+        ifilesystem::system_error(ec);
+    }
+    return !ec;
+}
+
+} // anon
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+// A single thread walks the source and creates directories, files are queued to the workers.
+// Each directory holds a reference for the walker, every queued entry and every open subdirectory.
+// Whoever drops the last one applies the directory's metadata, so its times are set after all of its entries exist.
+class ifilesystem::tree_copier {
+    struct dir_node {
+        std::shared_ptr<dir_node> parent;
+        unique_fd src;
+        unique_fd dst;
+        path dst_path;
+        struct stat sb;
+        std::atomic<size_t> pending;
+        bool created; // existing directories keep their metadata
+        
+        dir_node()
+            : parent()
+            , src()
+            , dst()
+            , dst_path()
+            , sb()
+            , pending{1}
+            , created() {}
+    };
+    using node_ptr = std::shared_ptr<dir_node>;
+    
+    enum class task_type {
+        file,
+        symlink,
+        followed, // a file reached through a link is copied on its own
+    };
+    
+    struct task {
+        node_ptr dir;
+        path src;
+        task_type type;
+    };
+    
+    // Other names of a hardlinked source wait for the first one to be copied and link to the copy.
+    struct link_target {
+        std::shared_future<bool> copied;
+        path dst;
+    };
+    
+    const copy_options m_opts;
+    const tree_filter m_filter;
+    const bool m_follow;
+    const size_t m_threads;
+    std::vector<std::thread> m_workers;
+    std::deque<task> m_tasks;
+    std::mutex m_lock;
+    std::condition_variable m_cond;
+    bool m_done;
+    std::atomic<bool> m_stop;
+    std::mutex m_links_lock;
+    std::unordered_map<file_id_type, link_target> m_links;
+    std::mutex m_error_lock;
+    error_code m_error;
+    std::exception_ptr m_exception;
+    std::atomic<copy_result::count_type> m_files;
+    std::atomic<copy_result::count_type> m_directories;
+    std::atomic<copy_result::count_type> m_symlinks;
+    std::atomic<copy_result::count_type> m_hardlinks;
+    std::atomic<copy_result::count_type> m_skipped;
+    std::atomic<file_size_type> m_cloned;
+    std::atomic<file_size_type> m_copied;
+    
+    static constexpr size_t tasks_per_worker = 64;
+    
+    bool option(copy_options o) const noexcept {
+        return is_set(m_opts & o);
+    }
+    
+    void fail(const error_code& ec) {
+        std::lock_guard<std::mutex> l{m_error_lock};
+        if (!m_error) {
+            m_error = ec;
+        }
+        m_stop = true;
+    }
+    
+    void fail(std::exception_ptr e) {
+        std::lock_guard<std::mutex> l{m_error_lock};
+        if (!m_exception) {
+            m_exception = e;
+        }
+        m_stop = true;
+    }
+    
+    void release(node_ptr n) {
+        while (n && --n->pending == 0) {
+            if (n->created && !m_stop) {
+                error_code ec;
+                apply_metadata(n->dst.get(), n->sb, n->src.get(), ec);
+                if (ec) {
+                    fail(ec);
+                }
+            }
+            n->src.reset();
+            n->dst.reset();
+            auto parent = std::move(n->parent);
+            n = std::move(parent);
+        }
+    }
+    
+    node_ptr open_root(const path& from, const path& to, error_code&);
+    node_ptr open_dir(const node_ptr&, const path& name, error_code&);
+    void walk(node_ptr, const path& from, error_code&);
+    void push(task&&);
+    void run_task(task&);
+    void copy_entry(const task&, error_code&);
+    void run();
+    
+public:
+    tree_copier(copy_options opts, const copy_config& cfg, bool follow, const tree_filter& filter = tree_filter{})
+        : m_opts(opts)
+        , m_filter(filter)
+        , m_follow(follow)
+        , m_threads(cfg.threads > 0 ? cfg.threads : std::max(std::thread::hardware_concurrency(), 1U))
+        , m_workers()
+        , m_tasks()
+        , m_lock()
+        , m_cond()
+        , m_done()
+        , m_stop()
+        , m_links_lock()
+        , m_links()
+        , m_error_lock()
+        , m_error()
+        , m_exception()
+        , m_files()
+        , m_directories()
+        , m_symlinks()
+        , m_hardlinks()
+        , m_skipped()
+        , m_cloned()
+        , m_copied() {}
+    PS_DISABLE_COPY(tree_copier);
+    
+    void copy(const path& from, const path& to, copy_result&, error_code&);
+};
+
+constexpr size_t ifilesystem::tree_copier::tasks_per_worker;
+
+ifilesystem::tree_copier::node_ptr ifilesystem::tree_copier::open_root(const path& from, const path& to, error_code& ec) {
+    auto n = std::make_shared<dir_node>();
+    n->src.reset(::open(from.c_str(), O_RDONLY|O_DIRECTORY|O_CLOEXEC));
+    if (!n->src || 0 != ::fstat(n->src.get(), &n->sb)) {
+        system_error(ec);
+        return {};
+    }
+    if (0 == ::mkdir(to.c_str(), 0700)) {
+        n->created = true;
+        ++m_directories;
+    } else if (errno != EEXIST) {
+        system_error(ec);
+        return {};
+    }
+    n->dst.reset(::open(to.c_str(), O_RDONLY|O_DIRECTORY|O_CLOEXEC));
+    if (!n->dst) {
+        system_error(ec);
+        return {};
+    }
+    n->dst_path = to;
+    return n;
+}
+
+ifilesystem::tree_copier::node_ptr ifilesystem::tree_copier::open_dir(const node_ptr& parent, const path& name, error_code& ec) {
+    auto n = std::make_shared<dir_node>();
+    n->src.reset(::openat(parent->src.get(), name.c_str(), O_RDONLY|O_DIRECTORY|O_CLOEXEC|nofollow(m_follow)));
+    if (!n->src || 0 != ::fstat(n->src.get(), &n->sb)) {
+        system_error(ec);
+        return {};
+    }
+    // Created private, the final mode is applied once the directory is complete.
+    if (0 == ::mkdirat(parent->dst.get(), name.c_str(), 0700)) {
+        n->created = true;
+        ++m_directories;
+    } else if (errno != EEXIST) {
+        system_error(ec);
+        return {};
+    }
+    n->dst.reset(::openat(parent->dst.get(), name.c_str(), O_RDONLY|O_DIRECTORY|O_CLOEXEC|O_NOFOLLOW));
+    if (!n->dst) {
+        system_error(ec);
+        return {};
+    }
+    n->dst_path = parent->dst_path / name;
+    n->parent = parent;
+    ++parent->pending;
+    return n;
+}
+
+void ifilesystem::tree_copier::push(task&& t) {
+    ++t.dir->pending;
+    std::unique_lock<std::mutex> l{m_lock};
+    if (m_workers.empty() || m_tasks.size() >= m_workers.size() * tasks_per_worker) {
+        // Rather than wait for room the walker does the work itself.
+        l.unlock();
+        run_task(t);
+        return;
+    }
+    m_tasks.push_back(std::move(t));
+    l.unlock();
+    m_cond.notify_one();
+}
+
+void ifilesystem::tree_copier::run_task(task& t) {
+    if (!m_stop) {
+        try {
+            error_code ec;
+            copy_entry(t, ec);
+            if (ec) {
+                fail(ec);
+            }
+        } catch (...) {
+            fail(std::current_exception());
+        }
+    }
+    release(std::move(t.dir));
+}
+
+void ifilesystem::tree_copier::copy_entry(const task& t, error_code& ec) {
+    const auto& d = *t.dir;
+    const auto name = t.src.filename();
+    if (t.type == task_type::symlink) {
+        struct stat sb;
+        if (0 != ::fstatat(d.src.get(), name.c_str(), &sb, AT_SYMLINK_NOFOLLOW)) {
+            system_error(ec);
+            return;
+        }
+        const auto copied = copy_symlink_at(d.src.get(), name.c_str(), sb, d.dst.get(), name.c_str(), m_opts, ec);
+        if (!ec) {
+            ++(copied ? m_symlinks : m_skipped);
+        }
+        return;
+    }
+    
+    if (option(copy_options::create_symlinks) || option(copy_options::create_hard_links)) {
+        const bool sym = option(copy_options::create_symlinks);
+        const auto rc = sym ? ::symlinkat(t.src.c_str(), d.dst.get(), name.c_str()) : ::linkat(d.src.get(), name.c_str(), d.dst.get(), name.c_str(), 0);
+        if (0 == rc) {
+            ++(sym ? m_symlinks : m_hardlinks);
+            struct stat sb;
+            if (!sym && m_filter.linked && 0 == ::fstatat(d.dst.get(), name.c_str(), &sb, AT_SYMLINK_NOFOLLOW)) {
+                m_filter.linked(sb);
+            }
+            return;
+        }
+        // Another filesystem (e.g. a nested mount), protected_hardlinks or the link count limit.
+        const bool unlinkable = errno == EXDEV || errno == EPERM || errno == EMLINK;
+        if (errno == EEXIST && option(copy_options::skip_existing)) {
+            ++m_skipped;
+            return;
+        } else if (sym || !unlinkable || !m_filter.copy_unlinkable) {
+            system_error(ec);
+            return;
+        }
+    }
+    
+    unique_fd src{::openat(d.src.get(), name.c_str(), O_RDONLY|O_CLOEXEC|nofollow(m_follow))};
+    struct stat ss;
+    if (!src || 0 != ::fstat(src.get(), &ss)) {
+        system_error(ec);
+        return;
+    }
+    if (!S_ISREG(ss.st_mode)) {
+        ec = einval();
+        return;
+    }
+    
+    std::promise<bool> first;
+    bool owner = false;
+    if (ss.st_nlink > 1 && t.type == task_type::file) {
+        const file_id_type fid{file_id_type::device_type(ss.st_dev), file_id_type::inode_type(ss.st_ino)};
+        link_target target;
+        {
+            std::lock_guard<std::mutex> l{m_links_lock};
+            auto i = m_links.find(fid);
+            if (i == m_links.end()) {
+                m_links.emplace(fid, link_target{first.get_future().share(), d.dst_path / name});
+                owner = true;
+            } else {
+                target = i->second;
+            }
+        }
+        // A failed link (e.g. an existing target) falls back to a copy so the existing target rules apply.
+        if (!owner && target.copied.get() && 0 == ::linkat(AT_FDCWD, target.dst.c_str(), d.dst.get(), name.c_str(), 0)) {
+            ++m_hardlinks;
+            return;
+        }
+    }
+    
+    copy_file_result r;
+    const auto copied = copy_file_at(src.get(), ss, d.dst.get(), name.c_str(), m_opts, r, ec);
+    if (owner) {
+        first.set_value(copied);
+    }
+    if (!ec) {
+        ++(copied ? m_files : m_skipped);
+        m_cloned += r.bytes_cloned;
+        m_copied += r.bytes_copied;
+    }
+}
+
+void ifilesystem::tree_copier::run() {
+    for (;;) {
+        task t;
+        {
+            std::unique_lock<std::mutex> l{m_lock};
+            m_cond.wait(l, [this]{ return !m_tasks.empty() || m_done; });
+            if (m_tasks.empty()) {
+                return;
+            }
+            t = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+        run_task(t);
+    }
+}
+
+void ifilesystem::tree_copier::walk(node_ptr root, const path& from, error_code& ec) {
+    auto opts = directory_options::include_postorder_directories|directory_options::include_apple_double_files;
+    if (!m_filter.one_filesystem) {
+        opts |= directory_options::follow_mountpoints;
+    }
+    iterator_config cfg;
+    if (m_follow) {
+        opts |= directory_options::follow_directory_symlink;
+        cfg.skip_visited_directories = true;
+    }
+    
+    // The open directory at each depth.
+    std::vector<node_ptr> dirs;
+    dirs.push_back(std::move(root));
+    for (recursive_directory_iterator i{from, opts, std::move(cfg), ec}; !ec && !m_stop && i != end(i); i.increment(ec)) {
+        const auto depth = static_cast<size_t>(i.depth()) + 1;
+        while (dirs.size() > depth) {
+            release(std::move(dirs.back()));
+            dirs.pop_back();
+        }
+        if (i.is_postorder()) {
+            continue;
+        }
+        
+        auto type = i->symlink_status(ec).type();
+        const bool link = type == file_type::symlink;
+        if (!ec && link && m_follow) {
+            type = i->status(ec).type();
+        }
+        if (ec) {
+            break;
+        }
+        switch (type) {
+            case file_type::directory:
+                if (!option(copy_options::recursive) || (!m_filter.exclude.empty() && i->path() == m_filter.exclude)) {
+                    i.disable_recursion_pending();
+                } else if (auto n = open_dir(dirs.back(), i->path().filename(), ec)) {
+                    if (i.recursion_pending()) {
+                        dirs.push_back(std::move(n));
+                    } else {
+                        release(std::move(n));
+                    }
+                }
+                break;
+            case file_type::symlink:
+                if (!option(copy_options::skip_symlinks)) {
+                    push(task{dirs.back(), i->path(), task_type::symlink});
+                }
+                break;
+            case file_type::regular:
+                if (!option(copy_options::directories_only)) {
+                    push(task{dirs.back(), i->path(), link ? task_type::followed : task_type::file});
+                }
+                break;
+            default:
+                if (!m_filter.skip_special_files) {
+                    ec = einval();
+                }
+                break;
+        }
+    }
+    
+    while (!dirs.empty()) {
+        release(std::move(dirs.back()));
+        dirs.pop_back();
+    }
+}
+
+void ifilesystem::tree_copier::copy(const path& from, const path& to, copy_result& r, error_code& ec) {
+    auto root = open_root(from, to, ec);
+    if (!root) {
+        return;
+    }
+    
+    // The walker counts as a worker, with one thread the copy is sequential.
+    try {
+        for (size_t i = 1; i < m_threads; ++i) {
+            m_workers.emplace_back([this]{ run(); });
+        }
+    } catch (const std::system_error&) {
+        // Whatever was started is enough, the walker copies if there are no workers.
+    }
+    
+    error_code wec;
+    try {
+        walk(std::move(root), from, wec);
+    } catch (...) {
+        fail(std::current_exception());
+    }
+    {
+        std::lock_guard<std::mutex> l{m_lock};
+        m_done = true;
+    }
+    m_cond.notify_all();
+    for (auto& t : m_workers) {
+        t.join();
+    }
+    
+    if (m_exception) {
+        std::rethrow_exception(m_exception);
+    }
+    ec = m_error ? m_error : wec;
+    r.files = m_files;
+    r.directories = m_directories;
+    r.symlinks = m_symlinks;
+    r.hardlinks = m_hardlinks;
+    r.skipped = m_skipped;
+    r.bytes_cloned = m_cloned;
+    r.bytes_copied = m_copied;
+}
+
+void ifilesystem::copy_tree(const path& from, const path& to, copy_options opts, const copy_config& cfg, const tree_filter& filter, copy_result& r, error_code& ec) {
+    r = copy_result{};
+    ec.clear();
+    const bool follow = !is_set(opts & (copy_options::copy_symlinks|copy_options::skip_symlinks|copy_options::create_symlinks));
+    tree_copier{opts, cfg, follow, filter}.copy(from, to, r, ec);
+}
+
+} // v1
+} // filesystem
+} // prosoft
+
+#endif // !_WIN32
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+#if _WIN32
+namespace {
+
+// Sequential, files are copied with copy_file() and directories keep the times of their creation.
+void copy_tree(const path& from, const path& to, copy_options opts, copy_result& r, error_code& ec) {
+    error_code cec;
+    if (create_directory(to, cec)) {
+        ++r.directories;
+    } else if (!is_directory(to, ec)) {
+        if (!ec) {
+            ec = cec ? cec : einval();
+        }
+        return;
+    }
+    
+    constexpr auto dopts = directory_options::follow_mountpoints;
+    std::vector<path> dirs{to};
+    for (recursive_directory_iterator i{from, dopts, ec}; !ec && i != end(i); i.increment(ec)) {
+        dirs.resize(static_cast<size_t>(i.depth()) + 1);
+        const auto dst = dirs.back() / i->path().filename();
+        const auto st = i->status(ec);
+        if (ec) {
+            break;
+        }
+        if (is_directory(st)) {
+            if (!is_set(opts & copy_options::recursive)) {
+                i.disable_recursion_pending();
+            } else if (create_directory(dst, cec)) {
+                ++r.directories;
+                dirs.push_back(dst);
+            } else if (is_directory(dst, ec)) {
+                dirs.push_back(dst);
+            }
+        } else if (is_regular_file(st)) {
+            if (!is_set(opts & copy_options::directories_only)) {
+                copy_file_result fr;
+                ++(copy_file(i->path(), dst, opts, fr, ec) ? r.files : r.skipped);
+                r.bytes_copied += fr.bytes_copied;
+            }
+        } else {
+            ec = einval();
+        }
+    }
+}
+
+} // anon
+#endif
+
+void copy(const path& from, const path& to, copy_options opts) {
+    copy_result r;
+    copy(from, to, opts, copy_config{}, r);
+}
+
+void copy(const path& from, const path& to, copy_options opts, error_code& ec) {
+    copy_result r;
+    copy(from, to, opts, copy_config{}, r, ec);
+}
+
+void copy(const path& from, const path& to, copy_options opts, const copy_config& cfg, copy_result& r) {
+    error_code ec;
+    copy(from, to, opts, cfg, r, ec);
+    PS_THROW_IF(ec.value() != 0, filesystem_error("Could not copy", from, to, ec));
+}
+
+void copy(const path& from, const path& to, copy_options opts, const copy_config& cfg, copy_result& r, error_code& ec) {
+    r = copy_result{};
+    ec.clear();
+    const bool follow = !is_set(opts & (copy_options::copy_symlinks|copy_options::skip_symlinks|copy_options::create_symlinks));
+    const auto st = follow ? status(from, ec) : symlink_status(from, ec);
+    if (ec) {
+        return;
+    }
+    
+    if (is_symlink(st)) {
+        if (is_set(opts & copy_options::skip_symlinks)) {
+            return;
+        }
+        if (!is_set(opts & copy_options::copy_symlinks)) {
+            ec = einval();
+            return;
+        }
+#if !_WIN32
+        struct stat sb;
+        if (0 != ::lstat(from.c_str(), &sb)) {
+            ifilesystem::system_error(ec);
+            return;
+        }
+        ++(copy_symlink_at(AT_FDCWD, from.c_str(), sb, AT_FDCWD, to.c_str(), opts, ec) ? r.symlinks : r.skipped);
+#else
+        ec.assign(ERROR_NOT_SUPPORTED, std::system_category());
+#endif
+        return;
+    }
+    
+    if (is_directory(st)) {
+        if (is_set(opts & copy_options::create_symlinks)) {
+            ec = std::make_error_code(std::errc::is_a_directory);
+        } else if (is_set(opts & copy_options::recursive) || opts == copy_options::none) {
+#if !_WIN32
+            ifilesystem::tree_copier{opts, cfg, follow}.copy(from, to, r, ec);
+#else
+            (void)cfg;
+            copy_tree(from, to, opts, r, ec);
+#endif
+        }
+        return;
+    }
+    
+    if (!is_regular_file(st)) {
+        ec = einval();
+        return;
+    }
+    if (is_set(opts & copy_options::directories_only)) {
+        return;
+    }
+    error_code tec;
+    const auto target = is_directory(to, tec) ? to / from.filename() : to;
+    if (is_set(opts & copy_options::create_symlinks)) {
+        create_symlink(from, target, ec);
+        r.symlinks = ec ? 0 : 1;
+    } else if (is_set(opts & copy_options::create_hard_links)) {
+#if !_WIN32
+        if (0 != ::link(from.c_str(), target.c_str())) {
+            ifilesystem::system_error(ec);
+        }
+#else
+        if (!::CreateHardLinkW(ifilesystem::to_native_path{}(target.native()).c_str(), ifilesystem::to_native_path{}(from.native()).c_str(), nullptr)) {
+            ifilesystem::system_error(ec);
+        }
+#endif
+        r.hardlinks = ec ? 0 : 1;
+    } else {
+        copy_file_result fr;
+        ++(copy_file(from, target, opts, fr, ec) ? r.files : r.skipped);
+        r.bytes_cloned = fr.bytes_cloned;
+        r.bytes_copied = fr.bytes_copied;
+    }
+}
+
+} // v1
+} // filesystem
+} // prosoft
@@ -0,0 +1,357 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <prosoft/core/config/config.h>
+#include "fsconfig.h"
+
+#if !_WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if __linux__
+#include <linux/fs.h> // FICLONE
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#endif
+#else
+#include <windows.h>
+#endif
+
+#include <algorithm>
+#include <memory>
+#include <new>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include "copyops_internal.hpp"
+#include "filesystem_private.hpp"
+
+#if !_WIN32
+
+namespace {
+
+using namespace prosoft::filesystem;
+
+constexpr size_t copy_buffer_size = 1024 * 1024;
+constexpr size_t max_copy_chunk = 1024 * 1024 * 1024; // keeps a single call interruptible
+
+// The strategy isn't supported for this pair of files, as opposed to an I/O error.
+inline bool unsupported(int err) noexcept {
+    return err == EXDEV || err == EINVAL || err == ENOSYS || err == ENOTSUP || err == EOPNOTSUPP || err == ETXTBSY;
+}
+
+inline copy_strategy weaker(copy_strategy s) noexcept {
+    return s == copy_strategy::read_write ? s : static_cast<copy_strategy>(static_cast<int>(s) + 1);
+}
+
+bool write_all(int fd, const char* buf, size_t len, off_t off) noexcept {
+    while (len > 0) {
+        const auto n = ::pwrite(fd, buf, len, off);
+        if (n > 0) {
+            buf += n;
+            len -= static_cast<size_t>(n);
+            off += n;
+        } else if (n == 0 || errno != EINTR) {
+            if (n == 0) {
+                errno = EIO;
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+class segment_copier {
+    std::unique_ptr<char[]> m_buf; // for read_write
+    int m_src;
+    int m_dst;
+    
+    ssize_t copy_chunk(copy_strategy s, off_t off, size_t len) noexcept {
+        len = std::min(len, max_copy_chunk);
+        switch (s) {
+#if __linux__
+            case copy_strategy::copy_range: {
+                loff_t in = off;
+                loff_t out = off;
+                return ::copy_file_range(m_src, &in, m_dst, &out, len, 0);
+            }
+            case copy_strategy::sendfile: {
+                // sendfile writes at the file offset
+                if (::lseek(m_dst, off, SEEK_SET) != off) {
+                    return -1;
+                }
+                off_t in = off;
+                return ::sendfile(m_dst, m_src, &in, len);
+            }
+#endif
+            default:
+                break;
+        }
+        
+        if (!m_buf) {
+            m_buf.reset(new (std::nothrow) char[copy_buffer_size]);
+            if (!m_buf) {
+                errno = ENOMEM;
+                return -1;
+            }
+        }
+        const auto n = ::pread(m_src, m_buf.get(), std::min(len, copy_buffer_size), off);
+        if (n > 0 && !write_all(m_dst, m_buf.get(), static_cast<size_t>(n), off)) {
+            return -1;
+        }
+        return n;
+    }
+    
+public:
+    segment_copier(int src, int dst) noexcept
+        : m_buf()
+        , m_src(src)
+        , m_dst(dst) {}
+    
+    // Copies [off, off + len) and returns the offset reached, which is short only if the source was truncated.
+    off_t operator()(off_t off, off_t len, copy_strategy& s, copy_file_result& r, error_code& ec) noexcept {
+        while (len > 0) {
+            const auto n = copy_chunk(s, off, static_cast<size_t>(len));
+            if (n > 0) {
+                off += n;
+                len -= n;
+                r.bytes_copied += static_cast<file_size_type>(n);
+            } else if (n == 0) {
+                // copy_file_range and sendfile may return 0 early (FUSE, NFS, across filesystems), only pread's EOF is trusted.
+                if (s == copy_strategy::read_write) {
+                    break;
+                }
+                s = copy_strategy::read_write;
+            } else if (errno == EINTR) {
+                continue;
+            } else if (s != copy_strategy::read_write && unsupported(errno)) {
+                s = weaker(s);
+            } else {
+                ifilesystem::system_error(ec);
+                break;
+            }
+        }
+        return off;
+    }
+};
+
+} // anon
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+void ifilesystem::copy_data(int src, int dst, file_size_type size, copy_strategy strategy, copy_file_result& r, error_code& ec) noexcept {
+    r = copy_file_result{};
+    ec.clear();
+    if (size == 0) {
+        return;
+    }
+    
+#if __linux__
+    if (strategy == copy_strategy::clone) {
+        if (0 == ::ioctl(dst, FICLONE, src)) {
+            r.bytes_cloned = size;
+            r.strategy = copy_strategy::clone;
+            return;
+        }
+        strategy = copy_strategy::copy_range;
+    }
+#else
+    strategy = copy_strategy::read_write;
+#endif
+    
+    segment_copier copy{src, dst};
+    auto end = static_cast<off_t>(size);
+    for (off_t off = 0; off < end;) {
+        auto data = off;
+        auto hole = end;
+#ifdef SEEK_DATA
+        data = ::lseek(src, off, SEEK_DATA);
+        if (data == -1) {
+            if (errno == ENXIO) {
+                // Only a hole remains, up to the source's current size.
+                struct stat sb;
+                if (0 == ::fstat(src, &sb) && sb.st_size < end) {
+                    end = std::max(off, static_cast<off_t>(sb.st_size));
+                }
+                break;
+            }
+            data = off; // not supported
+        } else {
+            hole = ::lseek(src, data, SEEK_HOLE);
+            if (hole == -1 || hole > end) {
+                hole = end;
+            }
+        }
+        if (data >= end) {
+            break;
+        }
+#endif
+        const auto reached = copy(data, hole - data, strategy, r, ec);
+        if (ec) {
+            return;
+        }
+        if (reached < hole) {
+            end = reached; // the source was truncated
+            break;
+        }
+        off = hole;
+    }
+    
+    // Trailing holes only exist once the size is set.
+    if (0 != ::ftruncate(dst, end)) {
+        ifilesystem::system_error(ec);
+        return;
+    }
+    const auto copied_size = static_cast<file_size_type>(end);
+    r.bytes_skipped = copied_size - std::min(copied_size, r.bytes_copied);
+    r.strategy = r.bytes_copied > 0 ? strategy : copy_strategy::none;
+}
+
+} // v1
+} // filesystem
+} // prosoft
+
+#endif // !_WIN32
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+bool copy_file(const path& from, const path& to, copy_options opts) {
+    copy_file_result r;
+    return copy_file(from, to, opts, r);
+}
+
+bool copy_file(const path& from, const path& to, copy_options opts, error_code& ec) noexcept {
+    copy_file_result r;
+    return copy_file(from, to, opts, r, ec);
+}
+
+bool copy_file(const path& from, const path& to, copy_options opts, copy_file_result& r) {
+    error_code ec;
+    const auto copied = copy_file(from, to, opts, r, ec);
+    PS_THROW_IF(ec.value() != 0, filesystem_error("Could not copy file", from, to, ec));
+    return copied;
+}
+
+bool copy_file(const path& from, const path& to, copy_options opts, copy_file_result& r, error_code& ec) noexcept {
+    r = copy_file_result{};
+    ec.clear();
+    const bool replace = is_set(opts & (copy_options::overwrite_existing|copy_options::update_existing));
+#if !_WIN32
+    ifilesystem::unique_fd src{::open(from.c_str(), O_RDONLY|O_CLOEXEC)};
+    struct stat ss;
+    if (!src || 0 != ::fstat(src.get(), &ss)) {
+        ifilesystem::system_error(ec);
+        return false;
+    }
+    if (!S_ISREG(ss.st_mode)) {
+        ec = einval();
+        return false;
+    }
+    
+    int flags = O_WRONLY|O_CREAT|O_CLOEXEC;
+    struct stat ds;
+    if (0 == ::stat(to.c_str(), &ds)) {
+        if ((ds.st_dev == ss.st_dev && ds.st_ino == ss.st_ino) || !S_ISREG(ds.st_mode)) {
+            ec.assign(S_ISREG(ds.st_mode) ? EEXIST : EINVAL, std::system_category());
+            return false;
+        }
+        if (is_set(opts & copy_options::skip_existing) || (is_set(opts & copy_options::update_existing) && !ifilesystem::newer(ss, ds))) {
+            return false;
+        }
+        if (!replace) {
+            ec.assign(EEXIST, std::system_category());
+            return false;
+        }
+        flags |= O_TRUNC;
+    } else if (errno == ENOENT) {
+        flags |= O_EXCL;
+    } else {
+        ifilesystem::system_error(ec);
+        return false;
+    }
+    
+    const auto mode = static_cast<mode_t>(ss.st_mode & 07777);
+    ifilesystem::unique_fd dst{::open(to.c_str(), flags, mode)};
+    if (!dst) {
+        ifilesystem::system_error(ec);
+        return false;
+    }
+#if __linux__
+    (void)::posix_fadvise(src.get(), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    
+    ifilesystem::copy_data(src.get(), dst.get(), static_cast<file_size_type>(ss.st_size), copy_strategy::clone, r, ec);
+    if (!ec && 0 != ::fchmod(dst.get(), mode)) {
+        ifilesystem::system_error(ec);
+    }
+    // Deferred write errors (e.g. NFS) may only be reported by close.
+    if (0 != ::close(dst.release()) && !ec) {
+        ifilesystem::system_error(ec);
+    }
+    return !ec;
+#else
+    const auto st = status(from, status_info::size|status_info::times, ec);
+    if (ec) {
+        return false;
+    }
+    if (!is_regular_file(st)) {
+        ec = einval();
+        return false;
+    }
+    error_code tec;
+    const auto tst = status(to, status_info::times, tec);
+    if (exists(tst)) {
+        if (equivalent(from, to, tec) || !is_regular_file(tst)) {
+            ec.assign(is_regular_file(tst) ? ERROR_FILE_EXISTS : ERROR_INVALID_PARAMETER, std::system_category());
+            return false;
+        }
+        if (is_set(opts & copy_options::skip_existing) || (is_set(opts & copy_options::update_existing) && st.times().modified() <= tst.times().modified())) {
+            return false;
+        }
+        if (!replace) {
+            ec.assign(ERROR_FILE_EXISTS, std::system_category());
+            return false;
+        }
+    }
+    
+    auto&& nfrom = ifilesystem::to_native_path{}(from.native());
+    auto&& nto = ifilesystem::to_native_path{}(to.native());
+    if (::CopyFileW(nfrom.c_str(), nto.c_str(), !replace)) {
+        r.bytes_copied = st.size();
+        r.strategy = st.size() > 0 ? copy_strategy::read_write : copy_strategy::none;
+        return true;
+    } else {
+        ifilesystem::system_error(ec);
+        return false;
+    }
+#endif
+}
+
+} // v1
+} // filesystem
+} // prosoft
@@ -0,0 +1,97 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef PS_CORE_COPYOPS_INTERNAL_HPP
+#define PS_CORE_COPYOPS_INTERNAL_HPP
+
+#if !_WIN32
+#include <sys/stat.h>
+#endif
+
+#include <functional>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+namespace ifilesystem {
+
+#if !_WIN32
+class tree_copier; // copy_tree.cpp
+
+// Internal copy() variant for snapshots.
+struct tree_filter {
+    path exclude; // a directory within the source that isn't copied (e.g. the snapshot store)
+    bool skip_special_files; // fifos, sockets and devices are skipped rather than failing with EINVAL
+    bool one_filesystem; // mount points below the source are copied as empty directories
+    bool copy_unlinkable; // with create_hard_links, a file that can't be linked (EXDEV, EPERM, EMLINK) is copied instead
+    std::function<void (const struct stat&)> linked; // with create_hard_links, called from the copying threads with each new link
+};
+
+void copy_tree(const path& from, const path& to, copy_options, const copy_config&, const tree_filter&, copy_result&, error_code&);
+
+// Copies the first size bytes of src to the empty dst, starting with the given strategy and falling back to weaker ones as needed.
+// Holes in src are preserved when the system can find them.
+void copy_data(int src, int dst, file_size_type size, copy_strategy, copy_file_result&, error_code&) noexcept;
+
+inline const struct timespec& modify_time(const struct stat& sb) noexcept {
+#if __APPLE__
+    return sb.st_mtimespec;
+#else
+    return sb.st_mtim;
+#endif
+}
+
+inline const struct timespec& change_time(const struct stat& sb) noexcept {
+#if __APPLE__
+    return sb.st_ctimespec;
+#else
+    return sb.st_ctim;
+#endif
+}
+
+inline const struct timespec& access_time(const struct stat& sb) noexcept {
+#if __APPLE__
+    return sb.st_atimespec;
+#else
+    return sb.st_atim;
+#endif
+}
+
+// For copy_options::update_existing.
+inline bool newer(const struct stat& lhs, const struct stat& rhs) noexcept {
+    const auto& lt = modify_time(lhs);
+    const auto& rt = modify_time(rhs);
+    return lt.tv_sec > rt.tv_sec || (lt.tv_sec == rt.tv_sec && lt.tv_nsec > rt.tv_nsec);
+}
+#endif
+
+} // ifilesystem
+} // v1
+} // filesystem
+} // prosoft
+
+#endif // PS_CORE_COPYOPS_INTERNAL_HPP
@@ -0,0 +1,492 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <prosoft/core/config/config.h>
+#include "fsconfig.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include <prosoft/core/modules/filesystem/filesystem_diff.hpp>
+#include "filesystem_private.hpp"
+#include "manifest_internal.hpp"
+
+namespace {
+
+using namespace prosoft::filesystem;
+using key_type = std::vector<std::string>; // UTF-8 names from the root
+
+// Directories this many levels below the roots are still compared as separate tasks, deeper ones by the task that reaches them.
+// Enough to balance a tree with a few large top-level directories without a task per small directory.
+constexpr std::size_t split_levels = 3;
+
+// Entries in preorder with siblings in byte order of their names.
+class sorted_source {
+public:
+    sorted_source()
+        : m_current()
+        , m_key()
+        , m_paths()
+        , m_end() {}
+    virtual ~sorted_source() = default;
+    PS_DEFAULT_COPY(sorted_source);
+    
+    // Positions the source at its first entry.
+    virtual void start(error_code&) = 0;
+    // Moves past the current entry, and into it when descend is set.
+    virtual void next(bool descend, error_code&) = 0;
+    // The descendants of the current entry, start() has not been called.
+    virtual std::unique_ptr<sorted_source> subtree() const = 0;
+    
+    bool at_end() const noexcept {
+        return m_end;
+    }
+    
+    const manifest_record& current() const noexcept {
+        return m_current;
+    }
+    
+    const key_type& key() const noexcept {
+        return m_key;
+    }
+    
+    const path& relative() const noexcept {
+        return m_paths.back();
+    }
+    
+protected:
+    void set_key(std::string&& name) {
+        const auto depth = static_cast<std::size_t>(m_current.depth);
+        m_key.resize(depth);
+        m_key.push_back(std::move(name));
+        m_paths.resize(depth);
+        m_paths.push_back(depth > 0 ? m_paths.back() / m_current.name : m_current.name);
+    }
+    
+    manifest_record m_current;
+    key_type m_key;
+    std::vector<path> m_paths;
+    bool m_end;
+};
+
+class tree_source : public sorted_source {
+    path m_dir; // listed by start()
+    path m_current_path;
+    std::vector<std::vector<ifilesystem::sorted_entry>> m_levels; // the remaining siblings, reversed
+    diff_options m_opts;
+    std::size_t m_base; // the depth of the first level
+    
+    void push_children(const path& dir, bool root, error_code& ec) {
+        std::vector<ifilesystem::sorted_entry> children;
+        ifilesystem::sorted_children(dir, children, ec);
+        if ((ec == std::errc::no_such_file_or_directory && !root) // removed while walking
+            || (ec == std::errc::permission_denied && is_set(m_opts & diff_options::skip_permission_denied))) {
+            ec.clear();
+        }
+        std::reverse(children.begin(), children.end());
+        m_levels.push_back(std::move(children));
+    }
+    
+    void load(error_code& ec) {
+        while (!ec) {
+            while (!m_levels.empty() && m_levels.back().empty()) {
+                m_levels.pop_back();
+            }
+            if (m_levels.empty()) {
+                m_end = true;
+                return;
+            }
+            auto e = std::move(m_levels.back().back());
+            m_levels.back().pop_back();
+            ifilesystem::make_record(e.entry, static_cast<iterator_depth_type>(m_base + m_levels.size() - 1), m_current, ec);
+            if (ec == std::errc::no_such_file_or_directory) {
+                ec.clear(); // removed while walking
+                continue;
+            }
+            if (!ec) {
+                set_key(std::move(e.key));
+                m_current_path = std::move(e.entry).path();
+            }
+            return;
+        }
+    }
+    
+public:
+    tree_source(const path& dir, const key_type& key, const std::vector<path>& paths, diff_options opts)
+        : sorted_source()
+        , m_dir(dir)
+        , m_current_path()
+        , m_levels()
+        , m_opts(opts)
+        , m_base(key.size()) {
+        m_key = key;
+        m_paths = paths;
+    }
+    
+    void start(error_code& ec) override {
+        m_end = false;
+        push_children(m_dir, m_base == 0, ec);
+        load(ec);
+    }
+    
+    void next(bool descend, error_code& ec) override {
+        if (descend && m_current.type == file_type::directory) {
+            push_children(m_current_path, false, ec);
+        }
+        load(ec);
+    }
+    
+    std::unique_ptr<sorted_source> subtree() const override {
+        return std::unique_ptr<sorted_source>{new tree_source{m_current_path, m_key, m_paths, m_opts}};
+    }
+};
+
+class manifest_source : public sorted_source {
+    manifest_iterator m_i;
+    const manifest* m_manifest;
+    iterator_depth_type m_min_depth;
+    
+    void load() {
+        if (m_i == end(m_i) || m_i.depth() < m_min_depth) {
+            m_end = true;
+            return;
+        }
+        m_current = m_i.record();
+        set_key(m_current.name.u8string().str());
+    }
+    
+public:
+    explicit manifest_source(const manifest& m)
+        : sorted_source()
+        , m_i()
+        , m_manifest(&m)
+        , m_min_depth() {}
+    
+    void start(error_code& ec) override {
+        if (m_manifest) {
+            m_i = manifest_iterator{*m_manifest, ec};
+            m_manifest = nullptr;
+        } else { // a subtree, positioned at its root
+            m_i.increment(ec);
+        }
+        if (!ec) {
+            load();
+        }
+    }
+    
+    void next(bool descend, error_code& ec) override {
+        if (descend) {
+            m_i.increment(ec);
+        } else {
+            m_i.skip_descendants(ec);
+        }
+        if (!ec) {
+            load();
+        }
+    }
+    
+    std::unique_ptr<sorted_source> subtree() const override {
+        auto s = new manifest_source{*this};
+        s->m_min_depth = m_current.depth + 1;
+        return std::unique_ptr<sorted_source>{s};
+    }
+};
+
+bool changed(const manifest_record& x, const manifest_record& y, diff_options opts) {
+    return x.type != y.type
+        || (x.type != file_type::directory && x.size != y.size)
+        || x.modified != y.modified
+        || (is_set(opts & diff_options::compare_metadata) && (x.permissions != y.permissions || x.metadata_modified != y.metadata_modified));
+}
+
+bool unchanged_directory(const manifest_record& x, const manifest_record& y) {
+    return x.type == file_type::directory && y.type == file_type::directory
+        && x.id == y.id && x.modified == y.modified && x.metadata_modified == y.metadata_modified;
+}
+
+class differ {
+    using task = std::function<void()>;
+    
+    const diff_config& m_cfg;
+    const diff_visitor& m_visitor;
+    std::mutex m_visit_lock;
+    std::vector<diff_record> m_added;
+    std::vector<diff_record> m_removed;
+    std::exception_ptr m_exception;
+    error_code m_error;
+    std::atomic<bool> m_stop;
+    // subtrees
+    std::deque<task> m_tasks;
+    std::mutex m_lock;
+    std::condition_variable m_cond;
+    bool m_done;
+    
+    bool detect_renames() const noexcept {
+        return is_set(m_cfg.options & diff_options::detect_renames);
+    }
+    
+    void fail(const error_code& ec) {
+        std::lock_guard<std::mutex> l{m_visit_lock};
+        if (!m_error) {
+            m_error = ec;
+        }
+        m_stop = true;
+    }
+    
+    void fail(std::exception_ptr e) {
+        std::lock_guard<std::mutex> l{m_visit_lock};
+        if (!m_exception) {
+            m_exception = e;
+        }
+        m_stop = true;
+    }
+    
+    void emit(diff_record& r) {
+        // m_visit_lock is held
+        if (m_stop) {
+            return;
+        }
+        try {
+            m_visitor(r);
+        } catch (...) {
+            if (!m_exception) {
+                m_exception = std::current_exception();
+            }
+            m_stop = true;
+        }
+    }
+    
+    void report(diff_kind k, const path& p, const manifest_record* before, const manifest_record* after) {
+        diff_record r{k, p, path{}, before ? *before : manifest_record{}, after ? *after : manifest_record{}};
+        std::lock_guard<std::mutex> l{m_visit_lock};
+        if (detect_renames() && k == diff_kind::added) {
+            m_added.push_back(std::move(r));
+        } else if (detect_renames() && k == diff_kind::removed) {
+            m_removed.push_back(std::move(r));
+        } else {
+            emit(r);
+        }
+    }
+    
+    // Directories are scheduled as separate tasks while split is non-zero.
+    void merge(sorted_source& a, sorted_source& b, std::size_t split) {
+        error_code ec;
+        a.start(ec);
+        if (!ec) {
+            b.start(ec);
+        }
+        while (!ec && !m_stop && !(a.at_end() && b.at_end())) {
+            const int c = a.at_end() ? 1 : b.at_end() ? -1 : a.key() < b.key() ? -1 : b.key() < a.key() ? 1 : 0;
+            if (c < 0) {
+                report(diff_kind::removed, a.relative(), &a.current(), nullptr);
+                a.next(true, ec);
+            } else if (c > 0) {
+                report(diff_kind::added, b.relative(), nullptr, &b.current());
+                b.next(true, ec);
+            } else {
+                const auto& x = a.current();
+                const auto& y = b.current();
+                if (changed(x, y, m_cfg.options)) {
+                    report(diff_kind::modified, b.relative(), &x, &y);
+                }
+                bool descend = true;
+                if (is_set(m_cfg.options & diff_options::prune_unchanged_directories) && unchanged_directory(x, y)) {
+                    descend = false;
+                } else if (split > 0 && x.type == file_type::directory && y.type == file_type::directory) {
+                    schedule(a.subtree(), b.subtree(), split - 1);
+                    descend = false;
+                }
+                a.next(descend, ec);
+                if (!ec) {
+                    b.next(descend, ec);
+                }
+            }
+        }
+        if (ec) {
+            fail(ec);
+        }
+    }
+    
+    void schedule(std::unique_ptr<sorted_source> a, std::unique_ptr<sorted_source> b, std::size_t split) {
+        std::shared_ptr<sorted_source> sa{std::move(a)};
+        std::shared_ptr<sorted_source> sb{std::move(b)};
+        {
+            std::lock_guard<std::mutex> l{m_lock};
+            m_tasks.push_back([this, sa, sb, split]{ merge(*sa, *sb, split); });
+        }
+        m_cond.notify_one();
+    }
+    
+    void run() {
+        for (;;) {
+            task t;
+            {
+                std::unique_lock<std::mutex> l{m_lock};
+                m_cond.wait(l, [this]{ return !m_tasks.empty() || m_done; });
+                if (m_tasks.empty()) {
+                    return;
+                }
+                t = std::move(m_tasks.front());
+                m_tasks.pop_front();
+            }
+            if (!m_stop) {
+                try {
+                    t();
+                } catch (...) {
+                    fail(std::current_exception());
+                }
+            }
+        }
+    }
+    
+    void report_renames() {
+        std::lock_guard<std::mutex> l{m_visit_lock};
+        const auto by_path = [](const diff_record& l, const diff_record& r) { return l.path < r.path; };
+        std::sort(m_removed.begin(), m_removed.end(), by_path);
+        std::sort(m_added.begin(), m_added.end(), by_path);
+        
+        std::unordered_map<file_id_type, std::size_t> removed;
+        for (std::size_t i = 0; i < m_removed.size(); ++i) {
+            const auto& id = m_removed[i].before.id;
+            if (id.valid()) {
+                removed.emplace(id, i);
+            }
+        }
+        std::vector<bool> renamed(m_removed.size());
+        for (auto& r : m_added) {
+            const auto i = removed.find(r.after.id);
+            if (i != removed.end() && !renamed[i->second] && m_removed[i->second].before.type == r.after.type) {
+                auto& old = m_removed[i->second];
+                renamed[i->second] = true;
+                r.kind = diff_kind::renamed;
+                r.old_path = std::move(old.path);
+                r.before = std::move(old.before);
+            }
+        }
+        for (std::size_t i = 0; i < m_removed.size(); ++i) {
+            if (!renamed[i]) {
+                emit(m_removed[i]);
+            }
+        }
+        for (auto& r : m_added) {
+            emit(r);
+        }
+    }
+    
+public:
+    differ(const diff_config& cfg, const diff_visitor& v)
+        : m_cfg(cfg)
+        , m_visitor(v)
+        , m_visit_lock()
+        , m_added()
+        , m_removed()
+        , m_exception()
+        , m_error()
+        , m_stop()
+        , m_tasks()
+        , m_lock()
+        , m_cond()
+        , m_done() {}
+    PS_DISABLE_COPY(differ);
+    
+    void operator()(sorted_source& before, sorted_source& after, error_code& ec) {
+        const auto threads = m_cfg.threads > 0 ? m_cfg.threads : std::max(std::thread::hardware_concurrency(), 1U);
+        std::vector<std::thread> workers;
+        try {
+            for (std::size_t i = 1; i < threads; ++i) {
+                workers.emplace_back([this]{ run(); });
+            }
+        } catch (const std::system_error&) {
+            // The caller runs the remaining subtrees.
+        }
+        
+        try {
+            merge(before, after, threads > 1 ? split_levels : 0);
+        } catch (...) {
+            fail(std::current_exception());
+        }
+        {
+            std::lock_guard<std::mutex> l{m_lock};
+            m_done = true;
+        }
+        m_cond.notify_all();
+        run();
+        for (auto& t : workers) {
+            t.join();
+        }
+        
+        if (!m_stop && detect_renames()) {
+            report_renames();
+        }
+        if (m_exception) {
+            std::rethrow_exception(m_exception);
+        }
+        ec = m_error;
+    }
+};
+
+} // anon
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+void diff(const manifest& before, const path& after, const diff_config& cfg, diff_visitor v) {
+    error_code ec;
+    diff(before, after, cfg, std::move(v), ec);
+    PS_THROW_IF(ec.value() != 0, filesystem_error("Could not compare", before.root(), after, ec));
+}
+
+void diff(const manifest& before, const path& after, const diff_config& cfg, diff_visitor v, error_code& ec) {
+    if (!before.sorted()) {
+        ec = einval();
+        return;
+    }
+    manifest_source a{before};
+    tree_source b{after, key_type{}, std::vector<path>{}, cfg.options};
+    differ{cfg, v}(a, b, ec);
+}
+
+void diff(const path& before, const path& after, const diff_config& cfg, diff_visitor v) {
+    error_code ec;
+    diff(before, after, cfg, std::move(v), ec);
+    PS_THROW_IF(ec.value() != 0, filesystem_error("Could not compare", before, after, ec));
+}
+
+void diff(const path& before, const path& after, const diff_config& cfg, diff_visitor v, error_code& ec) {
+    tree_source a{before, key_type{}, std::vector<path>{}, cfg.options};
+    tree_source b{after, key_type{}, std::vector<path>{}, cfg.options};
+    differ{cfg, v}(a, b, ec);
+}
+
+} // v1
+} // filesystem
+} // prosoft
@@ -0,0 +1,439 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <prosoft/core/config/config.h>
+#include "fsconfig.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+#include <prosoft/core/modules/filesystem/filesystem_duplicates.hpp>
+#include "filesystem_private.hpp"
+#include "hash_internal.hpp"
+
+namespace {
+
+using namespace prosoft::filesystem;
+
+struct candidate {
+    path p;
+    file_id_type id;
+    file_digest digest;
+    bool failed;
+};
+
+// Files of the same size and, after each stage, the same digest.
+struct bucket {
+    const file_size_type size;
+    std::vector<candidate> files;
+    std::atomic<std::size_t> remaining; // tasks of the current stage
+    
+    explicit bucket(file_size_type sz)
+        : size(sz)
+        , files()
+        , remaining() {}
+    PS_DISABLE_COPY(bucket);
+};
+using bucket_ptr = std::shared_ptr<bucket>;
+
+// Runs of at least 2 files with the same digest.
+std::vector<bucket_ptr> split(bucket& b) {
+    auto& files = b.files;
+    files.erase(std::remove_if(files.begin(), files.end(), [](const candidate& c) { return c.failed; }), files.end());
+    std::sort(files.begin(), files.end(), [](const candidate& l, const candidate& r) { return l.digest < r.digest; });
+    
+    std::vector<bucket_ptr> runs;
+    for (auto first = files.begin(); first != files.end();) {
+        const auto last = std::find_if(first, files.end(), [first](const candidate& c) { return c.digest != first->digest; });
+        if (std::distance(first, last) > 1) {
+            runs.push_back(std::make_shared<bucket>(b.size));
+            std::move(first, last, std::back_inserter(runs.back()->files));
+        }
+        first = last;
+    }
+    return runs;
+}
+
+std::vector<path> paths(const std::vector<candidate>& files) {
+    std::vector<path> v;
+    v.reserve(files.size());
+    for (const auto& c : files) {
+        v.push_back(c.p);
+    }
+    return v;
+}
+
+bool same_contents(const path& lp, const path& rp, error_code& ec) {
+    constexpr std::streamsize buffer_size = 64 * 1024;
+    std::ifstream l{lp.c_str(), std::ios::binary};
+    std::ifstream r{rp.c_str(), std::ios::binary};
+    std::vector<char> lb(buffer_size), rb(buffer_size);
+    while (l && r) {
+        l.read(lb.data(), buffer_size);
+        r.read(rb.data(), buffer_size);
+        if (l.gcount() != r.gcount() || !std::equal(lb.begin(), lb.begin() + l.gcount(), rb.begin())) {
+            return false;
+        }
+    }
+    if (l.bad() || r.bad() || !l.eof() || !r.eof()) {
+        ec = std::make_error_code(std::errc::io_error);
+        return false;
+    }
+    return true;
+}
+
+} // anon
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+class ifilesystem::duplicate_finder_state {
+    using task = std::function<void()>;
+    using count_type = duplicate_statistics::count_type;
+    using device_type = file_id_type::device_type;
+    
+    const duplicate_config m_cfg;
+    const duplicate_visitor m_visitor;
+    std::map<file_size_type, bucket_ptr> m_sizes;
+    std::unordered_set<file_id_type> m_ids;
+    duplicate_statistics m_stats;
+    std::atomic<count_type> m_edge_hashed;
+    std::atomic<count_type> m_confirmed;
+    std::atomic<count_type> m_groups;
+    std::atomic<file_size_type> m_bytes_read;
+    // Each device has its own queue so a slow disk only holds up its own workers.
+    std::map<device_type, std::deque<task>> m_queues;
+    std::mutex m_lock;
+    std::condition_variable m_cond;
+    std::size_t m_outstanding;
+    std::vector<std::thread> m_workers;
+    std::mutex m_visit_lock;
+    std::exception_ptr m_exception;
+    std::atomic<bool> m_stop;
+    bool m_finished;
+    
+    bool whole_file_edges(file_size_type size) const noexcept {
+        return size <= m_cfg.edge_size || size - m_cfg.edge_size <= m_cfg.edge_size;
+    }
+    
+    void fail(std::exception_ptr e) {
+        std::lock_guard<std::mutex> l{m_visit_lock};
+        if (!m_exception) {
+            m_exception = e;
+        }
+        m_stop = true;
+    }
+    
+    void schedule(device_type dev, task t) {
+        {
+            std::lock_guard<std::mutex> l{m_lock};
+            m_queues[dev].push_back(std::move(t));
+            ++m_outstanding;
+        }
+        m_cond.notify_all();
+    }
+    
+    std::deque<task>* next(const device_type* dev) {
+        if (dev) {
+            auto& q = m_queues[*dev];
+            return q.empty() ? nullptr : &q;
+        }
+        for (auto& q : m_queues) {
+            if (!q.second.empty()) {
+                return &q.second;
+            }
+        }
+        return nullptr;
+    }
+    
+    // A null device serves every queue.
+    void run(const device_type* dev) {
+        std::unique_lock<std::mutex> l{m_lock};
+        for (;;) {
+            std::deque<task>* q = nullptr;
+            m_cond.wait(l, [&]{ return (q = next(dev)) != nullptr || m_outstanding == 0; });
+            if (!q) {
+                return;
+            }
+            auto t = std::move(q->front());
+            q->pop_front();
+            l.unlock();
+            if (!m_stop) {
+                try {
+                    t();
+                } catch (...) {
+                    fail(std::current_exception());
+                }
+            }
+            l.lock();
+            if (--m_outstanding == 0) {
+                m_cond.notify_all();
+            }
+        }
+    }
+    
+    void emit(bucket& b, const file_digest& d) {
+        duplicate_group g{b.size, d, paths(b.files)};
+        std::lock_guard<std::mutex> l{m_visit_lock};
+        if (m_stop) {
+            return;
+        }
+        ++m_groups;
+        try {
+            m_visitor(g);
+        } catch (...) {
+            m_exception = std::current_exception();
+            m_stop = true;
+        }
+    }
+    
+    void edges(const bucket_ptr& b, std::size_t i) {
+        auto& c = b->files[i];
+        file_size_type size = 0;
+        error_code ec;
+        // The edges of a small file are the whole file, so their hash is the final one.
+        const auto a = whole_file_edges(b->size) ? m_cfg.algorithm : m_cfg.edge_algorithm;
+        c.digest = hash_file_edges(c.p, m_cfg.edge_size, a, size, ec);
+        c.failed = ec || size != b->size; // changed since it was found
+        ++m_edge_hashed;
+        m_bytes_read += whole_file_edges(b->size) ? b->size : m_cfg.edge_size * 2;
+        if (--b->remaining == 0) {
+            edges_done(*b);
+        }
+    }
+    
+    void edges_done(bucket& b) {
+        for (auto& r : split(b)) {
+            if (is_set(m_cfg.options & duplicate_options::byte_compare)) {
+                schedule(r->files.front().id.device(), [this, r]{ compare(*r); });
+            } else if (whole_file_edges(r->size)) {
+                emit(*r, r->files.front().digest);
+            } else {
+                r->remaining = r->files.size();
+                for (std::size_t i = 0; i < r->files.size(); ++i) {
+                    schedule(r->files[i].id.device(), [this, r, i]{ full(r, i); });
+                }
+            }
+        }
+    }
+    
+    void full(const bucket_ptr& b, std::size_t i) {
+        auto& c = b->files[i];
+        hash_statistics stats;
+        error_code ec;
+        c.digest = hash_file(c.p, hash_config{m_cfg.algorithm, 1}, stats, ec);
+        c.failed = ec || stats.bytes() != b->size;
+        ++m_confirmed;
+        m_bytes_read += stats.bytes();
+        if (--b->remaining == 0) {
+            for (auto& r : split(*b)) {
+                emit(*r, r->files.front().digest);
+            }
+        }
+    }
+    
+    void compare(bucket& b) {
+        std::vector<bucket_ptr> classes;
+        for (auto& c : b.files) {
+            error_code ec;
+            auto cls = std::find_if(classes.begin(), classes.end(), [&](const bucket_ptr& k) {
+                m_bytes_read += b.size * 2;
+                return same_contents(k->files.front().p, c.p, ec) || ec;
+            });
+            ++m_confirmed;
+            if (ec) {
+                continue;
+            }
+            if (cls == classes.end()) {
+                classes.push_back(std::make_shared<bucket>(b.size));
+                cls = classes.end() - 1;
+            }
+            (*cls)->files.push_back(std::move(c));
+        }
+        for (auto& k : classes) {
+            if (k->files.size() > 1) {
+                emit(*k, file_digest{});
+            }
+        }
+    }
+    
+public:
+    duplicate_finder_state(const duplicate_config& cfg, duplicate_visitor&& v)
+        : m_cfg(cfg)
+        , m_visitor(std::move(v))
+        , m_sizes()
+        , m_ids()
+        , m_stats()
+        , m_edge_hashed()
+        , m_confirmed()
+        , m_groups()
+        , m_bytes_read()
+        , m_queues()
+        , m_lock()
+        , m_cond()
+        , m_outstanding()
+        , m_workers()
+        , m_visit_lock()
+        , m_exception()
+        , m_stop()
+        , m_finished() {}
+    
+    ~duplicate_finder_state() {
+        m_stop = true;
+        for (auto& t : m_workers) {
+            t.join();
+        }
+    }
+    PS_DISABLE_COPY(duplicate_finder_state);
+    
+    void push(const directory_entry& e) {
+        error_code ec;
+        if (m_finished || e.is_symlink(ec) || !e.is_regular_file(ec)) {
+            return;
+        }
+        const auto size = e.file_size(ec);
+        if (ec || size < m_cfg.min_size) {
+            return;
+        }
+        const auto id = e.file_id(ec);
+        if (ec) {
+            return;
+        }
+        ++m_stats.files;
+        if (!m_ids.insert(id).second) {
+            ++m_stats.hardlinks;
+            return;
+        }
+        auto& b = m_sizes[size];
+        if (!b) {
+            b = std::make_shared<bucket>(size);
+        }
+        b->files.push_back(candidate{e.path(), id, file_digest{}, false});
+    }
+    
+    void finish() {
+        if (m_finished) {
+            return;
+        }
+        m_finished = true;
+        m_ids.clear();
+        
+        for (auto& s : m_sizes) {
+            const auto& b = s.second;
+            if (b->files.size() < 2) {
+                continue;
+            }
+            b->remaining = b->files.size();
+            for (std::size_t i = 0; i < b->files.size(); ++i) {
+                schedule(b->files[i].id.device(), [this, b, i]{ edges(b, i); });
+            }
+        }
+        m_sizes.clear();
+        
+        try {
+            for (const auto& q : m_queues) {
+                const auto dev = q.first;
+                for (std::size_t n = 0; n < std::max<std::size_t>(m_cfg.threads_per_device, 1); ++n) {
+                    m_workers.emplace_back([this, dev]{ run(&dev); });
+                }
+            }
+        } catch (const std::system_error&) {
+            // The caller serves the devices without a worker.
+        }
+        run(nullptr);
+        for (auto& t : m_workers) {
+            t.join();
+        }
+        m_workers.clear();
+        
+        m_stats.edge_hashed = m_edge_hashed;
+        m_stats.confirmed = m_confirmed;
+        m_stats.bytes_read = m_bytes_read;
+        m_stats.groups = m_groups;
+    }
+    
+    std::exception_ptr exception() const {
+        return m_exception;
+    }
+    
+    const duplicate_statistics& statistics() const noexcept {
+        return m_stats;
+    }
+};
+
+duplicate_finder::duplicate_finder(const duplicate_config& cfg, duplicate_visitor v)
+    : m_state(new ifilesystem::duplicate_finder_state{cfg, std::move(v)}) {}
+
+duplicate_finder::~duplicate_finder() = default;
+
+void duplicate_finder::push(const directory_entry& e) {
+    m_state->push(e);
+}
+
+void duplicate_finder::finish() {
+    m_state->finish();
+    if (auto e = m_state->exception()) {
+        std::rethrow_exception(e);
+    }
+}
+
+const duplicate_statistics& duplicate_finder::statistics() const {
+    return m_state->statistics();
+}
+
+std::vector<duplicate_group> find_duplicates(const path& root, const duplicate_config& cfg) {
+    error_code ec;
+    auto groups = find_duplicates(root, cfg, ec);
+    PS_THROW_IF(ec.value() != 0, filesystem_error("Could not find duplicates", root, ec));
+    return groups;
+}
+
+std::vector<duplicate_group> find_duplicates(const path& root, const duplicate_config& cfg, error_code& ec) {
+    std::vector<duplicate_group> groups;
+    duplicate_finder finder{cfg, [&groups](duplicate_group& g) {
+        groups.push_back(std::move(g));
+    }};
+    for (recursive_directory_iterator i{root, directory_options::skip_permission_denied, ec}; !ec && i != end(i); i.increment(ec)) {
+        finder.push(*i);
+    }
+    if (ec) {
+        return {};
+    }
+    finder.finish();
+    return groups;
+}
+
+} // v1
+} // filesystem
+} // prosoft
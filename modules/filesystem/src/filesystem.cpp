@@ -53,45 +53,33 @@ bool equivalent(const path& p1, const path& p2) {
 }
 
 bool equivalent(const path& p1, const path& p2, error_code& ec) noexcept {
-    ec.clear();
-#if !_WIN32
-    struct stat sb;
-    sb.st_ino = 0;
-    sb.st_dev = 0;
-    if (0 != ::stat(p1.c_str(), &sb)) {
-        ifilesystem::system_error(ec);
-        return false;
-    }
-    
-    const auto ino = sb.st_ino;
-    const auto dev = sb.st_dev;
-    
-    sb.st_ino = 0;
-    sb.st_dev = 0;
-    if (0 != ::stat(p2.c_str(), &sb)) {
-        ifilesystem::system_error(ec);
-        return false;
-    }
-    
-    return (dev == sb.st_dev && ino == sb.st_ino);
-#else
-    ::BY_HANDLE_FILE_INFORMATION info;
-    if (!ifilesystem::finfo(p1, &info, ec)) {
+    const auto id = file_id(p1, ec);
+    if (ec.value()) {
         return false;
     }
+    return id == file_id(p2, ec) && !ec.value();
+}
 
-    const uint64_t ino = uint64_t(info.nFileIndexLow) |  (uint64_t(info.nFileIndexHigh) << 32ULL);
-    const auto vsn = info.dwVolumeSerialNumber;
+file_id_type file_id(const path& p) {
+    error_code ec;
+    auto val = file_id(p, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not get file id", p, ec));
+    return val;
+}
 
-    info.nFileIndexLow = info.nFileIndexHigh = 0;
-    info.dwVolumeSerialNumber = 0;
-    if (!ifilesystem::finfo(p2, &info, ec)) {
-        return false;
-    }
+file_id_type file_id(const path& p, error_code& ec) noexcept {
+    return get_file_id(p, true, ec);
+}
 
-    const uint64_t ino2 = uint64_t(info.nFileIndexLow) |  (uint64_t(info.nFileIndexHigh) << 32ULL);
-    return (vsn == info.dwVolumeSerialNumber && ino == ino2);
-#endif
+file_id_type symlink_file_id(const path& p) {
+    error_code ec;
+    auto val = symlink_file_id(p, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not get symlink file id", p, ec));
+    return val;
+}
+
+file_id_type symlink_file_id(const path& p, error_code& ec) noexcept {
+    return get_file_id(p, false, ec);
 }
 
 file_status status(const path& p, status_info what) {
@@ -150,7 +138,17 @@ void last_write_time(const path& p, file_time_type t) {
 }
 
 void last_write_time(const path& p, file_time_type t, error_code& ec) noexcept {
-#if !_WIN32
+#if __linux__
+    ::timespec tsvals[2];
+    tsvals[0].tv_sec = 0;
+    tsvals[0].tv_nsec = UTIME_OMIT;
+    tsvals[1] = to_times{}.to_timespec(t); // keep nsec, utimes is limited to usec
+    if (0 == ::utimensat(AT_FDCWD, p.c_str(), tsvals, 0)) {
+        ec.clear();
+    } else {
+        ec = system::system_error();
+    }
+#elif !_WIN32
     struct stat sb;
     if (0 == ::stat(p.c_str(), &sb)) {
         ::timeval utvals[2];
@@ -637,6 +637,49 @@ const access_control_list& no_access() noexcept {
     return acl;
 }
 
+#if !_WIN32
+void ifilesystem::copy_acl(int from, int to, error_code& ec) noexcept {
+    ec.clear();
+#if __linux__
+    const int ext = ::acl_extended_fd(from);
+    if (ext <= 0) {
+        if (-1 == ext && ENOTSUP != errno) {
+            ifilesystem::system_error(ec);
+        }
+        return;
+    }
+    unique_acl_t<::acl_t> a{::acl_get_fd(from)};
+    if (!a || 0 != ::acl_set_fd(to, a.get())) {
+        ifilesystem::system_error(ec);
+        return;
+    }
+    // There's no fd variant for the default ACL.
+    struct stat sb;
+    if (0 == ::fstat(from, &sb) && S_ISDIR(sb.st_mode)) {
+        const auto fromp = "/proc/self/fd/" + std::to_string(from);
+        const auto top = "/proc/self/fd/" + std::to_string(to);
+        unique_acl_t<::acl_t> d{::acl_get_file(fromp.c_str(), ACL_TYPE_DEFAULT)};
+        if (d && ::acl_entries(d.get()) > 0 && 0 != ::acl_set_file(top.c_str(), ACL_TYPE_DEFAULT, d.get())) {
+            ifilesystem::system_error(ec);
+        }
+    }
+#elif __APPLE__
+    unique_acl_t<::acl_t> a{::acl_get_fd_np(from, ACL_TYPE_EXTENDED)};
+    if (!a) {
+        if (ENOENT != errno) { // no ACL
+            ifilesystem::system_error(ec);
+        }
+    } else if (0 != ::acl_set_fd_np(to, a.get(), ACL_TYPE_EXTENDED)) {
+        ifilesystem::system_error(ec);
+    }
+#else
+    (void)from;
+    (void)to;
+    ifilesystem::error(ENOTSUP, ec);
+#endif
+}
+#endif // !_WIN32
+
 #if _WIN32
 namespace ifilesystem {
 
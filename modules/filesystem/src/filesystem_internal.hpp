@@ -27,6 +27,7 @@
 #define PS_CORE_FILESYSTEM_INTERNAL_HPP
 
 #if !_WIN32
+#include <fcntl.h>
 #include <sys/errno.h>
 #include <sys/stat.h>
 #include <sys/time.h>
@@ -35,8 +36,10 @@
 #include <windows.h>
 #endif
 
+#include <atomic>
+
 #include <prosoft/core/modules/filesystem/filesystem.hpp>
-#include "fsconfig.h"       // PS_FS_HAVE_BSD_STATFS
+#include "fsconfig.h"       // PS_FS_HAVE_BSD_STATFS, PS_FS_HAVE_STATX
 #include "filesystem_private.hpp"       // ifilesystem::system_error
 
 namespace prosoft {
@@ -49,7 +52,11 @@ typedef struct ::stat stat_buf; // GCC complains with a 'using' directive here.
 
 struct to_file_type {
     file_type operator()(const stat_buf& sb) const noexcept {
-        switch ((sb.st_mode & S_IFMT)) {
+        return operator()(sb.st_mode);
+    }
+
+    file_type operator()(mode_t mode) const noexcept {
+        switch ((mode & S_IFMT)) {
             case S_IFBLK: return file_type::block;
             case S_IFCHR: return file_type::character;
             case S_IFDIR: return file_type::directory;
@@ -73,15 +80,23 @@ struct to_file_type {
 
 struct to_perms {
     perms operator()(const stat_buf& sb) const noexcept {
-        return static_cast<perms>(sb.st_mode) & perms::mask;
+        return operator()(sb.st_mode);
+    };
+
+    perms operator()(mode_t mode) const noexcept {
+        return static_cast<perms>(mode) & perms::mask;
     };
 };
 
 struct to_owner {
     owner operator()(const stat_buf& sb) const noexcept {
+        return operator()(sb.st_uid, sb.st_gid);
+    }
+
+    owner operator()(uid_t uid, gid_t gid) const noexcept {
         return owner{
-            access_control_identity{access_control_identity_type::user, sb.st_uid},
-            access_control_identity{access_control_identity_type::group, sb.st_gid}};
+            access_control_identity{access_control_identity_type::user, uid},
+            access_control_identity{access_control_identity_type::group, gid}};
     }
 };
 
@@ -109,11 +124,10 @@ struct to_times {
 #if defined(st_birthtime)
     #define PS_ST_BTIME st_birthtimespec
 #endif
-    file_time_type from(const struct timespec& ts) const {
-        using namespace std::chrono;
-        using fduration = typename file_time_type::duration;
-        return file_time_type{ duration_cast<fduration>(seconds{ts.tv_sec}) + duration_cast<fduration>(nanoseconds{ts.tv_nsec}) };
-    }
+#elif __linux__
+    #define PS_ST_MTIME st_mtim
+    #define PS_ST_CTIME st_ctim
+    #define PS_ST_ATIME st_atim
 #else
     #define PS_ST_MTIME st_mtime
     #define PS_ST_CTIME st_ctime
@@ -122,6 +136,15 @@ struct to_times {
         return file_time_type::clock::from_time_t(t);
     }
 #endif
+    file_time_type from(const struct timespec& ts) const {
+        return from(ts.tv_sec, ts.tv_nsec);
+    }
+
+    file_time_type from(::time_t sec, long nsec) const {
+        using namespace std::chrono;
+        using fduration = typename file_time_type::duration;
+        return file_time_type{ duration_cast<fduration>(seconds{sec}) + duration_cast<fduration>(nanoseconds{nsec}) };
+    }
     
     times operator()(const stat_buf& sb) const {
         times t;
@@ -149,7 +172,7 @@ inline file_status file_stat(statcall_type statcall, const path& p, status_info
     if (0 == statcall(p.c_str(), &sb)) {
         ec.clear();
         // Not a big type conversion cost, so just do minimal/complete
-        if (status_info::basic == what) {
+        if (status_info::basic == (what & status_info::all)) {
             return file_status{to_file_type{}(sb)};
         } else {
             static_assert(sizeof(file_size_type) >= sizeof(sb.st_size), "Broken assumption");
@@ -161,6 +184,109 @@ inline file_status file_stat(statcall_type statcall, const path& p, status_info
     }
 }
 
+#if PS_FS_HAVE_STATX && defined(STATX_BASIC_STATS)
+
+using statx_buf = struct ::statx;
+
+inline unsigned int statx_mask(status_info what) noexcept {
+    unsigned int mask = STATX_TYPE;
+    if (is_set(what & status_info::perms)) {
+        mask |= STATX_MODE|STATX_UID|STATX_GID;
+    }
+    if (is_set(what & status_info::times)) {
+        mask |= STATX_ATIME|STATX_MTIME|STATX_CTIME|STATX_BTIME;
+    }
+    if (is_set(what & status_info::size)) {
+        mask |= STATX_SIZE;
+    }
+    return mask;
+}
+
+struct to_statx_times {
+    file_time_type from(const struct ::statx_timestamp& ts) const {
+        return to_times{}.from(::time_t(ts.tv_sec), long(ts.tv_nsec));
+    }
+
+    times operator()(const statx_buf& sb) const {
+        times t;
+        if ((sb.stx_mask & STATX_MTIME)) {
+            t.modified(from(sb.stx_mtime));
+        }
+        if ((sb.stx_mask & STATX_CTIME)) {
+            t.metadata_modified(from(sb.stx_ctime));
+        }
+        if ((sb.stx_mask & STATX_ATIME)) {
+            t.accessed(from(sb.stx_atime));
+        }
+        if ((sb.stx_mask & STATX_BTIME)) { // Not all filesystems track birth time.
+            t.created(from(sb.stx_btime));
+        }
+        return t;
+    }
+};
+
+inline file_status to_file_status(const statx_buf& sb, status_info what) {
+    const auto ft = to_file_type{}(mode_t(sb.stx_mode));
+    if (status_info::basic == (what & status_info::all)) {
+        return file_status{ft};
+    }
+    // The kernel may return more than was asked for, so take whatever it reports as valid.
+    file_status fs{ft};
+    if ((sb.stx_mask & STATX_MODE)) {
+        fs.permissions(to_perms{}(mode_t(sb.stx_mode)));
+    }
+    if ((sb.stx_mask & (STATX_UID|STATX_GID)) == (STATX_UID|STATX_GID)) {
+        fs.owner(to_owner{}(uid_t(sb.stx_uid), gid_t(sb.stx_gid)));
+    }
+    if ((sb.stx_mask & STATX_SIZE)) {
+        fs.size(file_size_type(sb.stx_size));
+    }
+    fs.times(to_statx_times{}(sb));
+    return fs;
+}
+
+// ENOSYS before 4.11, EPERM from seccomp filters (e.g. container defaults) and EINVAL from some old kernels and filesystems.
+// The stat fallback reports the real error, if there is one.
+inline bool statx_unavailable(int err) noexcept {
+    return err == ENOSYS || err == EPERM || err == EINVAL;
+}
+
+// Returns false if statx is unavailable (pre 4.11 kernel or a filter denies it) and the caller should fall back to stat.
+inline bool file_statx(const path& p, int flags, status_info what, file_status& fs, error_code& ec) {
+    static std::atomic<bool> unsupported{false};
+    if (unsupported.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    if (is_set(what & status_info::cached)) {
+        flags |= AT_STATX_DONT_SYNC;
+    }
+    statx_buf sb;
+    if (0 == ::statx(AT_FDCWD, p.c_str(), flags, statx_mask(what), &sb)) {
+        ec.clear();
+        fs = to_file_status(sb, what);
+        return true;
+    }
+    if (statx_unavailable(errno)) {
+        unsupported.store(true, std::memory_order_relaxed);
+        return false;
+    }
+    ifilesystem::system_error(ec);
+    fs = file_status{to_file_type{}(ec)};
+    return true;
+}
+
+inline file_status file_stat(const path& p, status_info what, error_code& ec) {
+    file_status fs;
+    return file_statx(p, 0, what, fs, ec) ? fs : file_stat(::stat, p, what, ec);
+}
+
+inline file_status link_stat(const path& p, status_info what, error_code& ec) {
+    file_status fs;
+    return file_statx(p, AT_SYMLINK_NOFOLLOW, what, fs, ec) ? fs : file_stat(::lstat, p, what, ec);
+}
+
+#else
+
 inline file_status file_stat(const path& p, status_info what, error_code& ec) {
     return file_stat(::stat, p, what, ec);
 }
@@ -169,6 +295,22 @@ inline file_status link_stat(const path& p, status_info what, error_code& ec) {
     return file_stat(::lstat, p, what, ec);
 }
 
+#endif // PS_FS_HAVE_STATX
+
+inline file_id_type to_file_id(dev_t dev, ino_t ino) noexcept {
+    return file_id_type{file_id_type::device_type(dev), file_id_type::inode_type(ino)};
+}
+
+inline file_id_type get_file_id(const path& p, bool follow, error_code& ec) noexcept {
+    stat_buf sb;
+    if (0 == (follow ? ::stat(p.c_str(), &sb) : ::lstat(p.c_str(), &sb))) {
+        ec.clear();
+        return to_file_id(sb.st_dev, sb.st_ino);
+    }
+    ifilesystem::system_error(ec);
+    return {};
+}
+
 #else
 
 inline bool is_device_path(const path& p) {
@@ -425,6 +567,19 @@ inline file_status link_stat(const path& p, status_info what, error_code& ec) no
     return file_stat(p, what, ec, true);
 }
 
+inline file_id_type get_file_id(const path& p, bool follow, error_code& ec) noexcept {
+    const DWORD flags = FILE_FLAG_BACKUP_SEMANTICS | (follow ? 0 : FILE_FLAG_OPEN_REPARSE_POINT); // backup semantics are required for dirs
+    if (auto h = ifilesystem::open(p, 0, FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE, OPEN_EXISTING, flags, ec)) {
+        ::BY_HANDLE_FILE_INFORMATION info;
+        if (::GetFileInformationByHandle(h.get(), &info)) {
+            ec.clear();
+            return file_id_type{info.dwVolumeSerialNumber, uint64_t(info.nFileIndexLow) | (uint64_t(info.nFileIndexHigh) << 32ULL)};
+        }
+        ifilesystem::system_error(ec);
+    }
+    return {};
+}
+
 #endif // !_WIN32
 
 } // namespace v1
@@ -26,7 +26,9 @@
 #ifndef PS_CORE_FILESYSTEM_PRIVATE_HPP
 #define PS_CORE_FILESYSTEM_PRIVATE_HPP
 
-#if _WIN32
+#if !_WIN32
+#include <unistd.h>
+#else
 #include <prosoft/core/include/unique_resource.hpp>
 #endif
 
@@ -77,6 +79,45 @@ inline filesystem_error system_error(const char* msg) {
 
 #if !_WIN32
 constexpr const char* TMPDIR = "TMPDIR";
+
+// The POSIX counterpart of windows::Handle.
+class unique_fd {
+    int m_fd;
+public:
+    explicit unique_fd(int fd = -1) noexcept
+        : m_fd(fd) {}
+    ~unique_fd() {
+        reset();
+    }
+    PS_DISABLE_COPY(unique_fd);
+    unique_fd(unique_fd&& other) noexcept
+        : m_fd(other.release()) {}
+    unique_fd& operator=(unique_fd&& other) noexcept {
+        reset(other.release());
+        return *this;
+    }
+    
+    int get() const noexcept {
+        return m_fd;
+    }
+    
+    explicit operator bool() const noexcept {
+        return m_fd >= 0;
+    }
+    
+    int release() noexcept {
+        const int fd = m_fd;
+        m_fd = -1;
+        return fd;
+    }
+    
+    void reset(int fd = -1) noexcept {
+        if (m_fd >= 0) {
+            (void)::close(m_fd);
+        }
+        m_fd = fd;
+    }
+};
 #endif
 
 #if _WIN32
@@ -134,6 +175,12 @@ std::wstring first_unused_drive_letter(error_code&);
 
 #endif //_WIN32
 
+#if !_WIN32
+// Copies an extended ACL, and on Linux a directory's default ACL, between descriptors. Implemented in ACL module.
+// Nothing is copied if the source only has the ACL that mirrors its mode.
+void copy_acl(int from, int to, error_code&) noexcept;
+#endif
+
 // currently only implemented for macOS (in attrs.cpp)
 bool is_mounted_readonly(const path&, error_code&);
 
@@ -29,5 +29,9 @@
 
 #define PS_FS_HAVE_BSD_STATFS __APPLE__ || __FreeBSD__ || __OpenBSD__ || __NetBSD__
 #define PS_FS_HAVE_MNTENT_H __linux__
+#define PS_FS_HAVE_MOUNTINFO __linux__ // /proc/self/mountinfo
+#define PS_FS_HAVE_GETDENTS64 __linux__
+#define PS_FS_HAVE_DIRENT_OFFSET __linux__ // d_off is a seekdir() cookie that stays valid when the dir is reopened
+#define PS_FS_HAVE_STATX __linux__ // Also requires glibc 2.28+ headers (STATX_*)
 
 #endif // PS_CORE_FILESYSTEM_CONFIG_H
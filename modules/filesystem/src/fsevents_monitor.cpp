@@ -46,11 +46,11 @@ constexpr FSEventStreamEventFlags platform_flag_defaults = kFSEventStreamCreateF
 constexpr FSEventStreamEventFlags valid_reserved_flags_mask = kFSEventStreamCreateFlagIgnoreSelf|kFSEventStreamCreateFlagMarkSelf;
 
 FSEventStreamCreateFlags platform_flags(const fs::change_config& cfg) {
-    constexpr fs::change_config cfg_default;
-    static_assert(cfg_default.notification_latency > decltype(cfg_default.notification_latency){}, "Broken assumption");
+    constexpr auto default_latency = fs::change_config::default_notification_latency();
+    static_assert(default_latency > decltype(default_latency){}, "Broken assumption");
     
     FSEventStreamCreateFlags clear_flags{};
-    if (cfg.notification_latency > cfg_default.notification_latency) {
+    if (cfg.notification_latency > default_latency) {
         clear_flags = kFSEventStreamCreateFlagNoDefer; // enable batch mode
     }
     
@@ -76,7 +76,7 @@ void dispatch_events::callout_to_client(platform_state* state, fs::change_notifi
             // Before the callback so the client can archive the state with the correct id.
             ss->m_lastid = lastNoteID;
         }
-        PSIgnoreCppException(fs::change_manager::process_renames(*n); ss->m_callback(std::move(*n)));
+        PSIgnoreCppException(fs::change_manager::process_renames(*n); fs::change_manager::coalesce(*n, ss->m_root, ss->m_subtree_threshold); ss->m_callback(std::move(*n)));
     }
 }
 
@@ -213,6 +213,10 @@ platform_state::platform_state(const fs::path& p, const fs::change_config& cfg,
                 PSASSERT(m_stopid == 0, "Broken assumption");
             }
             
+            m_root = p;
+            m_subtree_threshold = cfg.subtree_threshold;
+            m_memory_limit = cfg.memory_limit;
+            
             const auto latency = std::chrono::duration_cast<cfduration>(cfg.notification_latency).count();
             if (auto stream = FSEventStreamCreate(kCFAllocatorDefault, fsevents_callback, &ctx, cfpa.get(), m_lastid, latency, platform_flags(cfg))) {
                 m_stream.reset(stream);
@@ -531,6 +535,10 @@ change_registration monitor(const path& p, const change_config& cfg, change_call
         return change_registration{};
     }
     
+    if (cfg.poll_interval.count() > 0) {
+        return poll_monitor(p, cfg, std::move(cb), false, ec);
+    }
+    
     // We'd need to use dispatch (or kqueue for *BSD support) to watch file and non-recursive dir changes. (Though we could filter FSEvents for root dir changes).
     ec = fs::error_code(platform_error::not_supported, platform_category());
     return change_registration{};
@@ -542,6 +550,10 @@ change_registration recursive_monitor(const path& p, const change_config& cfg, c
         return change_registration{};
     }
     
+    if (cfg.poll_interval.count() > 0) {
+        return poll_monitor(p, cfg, std::move(cb), true, ec);
+    }
+    
     auto state = std::make_shared<platform_state>(p, cfg, ec);
     if (!ec) {
         start_monitor_thread();
@@ -561,32 +573,6 @@ void stop(change_state* state, error_code& ec) {
     }
 }
 
-void change_manager::process_renames(fs::change_notifications& notes) {
-    size_t count = notes.size();
-    for (size_t i = 0; i < count; ++i) {
-        auto& n = notes[i];
-        // XXX: this fails if FS events are merged (e.g. create and rename) as the merged event will not have the same id as the pure rename event
-        if (is_set(n.event() & fs::change_event::renamed) && n.m_eventid > 0) {
-            for (size_t j = i+1; j < count; ++j) {
-                auto& nn = notes[j];
-                if (is_set(nn.event() & fs::change_event::renamed) && n.m_eventid == nn.m_eventid) {
-                    if (!is_set(nn.event() & fs::change_event::removed)) {
-                        // rename within the tree and within the same latency period.
-                        n.m_newpath = std::move(nn.path());
-                        notes.erase(notes.begin()+j); // need to maintain order, swap() trick with last() will not work
-                        --count;
-                    } else {
-                        nn.m_event &= ~fs::change_event::renamed;
-                    }
-                    break;
-                }
-            }
-        }
-        
-        // Other methods of detecting a rename (such as using stat on the paths of renamed events) are prone to race conditions.
-    }
-}
-
 } // v1
 } // filesystem
 } // prosoft
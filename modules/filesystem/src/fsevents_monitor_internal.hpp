@@ -62,11 +62,14 @@ using unique_fsstream = prosoft::unique_cftype<FSEventStreamRef, fsevents_delete
 
 struct platform_state : public fs::change_state {
     fs::change_callback m_callback;
+    fs::path m_root;
     unique_fsstream m_stream;
     unique_dispatch_queue m_dispatch_q;
     std::uintptr_t m_regid;
     int m_rootfd;
     FSEventStreamEventId m_stopid; // event to stop at
+    std::size_t m_subtree_threshold;
+    std::size_t m_memory_limit;
     // persistent values //
     prosoft::unique_cftype<CFUUIDRef> m_uuid; // set when constructed and then read-only
     std::string m_uuid_str; // cached for persistence
@@ -74,10 +77,13 @@ struct platform_state : public fs::change_state {
     
     platform_state()
         : m_callback()
+        , m_root()
         , m_stream()
         , m_dispatch_q()
         , m_rootfd(-1)
         , m_stopid(0)
+        , m_subtree_threshold(0)
+        , m_memory_limit(0)
         , m_uuid()
         , m_lastid(kFSEventStreamEventIdSinceNow) {}
     platform_state(const fs::path&, const fs::change_config&, fs::error_code&);
@@ -208,6 +214,8 @@ void fsevents_callback(ConstFSEventStreamRef, void* info, size_t nevents, void*
         PSASSERT_NOTNULL(state);
         
         auto notes = std::make_unique<fs::change_notifications>();
+        std::size_t notes_size = 0;
+        bool overflowed = false; // memory limit, the rest of the batch is covered by a rescan of the root
         
         FSEventStreamEventId lastID{};
         auto paths = reinterpret_cast<const char* *>(evpaths);
@@ -264,7 +272,18 @@ void fsevents_callback(ConstFSEventStreamRef, void* info, size_t nevents, void*
             const bool historyDone = kFSEventStreamEventFlagHistoryDone == flags;
             if (!historyDone) {
                 lastID = evids[i];
-                fs::change_manager::emplace_back(*notes, fs::path{paths[i]}, fs::path{}, state, evids[i], to_event(flags & ~negated_flags), to_type(flags));
+                if (!overflowed) {
+                    fs::change_manager::emplace_back(*notes, fs::path{paths[i]}, fs::path{}, state, evids[i], to_event(flags & ~negated_flags), to_type(flags));
+                    if (state->m_memory_limit > 0) {
+                        notes_size += fs::change_manager::memory_size(notes->back());
+                        if (notes_size > state->m_memory_limit) {
+                            // Checked as the batch is built, the stream keeps running.
+                            notes->clear();
+                            fs::change_manager::emplace_back(*notes, fs::path{state->m_root}, fs::path{}, state, evids[i], fs::change_event::rescan, fs::file_type::directory);
+                            overflowed = true;
+                        }
+                    }
+                }
 #if 0
                 std::cout << evids[i] << "," << paths[i] << "," << flags << "," << (flags & ~negated_flags) << "\n";
 #endif
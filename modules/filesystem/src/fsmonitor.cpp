@@ -28,9 +28,44 @@
 #include <prosoft/core/modules/filesystem/filesystem.hpp>
 #include <prosoft/core/modules/filesystem/filesystem_change_monitor.hpp>
 #if PS_HAVE_FILESYSTEM_CHANGE_MONITOR
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 #include "filesystem_private.hpp"
 #include "fsmonitor_private.hpp"
 
+namespace {
+
+using key_type = std::basic_string<fs::path::encoding_value_type>;
+
+inline key_type key(const fs::path& p) {
+    return key_type{p.c_str()};
+}
+
+// Events that must keep their position and are never merged.
+inline bool barrier(const fs::change_notification& n) {
+    constexpr auto mask = fs::change_event::renamed|fs::change_event::rescan|fs::change_event::canceled|fs::change_event::replay_done;
+    return is_set(n.event() & mask);
+}
+
+// Calls f(prefix) for each ancestor directory of s below root.
+// The root itself is never folded, that's the same as rescan_required.
+template <class Function>
+void for_each_ancestor(const key_type& s, const key_type& root, Function&& f) {
+    constexpr auto sep = fs::path::preferred_separator;
+    size_t pos = 1;
+    if (!root.empty() && 0 == s.compare(0, root.size(), root)) {
+        pos = root.size() + 1;
+    }
+    for (; (pos = s.find(sep, pos)) != key_type::npos; ++pos) {
+        f(s.substr(0, pos));
+    }
+}
+
+} // namespace
+
 namespace prosoft {
 namespace filesystem {
 inline namespace v1 {
@@ -55,7 +90,9 @@ void stop(const change_registration& reg, error_code& ec) {
     if (reg) {
         if (auto p = change_manager::state(reg)) {
             ec.clear();
-            stop(p.get(), ec);
+            if (!stop_poll_monitor(p.get(), ec)) {
+                stop(p.get(), ec);
+            }
             return;
         }
     }
@@ -74,6 +111,8 @@ void stop(const change_registration& reg) {
 bool valid(const fs::change_config& cfg) {
     return cfg.events != fs::change_event::none
         && cfg.notification_latency >= decltype(cfg.notification_latency){}
+        && cfg.poll_interval >= decltype(cfg.poll_interval){}
+        && (cfg.poll_interval.count() == 0 || cfg.max_poll_interval >= cfg.poll_interval)
         && cfg.reserved_flags == 0;
 }
 
@@ -98,6 +137,178 @@ std::string platform_error_category::message(int code) const {
     }
 }
 
+void change_manager::process_renames(fs::change_notifications& notes) {
+    size_t count = notes.size();
+    for (size_t i = 0; i < count; ++i) {
+        auto& n = notes[i];
+        // XXX: this fails if FS events are merged (e.g. create and rename) as the merged event will not have the same id as the pure rename event
+        if (is_set(n.event() & fs::change_event::renamed) && n.m_eventid > 0) {
+            for (size_t j = i+1; j < count; ++j) {
+                auto& nn = notes[j];
+                if (is_set(nn.event() & fs::change_event::renamed) && n.m_eventid == nn.m_eventid) {
+                    if (!is_set(nn.event() & fs::change_event::removed)) {
+                        // rename within the tree and within the same latency period.
+                        n.m_newpath = std::move(nn.path());
+                        notes.erase(notes.begin()+j); // need to maintain order, swap() trick with last() will not work
+                        --count;
+                    } else {
+                        nn.m_event &= ~fs::change_event::renamed;
+                    }
+                    break;
+                }
+            }
+        }
+        
+        // Other methods of detecting a rename (such as using stat on the paths of renamed events) are prone to race conditions.
+    }
+}
+
+void change_manager::coalesce(fs::change_notifications& notes, const path& root, std::size_t subtree_threshold) {
+    merge_paths(notes);
+    if (subtree_threshold > 0 && notes.size() > subtree_threshold) {
+        fold_subtrees(notes, root, subtree_threshold);
+    }
+}
+
+void change_manager::merge_paths(fs::change_notifications& notes) {
+    struct merge_state {
+        bool created; // first event
+        bool removed; // last event
+    };
+    
+    std::unordered_map<key_type, size_t> slots;
+    std::vector<merge_state> states;
+    fs::change_notifications merged;
+    for (auto& n : notes) {
+        auto k = key(n.path());
+        if (barrier(n)) {
+            slots.erase(k);
+            if (!n.m_newpath.empty()) {
+                slots.erase(key(n.m_newpath));
+            }
+            merged.emplace_back(std::move(n));
+            states.push_back({false, false});
+            continue;
+        }
+        
+        const bool created = is_set(n.m_event & change_event::created);
+        const bool removed = is_set(n.m_event & change_event::removed);
+        auto i = slots.find(k);
+        if (i == slots.end()) {
+            slots.emplace(std::move(k), merged.size());
+            merged.emplace_back(std::move(n));
+            states.push_back({created && !removed, removed && !created});
+        } else {
+            auto& m = merged[i->second];
+            m.m_event |= n.m_event;
+            m.m_eventid = std::max(m.m_eventid, n.m_eventid);
+            if (n.m_type != file_type::none) {
+                m.m_type = n.m_type;
+            }
+            auto& st = states[i->second];
+            if (removed != created) {
+                st.removed = removed;
+            }
+        }
+    }
+    
+    // A path created and then removed within the same callback never existed as far as the client is concerned.
+    size_t idx = 0;
+    merged.erase(std::remove_if(merged.begin(), merged.end(), [&states, &idx](const change_notification&) {
+        const auto& st = states[idx++];
+        return st.created && st.removed;
+    }), merged.end());
+    
+    notes.swap(merged);
+}
+
+void change_manager::fold_subtrees(fs::change_notifications& notes, const path& root, std::size_t threshold) {
+    struct dir_info {
+        size_t count;
+        size_t reduced; // by folded descendants
+        bool folded;
+    };
+    
+    const auto rootkey = key(root);
+    std::unordered_map<key_type, dir_info> dirs;
+    for (const auto& n : notes) {
+        if (!barrier(n)) {
+            for_each_ancestor(key(n.path()), rootkey, [&dirs](key_type&& d) {
+                ++dirs[std::move(d)].count;
+            });
+        }
+    }
+    
+    // Deepest first so a folded directory only counts once towards its ancestors.
+    std::vector<std::pair<size_t, const key_type*>> candidates;
+    for (const auto& d : dirs) {
+        if (d.second.count > threshold) {
+            candidates.emplace_back(std::count(d.first.begin(), d.first.end(), path::preferred_separator), &d.first);
+        }
+    }
+    if (candidates.empty()) {
+        return;
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const std::pair<size_t, const key_type*>& lhs, const std::pair<size_t, const key_type*>& rhs) {
+        return lhs.first > rhs.first;
+    });
+    for (const auto& c : candidates) {
+        auto& info = dirs[*c.second];
+        const auto effective = info.count - info.reduced;
+        if (effective > threshold) {
+            info.folded = true;
+            for_each_ancestor(*c.second, rootkey, [&dirs, effective](key_type&& d) {
+                dirs[std::move(d)].reduced += effective - 1;
+            });
+        }
+    }
+    
+    std::unordered_map<key_type, size_t> emitted; // folded dir -> index in folded
+    fs::change_notifications folded;
+    for (auto& n : notes) {
+        key_type top;
+        if (!barrier(n)) {
+            auto k = key(n.path());
+            for_each_ancestor(k, rootkey, [&dirs, &top](key_type&& d) {
+                if (top.empty()) {
+                    auto i = dirs.find(d);
+                    if (i != dirs.end() && i->second.folded) {
+                        top = std::move(d);
+                    }
+                }
+            });
+            if (top.empty()) { // the folded directory itself
+                auto i = dirs.find(k);
+                if (i != dirs.end() && i->second.folded) {
+                    top = std::move(k);
+                }
+            }
+        }
+        
+        if (top.empty()) {
+            folded.emplace_back(std::move(n));
+            continue;
+        }
+        
+        auto i = emitted.find(top);
+        if (i == emitted.end()) {
+            emitted.emplace(top, folded.size());
+            folded.emplace_back(path{top.c_str()}, path{}, n.m_eventid, change_event::rescan, file_type::directory);
+            folded.back().m_regid = n.m_regid;
+        } else {
+            auto& f = folded[i->second];
+            f.m_eventid = std::max(f.m_eventid, n.m_eventid);
+        }
+    }
+    
+    notes.swap(folded);
+}
+
+std::size_t change_manager::memory_size(const change_notification& n) noexcept {
+    using traits = std::char_traits<path::encoding_value_type>;
+    return sizeof(n) + (traits::length(n.m_path.c_str()) + traits::length(n.m_newpath.c_str())) * sizeof(path::encoding_value_type);
+}
+
 const std::error_category& platform_category() noexcept(std::is_nothrow_default_constructible<platform_error_category>::value) {
     static const platform_error_category cat;
     return cat;
@@ -33,6 +33,11 @@ inline namespace v1 {
 bool valid(const fs::change_config&);
 void stop(change_state*, error_code&);
 
+// Polling backend (poll_monitor.cpp), used by monitor() and recursive_monitor() when change_config::poll_interval is set.
+change_registration poll_monitor(const path&, const change_config&, change_callback&&, bool recursive, error_code&);
+// Returns false if the state does not belong to a polling monitor.
+bool stop_poll_monitor(change_state*, error_code&);
+
 class change_manager {
     using evid_type = change_notification::platform_event_id_type;
 public:
@@ -58,6 +63,16 @@ public:
     }
     
     static void process_renames(fs::change_notifications&);
+    
+    // Merges events for the same path and folds busy subtrees into a single rescan event for the subtree root.
+    // Run after process_renames() as renames are not merged.
+    static void coalesce(fs::change_notifications&, const path& root, std::size_t subtree_threshold);
+    
+    static std::size_t memory_size(const change_notification&) noexcept;
+    
+private:
+    static void merge_paths(fs::change_notifications&);
+    static void fold_subtrees(fs::change_notifications&, const path& root, std::size_t threshold);
 };
 
 enum platform_error {
@@ -0,0 +1,353 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <cstring>
+
+#include "hash_internal.hpp"
+
+namespace {
+
+using std::uint8_t;
+using std::uint32_t;
+using std::uint64_t;
+
+inline uint64_t rotl64(uint64_t x, unsigned r) noexcept {
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint32_t rotr32(uint32_t x, unsigned r) noexcept {
+    return (x >> r) | (x << (32 - r));
+}
+
+// Byte order independent loads.
+inline uint64_t load64le(const uint8_t* p) noexcept {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; --i) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+inline uint32_t load32le(const uint8_t* p) noexcept {
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+inline uint32_t load32be(const uint8_t* p) noexcept {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+inline void store64le(uint64_t v, uint8_t* p) noexcept {
+    for (int i = 0; i < 8; ++i, v >>= 8) {
+        p[i] = uint8_t(v);
+    }
+}
+
+inline void store64be(uint64_t v, uint8_t* p) noexcept {
+    for (int i = 7; i >= 0; --i, v >>= 8) {
+        p[i] = uint8_t(v);
+    }
+}
+
+inline void store32be(uint32_t v, uint8_t* p) noexcept {
+    for (int i = 3; i >= 0; --i, v >>= 8) {
+        p[i] = uint8_t(v);
+    }
+}
+
+// Feeds whole blocks to f, keeping a partial block in buf.
+template <std::size_t BlockSize, class F>
+void blocks(uint8_t (&buf)[BlockSize], std::size_t& buffered, const uint8_t* p, std::size_t n, F&& f) {
+    if (buffered > 0) {
+        const auto take = std::min(n, BlockSize - buffered);
+        std::memcpy(buf + buffered, p, take);
+        buffered += take;
+        p += take;
+        n -= take;
+        if (buffered < BlockSize) {
+            return;
+        }
+        f(buf);
+        buffered = 0;
+    }
+    for (; n >= BlockSize; p += BlockSize, n -= BlockSize) {
+        f(p);
+    }
+    if (n > 0) {
+        std::memcpy(buf, p, n);
+        buffered = n;
+    }
+}
+
+constexpr uint64_t xxp1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t xxp2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t xxp3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t xxp4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t xxp5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t xxround(uint64_t acc, uint64_t input) noexcept {
+    acc += input * xxp2;
+    acc = rotl64(acc, 31);
+    return acc * xxp1;
+}
+
+inline uint64_t xxmerge(uint64_t acc, uint64_t v) noexcept {
+    acc ^= xxround(0, v);
+    return acc * xxp1 + xxp4;
+}
+
+constexpr uint64_t mmc1 = 0x87c37b91114253d5ULL;
+constexpr uint64_t mmc2 = 0x4cf5ad432745937fULL;
+
+inline uint64_t fmix64(uint64_t k) noexcept {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+inline uint64_t mmk1(uint64_t k1) noexcept {
+    return rotl64(k1 * mmc1, 31) * mmc2;
+}
+
+inline uint64_t mmk2(uint64_t k2) noexcept {
+    return rotl64(k2 * mmc2, 33) * mmc1;
+}
+
+constexpr uint32_t sha_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+} // anon
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+namespace ifilesystem {
+
+constexpr std::size_t xxh64::digest_size;
+constexpr std::size_t murmur3_128::digest_size;
+constexpr std::size_t sha256::digest_size;
+
+xxh64::xxh64() noexcept
+    : m_v{xxp1 + xxp2, xxp2, 0, 0 - xxp1}
+    , m_total()
+    , m_buf()
+    , m_buffered() {}
+
+void xxh64::update(const void* data, std::size_t n) noexcept {
+    m_total += n;
+    blocks(m_buf, m_buffered, static_cast<const uint8_t*>(data), n, [this](const uint8_t* p) {
+        for (int i = 0; i < 4; ++i) {
+            m_v[i] = xxround(m_v[i], load64le(p + i * 8));
+        }
+    });
+}
+
+uint64_t xxh64::value() const noexcept {
+    uint64_t h;
+    if (m_total >= 32) {
+        h = rotl64(m_v[0], 1) + rotl64(m_v[1], 7) + rotl64(m_v[2], 12) + rotl64(m_v[3], 18);
+        for (auto v : m_v) {
+            h = xxmerge(h, v);
+        }
+    } else {
+        h = xxp5;
+    }
+    h += m_total;
+    
+    const uint8_t* p = m_buf;
+    auto n = m_buffered;
+    for (; n >= 8; p += 8, n -= 8) {
+        h ^= xxround(0, load64le(p));
+        h = rotl64(h, 27) * xxp1 + xxp4;
+    }
+    if (n >= 4) {
+        h ^= uint64_t(load32le(p)) * xxp1;
+        h = rotl64(h, 23) * xxp2 + xxp3;
+        p += 4;
+        n -= 4;
+    }
+    for (; n > 0; ++p, --n) {
+        h ^= *p * xxp5;
+        h = rotl64(h, 11) * xxp1;
+    }
+    
+    h ^= h >> 33;
+    h *= xxp2;
+    h ^= h >> 29;
+    h *= xxp3;
+    h ^= h >> 32;
+    return h;
+}
+
+void xxh64::finish(uint8_t* out) const noexcept {
+    store64be(value(), out);
+}
+
+murmur3_128::murmur3_128() noexcept
+    : m_h1()
+    , m_h2()
+    , m_total()
+    , m_buf()
+    , m_buffered() {}
+
+void murmur3_128::block(const uint8_t* p) noexcept {
+    m_h1 ^= mmk1(load64le(p));
+    m_h1 = rotl64(m_h1, 27) + m_h2;
+    m_h1 = m_h1 * 5 + 0x52dce729;
+    m_h2 ^= mmk2(load64le(p + 8));
+    m_h2 = rotl64(m_h2, 31) + m_h1;
+    m_h2 = m_h2 * 5 + 0x38495ab5;
+}
+
+void murmur3_128::update(const void* data, std::size_t n) noexcept {
+    m_total += n;
+    blocks(m_buf, m_buffered, static_cast<const uint8_t*>(data), n, [this](const uint8_t* p) { block(p); });
+}
+
+void murmur3_128::finish(uint8_t* out) const noexcept {
+    auto h1 = m_h1;
+    auto h2 = m_h2;
+    uint64_t k1 = 0;
+    uint64_t k2 = 0;
+    for (auto i = m_buffered; i > 8; --i) {
+        k2 ^= uint64_t(m_buf[i - 1]) << ((i - 9) * 8);
+    }
+    for (auto i = std::min(m_buffered, std::size_t{8}); i > 0; --i) {
+        k1 ^= uint64_t(m_buf[i - 1]) << ((i - 1) * 8);
+    }
+    if (m_buffered > 8) {
+        h2 ^= mmk2(k2);
+    }
+    if (m_buffered > 0) {
+        h1 ^= mmk1(k1);
+    }
+    
+    h1 ^= m_total;
+    h2 ^= m_total;
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+    h1 += h2;
+    h2 += h1;
+    store64le(h1, out);
+    store64le(h2, out + 8);
+}
+
+sha256::sha256() noexcept
+    : m_h{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19}
+    , m_total()
+    , m_buf()
+    , m_buffered() {}
+
+void sha256::block(const uint8_t* p) noexcept {
+    uint32_t w[64];
+    for (int i = 0; i < 16; ++i) {
+        w[i] = load32be(p + i * 4);
+    }
+    for (int i = 16; i < 64; ++i) {
+        const auto s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        const auto s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    
+    auto a = m_h[0], b = m_h[1], c = m_h[2], d = m_h[3], e = m_h[4], f = m_h[5], g = m_h[6], h = m_h[7];
+    for (int i = 0; i < 64; ++i) {
+        const auto s1 = rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25);
+        const auto ch = (e & f) ^ (~e & g);
+        const auto t1 = h + s1 + ch + sha_k[i] + w[i];
+        const auto s0 = rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22);
+        const auto maj = (a & b) ^ (a & c) ^ (b & c);
+        const auto t2 = s0 + maj;
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    m_h[0] += a;
+    m_h[1] += b;
+    m_h[2] += c;
+    m_h[3] += d;
+    m_h[4] += e;
+    m_h[5] += f;
+    m_h[6] += g;
+    m_h[7] += h;
+}
+
+void sha256::update(const void* data, std::size_t n) noexcept {
+    m_total += n;
+    blocks(m_buf, m_buffered, static_cast<const uint8_t*>(data), n, [this](const uint8_t* p) { block(p); });
+}
+
+void sha256::finish(uint8_t* out) const noexcept {
+    auto tail = *this;
+    uint8_t pad[72] = {0x80};
+    const auto padlen = (m_buffered < 56 ? 56 : 120) - m_buffered;
+    store64be(m_total * 8, pad + padlen);
+    tail.update(pad, padlen + 8);
+    for (int i = 0; i < 8; ++i) {
+        store32be(tail.m_h[i], out + i * 4);
+    }
+}
+
+file_digest hasher::finish() const {
+    std::uint8_t out[file_digest::max_size];
+    std::size_t n = 0;
+    switch (m_algorithm) {
+        case hash_algorithm::xxh64:
+            m_xxh64.finish(out);
+            n = xxh64::digest_size;
+            break;
+        case hash_algorithm::murmur3_128:
+            m_murmur3.finish(out);
+            n = murmur3_128::digest_size;
+            break;
+        case hash_algorithm::sha256:
+            m_sha256.finish(out);
+            n = sha256::digest_size;
+            break;
+    }
+    return file_digest{m_algorithm, out, n};
+}
+
+} // ifilesystem
+} // v1
+} // filesystem
+} // prosoft
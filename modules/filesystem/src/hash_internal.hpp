@@ -0,0 +1,128 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef PS_CORE_HASH_INTERNAL_HPP
+#define PS_CORE_HASH_INTERNAL_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include <prosoft/core/modules/filesystem/filesystem_hash.hpp>
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+namespace ifilesystem {
+
+// Streaming implementations, any split of the input gives the same digest.
+
+// XXH64 with a seed of 0, the digest is big endian (XXH64_canonicalFromHash).
+class xxh64 {
+public:
+    static constexpr std::size_t digest_size = 8;
+    
+    xxh64() noexcept;
+    void update(const void*, std::size_t) noexcept;
+    std::uint64_t value() const noexcept;
+    void finish(std::uint8_t* out) const noexcept;
+    
+private:
+    std::uint64_t m_v[4];
+    std::uint64_t m_total;
+    std::uint8_t m_buf[32];
+    std::size_t m_buffered;
+};
+
+// MurmurHash3_x64_128 with a seed of 0, the digest is h1 then h2 in little endian (as the reference on x86).
+class murmur3_128 {
+public:
+    static constexpr std::size_t digest_size = 16;
+    
+    murmur3_128() noexcept;
+    void update(const void*, std::size_t) noexcept;
+    void finish(std::uint8_t* out) const noexcept;
+    
+private:
+    void block(const std::uint8_t*) noexcept;
+    
+    std::uint64_t m_h1;
+    std::uint64_t m_h2;
+    std::uint64_t m_total;
+    std::uint8_t m_buf[16];
+    std::size_t m_buffered;
+};
+
+// FIPS 180-4
+class sha256 {
+public:
+    static constexpr std::size_t digest_size = 32;
+    
+    sha256() noexcept;
+    void update(const void*, std::size_t) noexcept;
+    void finish(std::uint8_t* out) const noexcept;
+    
+private:
+    void block(const std::uint8_t*) noexcept;
+    
+    std::uint32_t m_h[8];
+    std::uint64_t m_total;
+    std::uint8_t m_buf[64];
+    std::size_t m_buffered;
+};
+
+class hasher {
+public:
+    explicit hasher(hash_algorithm a) noexcept
+        : m_algorithm(a)
+        , m_xxh64()
+        , m_murmur3()
+        , m_sha256() {}
+    
+    void update(const void* p, std::size_t n) noexcept {
+        switch (m_algorithm) {
+            case hash_algorithm::xxh64: m_xxh64.update(p, n); break;
+            case hash_algorithm::murmur3_128: m_murmur3.update(p, n); break;
+            case hash_algorithm::sha256: m_sha256.update(p, n); break;
+        }
+    }
+    
+    file_digest finish() const;
+    
+private:
+    hash_algorithm m_algorithm;
+    xxh64 m_xxh64;
+    murmur3_128 m_murmur3;
+    sha256 m_sha256;
+};
+
+// Hashes the first and last edge bytes, or the whole file when it's no larger than 2 * edge. size is set to the size when opened.
+file_digest hash_file_edges(const path&, file_size_type edge, hash_algorithm, file_size_type& size, error_code&);
+
+} // ifilesystem
+} // v1
+} // filesystem
+} // prosoft
+
+#endif // PS_CORE_HASH_INTERNAL_HPP
@@ -0,0 +1,810 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+#include "inotify_monitor_internal.hpp"
+#include <prosoft/core/config/config_analyzer.h>
+
+#include <nlohmann/json.hpp>
+
+using namespace prosoft::filesystem;
+
+namespace {
+
+using json = nlohmann::json;
+
+constexpr size_t event_buffer_size = 64 * 1024;
+
+enum class get_state_opts {
+    none,
+    delete_master
+};
+
+dev_t device(const fs::path& p, fs::error_code& ec) {
+    struct stat sb;
+    if (0 == stat(p.c_str(), &sb)) {
+        ec.clear();
+        return sb.st_dev;
+    } else {
+        ec = prosoft::system::system_error();
+        return 0; // assuming major,minor of 0,0 is invalid
+    }
+}
+
+// inotify has no history, so a stream is only valid for the current boot.
+const std::string& boot_id() {
+    static const std::string bid = [] {
+        std::string s;
+        std::ifstream f{"/proc/sys/kernel/random/boot_id"};
+        std::getline(f, s);
+        return s;
+    }();
+    return bid;
+}
+
+std::string stream_uuid(dev_t dev) {
+    const auto& bid = boot_id();
+    return !bid.empty() ? bid + "/" + std::to_string(dev) : std::string{};
+}
+
+std::string uuid_device(const std::string& uuid) {
+    const auto i = uuid.rfind('/');
+    return i != std::string::npos ? uuid.substr(i + 1) : std::string{};
+}
+
+bool same_device(const std::string& uuid1, const std::string& uuid2) {
+    const auto dev = uuid_device(uuid1);
+    return !dev.empty() && dev == uuid_device(uuid2);
+}
+
+fs::change_event_id eventid(const fs::change_config& cc, const std::string& uuid, bool journal, std::error_code& ec) {
+    if (auto pc = dynamic_cast<const platform_state*>(cc.state)) {
+        if (!pc->m_uuid.empty()) {
+            const auto evid = pc->m_lastid.load();
+            if (pc->m_uuid == uuid && evid > 0) {
+                return evid;
+            } else if (journal && evid > 0 && same_device(pc->m_uuid, uuid)) {
+                return 1; // rebooted, ids from the old boot predate any journal entry
+            } else {
+                ec.assign(EINVAL, std::system_category());
+            }
+        }
+    }
+    return 0;
+}
+
+fs::path journal_path(const fs::change_config& cc) {
+    if (!cc.journal.empty()) {
+        return cc.journal;
+    }
+    if (auto pc = dynamic_cast<const platform_state*>(cc.state)) {
+        return pc->m_journal_path;
+    }
+    return {};
+}
+
+bool replay(const fs::change_config& cc) {
+    if (auto pc = dynamic_cast<const platform_state*>(cc.state)) {
+        return pc->m_stopid == wants_replay;
+    }
+    return false;
+}
+
+bool watch_limit(const fs::error_code& ec) {
+    return ec.value() == ENOSPC || ec.value() == ENOMEM;
+}
+
+class gstate {
+public:
+    std::vector<shared_state> registrations;
+    std::mutex lck;
+    
+    gstate() = default;
+    PS_DISABLE_COPY(gstate);
+    PS_DISABLE_MOVE(gstate);
+};
+
+PS_NOINLINE
+gstate& gs() {
+    prosoft::intentional_leak_guard lg;
+    static auto gp = new gstate;
+    return *gp;
+}
+
+using g_guard = std::lock_guard<decltype(gstate::lck)>;
+
+constexpr const char* json_key_uuid = "uuid";
+constexpr const char* json_key_evid = "evid";
+constexpr const char* json_key_journal = "journal";
+
+} // namespace
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+platform_state::platform_state(const fs::path& p, const fs::change_config& cfg, bool recursive, fs::error_code& ec)
+    : platform_state() {
+    const auto dev = device(p, ec);
+    if (dev == 0) {
+        return;
+    }
+    
+    m_uuid = stream_uuid(dev);
+    if (m_uuid.empty()) {
+        ec = fs::error_code(ENOTSUP, std::system_category());
+        return;
+    }
+    
+    m_journal_path = journal_path(cfg);
+    m_replayid = eventid(cfg, m_uuid, !m_journal_path.empty(), ec);
+    if (ec) {
+        ec = fs::error_code(platform_error::monitor_thaw, platform_category());
+        m_uuid.clear();
+        return;
+    }
+    if (replay(cfg)) {
+        m_stopid = current_eventid();
+    }
+    
+    m_root = p;
+    m_recursive = recursive;
+    m_latency = cfg.notification_latency;
+    m_events = cfg.events;
+    m_subtree_threshold = cfg.subtree_threshold;
+    m_memory_limit = cfg.memory_limit;
+    m_evid = current_eventid();
+    if (!m_journal_path.empty()) {
+        m_journal.open(m_journal_path, m_uuid, m_root, cfg.journal_size, m_evid, ec);
+        if (ec) {
+            m_uuid.clear();
+            return;
+        }
+        m_evid = std::max(m_evid, m_journal.last_id());
+    }
+    m_lastid = m_replayid > 0 ? m_replayid : m_evid;
+    
+    m_fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+    m_wakefd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+    if (-1 == m_fd || -1 == m_wakefd) {
+        ec = fs::error_code(platform_error::monitor_create, platform_category());
+        m_uuid.clear();
+        return;
+    }
+    
+    m_roottype = fs::status(p, ec).type();
+    m_rootwd = add_watch(p, ec);
+    if (-1 != m_rootwd && m_recursive && m_roottype == fs::file_type::directory) {
+        watch_tree(p, nullptr, ec);
+    }
+    if (!ec && p.has_parent_path() && p.has_filename()) {
+        // The root's own events (MOVE_SELF, DELETE_SELF) don't include the new path and may be delayed while the inode is in use.
+        m_parentwd = inotify_add_watch(m_fd, p.parent_path().c_str(), parent_mask);
+    }
+    if (ec) {
+        m_uuid.clear();
+    } else {
+        // Only once everything is watched, earlier events are not in the journal.
+        if (m_journal.writer()) {
+            m_journal.start_session(next_eventid());
+            if (m_replayid == 0) {
+                m_lastid = m_evid;
+            }
+        }
+    }
+}
+
+platform_state::platform_state(const std::string& s, fs::change_thaw_options opts)
+    : platform_state() {
+    // throws for invalid json, but not empty string
+    auto j = !s.empty() ? json::parse(s) : json{};
+    auto i = j.find(json_key_uuid);
+    if (i != j.end()) {
+        m_uuid = i->get<std::string>();
+    }
+    i = j.find(json_key_evid);
+    if (i != j.end()) {
+        m_lastid = i->get<fs::change_event_id>();
+        if (is_set(opts & fs::change_thaw_options::replay_to_current_event)) {
+            m_stopid = wants_replay;
+        }
+    }
+    i = j.find(json_key_journal);
+    if (i != j.end()) {
+        m_journal_path = fs::path{i->get<std::string>()};
+    }
+}
+
+platform_state::~platform_state() {
+    if (m_thread.joinable()) {
+        m_stop = true;
+        if (m_thread.get_id() == std::this_thread::get_id()) {
+            m_thread.detach();
+        } else {
+            wake();
+            m_thread.join();
+        }
+    }
+    for (int fd : {m_fd, m_wakefd}) {
+        if (-1 != fd) {
+            close(fd);
+        }
+    }
+}
+
+fs::change_event_id platform_state::last_event_id() const {
+    return m_lastid.load();
+}
+
+std::string platform_state::serialize() const {
+    return this->serialize(m_lastid.load());
+}
+
+std::string platform_state::serialize(fs::change_event_id evid) const {
+    if (!m_uuid.empty() && evid > 0) {
+        json j {
+            {json_key_uuid, m_uuid},
+            {json_key_evid, evid}
+        };
+        if (!m_journal_path.empty()) {
+            j[json_key_journal] = m_journal_path.string();
+        }
+        return j.dump();
+    }
+    return "";
+}
+
+fs::change_event_id platform_state::next_eventid() noexcept {
+    const auto evid = current_eventid();
+    m_evid = evid > m_evid ? evid : m_evid + 1;
+    return m_evid;
+}
+
+void platform_state::wake() noexcept {
+    const uint64_t val = 1;
+    const auto err = ::write(m_wakefd, &val, sizeof(val));
+    (void)err;
+}
+
+int platform_state::add_watch(const fs::path& p, fs::error_code& ec) {
+    auto mask = to_mask(m_events, m_recursive);
+    if (-1 != m_rootwd) { // descendants are only watched through real directories
+        mask |= IN_ONLYDIR|IN_DONT_FOLLOW;
+    }
+    const int wd = inotify_add_watch(m_fd, p.c_str(), mask);
+    if (-1 != wd) {
+        m_watches[wd] = p;
+        ec.clear();
+    } else {
+        ifilesystem::system_error(ec);
+    }
+    return wd;
+}
+
+void platform_state::watch_tree(const fs::path& dir, fs::change_notifications* notes, fs::error_code& ec) {
+    // Entries created before the watch was added are reported as created so nothing is lost to the race.
+    fs::recursive_directory_iterator i{dir, fs::directory_options::skip_permission_denied, ec};
+    for (const fs::recursive_directory_iterator last; !ec && i != last; i.increment(ec)) {
+        fs::error_code sec;
+        const auto ft = i->symlink_status(sec).type();
+        if (ft == fs::file_type::directory && -1 == add_watch(i->path(), sec) && watch_limit(sec)) {
+            ec = sec;
+            return;
+        }
+        if (notes) {
+            fs::change_manager::emplace_back(*notes, fs::path{i->path()}, fs::path{}, this, next_eventid(), fs::change_event::created, ft);
+        }
+    }
+}
+
+void platform_state::rename_watches(const fs::path& from, const fs::path& to) {
+    for (auto& w : m_watches) {
+        if (is_under(w.second, from)) {
+            auto rel = w.second.lexically_relative(from);
+            w.second = rel == fs::path{PS_TEXT(".")} ? to : to / rel;
+        }
+    }
+}
+
+void platform_state::remove_watches(const fs::path& dir) {
+    for (auto i = m_watches.begin(); i != m_watches.end();) {
+        if (i->first != m_rootwd && is_under(i->second, dir)) {
+            inotify_rm_watch(m_fd, i->first);
+            i = m_watches.erase(i);
+        } else {
+            ++i;
+        }
+    }
+}
+
+void platform_state::cancel_root(uint32_t mask, fs::path&& np, fs::change_notifications& notes) {
+    auto ev = fs::change_event::canceled|fs::change_event::rescan;
+    if (!np.empty()) {
+        ev |= fs::change_event::renamed;
+        ev &= ~fs::change_event::rescan;
+    } else if ((mask & (IN_DELETE|IN_DELETE_SELF))) {
+        ev |= fs::change_event::removed;
+    }
+    
+    fs::change_manager::emplace_back(notes, fs::path{m_root}, std::move(np), this, next_eventid(), ev, m_roottype);
+    m_canceled = true; // further events are invalid
+}
+
+bool platform_state::root_changed(const struct inotify_event* ev, fs::change_notifications& notes) {
+    if (ev->wd == m_parentwd) {
+        if (ev->len > 0 && (ev->mask & (IN_MOVED_TO)) && m_rootcookie == ev->cookie) {
+            cancel_root(ev->mask, m_root.parent_path() / fs::path{static_cast<const char*>(ev->name)}, notes);
+        } else if (ev->len > 0 && fs::path{static_cast<const char*>(ev->name)} == m_root.filename()) {
+            if ((ev->mask & IN_MOVED_FROM)) {
+                m_rootcookie = ev->cookie; // the new path is only known if moved within the same parent
+            } else if ((ev->mask & IN_DELETE)) {
+                cancel_root(ev->mask, fs::path{}, notes);
+            }
+        }
+        return true;
+    }
+    
+    if (ev->wd == m_rootwd && (ev->mask & (IN_DELETE_SELF|IN_MOVE_SELF|IN_UNMOUNT))) {
+        cancel_root(ev->mask, fs::path{}, notes);
+        return true;
+    }
+    
+    return false;
+}
+
+void platform_state::translate(const char* buf, size_t len, fs::change_notifications& notes) {
+    using namespace fs;
+    const char* const end = buf + len;
+    for (const char* p = buf; p < end && !m_canceled;) {
+        auto ev = reinterpret_cast<const struct inotify_event*>(p);
+        p += sizeof(struct inotify_event) + ev->len;
+        
+        if ((ev->mask & IN_Q_OVERFLOW)) {
+            change_manager::emplace_back(notes, path{m_root}, path{}, this, next_eventid(), to_event(ev->mask), m_roottype);
+            m_canceled = true;
+            break;
+        }
+        
+        if ((ev->mask & IN_IGNORED)) {
+            m_watches.erase(ev->wd);
+            continue;
+        }
+        
+        if (root_changed(ev, notes)) {
+            continue;
+        }
+        
+        auto w = m_watches.find(ev->wd);
+        if (w == m_watches.end()) {
+            continue; // removed watch, the event is stale
+        }
+        if ((ev->mask & (IN_DELETE_SELF|IN_MOVE_SELF))) {
+            continue; // reported by the parent
+        }
+        
+        path evp = ev->len > 0 ? w->second / path{static_cast<const char*>(ev->name)} : w->second;
+        const auto ft = to_type(ev->mask);
+        auto event = to_event(ev->mask);
+        
+        if ((ev->mask & IN_MOVED_FROM)) {
+            // The matching MOVED_TO is usually the next event. Both halves share an id so process_renames() can pair them.
+            const auto evid = next_eventid();
+            m_moves[ev->cookie] = pending_move{notes.size(), evid};
+            change_manager::emplace_back(notes, std::move(evp), path{}, this, evid, event, ft);
+            continue;
+        }
+        
+        if ((ev->mask & IN_MOVED_TO)) {
+            auto i = m_moves.find(ev->cookie);
+            if (i != m_moves.end()) {
+                if (ft == file_type::directory && m_recursive) {
+                    rename_watches(notes[i->second.index].path(), evp);
+                }
+                change_manager::emplace_back(notes, std::move(evp), path{}, this, i->second.evid, event, ft);
+                m_moves.erase(i);
+                continue;
+            }
+            event = change_event::created|change_event::outside_tree;
+        }
+        
+        if (ft == file_type::directory && m_recursive && is_set(event & change_event::created)) {
+            change_manager::emplace_back(notes, path{evp}, path{}, this, next_eventid(), event, ft);
+            error_code ec;
+            if (-1 != add_watch(evp, ec)) {
+                watch_tree(evp, &notes, ec);
+            }
+            if (watch_limit(ec)) {
+                // Part of the tree is no longer monitored.
+                change_manager::emplace_back(notes, std::move(evp), path{}, this, next_eventid(), change_event::rescan_required, ft);
+                m_canceled = true;
+            }
+            continue;
+        }
+        
+        change_manager::emplace_back(notes, std::move(evp), path{}, this, next_eventid(), event, ft);
+    }
+}
+
+void platform_state::resolve_moves(fs::change_notifications& notes) {
+    using namespace fs;
+    for (const auto& m : m_moves) {
+        auto& n = notes[m.second.index];
+        if (n.type() == file_type::directory && m_recursive) {
+            remove_watches(n.path());
+        }
+        n = change_manager::make_notification(path{n.path()}, path{}, this, change_event::removed|change_event::outside_tree, n.type(), m.second.evid);
+    }
+    m_moves.clear();
+}
+
+void platform_state::enforce_memory_limit(fs::change_notifications& notes, size_t first) {
+    using namespace fs;
+    if (m_memory_limit == 0 || m_canceled) {
+        return;
+    }
+    change_notifications kept;
+    if (m_overflowed) {
+        PSASSERT(!notes.empty(), "Broken assumption");
+        kept.push_back(std::move(notes.front()));
+    } else {
+        for (size_t i = first; i < notes.size(); ++i) {
+            m_pending_size += change_manager::memory_size(notes[i]);
+        }
+        if (m_pending_size <= m_memory_limit) {
+            return;
+        }
+        m_overflowed = true;
+        change_manager::emplace_back(kept, path{m_root}, path{}, this, next_eventid(), change_event::rescan, m_roottype);
+    }
+    // The first half of a move is kept, so the pair still updates the watches when the second half is read.
+    for (auto& m : m_moves) {
+        kept.push_back(std::move(notes[m.second.index]));
+        m.second.index = kept.size() - 1;
+    }
+    notes.swap(kept);
+    m_pending_size = 0;
+    for (const auto& n : notes) {
+        m_pending_size += change_manager::memory_size(n);
+    }
+}
+
+void platform_state::dispatch(fs::change_notifications& notes) {
+    using namespace fs;
+    resolve_moves(notes);
+    
+    const auto mask = m_events|change_event::rescan_required|change_event::replay_done;
+    notes.erase(std::remove_if(notes.begin(), notes.end(), [mask](const change_notification& n) {
+        return !is_set(n.event() & mask);
+    }), notes.end());
+    
+    if (!notes.empty() && !m_stop) {
+        // Before the callback so the client can archive the state with the correct id.
+        m_lastid = m_evid;
+        PSIgnoreCppException(change_manager::process_renames(notes); change_manager::coalesce(notes, m_root, m_subtree_threshold); m_journal.append(notes); m_callback(std::move(notes)));
+    }
+    notes.clear();
+    m_pending_size = 0;
+    m_overflowed = false;
+}
+
+bool platform_state::read_events(char* buf, size_t len, fs::change_notifications& notes) {
+    const auto n = ::read(m_fd, buf, len);
+    if (n > 0) {
+        const auto first = notes.size();
+        translate(buf, static_cast<size_t>(n), notes);
+        enforce_memory_limit(notes, first);
+        return true;
+    }
+    return false;
+}
+
+void platform_state::replay_journal(fs::change_notifications& notes) {
+    using namespace fs;
+    if (!m_journal.is_open()) {
+        // There is no event history to replay from, so all we can do is report that changes may have been missed.
+        change_manager::emplace_back(notes, path{m_root}, path{}, this, next_eventid(), change_event::rescan, m_roottype);
+        return;
+    }
+    
+    if (m_journal.replay(m_replayid, replay_slack, m_root, m_events, notes, this)) {
+        for (const auto& n : notes) {
+            m_evid = std::max(m_evid, n.event_id());
+        }
+        enforce_memory_limit(notes, 0);
+    } else {
+        notes.clear();
+        change_manager::emplace_back(notes, path{m_root}, path{}, this, next_eventid(), change_event::rescan_required, m_roottype);
+        m_canceled = true;
+    }
+}
+
+void platform_state::run() {
+    using namespace fs;
+    pthread_setname_np(pthread_self(), "inotify_monitor");
+    
+    std::unique_ptr<char[]> buf{new char[event_buffer_size]};
+    change_notifications notes;
+    
+    if (m_replayid > 0) {
+        replay_journal(notes);
+    }
+    if (m_stopid > 0 && !m_canceled) {
+        change_manager::emplace_back(notes, path{}, path{}, this, 0, change_event::replay_end, file_type::none);
+        m_canceled = true;
+    }
+    
+    auto first = clock_type::now();
+    pollfd fds[2] = {{m_fd, POLLIN, 0}, {m_wakefd, POLLIN, 0}};
+    while (!m_stop) {
+        if (!notes.empty()) {
+            if (!m_moves.empty() && !m_canceled) { // a pair may be split across reads
+                read_events(buf.get(), event_buffer_size, notes);
+            }
+            if (m_canceled || clock_type::now() - first >= m_latency) {
+                dispatch(notes);
+            }
+        }
+        if (m_canceled) {
+            break;
+        }
+        
+        int timeout = -1;
+        if (!notes.empty()) {
+            const auto remaining = std::chrono::duration_cast<change_config::latency_type>(m_latency - (clock_type::now() - first));
+            timeout = static_cast<int>(std::max(remaining.count(), change_config::latency_type::rep{0})) + 1;
+        }
+        
+        if (-1 == ::poll(fds, 2, timeout)) {
+            if (errno != EINTR) {
+                change_manager::emplace_back(notes, path{m_root}, path{}, this, next_eventid(), change_event::rescan_required, m_roottype);
+                m_canceled = true;
+            }
+            continue;
+        }
+        if (fds[1].revents) {
+            break;
+        }
+        if ((fds[0].revents & POLLIN)) {
+            const bool empty = notes.empty();
+            read_events(buf.get(), event_buffer_size, notes);
+            if (empty) {
+                first = clock_type::now();
+            }
+        }
+    }
+}
+
+} // namespace v1
+} // namespace filesystem
+} // namespace prosoft
+
+namespace {
+
+void stop_events_monitor(shared_state& ss) {
+    PSASSERT(ss, "NULL");
+    ss->m_stop = true;
+    if (ss->m_thread.joinable()) {
+        if (ss->m_thread.get_id() == std::this_thread::get_id()) {
+            ss->m_thread.detach(); // stopped from the callback, the thread exits once it returns
+        } else {
+            ss->wake();
+            ss->m_thread.join();
+        }
+    }
+}
+
+} // namespace
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+shared_state get_shared_state(platform_state* state, get_state_opts opts) {
+    auto& g = gs();
+    g_guard lg{g.lck};
+    auto i = std::find_if(g.registrations.begin(), g.registrations.end(), [state](const shared_state& p) {
+        return state == p.get();
+    });
+    if (i != g.registrations.end()) {
+        shared_state ss{*i};
+        if (get_state_opts::delete_master == opts) {
+            g.registrations.erase(i);
+        }
+        return ss;
+    } else {
+        return shared_state{};
+    }
+}
+
+shared_state get_shared_state(platform_state* state) {
+    return get_shared_state(state, get_state_opts::none);
+}
+
+fs::change_registration register_events_monitor(shared_state&& state, fs::change_callback&& cb, fs::error_code& ec) {
+    auto reg = fs::change_manager::make_registration(state);
+    auto p = state.get();
+    PSASSERT_NOTNULL(p);
+    p->m_callback = std::move(cb);
+    {
+        auto& g = gs();
+        g_guard lg{g.lck};
+        g.registrations.emplace_back(state);
+    }
+    
+    try {
+        // The thread keeps the state alive as stop() may be called from the callback.
+        p->m_thread = std::thread{[ss = std::move(state)]() {
+            ss->run();
+        }};
+        ec.clear();
+        return reg;
+    } catch (const std::system_error&) {
+        ec = fs::error_code(fs::platform_error::monitor_start, fs::platform_category());
+        get_shared_state(p, get_state_opts::delete_master);
+        return fs::change_registration{};
+    }
+}
+
+void unregister_events_monitor(platform_state* state, fs::error_code& ec) {
+    PSASSERT_NOTNULL(state);
+    if (shared_state ss = get_shared_state(state, get_state_opts::delete_master)) {
+        stop_events_monitor(ss);
+    } else {
+        ec = fs::error_code{ENOENT, std::system_category()};
+    }
+}
+
+struct change_token {
+    std::string m_uuid;
+    
+    change_token(const path&, error_code&);
+};
+
+change_token::change_token(const path& p, error_code& ec) {
+    const auto dev = device(p, ec);
+    if (0 != dev) {
+        m_uuid = stream_uuid(dev);
+        if (m_uuid.empty()) {
+            ec.assign(ENOTSUP, std::system_category());
+        }
+    }
+}
+
+change_state::token_type change_state::serialize_token(const path& p, error_code& ec) {
+    auto ct = std::make_shared<change_token>(p, ec);
+    if (ec.value() == 0) {
+        return ct;
+    } else {
+        return {};
+    }
+}
+
+change_state::token_type change_state::serialize_token(const path& p) {
+    fs::error_code ec;
+    auto s = serialize_token(p, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not serialize filesystem monitor state", p, ec));
+    return s;
+}
+
+std::string change_state::serialize(const token_type& token, error_code& ec) {
+    (void)ec;   // unused
+    if (token) {
+        json j {
+            {json_key_uuid, token->m_uuid},
+            {json_key_evid, current_eventid()}
+        };
+        return j.dump();
+    }
+    return "";
+}
+
+std::string change_state::serialize(const token_type& token) {
+    fs::error_code ec;
+    auto s = serialize(token, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not serialize filesystem monitor state", ec));
+    return s;
+}
+
+std::string change_state::serialize(const path& p, error_code& ec) {
+    if (auto token = serialize_token(p, ec)) {
+        return serialize(token, ec);
+    }
+    return "";
+}
+
+std::string change_state::serialize(const path& p) {
+    fs::error_code ec;
+    auto s = serialize(p, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not serialize filesystem monitor state", p, ec));
+    return s;
+}
+
+std::unique_ptr<change_state> change_state::serialize(const std::string& s, change_thaw_options opts) {
+    return std::make_unique<platform_state>(s, opts);
+}
+
+bool operator==(const change_state& lhs, const change_state& rhs) {
+    return &lhs == &rhs; // All copies of change_registration point to a shared platform state
+}
+
+change_registration monitor(const path& p, const change_config& cfg, change_callback cb, error_code& ec) {
+    if (p.empty() || !valid(cfg) || !cb) {
+        ec = einval();
+        return change_registration{};
+    }
+    
+    if (cfg.poll_interval.count() > 0) {
+        return poll_monitor(p, cfg, std::move(cb), false, ec);
+    }
+    
+    auto state = std::make_shared<platform_state>(p, cfg, false, ec);
+    if (!ec) {
+        return register_events_monitor(std::move(state), std::move(cb), ec);
+    }
+    
+    return change_registration{};
+}
+
+change_registration recursive_monitor(const path& p, const change_config& cfg, change_callback cb, error_code& ec) {
+    if (p.empty() || !valid(cfg) || !cb) {
+        ec = einval();
+        return change_registration{};
+    }
+    
+    if (cfg.poll_interval.count() > 0) {
+        return poll_monitor(p, cfg, std::move(cb), true, ec);
+    }
+    
+    auto state = std::make_shared<platform_state>(p, cfg, true, ec);
+    if (!ec) {
+        return register_events_monitor(std::move(state), std::move(cb), ec);
+    }
+    
+    return change_registration{};
+}
+
+void stop(change_state* state, error_code& ec) {
+    PSASSERT_NOTNULL(state);
+    if (auto p = dynamic_cast<platform_state*>(state)) {
+        unregister_events_monitor(p, ec);
+        // p is probably bad now
+    } else {
+        throw std::bad_cast{}; // should never happen or something's gone south
+    }
+}
+
+} // v1
+} // filesystem
+} // prosoft
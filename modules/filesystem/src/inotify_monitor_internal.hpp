@@ -0,0 +1,241 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef PS_CORE_INOTIFY_MONITOR_INTERNAL_HPP
+#define PS_CORE_INOTIFY_MONITOR_INTERNAL_HPP
+
+#include <sys/inotify.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <unordered_map>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>   // error_code
+#include <prosoft/core/modules/filesystem/filesystem_path.hpp>  // path
+#include <prosoft/core/modules/filesystem/filesystem_change_monitor.hpp>    // change_registration
+#include "filesystem_private.hpp"
+#include "fsmonitor_private.hpp"
+#include "change_journal_linux_internal.hpp"
+
+namespace fs = prosoft::filesystem::v1;
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+struct platform_state : public fs::change_state {
+    using clock_type = std::chrono::steady_clock;
+    using watch_map = std::unordered_map<int, fs::path>;
+    struct pending_move {
+        size_t index; // into the current batch
+        fs::change_event_id evid;
+    };
+    using move_map = std::unordered_map<uint32_t, pending_move>; // inotify cookie -> MOVED_FROM notification
+    
+    fs::change_callback m_callback;
+    fs::path m_root;
+    watch_map m_watches; // owned by the monitor thread once started
+    move_map m_moves;
+    ifilesystem::change_journal m_journal;
+    std::thread m_thread;
+    fs::change_config::latency_type m_latency;
+    fs::change_event m_events;
+    std::size_t m_subtree_threshold;
+    std::size_t m_memory_limit;
+    std::size_t m_pending_size; // of the current batch
+    fs::file_type m_roottype;
+    int m_fd; // inotify
+    int m_wakefd; // signaled by stop()
+    int m_rootwd;
+    int m_parentwd; // for root renames and removal
+    uint32_t m_rootcookie; // root MOVED_FROM
+    bool m_recursive;
+    bool m_canceled; // no more events will be read
+    bool m_overflowed; // the batch was replaced by a rescan of the root (memory limit)
+    std::atomic_bool m_stop;
+    fs::change_event_id m_stopid; // event to stop at
+    fs::change_event_id m_replayid; // thawed event, replayed from the journal if there is one
+    fs::change_event_id m_evid; // last event id handed out
+    // persistent values //
+    std::string m_uuid; // boot id and device, set when constructed and then read-only
+    fs::path m_journal_path; // read-only
+    std::atomic<fs::change_event_id> m_lastid;
+    
+    platform_state()
+        : m_callback()
+        , m_root()
+        , m_watches()
+        , m_moves()
+        , m_journal()
+        , m_thread()
+        , m_latency()
+        , m_events(fs::change_event::all)
+        , m_subtree_threshold(0)
+        , m_memory_limit(0)
+        , m_pending_size(0)
+        , m_roottype(fs::file_type::none)
+        , m_fd(-1)
+        , m_wakefd(-1)
+        , m_rootwd(-1)
+        , m_parentwd(-1)
+        , m_rootcookie(0)
+        , m_recursive(false)
+        , m_canceled(false)
+        , m_overflowed(false)
+        , m_stop(false)
+        , m_stopid(0)
+        , m_replayid(0)
+        , m_evid(0)
+        , m_uuid()
+        , m_journal_path()
+        , m_lastid(0) {}
+    platform_state(const fs::path&, const fs::change_config&, bool recursive, fs::error_code&);
+    platform_state(const std::string&, fs::change_thaw_options); // from serialzed data
+    virtual ~platform_state();
+    
+    virtual fs::change_event_id last_event_id() const override;
+    
+    virtual std::string serialize() const override;
+    virtual std::string serialize(fs::change_event_id) const override;
+    
+    // Monitor thread.
+    void run();
+    void wake() noexcept;
+    fs::change_event_id next_eventid() noexcept;
+    bool read_events(char*, size_t, fs::change_notifications&);
+    // Adds the journaled events after the thawed id, or rescan_required if some may be missing.
+    void replay_journal(fs::change_notifications&);
+    // Converts a buffer of raw inotify events, maintaining watches for a recursive monitor.
+    void translate(const char* buf, size_t len, fs::change_notifications&);
+    // Unpaired MOVED_FROM events are moves out of the tree.
+    void resolve_moves(fs::change_notifications&);
+    void dispatch(fs::change_notifications&);
+    // Replaces the batch with a rescan of the root once the memory limit is exceeded. Monitoring continues.
+    void enforce_memory_limit(fs::change_notifications&, size_t first);
+    void cancel_root(uint32_t mask, fs::path&& newpath, fs::change_notifications&);
+    bool root_changed(const struct inotify_event*, fs::change_notifications&);
+    
+    int add_watch(const fs::path&, fs::error_code&);
+    void watch_tree(const fs::path&, fs::change_notifications*, fs::error_code&);
+    void rename_watches(const fs::path& from, const fs::path& to);
+    void remove_watches(const fs::path&);
+};
+
+// Event ids are boot time based so they are monotonic across monitors and processes for the lifetime of the boot id.
+inline fs::change_event_id current_eventid() noexcept {
+    struct timespec ts;
+    ::clock_gettime(CLOCK_BOOTTIME, &ts);
+    return static_cast<fs::change_event_id>(ts.tv_sec) * 1000000000ULL + static_cast<fs::change_event_id>(ts.tv_nsec);
+}
+
+constexpr fs::change_event_id wants_replay = ~fs::change_event_id{};
+
+// How far apart the ids of two monitors may be for the same event.
+constexpr fs::change_event_id replay_slack = 1000000000ULL;
+
+constexpr uint32_t parent_mask = IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_ONLYDIR;
+
+inline uint32_t to_mask(fs::change_event events, bool recursive) {
+    uint32_t mask = IN_DELETE_SELF|IN_MOVE_SELF|IN_EXCL_UNLINK;
+    if (is_set(events & fs::change_event::created)) {
+        mask |= IN_CREATE;
+    }
+    if (is_set(events & fs::change_event::removed)) {
+        mask |= IN_DELETE;
+    }
+    if (is_set(events & fs::change_event::renamed)) {
+        mask |= IN_MOVED_FROM|IN_MOVED_TO;
+    }
+    if (is_set(events & fs::change_event::content_modified)) {
+        mask |= IN_MODIFY;
+    }
+    if (is_set(events & fs::change_event::metadata_modified)) {
+        mask |= IN_ATTRIB;
+    }
+    if (recursive) { // required to maintain the watch tree
+        mask |= IN_CREATE|IN_MOVED_FROM|IN_MOVED_TO;
+    }
+    return mask;
+}
+
+inline fs::change_event to_event(uint32_t mask) {
+    fs::change_event evts{};
+    
+    if ((mask & IN_Q_OVERFLOW)) {
+        return fs::change_event::rescan_required;
+    }
+    if ((mask & IN_UNMOUNT)) {
+        evts |= fs::change_event::rescan;
+        return evts;
+    }
+    
+    if ((mask & (IN_MOVED_FROM|IN_MOVED_TO|IN_MOVE_SELF))) {
+        evts |= fs::change_event::renamed;
+    }
+    if ((mask & (IN_DELETE|IN_DELETE_SELF))) {
+        evts |= fs::change_event::removed;
+    }
+    if ((mask & IN_CREATE)) {
+        evts |= fs::change_event::created;
+    }
+    if ((mask & IN_MODIFY)) {
+        evts |= fs::change_event::content_modified;
+    }
+    if ((mask & IN_ATTRIB)) {
+        evts |= fs::change_event::metadata_modified;
+    }
+    
+    return evts;
+}
+
+inline fs::file_type to_type(uint32_t mask) {
+    return (mask & IN_ISDIR) ? fs::file_type::directory : fs::file_type::none;
+}
+
+inline bool is_under(const fs::path& p, const fs::path& dir) {
+    auto i = p.begin();
+    const auto last = p.end();
+    for (const auto& c : dir) {
+        if (i == last || *i != c) {
+            return false;
+        }
+        ++i;
+    }
+    return true;
+}
+
+using shared_state = std::shared_ptr<platform_state>;
+shared_state get_shared_state(platform_state*);
+
+fs::change_registration register_events_monitor(shared_state&& state, fs::change_callback&& cb, fs::error_code& ec);
+
+void unregister_events_monitor(platform_state* state, fs::error_code& ec);
+
+} // namespace v1
+} // namespace filesystem
+} // namespace prosoft
+
+#endif // PS_CORE_INOTIFY_MONITOR_INTERNAL_HPP
@@ -78,25 +78,639 @@ struct dir_ops {
     PS_ALWAYS_INLINE static native_dir* open(const fs::path& p) {
         return open_dir(p);
     }
+    
+#if !_WIN32
+    PS_ALWAYS_INLINE static native_dir* open_at(native_dir* parent, const char* leaf, bool follow) {
+        return open_dir_at(dir_fd(parent), leaf, follow);
+    }
+#endif
 
     PS_ALWAYS_INLINE static native_dirent* read(native_dir* d) {
         return read_dir(d);
     }
     
+#if !_WIN32
+    PS_ALWAYS_INLINE static int stat(native_dir* d, struct ::stat& sb) {
+        return ::fstat(dir_fd(d), &sb);
+    }
+#endif
+    
+#if PS_FS_HAVE_DIRENT_OFFSET
+    PS_ALWAYS_INLINE static void seek(native_dir* d, std::uint64_t off) {
+        ::seekdir(d, static_cast<long>(off));
+    }
+#endif
+    
     PS_ALWAYS_INLINE static int close(native_dir* d) {
         return close_dir(d);
     }
 };
 
+#if PS_FS_HAVE_GETDENTS64
+class bulk_dir_ops {
+    size_t m_bufsize;
+public:
+    bulk_dir_ops() noexcept
+        : m_bufsize(fs::ifilesystem::iterator_config::default_bulk_read_size()) {}
+    explicit bulk_dir_ops(size_t bufsize) noexcept
+        : m_bufsize(bufsize) {}
+    
+    PS_ALWAYS_INLINE bulk_dir* open(const fs::path& p) const {
+        return open_bulk_dir(p, m_bufsize);
+    }
+    
+    PS_ALWAYS_INLINE bulk_dir* open_at(bulk_dir* parent, const char* leaf, bool follow) const {
+        return open_bulk_dir_at(dir_fd(parent), leaf, follow, m_bufsize);
+    }
+    
+    PS_ALWAYS_INLINE static native_dirent* read(bulk_dir* d) {
+        return read_bulk_dir(d);
+    }
+    
+    PS_ALWAYS_INLINE static size_t name_length(const native_dirent* e) {
+        return bulk_name_length(e);
+    }
+    
+    PS_ALWAYS_INLINE static int stat(bulk_dir* d, struct ::stat& sb) {
+        return ::fstat(dir_fd(d), &sb);
+    }
+    
+    PS_ALWAYS_INLINE static void seek(bulk_dir* d, std::uint64_t off) {
+        seek_bulk_dir(d, off);
+    }
+    
+    PS_ALWAYS_INLINE static int close(bulk_dir* d) {
+        return close_bulk_dir(d);
+    }
+};
+#endif
+
+using char_type = ifilesystem::name_filter::char_type;
+using uchar_type = std::make_unsigned<char_type>::type;
+
+inline uchar_type uc(char_type c) {
+    return static_cast<uchar_type>(c);
+}
+
+// p follows the opening '['. Returns false if the set is not terminated.
+bool match_set(const char_type* p, const char_type* pend, char_type c, const char_type*& next, bool& matched) {
+    bool negate = false;
+    if (p < pend && (*p == '!' || *p == '^')) {
+        negate = true;
+        ++p;
+    }
+    bool m = false;
+    for (bool first = true; p < pend && (first || *p != ']'); first = false) {
+        if (*p == '\\' && p + 1 < pend) {
+            ++p;
+        }
+        const auto lo = *p++;
+        auto hi = lo;
+        if (p + 1 < pend && *p == '-' && p[1] != ']') {
+            if (p[1] == '\\' && p + 2 < pend) {
+                ++p;
+            }
+            hi = p[1];
+            p += 2;
+        }
+        if (uc(lo) <= uc(c) && uc(c) <= uc(hi)) {
+            m = true;
+        }
+    }
+    if (p >= pend) {
+        return false;
+    }
+    next = p + 1;
+    matched = m != negate;
+    return true;
+}
+
+bool glob_match(const char_type* p, const char_type* pend, const char_type* s, const char_type* send) {
+    const char_type* star_p = nullptr;
+    const char_type* star_s = nullptr;
+    while (s < send) {
+        if (p < pend && *p == '*') {
+            star_p = ++p;
+            star_s = s;
+            continue;
+        }
+        if (p < pend) {
+            bool ok = false;
+            auto np = p + 1;
+            switch (*p) {
+                case '?':
+                    ok = true;
+                break;
+                case '[':
+                    if (!match_set(p + 1, pend, *s, np, ok)) { // not a set, so a literal
+                        ok = *s == '[';
+                    }
+                break;
+                case '\\':
+                    if (np < pend) {
+                        ok = *np++ == *s;
+                    } else {
+                        ok = *s == '\\';
+                    }
+                break;
+                default:
+                    ok = *p == *s;
+                break;
+            }
+            if (ok) {
+                p = np;
+                ++s;
+                continue;
+            }
+        }
+        if (!star_p) {
+            return false;
+        }
+        // Backtrack: let the last '*' consume one more character.
+        p = star_p;
+        s = ++star_s;
+    }
+    while (p < pend && *p == '*') {
+        ++p;
+    }
+    return p == pend;
+}
+
+// Checkpoint format: magic, version, level count, then per level: flags, offset, path and last name.
+// Numbers are LEB128 varints and strings are length prefixed (paths are UTF-8, names are raw). A path is stored as a leaf when it's a child of the previous level.
+constexpr char checkpoint_magic[] = {'P', 'S', 'I'};
+constexpr unsigned char checkpoint_version = 1;
+
+enum checkpoint_flags : unsigned char {
+    checkpoint_placeholder = 1U<<0,
+    checkpoint_leaf = 1U<<1,
+};
+
+void put_varint(std::string& s, std::uint64_t v) {
+    while (v >= 0x80) {
+        s.push_back(static_cast<char>((v & 0x7f) | 0x80));
+        v >>= 7;
+    }
+    s.push_back(static_cast<char>(v));
+}
+
+void put_string(std::string& s, const std::string& v) {
+    put_varint(s, v.size());
+    s.append(v);
+}
+
+class checkpoint_reader {
+    const std::string& m_s;
+    size_t m_pos;
+    bool m_ok;
+    
+public:
+    explicit checkpoint_reader(const std::string& s)
+        : m_s(s)
+        , m_pos()
+        , m_ok(true) {}
+    
+    bool ok() const noexcept {
+        return m_ok;
+    }
+    
+    bool at_end() const noexcept {
+        return m_pos == m_s.size();
+    }
+    
+    unsigned char byte() {
+        if (m_pos < m_s.size()) {
+            return static_cast<unsigned char>(m_s[m_pos++]);
+        }
+        m_ok = false;
+        return 0;
+    }
+    
+    std::uint64_t varint() {
+        std::uint64_t v = 0;
+        for (unsigned shift = 0; m_ok && shift < 64; shift += 7) {
+            const auto b = byte();
+            v |= std::uint64_t(b & 0x7f) << shift;
+            if (!(b & 0x80)) {
+                return v;
+            }
+        }
+        m_ok = false;
+        return 0;
+    }
+    
+    std::string string() {
+        const auto sz = varint();
+        if (m_ok && sz <= m_s.size() - m_pos) {
+            const auto pos = m_pos;
+            m_pos += static_cast<size_t>(sz);
+            return m_s.substr(pos, static_cast<size_t>(sz));
+        }
+        m_ok = false;
+        return {};
+    }
+};
+
+// Spilled items are stored as a native length followed by the bytes. Runs are only read by the process that wrote them.
+bool write_item(std::FILE* f, const sorted_dir::item_type& item) {
+    const auto sz = static_cast<std::uint32_t>(item.size());
+    return 1 == std::fwrite(&sz, sizeof(sz), 1, f) && item.size() == std::fwrite(item.data(), 1, item.size(), f);
+}
+
+bool read_item(std::FILE* f, sorted_dir::item_type& item) {
+    std::uint32_t sz;
+    if (1 != std::fread(&sz, sizeof(sz), 1, f)) {
+        return false;
+    }
+    item.resize(sz);
+    return sz == std::fread(&item[0], 1, sz, f);
+}
+
+int file_error() {
+    return errno != 0 ? errno : EIO;
+}
+
+inline size_t key_length(const sorted_dir::item_type& item) {
+    return item.find('\0');
+}
+
+template <class Traits>
+typename Traits::serialize_type serialize_iterator(const ifilesystem::iterator_state_ptr& i) {
+    return i ? i->checkpoint() : typename Traits::serialize_type{};
+}
+
 } // anon
 
 namespace prosoft {
 namespace filesystem {
 inline namespace v1 {
 
+std::string encode_checkpoint(const checkpoint_type& levels) {
+    std::string s{checkpoint_magic, sizeof(checkpoint_magic)};
+    s.push_back(static_cast<char>(checkpoint_version));
+    put_varint(s, levels.size());
+    const path* parent = nullptr;
+    for (const auto& l : levels) {
+        unsigned char flags = l.m_placeholder ? checkpoint_placeholder : 0;
+        const bool leaf = parent && l.m_path.parent_path() == *parent;
+        if (leaf) {
+            flags |= checkpoint_leaf;
+        }
+        s.push_back(static_cast<char>(flags));
+        put_varint(s, l.m_offset);
+        put_string(s, leaf ? l.m_path.filename().string() : l.m_path.string());
+        put_string(s, l.m_last);
+        parent = &l.m_path;
+    }
+    return s;
+}
+
+checkpoint_type decode_checkpoint(const std::string& s, error_code& ec) {
+    checkpoint_type levels;
+    checkpoint_reader r{s};
+    bool valid = s.compare(0, sizeof(checkpoint_magic), checkpoint_magic, sizeof(checkpoint_magic)) == 0;
+    if (valid) {
+        for (size_t i = 0; i < sizeof(checkpoint_magic); ++i) {
+            r.byte();
+        }
+        valid = r.byte() == checkpoint_version;
+    }
+    const auto count = valid ? r.varint() : 0;
+    for (std::uint64_t i = 0; valid && r.ok() && i < count; ++i) {
+        const auto flags = r.byte();
+        const auto offset = r.varint();
+        auto name = r.string();
+        auto last = r.string();
+        if (!r.ok() || name.empty() || ((flags & checkpoint_leaf) && levels.empty())) {
+            valid = false;
+            break;
+        }
+        path p{std::move(name)};
+        if (flags & checkpoint_leaf) {
+            p = levels.back().m_path / p;
+        }
+        levels.push_back(checkpoint_level{std::move(p), std::move(last), offset, 0 != (flags & checkpoint_placeholder)});
+    }
+    if (!valid || !r.ok() || !r.at_end()) {
+        ec = einval();
+        return {};
+    }
+    ec.clear();
+    return levels;
+}
+
+constexpr size_t sorted_dir::max_runs;
+constexpr size_t sorted_dir::release_divisor;
+
+sorted_dir::sorted_dir(size_t limit, const path& dir)
+    : m_items()
+    , m_next()
+    , m_bytes()
+    , m_limit(limit)
+    , m_dir(dir)
+    , m_runs()
+    , m_heap()
+    , m_popped()
+    , m_spilled()
+    , m_error()
+    , m_failed() {
+}
+
+sorted_dir::~sorted_dir() = default;
+
+void sorted_dir::fail(int err) {
+    m_error = err;
+    m_failed = true;
+    m_items.clear();
+    m_runs.clear();
+    m_heap.clear();
+}
+
+void sorted_dir::push_back(const native_dirent* e, size_t namelen) {
+    if (m_failed) {
+        return;
+    }
+    
+    // ASCII is never changed by normalization. A name that isn't UTF-8 sorts by its bytes and is rejected when read.
+    item_type item;
+#if !_WIN32
+    const auto name = e->d_name;
+    if (std::any_of(name, name + namelen, [](char c) { return (c & 0x80) != 0; }))
+#endif
+    {
+        PSSilenceCppException(item = path{path::string_type(e->d_name, namelen)}.u8string().str());
+    }
+    if (item.empty()) {
+        item.assign(reinterpret_cast<const char*>(e->d_name), namelen * sizeof(e->d_name[0]));
+    }
+    item.push_back('\0');
+#if !_WIN32
+    // Equal keys (the same name in different normal forms) are ordered by the raw name.
+    item.append(e->d_name, namelen);
+    item.push_back('\0');
+    item.append(reinterpret_cast<const char*>(e), offsetof(native_dirent, d_name));
+#else
+    item.append(reinterpret_cast<const char*>(e), sizeof(native_dirent));
+#endif
+    
+    m_bytes += sizeof(item_type) + item.size();
+    m_items.push_back(std::move(item));
+    if (m_bytes >= m_limit) {
+        spill();
+    }
+}
+
+bool sorted_dir::write_run(std::FILE* f) {
+    for (const auto& item : m_items) {
+        if (!write_item(f, item)) {
+            return false;
+        }
+    }
+    return 0 == std::fflush(f);
+}
+
+// std::tmpfile() always uses P_tmpdir, typically a tmpfs /tmp that competes with the sort buffer for memory.
+std::FILE* sorted_dir::open_run() {
+#if !_WIN32
+    if (m_dir.empty()) {
+        error_code ec;
+        m_dir = temp_directory_path(ec);
+        if (ec) {
+            errno = ec.value();
+            return nullptr;
+        }
+    }
+    int fd = -1;
+#if __linux__ && defined(O_TMPFILE)
+    fd = ::open(m_dir.c_str(), O_TMPFILE|O_RDWR|O_CLOEXEC, 0600);
+#endif
+    if (fd < 0) {
+        std::string name{(m_dir / path{".ps_sorted_XXXXXX"}).c_str()};
+        fd = ::mkstemp(&name[0]);
+        if (fd < 0) {
+            return nullptr;
+        }
+        ::unlink(name.c_str());
+        (void)::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    errno = 0;
+    if (auto f = ::fdopen(fd, "w+b")) {
+        return f;
+    }
+    const auto err = errno;
+    ::close(fd);
+    errno = err;
+    return nullptr;
+#else
+    return std::tmpfile();
+#endif
+}
+
+bool sorted_dir::spill() {
+    std::sort(m_items.begin(), m_items.end());
+    errno = 0;
+    unique_file f{open_run()};
+    if (!f || !write_run(f.get())) {
+        fail(file_error());
+        return false;
+    }
+    m_runs.push_back(run{std::move(f), item_type{}});
+    ++m_spilled;
+    m_items.clear(); // keeps the capacity for the next run
+    m_bytes = 0;
+    
+    // Bounds the files open and the merge width.
+    if (m_runs.size() >= max_runs && !(start_merge() && merge_runs())) {
+        fail(m_failed ? m_error : file_error());
+        return false;
+    }
+    return true;
+}
+
+// The items left in the runs are written to a single run, which then has to be started.
+bool sorted_dir::merge_runs() {
+    errno = 0;
+    unique_file merged{open_run()};
+    if (!merged) {
+        return false;
+    }
+    item_type item;
+    while (pop(item)) {
+        if (!write_item(merged.get(), item)) {
+            return false;
+        }
+    }
+    if (m_failed || 0 != std::fflush(merged.get())) {
+        return false;
+    }
+    m_runs.clear();
+    m_runs.push_back(run{std::move(merged), item_type{}});
+    return true;
+}
+
+bool sorted_dir::start_merge() {
+    m_heap.clear();
+    for (size_t i = 0; i < m_runs.size(); ++i) {
+        auto& r = m_runs[i];
+        std::rewind(r.m_file.get());
+        if (read_item(r.m_file.get(), r.m_current)) {
+            m_heap.push_back(i);
+        } else if (std::ferror(r.m_file.get())) {
+            return false;
+        }
+    }
+    std::make_heap(m_heap.begin(), m_heap.end(), [this](size_t l, size_t r) { return m_runs[l].m_current > m_runs[r].m_current; });
+    return true;
+}
+
+bool sorted_dir::pop(item_type& item) {
+    if (m_heap.empty()) {
+        return false;
+    }
+    const auto greater = [this](size_t l, size_t r) { return m_runs[l].m_current > m_runs[r].m_current; };
+    std::pop_heap(m_heap.begin(), m_heap.end(), greater);
+    auto& r = m_runs[m_heap.back()];
+    item.swap(r.m_current);
+    if (read_item(r.m_file.get(), r.m_current)) {
+        std::push_heap(m_heap.begin(), m_heap.end(), greater);
+    } else if (std::ferror(r.m_file.get())) {
+        fail(file_error());
+        return false;
+    } else {
+        m_heap.pop_back();
+    }
+    return true;
+}
+
+void sorted_dir::finish() {
+    if (m_failed) {
+        return;
+    }
+    if (m_runs.empty()) {
+        std::sort(m_items.begin(), m_items.end());
+    } else if ((m_items.empty() || spill()) && !start_merge()) {
+        fail(file_error());
+    } else {
+        std::vector<item_type>{}.swap(m_items);
+    }
+}
+
+void sorted_dir::release() {
+    if (m_failed) {
+        return;
+    }
+    if (m_runs.empty()) {
+        if (m_bytes <= m_limit / release_divisor) {
+            return;
+        }
+        if (m_next > 0) {
+            m_popped.swap(m_items[m_next - 1]); // last()
+            m_items.erase(m_items.begin(), m_items.begin() + static_cast<std::ptrdiff_t>(m_next));
+            m_next = 0;
+        }
+        if (!spill()) {
+            return;
+        }
+        std::vector<item_type>{}.swap(m_items);
+    } else if (m_runs.size() == 1) {
+        return;
+    } else if (!merge_runs()) {
+        fail(m_failed ? m_error : file_error());
+        return;
+    }
+    if (!start_merge()) {
+        fail(file_error());
+    }
+}
+
+const sorted_dir::item_type* sorted_dir::peek() const {
+    if (m_runs.empty()) {
+        return m_next < m_items.size() ? &m_items[m_next] : nullptr;
+    }
+    return !m_heap.empty() ? &m_runs[m_heap.front()].m_current : nullptr;
+}
+
+const sorted_dir::item_type* sorted_dir::last() const {
+    if (m_runs.empty()) {
+        return m_next > 0 ? &m_items[m_next - 1] : nullptr;
+    }
+    return !m_popped.empty() ? &m_popped : nullptr;
+}
+
+native_dirent* sorted_dir::read() {
+    const item_type* item = nullptr;
+    if (m_runs.empty()) {
+        if (m_next < m_items.size()) {
+            item = &m_items[m_next++];
+            m_bytes -= sizeof(item_type) + item->size();
+        }
+    } else if (pop(m_popped)) {
+        item = &m_popped;
+    }
+    
+    if (item) {
+        const auto keylen = key_length(*item);
+#if !_WIN32
+        constexpr size_t hdr = offsetof(native_dirent, d_name);
+        const size_t namelen = item->size() - hdr - keylen - 2;
+        std::memcpy(&m_cur, item->data() + item->size() - hdr, hdr);
+        std::memcpy(m_cur.d_name, item->data() + keylen + 1, namelen);
+        m_cur.d_name[namelen] = '\0';
+#else
+        std::memcpy(&m_cur, item->data() + keylen + 1, sizeof(native_dirent));
+#endif
+        errno = 0;
+        return &m_cur;
+    } else {
+        errno = m_error;
+#if _WIN32
+        ::SetLastError(m_error ? static_cast<DWORD>(m_error) : ERROR_NO_MORE_FILES);
+#endif
+        return nullptr;
+    }
+}
+
+std::string sorted_dir::last_key() const {
+    if (auto item = last()) {
+        return item->substr(0, key_length(*item));
+    }
+    return std::string{};
+}
+
+void sorted_dir::skip_through(const std::string& key) {
+    if (key.empty()) {
+        return;
+    }
+    while (auto item = peek()) {
+        if (item->compare(0, key_length(*item), key) > 0) {
+            break;
+        }
+        read();
+    }
+}
+
+ifilesystem::iterator_traits::serialize_type
+ifilesystem::iterator_traits::serialize(const basic_iterator<iterator_traits>& i) {
+    return serialize_iterator<iterator_traits>(i.m_i);
+}
+
+ifilesystem::recursive_iterator_traits::serialize_type
+ifilesystem::recursive_iterator_traits::serialize(const basic_iterator<recursive_iterator_traits>& i) {
+    return serialize_iterator<recursive_iterator_traits>(i.m_i);
+}
+
 ifilesystem::iterator_state_ptr
-ifilesystem::make_iterator_state(const path& p, directory_options opts, iterator_traits::configuration_type, error_code& ec) {
-    auto s = std::make_shared<state<dir_ops>>(p, opts, ec);
+ifilesystem::make_iterator_state(const path& p, directory_options opts, iterator_traits::configuration_type cfg, error_code& ec) {
+    iterator_state_ptr s;
+#if PS_FS_HAVE_GETDENTS64
+    if (cfg.bulk_read_size > 0) {
+        const auto sz = cfg.bulk_read_size;
+        s = std::make_shared<state<bulk_dir_ops>>(p, opts, bulk_dir_ops{sz}, std::move(cfg), ec);
+    } else
+#endif
+    {
+        s = std::make_shared<state<dir_ops>>(p, opts, dir_ops{}, std::move(cfg), ec);
+    }
     if (ec) {
         s.reset(); // null is the end iterator
     }
@@ -115,6 +729,68 @@ const error_code& ifilesystem::permission_denied_error() {
 
 constexpr file_size_type directory_entry::unknown_size;
 
+ifilesystem::name_filter::name_filter(const string_type& glob)
+    : m_pattern(glob)
+    , m_predicate()
+    , m_type(match_type::glob) {
+    if (glob.find_first_of(string_type{'?', '[', '\\'}) != string_type::npos) {
+        return;
+    }
+    const auto first = glob.find('*');
+    if (first == string_type::npos) {
+        m_type = match_type::exact;
+        return;
+    }
+    if (glob.find_first_not_of('*') == string_type::npos) {
+        m_type = match_type::any;
+        m_pattern.clear();
+        return;
+    }
+    const auto last = glob.rfind('*');
+    const auto end = glob.size() - 1;
+    if (first == last) {
+        if (first == end) {
+            m_type = match_type::prefix;
+            m_pattern.erase(first);
+        } else if (first == 0) {
+            m_type = match_type::suffix;
+            m_pattern.erase(0, 1);
+        }
+    } else if (first == 0 && last == end && glob.find('*', 1) == last) {
+        m_type = match_type::contains;
+        m_pattern = glob.substr(1, end - 1);
+    }
+}
+
+ifilesystem::name_filter::name_filter(predicate_type p)
+    : m_pattern()
+    , m_predicate(std::move(p))
+    , m_type(match_type::predicate) {
+    PSASSERT(m_predicate, "BUG");
+}
+
+bool ifilesystem::name_filter::operator()(const char_type* name, size_type len) const {
+    const auto plen = m_pattern.size();
+    switch (m_type) {
+        case match_type::exact:
+            return len == plen && std::equal(name, name + len, m_pattern.data());
+        case match_type::prefix:
+            return len >= plen && std::equal(m_pattern.data(), m_pattern.data() + plen, name);
+        case match_type::suffix:
+            return len >= plen && std::equal(m_pattern.data(), m_pattern.data() + plen, name + (len - plen));
+        case match_type::contains:
+            return std::search(name, name + len, m_pattern.data(), m_pattern.data() + plen) != name + len;
+        case match_type::any:
+            return true;
+        case match_type::glob:
+            return glob_match(m_pattern.data(), m_pattern.data() + plen, name, name + len);
+        case match_type::predicate:
+            return m_predicate && m_predicate(name, len);
+    }
+    PSASSERT_UNREACHABLE("WTF?");
+    return false;
+}
+
 void directory_entry::refresh() {
     error_code ec;
     refresh(ec);
@@ -128,11 +804,34 @@ void directory_entry::refresh(error_code& ec) {
         m_type = st.type();
         m_size = st.size();
         m_last_write = st.times().modified().time_since_epoch().count();
+        m_dev = 0; // fetched on demand
+        m_ino = 0;
     } else {
         clear_cache();
     }
 }
 
+file_id_type directory_entry::file_id() const {
+    error_code ec;
+    auto val = file_id(ec);
+    PS_THROW_IF(ec.value() != 0, filesystem_error("Failed to get file id.", m_path, ec));
+    return val;
+}
+
+file_id_type directory_entry::file_id(error_code& ec) const noexcept {
+    auto fid = cached_file_id();
+    if (fid.valid()) {
+        ec.clear();
+        return fid;
+    }
+    fid = symlink_file_id(m_path, ec);
+    if (!ec) {
+        m_dev = fid.device();
+        m_ino = fid.inode();
+    }
+    return fid;
+}
+
 } // v1
 } // filesystem
 } // prosoft
@@ -26,16 +26,35 @@
 #ifndef PS_CORE_ITERATOR_INTERNAL_HPP
 #define PS_CORE_ITERATOR_INTERNAL_HPP
 
+#include "fsconfig.h"   // PS_FS_HAVE_BSD_STATFS, PS_FS_HAVE_GETDENTS64, PS_FS_HAVE_DIRENT_OFFSET
+
 #if !_WIN32
 #include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if PS_FS_HAVE_GETDENTS64
+#include <sys/syscall.h>
+#endif
+#if PS_FS_HAVE_STATX
+#include <sys/sysmacros.h>
+#endif
 #else
 #include <windows.h>
 #endif
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_set>
 #include <vector>
 
 #include <prosoft/core/modules/filesystem/filesystem.hpp>
-#include "fsconfig.h"   // PS_FS_HAVE_BSD_STATFS
 #include "filesystem_private.hpp"       // einval()
 
 namespace prosoft {
@@ -202,6 +221,181 @@ inline native_dirent* read_dir(native_dir* d) {
     }
 }
 
+struct dir_delete {
+    void operator()(native_dir* d) noexcept {
+        (void)close_dir(d);
+    }
+};
+using unique_dir = std::unique_ptr<native_dir, dir_delete>;
+
+#if !_WIN32
+inline int dir_fd(native_dir* d) {
+    return ::dirfd(d);
+}
+
+// Opens a child of an open dir. Without follow, a leaf that was swapped for a symlink fails with ELOOP.
+inline int open_dir_fd_at(int dirfd, const char* leaf, bool follow) {
+    return ::openat(dirfd, leaf, O_RDONLY|O_DIRECTORY|O_CLOEXEC|(follow ? 0 : O_NOFOLLOW));
+}
+
+inline native_dir* open_dir_at(int dirfd, const char* leaf, bool follow) {
+    const int fd = open_dir_fd_at(dirfd, leaf, follow);
+    if (fd >= 0) {
+        if (auto d = ::fdopendir(fd)) {
+            return d;
+        }
+        const int err = errno;
+        ::close(fd);
+        errno = err;
+    }
+    return nullptr;
+}
+#endif // !_WIN32
+
+inline size_t name_length(const native_dirent* e) {
+#if PS_FS_HAVE_BSD_STATFS
+    return e->d_namlen;
+#elif !_WIN32
+    return ::strlen(e->d_name);
+#else
+    return ::wcslen(e->d_name);
+#endif
+}
+
+#if PS_FS_HAVE_GETDENTS64
+// Bulk reader: getdents64() fills a buffer with many linux_dirent64 records that are then walked in place.
+// The kernel record isn't exported by glibc, so it's defined here.
+struct linux_dirent64 {
+    std::uint64_t d_ino;
+    std::int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1]; // variable length, terminated
+};
+
+// True where dirent is dirent64 (64-bit ABIs, or 32-bit with _FILE_OFFSET_BITS=64), so records can be returned in place.
+// Otherwise each record is converted into a dirent.
+constexpr bool native_dirent_is_linux_dirent64 = sizeof(native_dirent::d_ino) == sizeof(linux_dirent64::d_ino)
+    && sizeof(native_dirent::d_off) == sizeof(linux_dirent64::d_off)
+    && offsetof(native_dirent, d_reclen) == offsetof(linux_dirent64, d_reclen)
+    && offsetof(native_dirent, d_type) == offsetof(linux_dirent64, d_type)
+    && offsetof(native_dirent, d_name) == offsetof(linux_dirent64, d_name);
+
+struct bulk_dir {
+    std::unique_ptr<char[]> m_buf;
+    size_t m_capacity;
+    size_t m_len;
+    size_t m_pos;
+    int m_fd;
+    native_dirent m_cur; // converted record if !native_dirent_is_linux_dirent64
+    
+    bulk_dir(int fd, size_t capacity)
+        : m_buf(new char[capacity])
+        , m_capacity(capacity)
+        , m_len()
+        , m_pos()
+        , m_fd(fd) {}
+    PS_DISABLE_COPY(bulk_dir);
+};
+
+// The kernel fails with EINVAL if a single record won't fit.
+constexpr size_t min_bulk_read_size = (offsetof(linux_dirent64, d_name) + 256) * 2;
+
+inline bulk_dir* make_bulk_dir(int fd, size_t bufsize) {
+    if (fd >= 0) {
+        PSIgnoreCppException(return new bulk_dir(fd, std::max(bufsize, min_bulk_read_size)));
+        ::close(fd);
+        errno = ENOMEM;
+    }
+    return nullptr;
+}
+
+inline bulk_dir* open_bulk_dir(const fs::path& p, size_t bufsize) {
+    return make_bulk_dir(::open(p.c_str(), O_RDONLY|O_DIRECTORY|O_CLOEXEC), bufsize);
+}
+
+inline bulk_dir* open_bulk_dir_at(int dirfd, const char* leaf, bool follow, size_t bufsize) {
+    return make_bulk_dir(open_dir_fd_at(dirfd, leaf, follow), bufsize);
+}
+
+inline int dir_fd(bulk_dir* d) {
+    return d->m_fd;
+}
+
+inline int close_bulk_dir(bulk_dir* d) {
+    if (d) {
+        const int err = ::close(d->m_fd);
+        delete d;
+        return err;
+    } else {
+        errno = einval().value();
+        return -1;
+    }
+}
+
+// Avoids a full strlen(): records are padded to an 8 byte boundary, so the terminator is within the last 8 bytes.
+// The padding itself is not guaranteed to be zeroed.
+template <class Record>
+inline size_t bulk_record_name_length(const Record* e) {
+    constexpr size_t align = 8;
+    const size_t reclen = e->d_reclen - offsetof(Record, d_name);
+    const size_t start = reclen > align ? reclen - align : 0;
+    if (auto term = static_cast<const char*>(std::memchr(e->d_name + start, '\0', reclen - start))) {
+        return static_cast<size_t>(term - e->d_name);
+    }
+    PSASSERT_UNREACHABLE("Unterminated record");
+    return ::strlen(e->d_name);
+}
+
+// d_reclen is set to the exact length so bulk_name_length() works on the converted record.
+inline native_dirent* convert_record(native_dirent& cur, const linux_dirent64* e) {
+    const size_t namelen = std::min(bulk_record_name_length(e), sizeof(cur.d_name) - 1);
+    cur.d_ino = static_cast<decltype(cur.d_ino)>(e->d_ino);
+    cur.d_off = static_cast<decltype(cur.d_off)>(e->d_off);
+    cur.d_type = e->d_type;
+    std::memcpy(cur.d_name, e->d_name, namelen);
+    cur.d_name[namelen] = '\0';
+    cur.d_reclen = static_cast<decltype(cur.d_reclen)>(offsetof(native_dirent, d_name) + namelen + 1);
+    return &cur;
+}
+
+inline native_dirent* read_bulk_dir(bulk_dir* d) {
+    if (d) {
+        errno = 0;
+        if (d->m_pos >= d->m_len) {
+            const auto n = ::syscall(SYS_getdents64, d->m_fd, d->m_buf.get(), d->m_capacity);
+            d->m_pos = 0;
+            if (n > 0) {
+                d->m_len = static_cast<size_t>(n);
+            } else {
+                d->m_len = 0;
+                return nullptr; // EOF or error (errno)
+            }
+        }
+        auto e = reinterpret_cast<linux_dirent64*>(d->m_buf.get() + d->m_pos);
+        d->m_pos += e->d_reclen;
+        if (native_dirent_is_linux_dirent64) {
+            return reinterpret_cast<native_dirent*>(e);
+        }
+        return convert_record(d->m_cur, e);
+    } else {
+        errno = einval().value();
+        return nullptr;
+    }
+}
+
+// Positions the dir after the record with this d_off.
+inline void seek_bulk_dir(bulk_dir* d, std::uint64_t off) {
+    ::lseek(d->m_fd, static_cast<off_t>(off), SEEK_SET);
+    d->m_len = 0;
+    d->m_pos = 0;
+}
+
+inline size_t bulk_name_length(const native_dirent* e) {
+    return bulk_record_name_length(e);
+}
+#endif // PS_FS_HAVE_GETDENTS64
+
 #if __APPLE__
 inline bool is_apple_double(const fs::path& dir, const fs::path& leaf) {
     static const fs::path::string_type dot_underscore_prefix{"._"};
@@ -263,25 +457,322 @@ inline bool leaf_is_dot_or_dot_dot(const fs::path& leaf) {
 
 extern native_dir* const INVALID_DIR;
 
+// The dir handle type is whatever Ops::open() returns (native_dir for the default ops).
+template <class Ops>
+using ops_dir_t = typename std::remove_pointer<decltype(std::declval<Ops&>().open(std::declval<const fs::path&>()))>::type;
+
+template <class Dir>
+inline Dir* invalid_dir() {
+    return reinterpret_cast<Dir*>(INVALID_DIR);
+}
+
+// Ops may provide a cheaper name_length(), otherwise the generic version is used.
+template <class Ops>
+inline auto name_length(const Ops& ops, const native_dirent* e, int) -> decltype(ops.name_length(e)) {
+    return ops.name_length(e);
+}
+
+template <class Ops>
+inline size_t name_length(const Ops&, const native_dirent* e, long) {
+    return name_length(e);
+}
+
+// Remaining entries of a dir that was closed early to stay within the open dir limit.
+class drained_dir {
+    std::vector<char> m_records;
+    size_t m_pos;
+    int m_error;
+    native_dirent m_cur;
+    
+    static size_t record_size(size_t namelen) {
+#if !_WIN32
+        constexpr size_t align = alignof(native_dirent);
+        const size_t sz = offsetof(native_dirent, d_name) + namelen + 1;
+        return std::min((sz + align - 1) & ~(align - 1), sizeof(native_dirent));
+#else
+        (void)namelen;
+        return sizeof(native_dirent);
+#endif
+    }
+    
+public:
+    drained_dir()
+        : m_records()
+        , m_pos()
+        , m_error() {}
+    PS_DISABLE_COPY(drained_dir);
+    
+    void push_back(const native_dirent* e, size_t namelen) {
+        const auto sz = record_size(namelen);
+        const auto off = m_records.size();
+        m_records.resize(off + sz);
+#if !_WIN32
+        // Only the used part of d_name is copied and d_reclen is rewritten to match.
+        native_dirent hdr;
+        std::memcpy(&hdr, e, offsetof(native_dirent, d_name));
+        hdr.d_reclen = static_cast<decltype(hdr.d_reclen)>(sz);
+        std::memcpy(&m_records[off], &hdr, offsetof(native_dirent, d_name));
+        std::memcpy(&m_records[off + offsetof(native_dirent, d_name)], e->d_name, namelen);
+#else
+        std::memcpy(&m_records[off], e, sz);
+#endif
+    }
+    
+    // The error that ended the original read, if any, is reported at the end.
+    void set_error(int err) noexcept {
+        m_error = err;
+    }
+    
+    native_dirent* read() {
+        if (m_pos < m_records.size()) {
+            const char* rec = &m_records[m_pos];
+#if !_WIN32
+            std::memcpy(&m_cur, rec, offsetof(native_dirent, d_name));
+            const size_t sz = m_cur.d_reclen;
+            std::memcpy(m_cur.d_name, rec + offsetof(native_dirent, d_name), sz - offsetof(native_dirent, d_name));
+#else
+            const size_t sz = sizeof(native_dirent);
+            std::memcpy(&m_cur, rec, sz);
+#endif
+            m_pos += sz;
+            errno = 0;
+            return &m_cur;
+        } else {
+            errno = m_error;
+#if _WIN32
+            ::SetLastError(m_error ? static_cast<DWORD>(m_error) : ERROR_NO_MORE_FILES);
+#endif
+            return nullptr;
+        }
+    }
+};
+
+// The entries of a dir in byte order of their normalized UTF-8 names (iterator_config::sorted).
+// Once the buffered items exceed the buffer size they're sorted and spilled to a temporary file as a run.
+// All runs are merged as the dir is read, at most max_runs at a time.
+// Runs are unnamed files in the spill dir, so nothing is left behind if the process dies.
+class sorted_dir {
+public:
+    using item_type = std::string; // key, '\0', [name, '\0',] entry header
+    static constexpr size_t max_runs = 64;
+    // release() spills the unread items once they exceed this fraction of the buffer.
+    static constexpr size_t release_divisor = 16;
+    
+private:
+    struct file_close {
+        void operator()(std::FILE* f) noexcept {
+            std::fclose(f);
+        }
+    };
+    using unique_file = std::unique_ptr<std::FILE, file_close>;
+    
+    struct run {
+        unique_file m_file;
+        item_type m_current;
+    };
+    
+    std::vector<item_type> m_items; // the run being filled, read in place if nothing was spilled
+    size_t m_next;
+    size_t m_bytes; // of m_items, only the unread ones once finished
+    size_t m_limit;
+    fs::path m_dir;
+    std::vector<run> m_runs;
+    std::vector<size_t> m_heap; // m_runs with an item, smallest current item first
+    item_type m_popped;
+    size_t m_spilled;
+    int m_error;
+    bool m_failed; // nothing is returned, only the error
+    native_dirent m_cur;
+    
+    void fail(int err);
+    bool spill();
+    bool write_run(std::FILE*);
+    std::FILE* open_run();
+    bool merge_runs();
+    bool start_merge();
+    bool pop(item_type&);
+    const item_type* peek() const;
+    const item_type* last() const;
+    
+public:
+    // An empty dir is temp_directory_path().
+    sorted_dir(size_t limit, const fs::path& dir);
+    ~sorted_dir();
+    PS_DISABLE_COPY(sorted_dir);
+    
+    void push_back(const native_dirent*, size_t namelen);
+    // Call once after the last entry.
+    void finish();
+    native_dirent* read();
+    
+    // The error that ended the original read, if any, is reported at the end.
+    void set_error(int err) noexcept {
+        m_error = err;
+    }
+    
+    // The key of the last entry read, empty at the start.
+    std::string last_key() const;
+    // Drops the entries up to and including key.
+    void skip_through(const std::string& key);
+    
+    // Call when a subdir is entered. The runs left are merged into one, or the unread items are spilled
+    // if they're over limit / release_divisor, so each ancestor holds at most one run or a small buffer.
+    void release();
+    
+    size_t spilled_runs() const noexcept {
+        return m_spilled;
+    }
+    
+    size_t open_runs() const noexcept {
+        return m_runs.size();
+    }
+};
+
+// Relative open: Ops may provide open_at(parent, leaf, follow), otherwise the full path is opened.
+template <class Ops, class Dir, class Char>
+inline auto open_at(Ops& ops, Dir* parent, const Char* leaf, bool follow, const fs::path&, int) -> decltype(ops.open_at(parent, leaf, follow)) {
+    return ops.open_at(parent, leaf, follow);
+}
+
+template <class Ops, class Dir, class Char>
+inline Dir* open_at(Ops& ops, Dir*, const Char*, bool, const fs::path& p, long) {
+    return ops.open(p);
+}
+
+#if !_WIN32
+// Ops may provide stat(dir, sb) on the open dir, otherwise the path is stat'ed.
+template <class Ops, class Dir>
+inline auto stat_dir(Ops& ops, Dir* d, const fs::path&, struct ::stat& sb, int) -> decltype(ops.stat(d, sb), bool()) {
+    return 0 == ops.stat(d, sb);
+}
+
+template <class Ops, class Dir>
+inline bool stat_dir(Ops&, Dir*, const fs::path& p, struct ::stat& sb, long) {
+    return 0 == ::stat(p.c_str(), &sb);
+}
+#endif
+
+// Ops may provide seek(dir, offset) to resume a dir at a d_off cookie, otherwise entries are read up to it.
+template <class Ops, class Dir>
+inline auto seek(Ops& ops, Dir* d, std::uint64_t off, int) -> decltype(ops.seek(d, off), bool()) {
+    ops.seek(d, off);
+    return true;
+}
+
+template <class Ops, class Dir>
+inline bool seek(Ops&, Dir*, std::uint64_t, long) {
+    return false;
+}
+
+// One level of a recursive iterator's position, see iterator_config::serialize_data.
+struct checkpoint_level {
+    fs::path m_path;
+    std::string m_last; // the raw name bytes of the last entry read when there is no offset, empty at the start
+    std::uint64_t m_offset; // d_off of the last entry read, 0 at the start
+    bool m_placeholder; // not opened (e.g. a mount point)
+};
+using checkpoint_type = std::vector<checkpoint_level>;
+
+std::string encode_checkpoint(const checkpoint_type&);
+checkpoint_type decode_checkpoint(const std::string&, fs::error_code&);
+
 template <class Ops>
 struct stack_entry {
-    native_dir* m_dir;
+    using dir_type = ops_dir_t<Ops>;
+    dir_type* m_dir; // null once drained
     fs::path m_path;
+    std::unique_ptr<drained_dir> m_drained;
+    std::unique_ptr<sorted_dir> m_sorted; // read instead of the dir
+#if !_WIN32
+    dev_t m_dev; // 0 if unknown
+#endif
+    // The resume cookie, updated as entries are read.
+#if PS_FS_HAVE_DIRENT_OFFSET
+    std::uint64_t m_offset;
+#else
+    std::string m_last; // raw name bytes
+#endif
+    
+    static dir_type* invalid() {
+        return invalid_dir<dir_type>();
+    }
     
-    stack_entry(native_dir* d, fs::path&& p) noexcept(std::is_nothrow_move_constructible<fs::path>::value)
+    stack_entry(dir_type* d, fs::path&& p) noexcept(std::is_nothrow_move_constructible<fs::path>::value)
         : m_dir(d)
-        , m_path(std::move(p)) {}
-    stack_entry(native_dir* d, const fs::path& p)
+        , m_path(std::move(p))
+        , m_drained()
+        , m_sorted()
+#if !_WIN32
+        , m_dev()
+#endif
+#if PS_FS_HAVE_DIRENT_OFFSET
+        , m_offset()
+#else
+        , m_last()
+#endif
+    {}
+    stack_entry(dir_type* d, const fs::path& p)
         : stack_entry(d, fs::path{p}) {}
     ~stack_entry() {
-        if (INVALID_DIR != m_dir) {
+        if (is_open()) {
             Ops{}.close(m_dir);
         }
     }
     stack_entry(stack_entry&& other) noexcept(std::is_nothrow_move_constructible<fs::path>::value)
         : m_dir(other.m_dir)
-        , m_path(std::move(other.m_path)) {
-        other.m_dir = INVALID_DIR;
+        , m_path(std::move(other.m_path))
+        , m_drained(std::move(other.m_drained))
+        , m_sorted(std::move(other.m_sorted))
+#if !_WIN32
+        , m_dev(other.m_dev)
+#endif
+#if PS_FS_HAVE_DIRENT_OFFSET
+        , m_offset(other.m_offset)
+#else
+        , m_last(std::move(other.m_last))
+#endif
+    {
+        other.m_dir = invalid();
+    }
+    
+    bool is_open() const noexcept {
+        return m_dir && invalid() != m_dir;
+    }
+    
+    void mark(const native_dirent* e, size_t namelen) {
+#if PS_FS_HAVE_DIRENT_OFFSET
+        (void)namelen;
+        m_offset = static_cast<std::uint64_t>(e->d_off);
+#else
+        m_last.assign(reinterpret_cast<const char*>(e->d_name), namelen * sizeof(e->d_name[0]));
+#endif
+    }
+    
+    bool at(const checkpoint_level& l) const {
+#if PS_FS_HAVE_DIRENT_OFFSET
+        return m_offset == l.m_offset;
+#else
+        return m_last == l.m_last;
+#endif
+    }
+    
+    checkpoint_level checkpoint() const {
+        if (m_sorted) {
+            return checkpoint_level{m_path, m_sorted->last_key(), 0, false};
+        }
+#if PS_FS_HAVE_DIRENT_OFFSET
+        return checkpoint_level{m_path, std::string{}, m_offset, invalid() == m_dir};
+#else
+        return checkpoint_level{m_path, m_last, 0, invalid() == m_dir};
+#endif
+    }
+    
+    void reset_mark() {
+#if PS_FS_HAVE_DIRENT_OFFSET
+        m_offset = 0;
+#else
+        m_last.clear();
+#endif
     }
     
     PS_DISABLE_COPY(stack_entry);
@@ -293,11 +784,58 @@ using fsiterator_cache = fs::ifilesystem::cache_info;
 template <class Ops> // Template used for testing
 class state : public fsiterator_state {
     using base = fsiterator_state;
-// XXX: each level of recursion adds another open file descriptor.
-// If this becomes an issue (thousands of subdirs), a solution would be to:
-// save subdirs as they are found, process all files, close parent and then recurse saved subdirs.
+// Each level of recursion adds another open dir. With iterator_config::max_open_dirs, outer dirs are drained
+// into memory and closed once the limit is reached, see reserve_open(). The runs of sorted dirs are counted too,
+// but a drained sorted dir keeps its run.
     using entry = stack_entry<Ops>;
+    using dir_type = typename entry::dir_type;
     std::vector<entry> m_stack;
+    fs::ifilesystem::iterator_config m_config;
+    size_t m_open;
+    size_t m_open_peak;
+    std::unordered_set<fs::file_id_type> m_visited; // iterator_config::skip_visited_directories
+    
+#if !_WIN32
+    // Drained dirs have no descriptor and fall back to the path.
+    bool stat_at(const entry& e, const native_dirent* ent, const fs::path& p, bool follow, struct ::stat& sb) const {
+        if (e.m_dir) {
+            return 0 == ::fstatat(dir_fd(e.m_dir), ent->d_name, &sb, follow ? 0 : AT_SYMLINK_NOFOLLOW);
+        } else {
+            return 0 == (follow ? ::stat(p.c_str(), &sb) : ::lstat(p.c_str(), &sb));
+        }
+    }
+#endif
+    
+    native_dirent* read(const entry& e) {
+        if (e.m_sorted) {
+            return e.m_sorted->read();
+        }
+        return e.m_dir ? m_ops.read(e.m_dir) : e.m_drained->read();
+    }
+    
+    void sort(entry&);
+    void release(const entry&);
+    void drain(entry&);
+    void add_open(size_t);
+    void reserve_open();
+    
+    void resume(const fs::path&, fs::error_code&);
+    void seek(entry&, const checkpoint_level&);
+    
+    enum class filter_result {
+        keep,
+        skip,
+        keep_if_directory, // not included, but the type is not known yet
+    };
+    filter_result filter(const native_dirent*, size_t namelen) const;
+    
+    bool entry_is_hidden(const entry&, const native_dirent*, const fs::path&, fs::error_code&) const;
+    bool entry_is_directory(const entry&, const native_dirent*, const fs::path&, fs::error_code&) const;
+    bool entry_is_mountpoint(const entry&, const native_dirent*, const fs::path&, fs::error_code&) const;
+    
+    bool follow_symlinks() const noexcept {
+        return is_set(options() & fs::directory_options::follow_directory_symlink);
+    }
     
 public:
     Ops m_ops;
@@ -306,13 +844,21 @@ public:
         return !is_set(options() & fs::directory_options::skip_subdirectory_descendants);
     }
     
+    bool relative() const noexcept {
+#if !_WIN32
+        return m_config.relative_traversal;
+#else
+        return false;
+#endif
+    }
+    
     size_t size() const {
         return m_stack.size();
     }
     
     bool is_valid() const {
         PSASSERT(m_stack.size() > 0, "Broken assumption");
-        return INVALID_DIR != m_stack.back().m_dir;
+        return entry::invalid() != m_stack.back().m_dir;
     }
     
     bool is_child() const {
@@ -324,22 +870,45 @@ public:
         return m_stack.back();
     }
     
-    const entry* peek_valid(); // there may not be a valid entry, hence the ptr
+    entry* peek_valid(); // there may not be a valid entry, hence the ptr
+    
+    bool push(dir_type*, fs::path&&, fs::error_code&);
     
-    bool push(fs::path&&, fs::error_code&);
+    bool push(fs::path&& p, fs::error_code& ec) {
+        return push(m_ops.open(p), std::move(p), ec);
+    }
     
     bool push(const fs::path& p, fs::error_code& ec) {
         return push(fs::path{p}, ec);
     }
     
+    // 'ent' is invalid once this returns: draining the parent reads past it and closes its dir.
+    bool push(const entry& parent, const native_dirent* ent, size_t namelen, fs::path&& p, fs::error_code& ec) {
+        if (relative()) {
+            // A dir symlink is only reached here if following is enabled. DT_UNKNOWN may be a link too.
+            const bool follow = follow_symlinks() && !is_directory(ent);
+            const fs::path::string_type leaf(ent->d_name, namelen);
+            release(parent);
+            reserve_open(); // may drain parent
+            if (parent.m_dir) {
+                return push(open_at(m_ops, parent.m_dir, leaf.c_str(), follow, p, 0), std::move(p), ec);
+            }
+        } else {
+            release(parent);
+            reserve_open();
+        }
+        return push(std::move(p), ec);
+    }
+    
     void push_placeholder(fs::path&& dir) {
-        m_stack.emplace_back(INVALID_DIR, std::move(dir));
+        m_stack.emplace_back(entry::invalid(), std::move(dir));
     }
 
 public:
     using fsiterator_state::fsiterator_state;
     
     state(const fs::path&, fs::directory_options, fs::error_code&);
+    state(const fs::path&, fs::directory_options, Ops&&, fs::ifilesystem::iterator_config&&, fs::error_code&);
     
     virtual ~state() {};
     
@@ -357,14 +926,16 @@ public:
     virtual void skip_descendants() override;
     
     virtual bool at_end() const override;
+    
+    virtual std::string checkpoint() const override;
 };
 
 
 template <class Ops>
-const typename state<Ops>::entry* state<Ops>::peek_valid() {
+typename state<Ops>::entry* state<Ops>::peek_valid() {
     if (size() > 0) {
-        const auto& e = m_stack.back();
-        if (INVALID_DIR != e.m_dir) {
+        auto& e = m_stack.back();
+        if (entry::invalid() != e.m_dir) {
             return &e;
         } else {
             pop();
@@ -376,10 +947,36 @@ const typename state<Ops>::entry* state<Ops>::peek_valid() {
 }
 
 template <class Ops>
-bool state<Ops>::push(fs::path&& p, fs::error_code& ec) {
-    if (auto d = m_ops.open(p)) {
+bool state<Ops>::push(dir_type* d, fs::path&& p, fs::error_code& ec) {
+    if (d) {
         set(fs::directory_options::reserved_state_will_recurse);
         m_stack.emplace_back(d, std::move(p));
+        add_open(1);
+#if !_WIN32
+        struct ::stat sb;
+        // m_dev stays 0 (unknown) only if both fail, mount points are then found by path.
+        const auto& dpath = m_stack.back().m_path;
+        if (stat_dir(m_ops, d, dpath, sb, 0) || 0 == ::stat(dpath.c_str(), &sb)) {
+            m_stack.back().m_dev = sb.st_dev;
+            if (m_config.skip_visited_directories
+                && !m_visited.emplace(fs::file_id_type::device_type(sb.st_dev), fs::file_id_type::inode_type(sb.st_ino)).second) {
+                // Already entered, most likely through a link. Following it again could loop forever.
+                fs::path visited{std::move(m_stack.back().m_path)}; // 'p' was moved into the entry
+                pop();
+                base::clear(fs::directory_options::reserved_state_will_recurse);
+                set(fs::directory_options::reserved_state_visited);
+                if (auto stats = m_config.statistics.get()) {
+                    ++stats->visited_dirs_skipped;
+                }
+                push_placeholder(std::move(visited));
+                ec.clear();
+                return true;
+            }
+        }
+#endif
+        if (m_config.sorted) {
+            sort(m_stack.back());
+        }
         ec.clear();
         return true;
     } else {
@@ -393,7 +990,17 @@ bool state<Ops>::push(fs::path&& p, fs::error_code& ec) {
 
 template <class Ops>
 state<Ops>::state(const fs::path& p, fs::directory_options opts, fs::error_code& ec)
-    : fsiterator_state(p, opts, ec) {
+    : state(p, opts, Ops{}, fs::ifilesystem::iterator_config{}, ec) {
+}
+
+template <class Ops>
+state<Ops>::state(const fs::path& p, fs::directory_options opts, Ops&& ops, fs::ifilesystem::iterator_config&& cfg, fs::error_code& ec)
+    : fsiterator_state(p, opts, ec)
+    , m_config(std::move(cfg))
+    , m_open()
+    , m_open_peak()
+    , m_visited()
+    , m_ops(std::move(ops)) {
 #if _WIN32
     // Empty path is valid in Win32 (implicit "."), but not POSIX. Use POSIX behavior for Windows.
     if (p.empty()) {
@@ -402,7 +1009,11 @@ state<Ops>::state(const fs::path& p, fs::directory_options opts, fs::error_code&
     }
 #endif
     if (!ec) {
-        push(p, ec);
+        if (m_config.serialize_data.empty()) {
+            push(p, ec);
+        } else {
+            resume(p, ec);
+        }
     }
 }
 
@@ -425,20 +1036,22 @@ fs::path state<Ops>::next(fsiterator_cache& cinfo, prosoft::system::error_code&
     while (auto e = peek_valid()) {
         PSASSERT(!e->m_path.empty(), "WTF?");
         for (;;) {
-            if (auto ent = m_ops.read(e->m_dir)) {
+            if (auto ent = read(*e)) {
 #if DT_WHT // BSD whiteout flag used for Union filesystems -- should never be hit in the realworld
                 if (DT_WHT == ent->d_type) {
                     continue;
                 }
 #endif
-                size_t namelen;
-                #if PS_FS_HAVE_BSD_STATFS
-                namelen = ent->d_namlen;
-                #elif !_WIN32
-                namelen = ::strlen(ent->d_name);
-                #else
-                namelen = ::wcslen(ent->d_name);
-                #endif
+                const size_t namelen = name_length(m_ops, ent, 0);
+                e->mark(ent, namelen);
+                
+                auto filtered = filter_result::keep;
+                if (!m_config.exclude.empty() || !m_config.include.empty()) {
+                    filtered = filter(ent, namelen);
+                    if (filtered == filter_result::skip) {
+                        continue;
+                    }
+                }
                 
                 fs::path leaf;
                 PSSilenceCppException(leaf = fs::path(fs::path::string_type(ent->d_name, namelen)));
@@ -460,22 +1073,31 @@ fs::path state<Ops>::next(fsiterator_cache& cinfo, prosoft::system::error_code&
                 cpath /= leaf;
                 
                 fs::error_code derr;
-                if (is_set(options() & fs::directory_options::skip_hidden_descendants) && is_hidden(cpath, derr)) {
+                if (is_set(options() & fs::directory_options::skip_hidden_descendants) && entry_is_hidden(*e, ent, cpath, derr)) {
                     continue;
                 }
                 
-                if (recurse()
-                    && (is_directory(ent)
-                        || (is_set(options() & fs::directory_options::follow_directory_symlink) && is_symlink(ent) && is_directory(cpath, derr)))
-                    ) {
-                    if ((!is_set(options() & fs::directory_options::follow_mountpoints) && is_mountpoint(cpath, derr))
+#if !_WIN32
+                const auto fid = e->m_dev != 0 ? fs::file_id_type{fs::file_id_type::device_type(e->m_dev), fs::file_id_type::inode_type(ent->d_ino)} : fs::file_id_type{};
+#endif
+                const bool included = filtered == filter_result::keep;
+                const bool isdir = (recurse() || !included) && entry_is_directory(*e, ent, cpath, derr);
+                if (!included && !isdir) {
+                    continue;
+                }
+                
+                if (recurse() && isdir) {
+                    if ((!is_set(options() & fs::directory_options::follow_mountpoints) && entry_is_mountpoint(*e, ent, cpath, derr))
                         || (is_set(options() & fs::directory_options::skip_package_content_descendants) && is_package(cpath, derr))
                     ) {
                         // push a placeholder so clients can call skipDescendants() w/o unexpected results.
                         push_placeholder(fs::path{cpath});
                     } else {
-                        static auto copy_link_path = [](const fs::path& p, native_dirent* e) -> fs::path {
-                            if (is_symlink(e)) {
+                        // Copied before the push, which may drain the dir 'ent' points into.
+                        cache_info(cinfo, ent);
+                        const bool islink = is_symlink(ent);
+                        static auto copy_link_path = [](const fs::path& p, bool islink) -> fs::path {
+                            if (islink) {
                                 fs::error_code ec;
                                 auto np = fs::canonical(p, ec);
                                 if (!np.empty()) {
@@ -485,14 +1107,25 @@ fs::path state<Ops>::next(fsiterator_cache& cinfo, prosoft::system::error_code&
                             return p;
                         };
                         
-                        if (!push(copy_link_path(cpath, ent), ec)) {
-                            PSASSERT(peek_unsafe().m_path == copy_link_path(cpath, ent), "Broken assumption"); // assuming placeholder is pushed
+                        // A link is opened as is when tracking visited dirs or by fd in relative mode, and its descendants keep the link's path.
+                        // Resolving it would cost the full path walk that relative mode avoids.
+                        const bool keep_link_path = m_config.skip_visited_directories || relative();
+                        auto dpath = keep_link_path ? fs::path{cpath} : copy_link_path(cpath, islink);
+                        if (!push(*e, ent, namelen, std::move(dpath), ec)) {
+                            PSASSERT(keep_link_path || peek_unsafe().m_path == copy_link_path(cpath, islink), "Broken assumption"); // assuming placeholder is pushed
                             // Fallthrough to return entry, even though there was an open error
                         }
+#if !_WIN32
+                        cinfo.fid = fid; // 'e' and 'ent' may be invalid after a push
+#endif
+                        return cpath;
                     }
                 }
                 
                 cache_info(cinfo, ent);
+#if !_WIN32
+                cinfo.fid = fid;
+#endif
                 return cpath;
             } else {
                 // we've read all entries in the current dir
@@ -522,9 +1155,205 @@ fs::path state<Ops>::next(fsiterator_cache& cinfo, prosoft::system::error_code&
     return fs::path{};
 }
 
+template <class Ops>
+typename state<Ops>::filter_result state<Ops>::filter(const native_dirent* ent, size_t namelen) const {
+    const auto name = ent->d_name;
+    for (const auto& f : m_config.exclude) {
+        if (f(name, namelen)) {
+            return filter_result::skip;
+        }
+    }
+    if (m_config.include.empty() || is_directory(ent)) {
+        return filter_result::keep;
+    }
+    for (const auto& f : m_config.include) {
+        if (f(name, namelen)) {
+            return filter_result::keep;
+        }
+    }
+#if !_WIN32
+    if (DT_UNKNOWN == ent->d_type) {
+        return filter_result::keep_if_directory;
+    }
+#endif
+    return (follow_symlinks() && is_symlink(ent)) ? filter_result::keep_if_directory : filter_result::skip;
+}
+
+template <class Ops>
+bool state<Ops>::entry_is_hidden(const entry& e, const native_dirent* ent, const fs::path& p, fs::error_code& ec) const {
+#if PS_FS_HAVE_BSD_STATFS
+    if (relative()) {
+        struct ::stat sb;
+        ec.clear();
+        return ent->d_name[0] == fs::path::dot || (stat_at(e, ent, p, false, sb) && UF_HIDDEN == (sb.st_flags & UF_HIDDEN));
+    }
+#else
+    (void)e;
+    (void)ent;
+#endif
+    return is_hidden(p, ec); // name only on Linux
+}
+
+template <class Ops>
+bool state<Ops>::entry_is_directory(const entry& e, const native_dirent* ent, const fs::path& p, fs::error_code& ec) const {
+    if (is_directory(ent)) {
+        return true;
+    }
+#if !_WIN32
+    if (relative()) {
+        // Unlike path mode, DT_UNKNOWN (some network and older filesystems) is resolved too.
+        if ((follow_symlinks() && is_symlink(ent)) || DT_UNKNOWN == ent->d_type) {
+            struct ::stat sb;
+            if (stat_at(e, ent, p, follow_symlinks(), sb)) {
+                ec.clear();
+                return S_ISDIR(sb.st_mode);
+            }
+            prosoft::system::system_error(ec);
+        }
+        return false;
+    }
+#else
+    (void)e;
+#endif
+    return follow_symlinks() && is_symlink(ent) && is_directory(p, ec);
+}
+
+template <class Ops>
+bool state<Ops>::entry_is_mountpoint(const entry& e, const native_dirent* ent, const fs::path& p, fs::error_code& ec) const {
+#if !_WIN32 && !__APPLE__ // Apple mount triggers require the path.
+    // A child on the same device as its parent is not a mount point. This avoids a mount table lookup per dir.
+    if (0 == e.m_dev) {
+        return is_mountpoint(p, ec);
+    }
+    dev_t dev = 0;
+#if PS_FS_HAVE_STATX && defined(STATX_ATTR_MOUNT_ROOT)
+    // Linux 5.8+ also flags a bind mount on the same device, for the cost of the stat.
+    if (relative() && e.m_dir) {
+        struct ::statx sx;
+        if (0 == ::statx(dir_fd(e.m_dir), ent->d_name, follow_symlinks() ? 0 : AT_SYMLINK_NOFOLLOW, STATX_TYPE, &sx)) {
+            ec.clear();
+            if ((sx.stx_attributes_mask & STATX_ATTR_MOUNT_ROOT)) {
+                return (sx.stx_attributes & STATX_ATTR_MOUNT_ROOT) != 0;
+            }
+            dev = makedev(sx.stx_dev_major, sx.stx_dev_minor);
+        }
+    }
+#endif
+    if (0 == dev) {
+        struct ::stat sb;
+        if (!(relative() ? stat_at(e, ent, p, follow_symlinks(), sb) : 0 == (follow_symlinks() ? ::stat(p.c_str(), &sb) : ::lstat(p.c_str(), &sb)))) {
+            prosoft::system::system_error(ec);
+            return false;
+        }
+        ec.clear();
+        dev = sb.st_dev;
+    }
+    if (dev == e.m_dev) {
+        return false;
+    }
+    // A btrfs subvolume has its own device too, so a change is confirmed with the mount root flag or the mount table.
+    return is_mountpoint(p, ec);
+#else
+    (void)e;
+    (void)ent;
+    return is_mountpoint(p, ec);
+#endif
+}
+
+template <class Ops>
+void state<Ops>::sort(entry& e) {
+    PSASSERT(e.is_open(), "BUG");
+    const auto limit = m_config.sort_buffer_size > 0 ? m_config.sort_buffer_size : fs::ifilesystem::iterator_config::default_sort_buffer_size();
+    e.m_sorted.reset(new sorted_dir(limit, m_config.sort_directory));
+    while (auto ent = m_ops.read(e.m_dir)) {
+        e.m_sorted->push_back(ent, name_length(m_ops, ent, 0));
+    }
+    fs::error_code ec;
+    prosoft::system::system_error(ec);
+    if (!is_no_entries(ec)) {
+        e.m_sorted->set_error(ec.value());
+    }
+    e.m_sorted->finish();
+    add_open(e.m_sorted->open_runs());
+    if (auto stats = m_config.statistics.get()) {
+        stats->sorted_runs_spilled += e.m_sorted->spilled_runs();
+    }
+    // The dir stays open for relative opens and stats.
+}
+
+template <class Ops>
+void state<Ops>::release(const entry& e) {
+    if (e.m_sorted) {
+        const auto runs = e.m_sorted->open_runs();
+        const auto spilled = e.m_sorted->spilled_runs();
+        e.m_sorted->release();
+        m_open = m_open - runs + e.m_sorted->open_runs();
+        if (auto stats = m_config.statistics.get()) {
+            stats->sorted_runs_spilled += e.m_sorted->spilled_runs() - spilled;
+        }
+    }
+}
+
+// Open dirs and the runs of sorted dirs.
+template <class Ops>
+void state<Ops>::add_open(size_t n) {
+    m_open += n;
+    if (m_open > m_open_peak) {
+        m_open_peak = m_open;
+        if (auto stats = m_config.statistics.get()) {
+            stats->open_dirs_peak = std::max(stats->open_dirs_peak, m_open_peak);
+        }
+    }
+}
+
+template <class Ops>
+void state<Ops>::drain(entry& e) {
+    PSASSERT(e.is_open(), "BUG");
+    if (!e.m_sorted) { // otherwise already read in full
+        e.m_drained.reset(new drained_dir);
+        while (auto ent = m_ops.read(e.m_dir)) {
+            e.m_drained->push_back(ent, name_length(m_ops, ent, 0));
+        }
+        fs::error_code ec;
+        prosoft::system::system_error(ec);
+        if (!is_no_entries(ec)) {
+            e.m_drained->set_error(ec.value());
+        }
+    }
+    Ops{}.close(e.m_dir);
+    e.m_dir = nullptr;
+    --m_open;
+    if (auto stats = m_config.statistics.get()) {
+        ++stats->drained_dirs;
+    }
+}
+
+template <class Ops>
+void state<Ops>::reserve_open() {
+    const auto limit = m_config.max_open_dirs;
+    if (limit > 0 && m_open >= limit) {
+        // The outermost open dir will be resumed last.
+        for (auto& e : m_stack) {
+            if (e.is_open()) {
+                drain(e);
+                if (m_open < limit) {
+                    break;
+                }
+            }
+        }
+    }
+}
+
 template <class Ops>
 void state<Ops>::pop() {
     if (size() > 0) {
+        const auto& e = m_stack.back();
+        if (e.is_open()) {
+            --m_open;
+        }
+        if (e.m_sorted) {
+            m_open -= e.m_sorted->open_runs();
+        }
         m_stack.pop_back();
     } else {
         PSASSERT_UNREACHABLE("BUG");
@@ -560,6 +1389,80 @@ bool state<Ops>::at_end() const {
     return size() == 0;
 }
 
+template <class Ops>
+std::string state<Ops>::checkpoint() const {
+    checkpoint_type levels;
+    levels.reserve(m_stack.size());
+    for (const auto& e : m_stack) {
+        levels.emplace_back(e.checkpoint());
+    }
+    return encode_checkpoint(levels);
+}
+
+// Each level is opened by path and positioned after its last entry read. Skipping is O(1) with offsets
+// and at most one pass over the dir with names.
+template <class Ops>
+void state<Ops>::resume(const fs::path& p, fs::error_code& ec) {
+    auto levels = decode_checkpoint(m_config.serialize_data, ec);
+    if (ec) {
+        return;
+    }
+    if (levels.empty() || levels.front().m_path != p || levels.front().m_placeholder) {
+        ec = einval();
+        return;
+    }
+    
+    for (auto& l : levels) {
+        if (l.m_placeholder) {
+            push_placeholder(fs::path{l.m_path});
+            continue;
+        }
+        fs::error_code lec;
+        if (!push(fs::path{l.m_path}, lec) && size() == 1) {
+            ec = lec;
+            return;
+        }
+        // A dir that can no longer be opened is a placeholder, as it would be in a new iteration.
+        auto& e = m_stack.back();
+        if (e.is_open()) {
+            seek(e, l);
+        }
+    }
+    base::clear(fs::directory_options::reserved_state_mask);
+}
+
+template <class Ops>
+void state<Ops>::seek(entry& e, const checkpoint_level& l) {
+    if (e.m_sorted) {
+        e.m_sorted->skip_through(l.m_last);
+        return;
+    }
+    if (e.at(l)) {
+        return; // the start
+    }
+#if PS_FS_HAVE_DIRENT_OFFSET
+    if (prosoft::filesystem::v1::seek(m_ops, e.m_dir, l.m_offset, 0)) {
+        e.m_offset = l.m_offset;
+        return;
+    }
+#endif
+    while (auto ent = m_ops.read(e.m_dir)) {
+        e.mark(ent, name_length(m_ops, ent, 0));
+        if (e.at(l)) {
+            return;
+        }
+    }
+    
+    // The last entry is gone, so the dir is listed again. Entries may be repeated, but none are lost.
+    Ops{}.close(e.m_dir);
+    e.reset_mark();
+    e.m_dir = m_ops.open(e.m_path);
+    if (!e.m_dir) {
+        e.m_dir = entry::invalid();
+        --m_open;
+    }
+}
+
 } // namespace v1
 } // namespace filesystem
 } // namespace prosoft
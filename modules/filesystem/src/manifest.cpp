@@ -0,0 +1,802 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <prosoft/core/config/config.h>
+#include "fsconfig.h"
+
+#if !_WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <windows.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include <prosoft/core/modules/filesystem/filesystem_manifest.hpp>
+#include "filesystem_private.hpp"
+#include "hash_internal.hpp"
+#include "manifest_internal.hpp"
+
+// Layout
+//   header: magic, u32 version, u32 block entries, u8 digest algorithm, u8 digest size, u16 reserved, u32 root size, root (UTF-8)
+//   blocks: u32 count, u32 names size, columns (u64 size, i64 modified ns, i64 metadata modified ns, u64 device, u64 inode,
+//           u32 perms, u16 depth, u8 type, u8 flags, digests), names (varint shared prefix, varint suffix size, suffix)
+//   index: u64 offset of each block
+//   footer: u64 entries, u64 blocks, u64 index offset, u64 flags, magic
+// The header and every block start on an 8 byte boundary. Names are front-coded within a block, so blocks decode independently.
+
+namespace {
+
+using namespace prosoft::filesystem;
+
+constexpr char header_magic[8] = {'P', 'S', 'M', 'A', 'N', 'F', 'S', 'T'};
+constexpr char footer_magic[8] = {'P', 'S', 'M', 'A', 'N', 'E', 'N', 'D'};
+constexpr std::uint32_t manifest_version = 1;
+constexpr std::size_t header_size = 24;
+constexpr std::size_t footer_size = 40;
+constexpr std::size_t block_header_size = 8;
+constexpr std::size_t fixed_entry_size = 5 * 8 + 4 + 2 + 1 + 1;
+constexpr std::size_t depth_column_offset = 5 * 8 + 4; // per entry of the block
+constexpr std::uint8_t flag_digest = 0x1; // entry
+constexpr std::uint64_t flag_sorted = 0x1; // footer
+constexpr std::int64_t invalid_time = std::numeric_limits<std::int64_t>::min();
+constexpr iterator_depth_type max_depth = std::numeric_limits<std::uint16_t>::max();
+
+template <typename T>
+void put(std::vector<std::uint8_t>& v, T val) {
+    using U = typename std::make_unsigned<T>::type;
+    const auto u = static_cast<U>(val);
+    for (std::size_t i = 0; i < sizeof(T); ++i) {
+        v.push_back(static_cast<std::uint8_t>(u >> (i * 8)));
+    }
+}
+
+template <typename T>
+T get(const std::uint8_t* p) noexcept {
+    using U = typename std::make_unsigned<T>::type;
+    U u = 0;
+    for (std::size_t i = 0; i < sizeof(T); ++i) {
+        u |= static_cast<U>(U(p[i]) << (i * 8));
+    }
+    return static_cast<T>(u);
+}
+
+void put_varint(std::vector<std::uint8_t>& v, std::uint64_t n) {
+    for (; n >= 0x80; n >>= 7) {
+        v.push_back(static_cast<std::uint8_t>(n | 0x80));
+    }
+    v.push_back(static_cast<std::uint8_t>(n));
+}
+
+bool get_varint(const std::uint8_t*& p, const std::uint8_t* end, std::uint64_t& n) noexcept {
+    n = 0;
+    for (unsigned shift = 0; p != end && shift < 64; shift += 7) {
+        const auto b = *p++;
+        n |= std::uint64_t(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void pad(std::vector<std::uint8_t>& v) {
+    v.resize(v.size() + (8 - v.size() % 8) % 8);
+}
+
+std::int64_t to_ns(const file_time_type& t) {
+    using namespace std::chrono;
+    return t == times::make_invalid() ? invalid_time : duration_cast<nanoseconds>(t.time_since_epoch()).count();
+}
+
+file_time_type from_ns(std::int64_t ns) {
+    using namespace std::chrono;
+    return ns == invalid_time ? times::make_invalid() : file_time_type{duration_cast<file_time_type::duration>(nanoseconds{ns})};
+}
+
+std::size_t digest_size(hash_algorithm a) {
+    return ifilesystem::hasher{a}.finish().size();
+}
+
+} // anon
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+class ifilesystem::manifest_block {
+    std::vector<std::uint64_t> m_size;
+    std::vector<std::int64_t> m_modified;
+    std::vector<std::int64_t> m_metadata_modified;
+    std::vector<std::uint64_t> m_device;
+    std::vector<std::uint64_t> m_inode;
+    std::vector<std::uint32_t> m_perms;
+    std::vector<std::uint16_t> m_depth;
+    std::vector<std::uint8_t> m_type;
+    std::vector<std::uint8_t> m_flags;
+    std::vector<std::uint8_t> m_digests;
+    std::vector<std::uint8_t> m_names;
+    std::string m_last_name;
+    
+public:
+    manifest_block() = default;
+    PS_DISABLE_COPY(manifest_block);
+    
+    std::size_t size() const noexcept {
+        return m_size.size();
+    }
+    
+    // Returns the UTF-8 name.
+    const std::string& add(const manifest_record& r, std::size_t digest_size) {
+        m_size.push_back(r.size);
+        m_modified.push_back(to_ns(r.modified));
+        m_metadata_modified.push_back(to_ns(r.metadata_modified));
+        m_device.push_back(r.id.device());
+        m_inode.push_back(r.id.inode());
+        m_perms.push_back(static_cast<std::uint32_t>(r.permissions));
+        m_depth.push_back(static_cast<std::uint16_t>(r.depth));
+        m_type.push_back(static_cast<std::uint8_t>(r.type));
+        const bool has_digest = digest_size > 0 && !r.digest.empty();
+        m_flags.push_back(has_digest ? flag_digest : 0);
+        if (digest_size > 0) {
+            const auto first = m_digests.size();
+            m_digests.resize(first + digest_size);
+            if (has_digest) {
+                std::memcpy(&m_digests[first], r.digest.data(), digest_size);
+            }
+        }
+        
+        const auto name = r.name.u8string().str();
+        const auto n = std::min(name.size(), m_last_name.size());
+        const auto shared = static_cast<std::size_t>(std::mismatch(name.begin(), name.begin() + n, m_last_name.begin()).first - name.begin());
+        put_varint(m_names, shared);
+        put_varint(m_names, name.size() - shared);
+        m_names.insert(m_names.end(), name.begin() + shared, name.end());
+        m_last_name = name;
+        return m_last_name;
+    }
+    
+    void serialize(std::vector<std::uint8_t>& out) const {
+        out.clear();
+        put(out, static_cast<std::uint32_t>(size()));
+        put(out, static_cast<std::uint32_t>(m_names.size()));
+        for (auto v : m_size) {
+            put(out, v);
+        }
+        for (auto v : m_modified) {
+            put(out, v);
+        }
+        for (auto v : m_metadata_modified) {
+            put(out, v);
+        }
+        for (auto v : m_device) {
+            put(out, v);
+        }
+        for (auto v : m_inode) {
+            put(out, v);
+        }
+        for (auto v : m_perms) {
+            put(out, v);
+        }
+        for (auto v : m_depth) {
+            put(out, v);
+        }
+        out.insert(out.end(), m_type.begin(), m_type.end());
+        out.insert(out.end(), m_flags.begin(), m_flags.end());
+        out.insert(out.end(), m_digests.begin(), m_digests.end());
+        out.insert(out.end(), m_names.begin(), m_names.end());
+        pad(out);
+    }
+    
+    void clear() noexcept {
+        m_size.clear();
+        m_modified.clear();
+        m_metadata_modified.clear();
+        m_device.clear();
+        m_inode.clear();
+        m_perms.clear();
+        m_depth.clear();
+        m_type.clear();
+        m_flags.clear();
+        m_digests.clear();
+        m_names.clear();
+        m_last_name.clear();
+    }
+};
+
+manifest_writer::manifest_writer(const path& file, const path& root, const manifest_config& cfg)
+    : m_file(file)
+    , m_cfg(cfg)
+    , m_block(new ifilesystem::manifest_block)
+    , m_index()
+    , m_offset()
+    , m_entries()
+    , m_siblings()
+    , m_sorted(true) {
+    error_code ec;
+    open(root, ec);
+    PS_THROW_IF(ec.value() != 0, filesystem_error("Could not create manifest", file, ec));
+}
+
+manifest_writer::manifest_writer(const path& file, const path& root, const manifest_config& cfg, error_code& ec)
+    : m_file(file, publish_options::none, ec)
+    , m_cfg(cfg)
+    , m_block(new ifilesystem::manifest_block)
+    , m_index()
+    , m_offset()
+    , m_entries()
+    , m_siblings()
+    , m_sorted(true) {
+    if (!ec) {
+        open(root, ec);
+    }
+}
+
+manifest_writer::manifest_writer(manifest_writer&&) noexcept = default;
+manifest_writer& manifest_writer::operator=(manifest_writer&&) noexcept = default;
+manifest_writer::~manifest_writer() = default;
+
+void manifest_writer::open(const path& root, error_code& ec) {
+    if (m_cfg.block_entries == 0) {
+        ec = einval();
+        return;
+    }
+    const auto r = root.u8string().str();
+    const bool digests = is_set(m_cfg.options & manifest_options::digests);
+    std::vector<std::uint8_t> h{std::begin(header_magic), std::end(header_magic)};
+    put(h, manifest_version);
+    put(h, m_cfg.block_entries);
+    h.push_back(static_cast<std::uint8_t>(m_cfg.hash.algorithm));
+    h.push_back(static_cast<std::uint8_t>(digests ? digest_size(m_cfg.hash.algorithm) : 0));
+    put(h, std::uint16_t{0});
+    put(h, static_cast<std::uint32_t>(r.size()));
+    h.insert(h.end(), r.begin(), r.end());
+    pad(h);
+    m_file.write(h.data(), h.size(), ec);
+    m_offset = h.size();
+}
+
+void manifest_writer::append(const manifest_record& r) {
+    error_code ec;
+    append(r, ec);
+    PS_THROW_IF(ec.value() != 0, filesystem_error("Could not append to manifest", r.name, ec));
+}
+
+void manifest_writer::append(const manifest_record& r, error_code& ec) {
+    const bool digests = is_set(m_cfg.options & manifest_options::digests);
+    if (!m_file.is_open() || r.name.empty() || r.depth < 0 || std::size_t(r.depth) > m_siblings.size() || r.depth > max_depth
+        || (digests && !r.digest.empty() && r.digest.algorithm() != m_cfg.hash.algorithm)) {
+        ec = einval();
+        return;
+    }
+    ec.clear();
+    const auto key = m_block->add(r, digests ? digest_size(m_cfg.hash.algorithm) : 0);
+    m_siblings.resize(static_cast<std::size_t>(r.depth) + 1);
+    auto& last = m_siblings.back();
+    if (m_sorted && !last.empty() && !(last < key)) {
+        m_sorted = false;
+    }
+    last = key;
+    ++m_entries;
+    if (m_block->size() == m_cfg.block_entries) {
+        flush(ec);
+    }
+}
+
+void manifest_writer::append(const recursive_directory_iterator& i) {
+    error_code ec;
+    append(i, ec);
+    PS_THROW_IF(ec.value() != 0, filesystem_error("Could not append to manifest", i->path(), ec));
+}
+
+void manifest_writer::append(const recursive_directory_iterator& i, error_code& ec) {
+    if (i.is_postorder()) {
+        ec.clear();
+        return;
+    }
+    append(*i, i.depth(), ec);
+}
+
+void manifest_writer::append(const directory_entry& e, iterator_depth_type depth) {
+    error_code ec;
+    append(e, depth, ec);
+    PS_THROW_IF(ec.value() != 0, filesystem_error("Could not append to manifest", e.path(), ec));
+}
+
+void manifest_writer::append(const directory_entry& e, iterator_depth_type depth, error_code& ec) {
+    manifest_record r;
+    ifilesystem::make_record(e, depth, r, ec);
+    if (ec) {
+        return;
+    }
+    if (is_set(m_cfg.options & manifest_options::digests) && r.type == file_type::regular) {
+        r.digest = hash_file(e.path(), m_cfg.hash, ec);
+        if (ec) {
+            return;
+        }
+    }
+    append(r, ec);
+}
+
+void manifest_writer::append_tree(const path& dir, directory_options opts) {
+    error_code ec;
+    append_tree(dir, opts, ec);
+    PS_THROW_IF(ec.value() != 0, filesystem_error("Could not append to manifest", dir, ec));
+}
+
+void manifest_writer::append_tree(const path& dir, directory_options opts, error_code& ec) {
+    // Sorted iteration spills very large dirs to disk instead of holding every sibling.
+    // Mount points are crossed and links aren't followed, as with a listing of each dir.
+    ifilesystem::iterator_config cfg;
+    cfg.sorted = true;
+    opts = (opts & directory_options::skip_permission_denied) | directory_options::follow_mountpoints;
+    for (recursive_directory_iterator i{dir, opts, std::move(cfg), ec}; !ec && i != end(i); i.increment(ec)) {
+        append(*i, i.depth(), ec);
+        if (ec == std::errc::no_such_file_or_directory) {
+            ec.clear(); // removed while walking
+        }
+    }
+}
+
+void ifilesystem::sorted_children(const path& dir, std::vector<sorted_entry>& out, error_code& ec) {
+    out.clear();
+    for (directory_iterator i{dir, ec}; !ec && i != end(i); i.increment(ec)) {
+        out.push_back(sorted_entry{i->path().filename().u8string().str(), *i});
+    }
+    if (ec) {
+        out.clear();
+        return;
+    }
+    std::sort(out.begin(), out.end(), [](const sorted_entry& l, const sorted_entry& r) { return l.key < r.key; });
+}
+
+void ifilesystem::make_record(const directory_entry& e, iterator_depth_type depth, manifest_record& r, error_code& ec) {
+    const auto st = symlink_status(e.path(), status_info::perms|status_info::times|status_info::size, ec);
+    if (ec) {
+        return;
+    }
+    r.name = e.path().filename();
+    r.depth = depth;
+    r.type = st.type();
+    r.permissions = st.permissions();
+    r.size = st.size();
+    r.modified = st.times().modified();
+    r.metadata_modified = st.times().metadata_modified();
+    r.digest = file_digest{};
+    r.id = e.file_id(ec);
+}
+
+void manifest_writer::flush(error_code& ec) {
+    if (m_block->size() == 0) {
+        return;
+    }
+    std::vector<std::uint8_t> buf;
+    m_block->serialize(buf);
+    m_block->clear();
+    m_file.write(buf.data(), buf.size(), ec);
+    if (!ec) {
+        m_index.push_back(m_offset);
+        m_offset += buf.size();
+    }
+}
+
+void manifest_writer::commit() {
+    error_code ec;
+    commit(ec);
+    PS_THROW_IF(ec.value() != 0, filesystem_error("Could not commit manifest", m_file.target(), ec));
+}
+
+void manifest_writer::commit(error_code& ec) {
+    if (!m_file.is_open()) {
+        ec = einval();
+        return;
+    }
+    flush(ec);
+    if (ec) {
+        return;
+    }
+    std::vector<std::uint8_t> tail;
+    for (auto off : m_index) {
+        put(tail, off);
+    }
+    put(tail, m_entries);
+    put(tail, static_cast<std::uint64_t>(m_index.size()));
+    put(tail, m_offset);
+    put(tail, m_sorted ? flag_sorted : std::uint64_t{0});
+    tail.insert(tail.end(), std::begin(footer_magic), std::end(footer_magic));
+    m_file.write(tail.data(), tail.size(), ec);
+    if (!ec) {
+        m_file.commit(ec);
+    }
+}
+
+manifest::manifest() noexcept
+    : m_data(nullptr)
+    , m_size()
+    , m_file()
+    , m_root()
+    , m_entries()
+    , m_blocks()
+    , m_index()
+    , m_block_entries()
+    , m_digest_size()
+    , m_digest_algorithm()
+    , m_sorted() {}
+
+manifest::manifest(const path& p)
+    : manifest() {
+    error_code ec;
+    open(p, ec);
+    PS_THROW_IF(ec.value() != 0, filesystem_error("Could not open manifest", p, ec));
+}
+
+manifest::manifest(const path& p, error_code& ec)
+    : manifest() {
+    open(p, ec);
+}
+
+manifest::manifest(manifest&& other) noexcept
+    : manifest() {
+    *this = std::move(other);
+}
+
+manifest& manifest::operator=(manifest&& other) noexcept {
+    if (this != &other) {
+        close();
+        m_data = other.m_data;
+        m_size = other.m_size;
+        m_file = std::move(other.m_file);
+        m_root = std::move(other.m_root);
+        m_entries = other.m_entries;
+        m_blocks = other.m_blocks;
+        m_index = other.m_index;
+        m_block_entries = other.m_block_entries;
+        m_digest_size = other.m_digest_size;
+        m_digest_algorithm = other.m_digest_algorithm;
+        m_sorted = other.m_sorted;
+        other.m_data = nullptr;
+        other.m_size = 0;
+        other.m_entries = 0;
+    }
+    return *this;
+}
+
+manifest::~manifest() {
+    close();
+}
+
+#if !_WIN32
+
+void manifest::open(const path& p, error_code& ec) {
+    ifilesystem::unique_fd fd{::open(p.c_str(), O_RDONLY|O_CLOEXEC)};
+    struct stat sb;
+    if (!fd || 0 != ::fstat(fd.get(), &sb)) {
+        ifilesystem::system_error(ec);
+        return;
+    }
+    if (static_cast<std::uint64_t>(sb.st_size) < header_size + footer_size) {
+        ec = einval();
+        return;
+    }
+    const auto size = static_cast<std::size_t>(sb.st_size);
+    auto m = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd.get(), 0);
+    if (m == MAP_FAILED) {
+        ifilesystem::system_error(ec);
+        return;
+    }
+    (void)::madvise(m, size, MADV_SEQUENTIAL);
+    m_data = static_cast<const std::uint8_t*>(m);
+    m_size = size;
+    m_file = p;
+    parse(ec);
+}
+
+void manifest::close() noexcept {
+    if (m_data) {
+        (void)::munmap(const_cast<std::uint8_t*>(m_data), m_size);
+        m_data = nullptr;
+        m_size = 0;
+        m_entries = 0;
+    }
+}
+
+#else // _WIN32
+
+void manifest::open(const path& p, error_code& ec) {
+    auto h = ifilesystem::open(p, GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, ec);
+    if (ec) {
+        return;
+    }
+    LARGE_INTEGER sz;
+    if (!::GetFileSizeEx(h.get(), &sz)) {
+        ifilesystem::system_error(ec);
+        return;
+    }
+    if (static_cast<std::uint64_t>(sz.QuadPart) < header_size + footer_size) {
+        ec = einval();
+        return;
+    }
+    auto mapping = ::CreateFileMappingW(h.get(), nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        ifilesystem::system_error(ec);
+        return;
+    }
+    auto view = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0); // keeps the mapping open
+    if (!view) {
+        ifilesystem::system_error(ec);
+    }
+    ::CloseHandle(mapping);
+    if (ec) {
+        return;
+    }
+    m_data = static_cast<const std::uint8_t*>(view);
+    m_size = static_cast<std::size_t>(sz.QuadPart);
+    m_file = p;
+    parse(ec);
+}
+
+void manifest::close() noexcept {
+    if (m_data) {
+        ::UnmapViewOfFile(m_data);
+        m_data = nullptr;
+        m_size = 0;
+        m_entries = 0;
+    }
+}
+
+#endif // _WIN32
+
+void manifest::parse(error_code& ec) {
+    const auto d = m_data;
+    const auto footer = d + m_size - footer_size;
+    m_block_entries = get<std::uint32_t>(d + 12);
+    m_digest_algorithm = static_cast<hash_algorithm>(d[16]);
+    m_digest_size = d[17];
+    const auto root_size = get<std::uint32_t>(d + 20);
+    m_entries = get<std::uint64_t>(footer);
+    m_blocks = get<std::uint64_t>(footer + 8);
+    m_index = get<std::uint64_t>(footer + 16);
+    m_sorted = (get<std::uint64_t>(footer + 24) & flag_sorted) != 0;
+    
+    const auto data_size = m_size - footer_size;
+    const bool valid = 0 == std::memcmp(d, header_magic, sizeof(header_magic))
+        && 0 == std::memcmp(footer + 32, footer_magic, sizeof(footer_magic))
+        && get<std::uint32_t>(d + 8) == manifest_version
+        && m_block_entries > 0
+        && m_digest_size <= file_digest::max_size
+        && root_size <= data_size - header_size
+        && m_index >= header_size + root_size
+        && m_index <= data_size
+        && m_blocks == (data_size - m_index) / 8
+        && (data_size - m_index) % 8 == 0
+        && m_entries <= m_blocks * m_block_entries
+        && (m_blocks == 0 || m_entries > (m_blocks - 1) * m_block_entries);
+    if (!valid) {
+        ec = einval();
+        close();
+        return;
+    }
+    m_root = root_size > 0 ? path{prosoft::u8string{std::string{reinterpret_cast<const char*>(d + header_size), root_size}}} : path{};
+    ec.clear();
+}
+
+manifest_iterator::manifest_iterator() noexcept
+    : m_manifest(nullptr)
+    , m_next()
+    , m_block_index()
+    , m_block(nullptr)
+    , m_names(nullptr)
+    , m_names_end(nullptr)
+    , m_block_count()
+    , m_block_pos()
+    , m_name()
+    , m_parents()
+    , m_record()
+    , m_entry() {}
+
+manifest_iterator::manifest_iterator(const manifest& m)
+    : manifest_iterator() {
+    error_code ec;
+    m_manifest = &m;
+    read(ec);
+    PS_THROW_IF(ec.value() != 0, filesystem_error("Invalid manifest", m.m_file, ec));
+}
+
+manifest_iterator::manifest_iterator(const manifest& m, error_code& ec)
+    : manifest_iterator() {
+    m_manifest = &m;
+    read(ec);
+}
+
+manifest_iterator& manifest_iterator::operator++() {
+    const auto file = m_manifest ? m_manifest->m_file : path{};
+    error_code ec;
+    increment(ec);
+    PS_THROW_IF(ec.value() != 0, filesystem_error("Invalid manifest", file, ec));
+    return *this;
+}
+
+manifest_iterator& manifest_iterator::increment(error_code& ec) {
+    if (m_manifest) {
+        read(ec);
+    } else {
+        ec.clear();
+    }
+    return *this;
+}
+
+manifest_iterator& manifest_iterator::skip_descendants() {
+    const auto file = m_manifest ? m_manifest->m_file : path{};
+    error_code ec;
+    skip_descendants(ec);
+    PS_THROW_IF(ec.value() != 0, filesystem_error("Invalid manifest", file, ec));
+    return *this;
+}
+
+manifest_iterator& manifest_iterator::skip_descendants(error_code& ec) {
+    ec.clear();
+    if (!m_manifest) {
+        return *this;
+    }
+    const auto& m = *m_manifest;
+    const auto depth = m_record.depth;
+    while (m_next < m.m_entries) {
+        if (m_block_pos == m_block_count) {
+            load_block(ec);
+            if (ec) {
+                *this = manifest_iterator{};
+                return *this;
+            }
+        }
+        const auto depths = m_block + block_header_size + std::size_t{m_block_count} * depth_column_offset;
+        auto pos = m_block_pos;
+        while (pos < m_block_count && get<std::uint16_t>(depths + pos * 2) > depth) {
+            ++pos;
+        }
+        if (pos == m_block_count) { // the names of a skipped block aren't needed
+            m_next += pos - m_block_pos;
+            m_block_pos = pos;
+            continue;
+        }
+        for (; m_block_pos < pos; ++m_block_pos, ++m_next) {
+            if (!read_name()) {
+                ec = einval();
+                *this = manifest_iterator{};
+                return *this;
+            }
+        }
+        break;
+    }
+    read(ec);
+    return *this;
+}
+
+void manifest_iterator::load_block(error_code& ec) {
+    const auto& m = *m_manifest;
+    const auto index = m.m_data + m.m_index;
+    const auto off = get<std::uint64_t>(index + m_block_index * 8);
+    const auto limit = m_block_index + 1 < m.m_blocks ? get<std::uint64_t>(index + (m_block_index + 1) * 8) : m.m_index;
+    if (off < header_size || off > limit || limit - off < block_header_size) {
+        ec = einval();
+        return;
+    }
+    m_block = m.m_data + off;
+    m_block_count = get<std::uint32_t>(m_block);
+    const auto names_size = get<std::uint32_t>(m_block + 4);
+    const auto expected = std::min<std::uint64_t>(m.m_block_entries, m.m_entries - m_block_index * m.m_block_entries);
+    const auto fixed = std::uint64_t{m_block_count} * (fixed_entry_size + m.m_digest_size);
+    if (m_block_count != expected || block_header_size + fixed + names_size > limit - off) {
+        ec = einval();
+        return;
+    }
+    m_names = m_block + block_header_size + fixed;
+    m_names_end = m_names + names_size;
+    m_block_pos = 0;
+    m_name.clear();
+    ++m_block_index;
+}
+
+// Applies the next front-coded name to m_name.
+bool manifest_iterator::read_name() {
+    std::uint64_t shared, suffix;
+    if (!get_varint(m_names, m_names_end, shared) || !get_varint(m_names, m_names_end, suffix)
+        || shared > m_name.size() || suffix > std::uint64_t(m_names_end - m_names)) {
+        return false;
+    }
+    m_name.resize(static_cast<std::size_t>(shared));
+    m_name.append(reinterpret_cast<const char*>(m_names), static_cast<std::size_t>(suffix));
+    m_names += suffix;
+    return true;
+}
+
+void manifest_iterator::read(error_code& ec) {
+    ec.clear();
+    if (m_next == m_manifest->m_entries) {
+        *this = manifest_iterator{};
+        return;
+    }
+    if (m_block_pos == m_block_count) {
+        load_block(ec);
+        if (ec) {
+            *this = manifest_iterator{};
+            return;
+        }
+    }
+    
+    const auto& m = *m_manifest;
+    const std::size_t i = m_block_pos;
+    const std::size_t n = m_block_count;
+    const auto* col = m_block + block_header_size;
+    auto& r = m_record;
+    r.size = get<std::uint64_t>(col + i * 8);
+    col += n * 8;
+    r.modified = from_ns(get<std::int64_t>(col + i * 8));
+    col += n * 8;
+    r.metadata_modified = from_ns(get<std::int64_t>(col + i * 8));
+    col += n * 8;
+    const auto dev = get<std::uint64_t>(col + i * 8);
+    col += n * 8;
+    r.id = file_id_type{dev, get<std::uint64_t>(col + i * 8)};
+    col += n * 8;
+    r.permissions = static_cast<perms>(get<std::uint32_t>(col + i * 4));
+    col += n * 4;
+    r.depth = get<std::uint16_t>(col + i * 2);
+    col += n * 2;
+    r.type = static_cast<file_type>(col[i]);
+    col += n;
+    const auto flags = col[i];
+    col += n;
+    r.digest = m.m_digest_size > 0 && (flags & flag_digest) ? file_digest{m.m_digest_algorithm, col + i * m.m_digest_size, m.m_digest_size} : file_digest{};
+    
+    if (!read_name() || std::size_t(r.depth) > m_parents.size()) {
+        ec = einval();
+        *this = manifest_iterator{};
+        return;
+    }
+    r.name = path{prosoft::u8string{m_name}};
+    
+    m_parents.resize(static_cast<std::size_t>(r.depth));
+    m_parents.push_back((r.depth > 0 ? m_parents.back() : m.m_root) / r.name);
+    
+    m_entry = directory_entry{path{m_parents.back()}};
+    ifilesystem::cache_info ci;
+    ci.ftype = r.type;
+    ci.fid = r.id;
+    ci.fsize = r.size;
+    ci.fwrite_time = r.modified;
+    ci.apply(m_entry);
+    
+    ++m_block_pos;
+    ++m_next;
+}
+
+} // v1
+} // filesystem
+} // prosoft
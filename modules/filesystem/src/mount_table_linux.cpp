@@ -0,0 +1,190 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <prosoft/core/config/config.h>
+#include "fsconfig.h"
+
+#if PS_FS_HAVE_MOUNTINFO
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
+
+#include "mount_table_linux_internal.hpp"
+#include "filesystem_private.hpp"
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+namespace ifilesystem {
+
+namespace {
+
+const char* next_field(const char* s, const char* end) {
+    s = static_cast<const char*>(std::memchr(s, ' ', size_t(end - s)));
+    return s ? s + 1 : nullptr;
+}
+
+} // anon
+
+mount_table::mount_table()
+    : m_fd(::open("/proc/self/mountinfo", O_RDONLY|O_CLOEXEC)) {
+    if (valid()) {
+        load();
+    }
+}
+
+mount_table::~mount_table() {
+    if (valid()) {
+        (void)::close(m_fd);
+    }
+}
+
+mount_table& mount_table::shared() {
+    static mount_table table;
+    return table;
+}
+
+path mount_table::mount_path(dev_t dev, error_code& ec) {
+    std::lock_guard<std::mutex> lg{m_lock};
+    if (changed()) {
+        load();
+    }
+    if (auto dir = find(dev)) {
+        ec.clear();
+        return path{*dir};
+    }
+    error(ENOENT, ec);
+    return {};
+}
+
+bool mount_table::parse(const char* line, size_t len, mount& m) {
+    // 36 35 98:0 /mnt1 /mnt2 rw,noatime master:1 - ext3 /dev/root rw,errors=continue
+    // (1)(2)(3)   (4)   (5)      (6)      (7)   (8) (9)   (10)         (11)
+    const auto end = line + len;
+    auto field = line;
+    for (int i = 0; i < 2 && field; ++i) {
+        field = next_field(field, end);
+    }
+    if (!field) {
+        return false;
+    }
+    char* last;
+    const auto major = std::strtoul(field, &last, 10);
+    if (last == field || last >= end || *last != ':') {
+        return false;
+    }
+    field = last + 1;
+    const auto minor = std::strtoul(field, &last, 10);
+    if (last == field) {
+        return false;
+    }
+    field = next_field(last, end); // root
+    const auto dir = field ? next_field(field, end) : nullptr;
+    if (!dir || dir >= end) {
+        return false;
+    }
+    const auto dir_end = static_cast<const char*>(std::memchr(dir, ' ', size_t(end - dir)));
+    m.device = makedev(major, minor);
+    m.dir = unescape(dir, size_t((dir_end ? dir_end : end) - dir));
+    return !m.dir.empty();
+}
+
+std::string mount_table::unescape(const char* s, size_t len) {
+    // The kernel escapes space, tab, newline and backslash as 3 digit octal (e.g. "\040").
+    std::string r;
+    r.reserve(len);
+    const auto octal = [](char c) { return c >= '0' && c <= '7'; };
+    for (size_t i = 0; i < len; ++i) {
+        if (s[i] == '\\' && i + 3 < len && octal(s[i+1]) && octal(s[i+2]) && octal(s[i+3])) {
+            r.push_back(char(((s[i+1] - '0') << 6) | ((s[i+2] - '0') << 3) | (s[i+3] - '0')));
+            i += 3;
+            continue;
+        }
+        r.push_back(s[i]);
+    }
+    return r;
+}
+
+bool mount_table::changed() const noexcept {
+    PSASSERT(valid(), "BUG");
+    struct ::pollfd pfd{m_fd, POLLPRI, 0};
+    return ::poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLPRI|POLLERR));
+}
+
+void mount_table::load() {
+    // Polling above consumed the event, so any change that races the read below will be flagged again.
+    std::string buf;
+    if (::lseek(m_fd, 0, SEEK_SET) == 0) {
+        char chunk[16 * 1024];
+        ssize_t n;
+        while ((n = ::read(m_fd, chunk, sizeof(chunk))) > 0) {
+            buf.append(chunk, size_t(n));
+        }
+    }
+
+    m_mounts.clear();
+    m_devices.clear();
+    mount m;
+    for (size_t pos = 0; pos < buf.size();) {
+        auto eol = buf.find('\n', pos);
+        if (eol == std::string::npos) {
+            eol = buf.size();
+        }
+        if (parse(buf.data() + pos, eol - pos, m)) {
+            m_devices.emplace(m.device, m_mounts.size()); // first mount of a device wins, like /proc/mounts order
+            m_mounts.push_back(std::move(m));
+        }
+        pos = eol + 1;
+    }
+}
+
+const std::string* mount_table::find(dev_t dev) {
+    auto i = m_devices.find(dev);
+    if (i != m_devices.end()) {
+        return &m_mounts[i->second].dir;
+    }
+    // Some filesystems (e.g. btrfs subvolumes) report a different st_dev than mountinfo. Match the hard way and remember the result.
+    struct ::stat sb;
+    for (size_t mi = 0; mi < m_mounts.size(); ++mi) {
+        if (0 == ::stat(m_mounts[mi].dir.c_str(), &sb) && dev == sb.st_dev) {
+            m_devices.emplace(dev, mi);
+            return &m_mounts[mi].dir;
+        }
+    }
+    return nullptr;
+}
+
+} // ifilesystem
+} // v1
+} // filesystem
+} // prosoft
+
+#endif // PS_FS_HAVE_MOUNTINFO
@@ -0,0 +1,86 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef PS_CORE_MOUNT_TABLE_LINUX_INTERNAL_HPP
+#define PS_CORE_MOUNT_TABLE_LINUX_INTERNAL_HPP
+
+#include <sys/types.h>
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+namespace ifilesystem {
+
+// Caches /proc/self/mountinfo keyed by st_dev. The kernel flags the file with POLLPRI when the mount namespace changes,
+// so a refresh costs a single non-blocking poll in the common case instead of re-reading and stat'ing every mount.
+class mount_table {
+public:
+    struct mount {
+        dev_t device;
+        std::string dir;
+    };
+
+    mount_table();
+    ~mount_table();
+    PS_DISABLE_COPY(mount_table);
+    PS_DISABLE_MOVE(mount_table);
+
+    static mount_table& shared();
+
+    // Empty with ENOENT if no mount matches the device.
+    path mount_path(dev_t, error_code&);
+
+    bool valid() const noexcept {
+        return m_fd >= 0;
+    }
+
+    // Parses a single mountinfo line.
+    static bool parse(const char* line, size_t len, mount&);
+    static std::string unescape(const char* s, size_t len);
+
+private:
+    bool changed() const noexcept;
+    void load();
+    const std::string* find(dev_t);
+
+    std::mutex m_lock;
+    std::vector<mount> m_mounts; // mountinfo order (parents before children)
+    std::unordered_map<dev_t, size_t> m_devices;
+    int m_fd;
+};
+
+} // ifilesystem
+} // v1
+} // filesystem
+} // prosoft
+
+#endif // PS_CORE_MOUNT_TABLE_LINUX_INTERNAL_HPP
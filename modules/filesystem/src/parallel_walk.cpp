@@ -0,0 +1,385 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <atomic>
+#include <exception>
+
+#include <prosoft/core/modules/filesystem/filesystem_parallel_walk.hpp>
+#include "iterator_internal.hpp"
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+// Each worker owns a deque of directories. New subdirs are pushed to the back and popped from the back (depth first)
+// to keep the working set small, idle workers steal from the front of other deques (the largest remaining subtrees).
+class ifilesystem::walker {
+    struct work {
+        path dir;
+        iterator_depth_type depth;
+    };
+    
+    struct work_queue {
+        std::mutex lock;
+        std::deque<work> items;
+    };
+    
+    const directory_options m_opts;
+    const walk_config::count_type m_batch_size;
+    const walk_visitor& m_visitor;
+    std::vector<work_queue> m_queues;
+    std::atomic<size_t> m_pending; // queued + in progress
+    std::atomic<size_t> m_queued;
+    std::atomic<size_t> m_idle;
+    std::atomic<bool> m_stop;
+    std::mutex m_idle_lock;
+    std::condition_variable m_idle_cond;
+    std::mutex m_error_lock;
+    std::exception_ptr m_exception;
+    
+    bool option(directory_options o) const noexcept {
+        return is_set(m_opts & o);
+    }
+    
+    void push(size_t self, work&& w) {
+        ++m_pending;
+        {
+            std::lock_guard<std::mutex> l{m_queues[self].lock};
+            m_queues[self].items.push_back(std::move(w));
+        }
+        ++m_queued;
+        // An idle worker checks m_queued under the idle lock, so taking it here means the wakeup can't be missed.
+        if (m_idle > 0) {
+            std::lock_guard<std::mutex> l{m_idle_lock};
+            m_idle_cond.notify_one();
+        }
+    }
+    
+    void notify_all() {
+        std::lock_guard<std::mutex> l{m_idle_lock};
+        m_idle_cond.notify_all();
+    }
+    
+    void stop() {
+        m_stop = true;
+        notify_all();
+    }
+    
+    bool pop(size_t self, work& w) {
+        auto& q = m_queues[self];
+        std::lock_guard<std::mutex> l{q.lock};
+        if (!q.items.empty()) {
+            w = std::move(q.items.back());
+            q.items.pop_back();
+            --m_queued;
+            return true;
+        }
+        return false;
+    }
+    
+    bool steal(size_t self, work& w) {
+        const auto n = m_queues.size();
+        for (size_t i = 1; i < n; ++i) {
+            auto& q = m_queues[(self + i) % n];
+            std::lock_guard<std::mutex> l{q.lock};
+            if (!q.items.empty()) {
+                w = std::move(q.items.front());
+                q.items.pop_front();
+                --m_queued;
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    void done() {
+        if (--m_pending == 0) {
+            notify_all();
+        }
+    }
+    
+    void wait() {
+        ++m_idle;
+        std::unique_lock<std::mutex> l{m_idle_lock};
+        m_idle_cond.wait(l, [this]{ return m_queued > 0 || m_pending == 0 || m_stop; });
+        --m_idle;
+    }
+    
+    void deliver(size_t self, walk_batch& b) {
+        m_visitor(b);
+        if (b.m_stop) {
+            stop();
+        }
+        for (size_t i = 0; i < b.m_subdirs.size() && !m_stop; ++i) {
+            if (b.m_subdirs[i].recurse) {
+                push(self, work{std::move(b.m_subdir_paths[i]), b.m_depth + 1});
+            }
+        }
+        b.clear();
+    }
+    
+    bool descend(const native_dirent*, const path&);
+    void process(size_t, work&);
+    void run(size_t);
+    
+public:
+    walker(directory_options opts, const walk_config& cfg, const walk_visitor& v)
+        : m_opts(opts)
+        , m_batch_size(std::max(cfg.batch_size, walk_config::count_type{1}))
+        , m_visitor(v)
+        , m_queues(std::max<walk_config::count_type>(cfg.threads > 0 ? cfg.threads : std::thread::hardware_concurrency(), 1))
+        , m_pending()
+        , m_queued()
+        , m_idle()
+        , m_stop() {}
+    PS_DISABLE_COPY(walker);
+    
+    void walk(const path&, error_code&);
+};
+
+bool ifilesystem::walker::descend(const native_dirent* ent, const path& p) {
+    if (option(directory_options::skip_subdirectory_descendants)) {
+        return false;
+    }
+    error_code ec;
+    if (is_directory(ent) || (option(directory_options::follow_directory_symlink) && is_symlink(ent) && is_directory(p, ec))) {
+        return !((!option(directory_options::follow_mountpoints) && is_mountpoint(p, ec))
+            || (option(directory_options::skip_package_content_descendants) && is_package(p, ec)));
+    }
+    return false;
+}
+
+void ifilesystem::walker::process(size_t self, work& w) {
+    walk_batch b{w.dir, w.depth};
+    unique_dir d{open_dir(w.dir)};
+    if (!d) {
+        prosoft::system::system_error(b.m_error);
+        if (!(option(directory_options::skip_permission_denied) && is_permssion_denied(b.m_error))) {
+            deliver(self, b);
+        }
+        return;
+    }
+#if !_WIN32
+    struct ::stat sb;
+    const auto dev = 0 == ::fstat(dir_fd(d.get()), &sb) ? sb.st_dev : dev_t{};
+#endif
+    
+    while (auto ent = read_dir(d.get())) {
+#if DT_WHT
+        if (DT_WHT == ent->d_type) {
+            continue;
+        }
+#endif
+        path leaf;
+        PSSilenceCppException(leaf = path(path::string_type(ent->d_name, name_length(ent))));
+        if (leaf.empty()) {
+            b.m_error = error_code{static_cast<int>(iterator_error::encoding_is_not_utf8), iterator_category()};
+            continue;
+        }
+        if (leaf_is_dot_or_dot_dot(leaf)) {
+            continue;
+        }
+        if (!option(directory_options::include_apple_double_files) && is_apple_double(w.dir, leaf)) {
+            continue;
+        }
+        
+        auto cpath = w.dir / leaf;
+        error_code ec;
+        if (option(directory_options::skip_hidden_descendants) && is_hidden(cpath, ec)) {
+            continue;
+        }
+        
+        const bool recurse = descend(ent, cpath);
+        fsiterator_cache cinfo;
+        filesystem::cache_info(cinfo, ent); // not ifilesystem::cache_info
+#if !_WIN32
+        if (dev != 0) {
+            cinfo.fid = file_id_type{file_id_type::device_type(dev), file_id_type::inode_type(ent->d_ino)};
+        }
+#endif
+        // Same as the iterator, descendants of a link use the real path.
+        path target;
+        if (recurse && is_symlink(ent)) {
+            target = canonical(cpath, ec);
+        }
+        directory_entry de{std::move(cpath)};
+        cinfo.apply(de);
+        b.add(std::move(de), recurse, std::move(target));
+        
+        if (b.m_entries.size() >= m_batch_size) {
+            deliver(self, b);
+            if (m_stop) {
+                return;
+            }
+        }
+    }
+    
+    error_code ec;
+    prosoft::system::system_error(ec);
+    if (ec && !is_no_entries(ec)) {
+        b.m_error = ec;
+    }
+    if (!b.m_entries.empty() || b.m_error) {
+        deliver(self, b);
+    }
+}
+
+void ifilesystem::walker::run(size_t self) {
+    work w;
+    while (!m_stop && m_pending > 0) {
+        if (pop(self, w) || steal(self, w)) {
+            try {
+                process(self, w);
+            } catch (...) {
+                std::lock_guard<std::mutex> l{m_error_lock};
+                if (!m_exception) {
+                    m_exception = std::current_exception();
+                }
+                stop();
+            }
+            done();
+        } else {
+            wait();
+        }
+    }
+}
+
+void ifilesystem::walker::walk(const path& p, error_code& ec) {
+    {
+        // The root is opened up front so that a failure is reported to the caller rather than the visitor.
+        unique_dir root{open_dir(p)};
+        if (!root) {
+            prosoft::system::system_error(ec);
+            if (!ec) {
+                ec = einval();
+            }
+            return;
+        }
+    }
+    ec.clear();
+    
+    push(0, work{p, 0});
+    std::vector<std::thread> threads;
+    threads.reserve(m_queues.size() - 1);
+    for (size_t i = 1; i < m_queues.size(); ++i) {
+        threads.emplace_back([this, i]{ run(i); });
+    }
+    run(0);
+    for (auto& t : threads) {
+        t.join();
+    }
+    
+    if (m_exception) {
+        std::rethrow_exception(m_exception);
+    }
+}
+
+void parallel_walk(const path& p, directory_options opts, const walk_config& cfg, const walk_visitor& v) {
+    error_code ec;
+    parallel_walk(p, opts, cfg, v, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not walk directory", p, ec));
+}
+
+void parallel_walk(const path& p, directory_options opts, const walk_config& cfg, const walk_visitor& v, error_code& ec) {
+#if _WIN32
+    if (p.empty()) {
+        ec = einval();
+        return;
+    }
+#endif
+    ifilesystem::walker w{make_public(opts), cfg, v};
+    w.walk(p, ec);
+}
+
+walk_queue::walk_queue(const path& p, directory_options opts, const walk_config& cfg, std::size_t capacity)
+    : m_batches()
+    , m_lock()
+    , m_cond()
+    , m_thread()
+    , m_error()
+    , m_exception()
+    , m_capacity(std::max(capacity, std::size_t{1}))
+    , m_done()
+    , m_canceled() {
+    m_thread = std::thread{[this, p, opts, cfg]{
+        error_code ec;
+        std::exception_ptr ex;
+        try {
+            parallel_walk(p, opts, cfg, [this](walk_batch& b){ push(b); }, ec);
+        } catch (...) {
+            ex = std::current_exception();
+        }
+        std::lock_guard<std::mutex> l{m_lock};
+        m_error = ec;
+        m_exception = ex;
+        m_done = true;
+        m_cond.notify_all();
+    }};
+}
+
+walk_queue::~walk_queue() {
+    {
+        std::lock_guard<std::mutex> l{m_lock};
+        m_canceled = true;
+        m_cond.notify_all();
+    }
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+void walk_queue::push(walk_batch& b) {
+    std::unique_lock<std::mutex> l{m_lock};
+    m_cond.wait(l, [this]{ return m_batches.size() < m_capacity || m_canceled; });
+    if (m_canceled) {
+        b.stop();
+        return;
+    }
+    // Subdirs stay with the walker.
+    walk_batch qb{b.directory(), b.depth()};
+    qb.m_entries = std::move(b.m_entries);
+    qb.m_error = b.m_error;
+    m_batches.push_back(std::move(qb));
+    m_cond.notify_all();
+}
+
+bool walk_queue::pop(walk_batch& b) {
+    std::unique_lock<std::mutex> l{m_lock};
+    m_cond.wait(l, [this]{ return !m_batches.empty() || m_done; });
+    if (!m_batches.empty()) {
+        b = std::move(m_batches.front());
+        m_batches.pop_front();
+        m_cond.notify_all();
+        return true;
+    }
+    if (m_exception) {
+        std::rethrow_exception(m_exception);
+    }
+    return false;
+}
+
+} // v1
+} // filesystem
+} // prosoft
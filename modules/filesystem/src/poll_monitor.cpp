@@ -0,0 +1,725 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <prosoft/core/config/config_platform.h>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_change_monitor.hpp>
+#if PS_HAVE_FILESYSTEM_CHANGE_MONITOR
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+
+#include "poll_monitor_internal.hpp"
+#include <prosoft/core/config/config_analyzer.h>
+
+using namespace prosoft::filesystem;
+
+namespace {
+
+using ifilesystem::dir_snapshot;
+using ifilesystem::poll_state;
+
+constexpr int dir_flags = O_RDONLY|O_DIRECTORY|O_CLOEXEC;
+// Coarsest timestamp granularity we expect (FAT). A change within it of a read may leave the directory's times as they were.
+constexpr std::int64_t timestamp_granularity = 2000000000LL; // ns
+
+inline std::int64_t nanoseconds(const struct timespec& ts) noexcept {
+    return static_cast<std::int64_t>(ts.tv_sec) * 1000000000LL + static_cast<std::int64_t>(ts.tv_nsec);
+}
+
+inline std::int64_t wall_time() noexcept {
+    using namespace std::chrono;
+    return duration_cast<std::chrono::nanoseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+inline const struct timespec& modify_time(const struct stat& sb) noexcept {
+#if __APPLE__
+    return sb.st_mtimespec;
+#else
+    return sb.st_mtim;
+#endif
+}
+
+inline const struct timespec& change_time(const struct stat& sb) noexcept {
+#if __APPLE__
+    return sb.st_ctimespec;
+#else
+    return sb.st_ctim;
+#endif
+}
+
+// The directory is no longer at its path, as opposed to being temporarily unreadable.
+inline bool gone(int err) noexcept {
+    return err == ENOENT || err == ENOTDIR || err == ELOOP || err == ESTALE;
+}
+
+inline poll_state::key_type key(const fs::path& p) {
+    return poll_state::key_type{p.c_str()};
+}
+
+using shared_state = std::shared_ptr<poll_state>;
+
+class gstate {
+public:
+    std::vector<shared_state> registrations;
+    std::mutex lck;
+    
+    gstate() = default;
+    PS_DISABLE_COPY(gstate);
+    PS_DISABLE_MOVE(gstate);
+};
+
+PS_NOINLINE
+gstate& gs() {
+    prosoft::intentional_leak_guard lg;
+    static auto gp = new gstate;
+    return *gp;
+}
+
+using g_guard = std::lock_guard<decltype(gstate::lck)>;
+
+shared_state unregister(poll_state* state) {
+    auto& g = gs();
+    g_guard lg{g.lck};
+    auto i = std::find_if(g.registrations.begin(), g.registrations.end(), [state](const shared_state& p) {
+        return state == p.get();
+    });
+    if (i != g.registrations.end()) {
+        shared_state ss{std::move(*i)};
+        g.registrations.erase(i);
+        return ss;
+    }
+    return shared_state{};
+}
+
+void stop_thread(poll_state& state) {
+    state.m_stop = true;
+    if (state.m_thread.joinable()) {
+        if (state.m_thread.get_id() == std::this_thread::get_id()) {
+            state.m_thread.detach(); // stopped from the callback, the thread exits once it returns
+        } else {
+            state.wake();
+            state.m_thread.join();
+        }
+    }
+}
+
+} // namespace
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+namespace ifilesystem {
+
+constexpr std::size_t poll_state::npos;
+
+dir_snapshot::entry dir_snapshot::make_entry(const stat_buf& sb) noexcept {
+    entry e{};
+    e.size = static_cast<std::uint64_t>(sb.st_size);
+    e.modified = nanoseconds(modify_time(sb));
+    e.changed = nanoseconds(change_time(sb));
+    e.ino = static_cast<std::uint64_t>(sb.st_ino);
+    e.type = static_cast<std::int8_t>(to_file_type{}(sb));
+    return e;
+}
+
+void dir_snapshot::add(const char* name, std::size_t len, entry e) {
+    e.name = static_cast<std::uint32_t>(m_names.size());
+    e.name_size = static_cast<std::uint16_t>(len);
+    m_names.append(name, len);
+    m_names.push_back('\0'); // for the *at() calls
+    m_entries.push_back(e);
+}
+
+void dir_snapshot::finish() {
+    const char* names = m_names.data();
+    std::sort(m_entries.begin(), m_entries.end(), [names](const entry& lhs, const entry& rhs) {
+        return std::strcmp(names + lhs.name, names + rhs.name) < 0;
+    });
+    m_entries.shrink_to_fit();
+    m_names.shrink_to_fit();
+}
+
+poll_state::poll_state(const fs::path& p, const fs::change_config& cfg, bool recursive, fs::error_code& ec)
+    : m_callback()
+    , m_root(p)
+    , m_nodes()
+    , m_free()
+    , m_index()
+    , m_queue()
+    , m_created()
+    , m_removed()
+    , m_thread()
+    , m_lock()
+    , m_wake()
+    , m_min_interval(cfg.poll_interval)
+    , m_max_interval(cfg.max_poll_interval)
+    , m_latency(cfg.notification_latency)
+    , m_events(cfg.events)
+    , m_subtree_threshold(cfg.subtree_threshold)
+    , m_memory_limit(cfg.memory_limit)
+    , m_pending_size(0)
+    , m_syscall_limit(cfg.poll_syscall_limit)
+    , m_syscalls(0)
+    , m_roottype(fs::file_type::none)
+    , m_recursive(recursive)
+    , m_restat(is_set(cfg.events & fs::change_event::modified))
+    , m_thawed(cfg.state != nullptr)
+    , m_canceled(false)
+    , m_overflowed(false)
+    , m_stop(false)
+    , m_evid(0)
+    , m_lastid(0) {
+    if (!cfg.journal.empty()) {
+        ec = fs::error_code(platform_error::not_supported, platform_category());
+        return;
+    }
+    
+    stat_buf sb;
+    if (-1 == ::stat(p.c_str(), &sb)) {
+        ifilesystem::system_error(ec);
+        return;
+    }
+    m_roottype = to_file_type{}(sb);
+    const auto e = dir_snapshot::make_entry(sb);
+    add_node(fs::path{p}, e, npos);
+    
+    const auto now = clock_type::now();
+    if (m_roottype != fs::file_type::directory) {
+        m_nodes[0].snapshot.add("", 0, e);
+        m_nodes[0].scanned = true;
+        schedule(0, now + m_min_interval);
+    } else {
+        const int fd = ::open(p.c_str(), dir_flags);
+        if (-1 == fd) {
+            ifilesystem::system_error(ec);
+            return;
+        }
+        ::close(fd);
+        // The snapshot is complete before returning so any later change is reported.
+        for (std::size_t i = 0; i < m_nodes.size() && !m_canceled; ++i) {
+            if (m_nodes[i].live) {
+                check(i, now, nullptr);
+            }
+        }
+        if (m_canceled) {
+            ec = fs::error_code(platform_error::monitor_create, platform_category());
+            return;
+        }
+    }
+    ec.clear();
+}
+
+poll_state::~poll_state() {
+    stop_thread(*this);
+}
+
+fs::change_event_id poll_state::last_event_id() const {
+    return m_lastid.load();
+}
+
+void poll_state::wake() {
+    std::lock_guard<std::mutex> lg{m_lock};
+    m_wake.notify_all();
+}
+
+std::size_t poll_state::add_node(fs::path&& p, const dir_snapshot::entry& e, std::size_t parent) {
+    std::size_t idx = m_nodes.size();
+    if (!m_free.empty()) {
+        idx = m_free.back();
+        m_free.pop_back();
+    } else {
+        m_nodes.emplace_back();
+    }
+    
+    m_index[key(p)] = idx;
+    auto& n = m_nodes[idx];
+    n.path = std::move(p);
+    n.snapshot.clear();
+    n.modified = e.modified;
+    n.changed = e.changed;
+    n.ino = e.ino;
+    n.interval = m_min_interval;
+    n.due = clock_type::time_point{};
+    n.parent = parent;
+    n.live = true;
+    n.scanned = false;
+    n.quiet = parent != npos && m_nodes[parent].quiet;
+    n.racy = false;
+    return idx;
+}
+
+void poll_state::remove_node(std::size_t idx) {
+    auto& n = m_nodes[idx];
+    for (const auto& e : n.snapshot) {
+        if (type(e) == fs::file_type::directory) {
+            const auto child = find_node(n.path / fs::path{n.snapshot.name_data(e)});
+            if (child != npos) {
+                remove_node(child);
+            }
+        }
+    }
+    m_index.erase(key(n.path));
+    n.path.clear();
+    n.snapshot = dir_snapshot{}; // release the memory
+    n.live = false;
+    m_free.push_back(idx);
+}
+
+std::size_t poll_state::find_node(const fs::path& p) const {
+    auto i = m_index.find(key(p));
+    return i != m_index.end() ? i->second : npos;
+}
+
+void poll_state::schedule(std::size_t idx, clock_type::time_point due) {
+    m_nodes[idx].due = due;
+    m_queue.emplace(due, idx);
+}
+
+void poll_state::cancel_root(fs::change_event ev, fs::change_notifications& notes) {
+    fs::change_manager::emplace_back(notes, fs::path{m_root}, fs::path{}, this, next_eventid(), ev, m_roottype);
+    m_canceled = true;
+}
+
+void poll_state::lost(std::size_t idx, int err, clock_type::time_point now, fs::change_notifications* notes) {
+    if (idx == 0) {
+        if (notes) {
+            cancel_root(err == ENOENT ? fs::change_event::removed|fs::change_event::rescan_required : fs::change_event::rescan_required, *notes);
+        } else {
+            m_canceled = true;
+        }
+        return;
+    }
+    
+    // The parent's next scan reports the change.
+    const auto parent = m_nodes[idx].parent;
+    remove_node(idx);
+    if (parent != npos && m_nodes[parent].live) {
+        schedule(parent, now + clock_type::duration{1});
+    }
+}
+
+bool poll_state::read(int fd, dir_snapshot& snap) {
+    DIR* d = ::fdopendir(fd);
+    if (!d) {
+        const int err = errno;
+        ::close(fd);
+        errno = err;
+        return false;
+    }
+    
+    const int dfd = ::dirfd(d);
+    while (auto de = ::readdir(d)) {
+        const char* name = de->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+        stat_buf sb;
+        ++m_syscalls;
+        if (0 == ::fstatat(dfd, name, &sb, AT_SYMLINK_NOFOLLOW)) {
+            snap.add(name, std::strlen(name), sb);
+        } // else removed since it was read, the directory's times changed so the next check reads it again
+    }
+    ::closedir(d);
+    snap.finish();
+    return true;
+}
+
+bool poll_state::restat(std::size_t idx, int fd, clock_type::time_point now, fs::change_notifications* notes) {
+    std::vector<std::pair<std::size_t, dir_snapshot::entry>> updates;
+    const auto& snap = m_nodes[idx].snapshot;
+    std::size_t pos = 0;
+    for (const auto& e : snap) {
+        stat_buf sb;
+        ++m_syscalls;
+        if (0 == ::fstatat(fd, snap.name_data(e), &sb, AT_SYMLINK_NOFOLLOW)) {
+            auto ne = dir_snapshot::make_entry(sb);
+            ne.name = e.name;
+            ne.name_size = e.name_size;
+            if (ne.ino != e.ino || ne.type != e.type || ne.size != e.size || ne.modified != e.modified || ne.changed != e.changed) {
+                updates.emplace_back(pos, ne);
+            }
+        }
+        ++pos;
+    }
+    
+    bool found = false;
+    for (const auto& u : updates) {
+        auto i = m_nodes[idx].snapshot.begin() + static_cast<std::ptrdiff_t>(u.first);
+        const auto before = *i;
+        *i = u.second;
+        found |= report(idx, m_nodes[idx].snapshot.name(before), &before, &u.second, now, notes);
+    }
+    return found;
+}
+
+bool poll_state::report(std::size_t idx, const std::string& name, const dir_snapshot::entry* before, const dir_snapshot::entry* after, clock_type::time_point now, fs::change_notifications* notes) {
+    using namespace fs;
+    const auto ev = to_event(before, after);
+    auto p = m_nodes[idx].path / path{name};
+    
+    if (m_recursive) {
+        const bool wasdir = before && type(*before) == file_type::directory;
+        const bool isdir = after && type(*after) == file_type::directory;
+        const bool replaced = is_set(ev & change_event::created) && is_set(ev & change_event::removed);
+        if (wasdir && (!isdir || replaced)) {
+            const auto child = find_node(p);
+            if (child != npos) {
+                remove_node(child);
+            }
+        }
+        if (isdir && (!wasdir || replaced)) {
+            // Read by the next poll, so a rename found by this one can still be applied.
+            schedule(add_node(path{p}, *after, idx), now + clock_type::duration{1});
+        } else if (isdir && before->modified != after->modified) {
+            // Something changed below, check the child now rather than when it's due.
+            const auto child = find_node(p);
+            const auto soon = now + clock_type::duration{1};
+            if (child != npos && m_nodes[child].due > soon) {
+                schedule(child, soon);
+            }
+        }
+    }
+    
+    if (ev == change_event::none) {
+        return false;
+    }
+    
+    if (notes && !m_nodes[idx].quiet) {
+        if (is_set(m_events & change_event::renamed)) {
+            if (ev == change_event::created) {
+                m_created.push_back(move_candidate{*after, notes->size()});
+            } else if (ev == change_event::removed) {
+                m_removed.push_back(move_candidate{*before, notes->size()});
+            }
+        }
+        change_manager::emplace_back(*notes, std::move(p), path{}, this, next_eventid(), ev, type(after ? *after : *before));
+    }
+    return true;
+}
+
+bool poll_state::check_file(std::size_t idx, clock_type::time_point now, fs::change_notifications* notes) {
+    stat_buf sb;
+    ++m_syscalls;
+    if (-1 == ::stat(m_root.c_str(), &sb)) {
+        lost(idx, errno, now, notes);
+        return true;
+    }
+    
+    auto& e = *m_nodes[idx].snapshot.begin();
+    const auto ne = dir_snapshot::make_entry(sb);
+    if (ne.ino != e.ino || ne.type != e.type) {
+        if (notes) {
+            cancel_root(fs::change_event::rescan_required, *notes);
+        }
+        return true;
+    }
+    
+    const auto ev = to_event(&e, &ne);
+    e = ne;
+    if (ev != fs::change_event::none && notes) {
+        fs::change_manager::emplace_back(*notes, fs::path{m_root}, fs::path{}, this, next_eventid(), ev, m_roottype);
+    }
+    return ev != fs::change_event::none;
+}
+
+void poll_state::check(std::size_t idx, clock_type::time_point now, fs::change_notifications* notes) {
+    using namespace fs;
+    bool found = false;
+    if (m_roottype != file_type::directory) {
+        found = check_file(idx, now, notes);
+    } else {
+        const int fd = ::open(m_nodes[idx].path.c_str(), idx == 0 ? dir_flags : dir_flags|O_NOFOLLOW);
+        stat_buf sb;
+        m_syscalls += 2;
+        if (-1 == fd || -1 == ::fstat(fd, &sb)) {
+            const int err = errno;
+            if (-1 != fd) {
+                ::close(fd);
+            }
+            if (idx == 0 || gone(err)) {
+                lost(idx, err, now, notes);
+                return;
+            }
+            // Unreadable for now, back off.
+        } else if (static_cast<std::uint64_t>(sb.st_ino) != m_nodes[idx].ino) {
+            ::close(fd);
+            lost(idx, ESTALE, now, notes); // replaced
+            return;
+        } else {
+            const auto e = dir_snapshot::make_entry(sb);
+            auto& n = m_nodes[idx];
+            if (!n.scanned || n.racy || e.modified != n.modified || e.changed != n.changed) {
+                if (idx == 0 && n.scanned && e.modified == n.modified && e.changed != n.changed && notes) {
+                    found = true;
+                    change_manager::emplace_back(*notes, path{m_root}, path{}, this, next_eventid(), change_event::metadata_modified, m_roottype);
+                }
+                // Like git's racily clean index entries: a change in the same timestamp tick as the read leaves the times as they are.
+                const auto scanned = wall_time();
+                dir_snapshot snap;
+                if (read(fd, snap)) {
+                    const auto before = std::move(m_nodes[idx].snapshot);
+                    compare(before, snap, [this, idx, now, notes, &found](const std::string& name, const dir_snapshot::entry* b, const dir_snapshot::entry* a) {
+                        found |= report(idx, name, b, a, now, notes);
+                    });
+                    // Only now, a failed read is retried by the next check.
+                    auto& rn = m_nodes[idx];
+                    rn.modified = e.modified;
+                    rn.changed = e.changed;
+                    rn.racy = e.modified >= scanned - timestamp_granularity;
+                    rn.snapshot = std::move(snap);
+                    rn.scanned = true;
+                    rn.quiet = false;
+                }
+            } else {
+                if (m_restat) {
+                    found = restat(idx, fd, now, notes);
+                }
+                ::close(fd);
+            }
+        }
+    }
+    
+    if (!m_nodes[idx].live) {
+        return;
+    }
+    auto& n = m_nodes[idx];
+    n.interval = next_interval(n.interval, found, m_min_interval, m_max_interval);
+    schedule(idx, now + (n.racy ? m_min_interval : n.interval));
+    if (found && n.parent != npos) {
+        // Changes tend to cluster, so the rest of the subtree is checked more often as well.
+        auto& pn = m_nodes[n.parent];
+        pn.interval = std::max(m_min_interval, pn.interval / 2);
+    }
+}
+
+void poll_state::poll(clock_type::time_point now, fs::change_notifications& notes) {
+    m_syscalls = 0;
+    const auto first = notes.size();
+    bool any = false;
+    while (!m_queue.empty() && !m_canceled) {
+        const auto top = m_queue.top();
+        if (top.first > now) {
+            break;
+        }
+        const auto& n = m_nodes[top.second];
+        if (!n.live || n.due != top.first) {
+            m_queue.pop(); // rescheduled or removed
+            continue;
+        }
+        if (any && m_syscall_limit > 0 && m_syscalls + 2 + n.snapshot.size() > m_syscall_limit) {
+            break; // remains due for the next poll
+        }
+        m_queue.pop();
+        any = true;
+        check(top.second, now, &notes);
+    }
+    
+    if (!m_canceled) {
+        resolve_moves(notes, first);
+    }
+    m_created.clear();
+    m_removed.clear();
+    enforce_memory_limit(notes, first);
+}
+
+void poll_state::resolve_moves(fs::change_notifications& notes, std::size_t first) {
+    using namespace fs;
+    if (m_created.empty() || m_removed.empty()) {
+        return;
+    }
+    
+    std::unordered_map<std::uint64_t, std::size_t> removed;
+    for (std::size_t i = 0; i < m_removed.size(); ++i) {
+        removed.emplace(m_removed[i].entry.ino, i);
+    }
+    
+    std::vector<bool> moved(notes.size() - first);
+    for (const auto& c : m_created) {
+        auto i = removed.find(c.entry.ino);
+        if (i == removed.end()) {
+            continue;
+        }
+        const auto& r = m_removed[i->second];
+        // Inodes are reused, a renamed file keeps its size and modification time.
+        const bool same = r.entry.type == c.entry.type
+            && (type(c.entry) == file_type::directory || (r.entry.size == c.entry.size && r.entry.modified == c.entry.modified));
+        if (!same) {
+            continue;
+        }
+        
+        auto& rn = notes[r.index];
+        const auto& cn = notes[c.index];
+        rn = change_manager::make_notification(path{rn.path()}, path{cn.path()}, this, change_event::renamed, cn.type(), rn.event_id());
+        moved[c.index - first] = true;
+        if (type(c.entry) == file_type::directory) {
+            const auto idx = find_node(cn.path());
+            if (idx != npos && !m_nodes[idx].scanned) {
+                m_nodes[idx].quiet = true; // only the rename is reported, as a system monitor would
+            }
+        }
+        removed.erase(i);
+    }
+    
+    std::size_t pos = 0;
+    notes.erase(std::remove_if(notes.begin() + static_cast<std::ptrdiff_t>(first), notes.end(), [&moved, &pos](const change_notification&) {
+        return moved[pos++];
+    }), notes.end());
+}
+
+void poll_state::enforce_memory_limit(fs::change_notifications& notes, std::size_t first) {
+    using namespace fs;
+    if (m_memory_limit == 0 || m_canceled) {
+        return;
+    }
+    if (m_overflowed) {
+        notes.erase(notes.begin() + 1, notes.end()); // the rescan covers everything found since
+        return;
+    }
+    for (std::size_t i = first; i < notes.size(); ++i) {
+        m_pending_size += change_manager::memory_size(notes[i]);
+    }
+    if (m_pending_size > m_memory_limit) {
+        notes.clear();
+        change_manager::emplace_back(notes, path{m_root}, path{}, this, next_eventid(), change_event::rescan, m_roottype);
+        m_overflowed = true;
+    }
+}
+
+void poll_state::dispatch(fs::change_notifications& notes) {
+    using namespace fs;
+    const auto mask = m_events|change_event::rescan_required;
+    notes.erase(std::remove_if(notes.begin(), notes.end(), [mask](const change_notification& n) {
+        return !is_set(n.event() & mask);
+    }), notes.end());
+    
+    if (!notes.empty() && !m_stop) {
+        // Before the callback so the client can archive the state with the correct id.
+        m_lastid = m_evid;
+        PSIgnoreCppException(change_manager::coalesce(notes, m_root, m_subtree_threshold); m_callback(std::move(notes)));
+    }
+    notes.clear();
+    m_pending_size = 0;
+    m_overflowed = false;
+}
+
+void poll_state::run() {
+    using namespace fs;
+    change_notifications notes;
+    auto first = clock_type::now(); // of the pending notifications
+    if (m_thawed) {
+        // There is no history to replay from, so all we can do is report that changes may have been missed.
+        change_manager::emplace_back(notes, path{m_root}, path{}, this, next_eventid(), change_event::rescan, m_roottype);
+    }
+    
+    auto last = clock_type::now(); // poll
+    std::unique_lock<std::mutex> lk{m_lock};
+    while (!m_stop) {
+        const auto now = clock_type::now();
+        if (!notes.empty() && (m_canceled || now - first >= m_latency)) {
+            lk.unlock();
+            dispatch(notes);
+            lk.lock();
+            continue;
+        }
+        if (m_canceled) {
+            break;
+        }
+        
+        // At most one poll per interval, so the syscall limit is also a rate.
+        auto due = m_queue.empty() ? now + m_max_interval : std::max(m_queue.top().first, last + m_min_interval);
+        if (due <= now) {
+            lk.unlock();
+            const bool empty = notes.empty();
+            last = now;
+            poll(now, notes);
+            if (empty && !notes.empty()) {
+                first = now;
+            }
+            lk.lock();
+            continue;
+        }
+        
+        if (!notes.empty()) {
+            due = std::min(due, first + m_latency);
+        }
+        m_wake.wait_until(lk, due);
+    }
+}
+
+} // ifilesystem
+
+change_registration poll_monitor(const path& p, const change_config& cfg, change_callback&& cb, bool recursive, error_code& ec) {
+    auto state = std::make_shared<poll_state>(p, cfg, recursive, ec);
+    if (ec) {
+        return change_registration{};
+    }
+    
+    auto reg = change_manager::make_registration(state);
+    auto sp = state.get();
+    sp->m_callback = std::move(cb);
+    {
+        auto& g = gs();
+        g_guard lg{g.lck};
+        g.registrations.emplace_back(state);
+    }
+    
+    try {
+        // The thread keeps the state alive as stop() may be called from the callback.
+        sp->m_thread = std::thread{[ss = std::move(state)]() {
+            ss->run();
+        }};
+        ec.clear();
+        return reg;
+    } catch (const std::system_error&) {
+        ec = error_code(platform_error::monitor_start, platform_category());
+        unregister(sp);
+        return change_registration{};
+    }
+}
+
+bool stop_poll_monitor(change_state* state, error_code& ec) {
+    auto p = dynamic_cast<poll_state*>(state);
+    if (!p) {
+        return false;
+    }
+    
+    if (auto ss = unregister(p)) {
+        stop_thread(*ss);
+    } else {
+        ec = error_code{ENOENT, std::system_category()};
+    }
+    return true;
+}
+
+} // v1
+} // filesystem
+} // prosoft
+#endif // PS_HAVE_FILESYSTEM_CHANGE_MONITOR
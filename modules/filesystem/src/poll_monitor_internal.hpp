@@ -0,0 +1,289 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef PS_CORE_POLL_MONITOR_INTERNAL_HPP
+#define PS_CORE_POLL_MONITOR_INTERNAL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_change_monitor.hpp>
+#include "filesystem_internal.hpp"  // stat_buf
+#include "fsmonitor_private.hpp"
+
+namespace fs = prosoft::filesystem::v1;
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+namespace ifilesystem {
+
+// The children of a single directory, sorted by name. Names are packed into one buffer to keep large trees small.
+class dir_snapshot {
+public:
+    struct entry {
+        std::uint64_t size;
+        std::int64_t modified; // ns
+        std::int64_t changed; // ns
+        std::uint64_t ino;
+        std::uint32_t name; // offset into the name buffer
+        std::uint16_t name_size;
+        std::int8_t type; // file_type
+    };
+    using entries_type = std::vector<entry>;
+    using iterator = entries_type::iterator;
+    using const_iterator = entries_type::const_iterator;
+    
+    dir_snapshot() = default;
+    ~dir_snapshot() = default;
+    PS_DEFAULT_COPY(dir_snapshot);
+    PS_DEFAULT_MOVE(dir_snapshot);
+    
+    static entry make_entry(const stat_buf&) noexcept;
+    
+    void add(const char* name, std::size_t len, const stat_buf& sb) {
+        add(name, len, make_entry(sb));
+    }
+    void add(const char* name, std::size_t len, entry);
+    // Must be called once all entries are added.
+    void finish();
+    
+    void clear() noexcept {
+        m_entries.clear();
+        m_names.clear();
+    }
+    
+    std::size_t size() const noexcept {
+        return m_entries.size();
+    }
+    
+    bool empty() const noexcept {
+        return m_entries.empty();
+    }
+    
+    iterator begin() noexcept {
+        return m_entries.begin();
+    }
+    
+    iterator end() noexcept {
+        return m_entries.end();
+    }
+    
+    const_iterator begin() const noexcept {
+        return m_entries.begin();
+    }
+    
+    const_iterator end() const noexcept {
+        return m_entries.end();
+    }
+    
+    std::string name(const entry& e) const {
+        return m_names.substr(e.name, e.name_size);
+    }
+    
+    const char* name_data(const entry& e) const noexcept {
+        return m_names.data() + e.name;
+    }
+    
+private:
+    entries_type m_entries;
+    std::string m_names;
+};
+
+inline fs::file_type type(const dir_snapshot::entry& e) noexcept {
+    return static_cast<fs::file_type>(e.type);
+}
+
+// Calls f(name, before, after) for each name whose entry differs, before is null for a new name and after is null for a removed one.
+template <class Function>
+void compare(const dir_snapshot& before, const dir_snapshot& after, Function&& f) {
+    auto i = before.begin();
+    auto j = after.begin();
+    auto name_compare = [&before, &after](const dir_snapshot::entry& lhs, const dir_snapshot::entry& rhs) {
+        const int c = std::string::traits_type::compare(before.name_data(lhs), after.name_data(rhs), std::min(lhs.name_size, rhs.name_size));
+        return c != 0 ? c : static_cast<int>(lhs.name_size) - static_cast<int>(rhs.name_size);
+    };
+    while (i != before.end() || j != after.end()) {
+        const int c = i == before.end() ? 1 : j == after.end() ? -1 : name_compare(*i, *j);
+        if (c < 0) {
+            f(before.name(*i), &*i, static_cast<const dir_snapshot::entry*>(nullptr));
+            ++i;
+        } else if (c > 0) {
+            f(after.name(*j), static_cast<const dir_snapshot::entry*>(nullptr), &*j);
+            ++j;
+        } else {
+            if (i->ino != j->ino || i->type != j->type || i->size != j->size || i->modified != j->modified || i->changed != j->changed) {
+                f(after.name(*j), &*i, &*j);
+            }
+            ++i;
+            ++j;
+        }
+    }
+}
+
+// A directory's own size and times change with its children, which are reported by the directory's scan instead.
+inline fs::change_event to_event(const dir_snapshot::entry* before, const dir_snapshot::entry* after) noexcept {
+    if (!before) {
+        return fs::change_event::created;
+    }
+    if (!after) {
+        return fs::change_event::removed;
+    }
+    if (before->ino != after->ino || before->type != after->type) {
+        return fs::change_event::removed|fs::change_event::created; // replaced
+    }
+    if (type(*after) == fs::file_type::directory) {
+        return before->modified == after->modified && before->changed != after->changed ? fs::change_event::metadata_modified : fs::change_event::none;
+    }
+    if (before->size != after->size || before->modified != after->modified) {
+        return fs::change_event::content_modified;
+    }
+    if (before->changed != after->changed) {
+        return fs::change_event::metadata_modified;
+    }
+    return fs::change_event::none;
+}
+
+// A directory with changes is checked again at the minimum interval, each check without changes doubles its interval up to the maximum.
+template <class Duration>
+inline Duration next_interval(Duration current, bool changed, Duration min, Duration max) {
+    if (changed || current < min) {
+        return min;
+    }
+    return current < max / 2 ? current * 2 : max;
+}
+
+struct poll_state : public fs::change_state {
+    using clock_type = std::chrono::steady_clock;
+    using key_type = std::basic_string<fs::path::encoding_value_type>;
+    using due_type = std::pair<clock_type::time_point, std::size_t>;
+    using queue_type = std::priority_queue<due_type, std::vector<due_type>, std::greater<due_type>>;
+    static constexpr std::size_t npos = ~std::size_t{};
+    
+    struct node {
+        fs::path path;
+        dir_snapshot snapshot; // a root that isn't a directory is a single unnamed entry
+        std::int64_t modified;
+        std::int64_t changed;
+        std::uint64_t ino;
+        clock_type::duration interval;
+        clock_type::time_point due;
+        std::size_t parent;
+        bool live;
+        bool scanned; // the entries of a new directory are reported as created by its first scan
+        bool quiet; // unless it was renamed
+        bool racy; // read too soon after it was modified to trust its times, so it's read again
+    };
+    
+    // A created or removed entry that may be half of a rename.
+    struct move_candidate {
+        dir_snapshot::entry entry;
+        std::size_t index; // into the poll's notifications
+    };
+    
+    fs::change_callback m_callback;
+    fs::path m_root;
+    std::vector<node> m_nodes;
+    std::vector<std::size_t> m_free;
+    std::unordered_map<key_type, std::size_t> m_index;
+    queue_type m_queue;
+    std::vector<move_candidate> m_created; // by the current poll
+    std::vector<move_candidate> m_removed;
+    std::thread m_thread;
+    std::mutex m_lock;
+    std::condition_variable m_wake;
+    clock_type::duration m_min_interval;
+    clock_type::duration m_max_interval;
+    fs::change_config::latency_type m_latency;
+    fs::change_event m_events;
+    std::size_t m_subtree_threshold;
+    std::size_t m_memory_limit;
+    std::size_t m_pending_size;
+    std::size_t m_syscall_limit;
+    std::size_t m_syscalls; // made by the current poll
+    fs::file_type m_roottype;
+    bool m_recursive;
+    bool m_restat; // entries of unchanged directories are checked for modifications
+    bool m_thawed; // there is no history, so this only results in a rescan
+    bool m_canceled;
+    bool m_overflowed; // the batch was replaced by a rescan of the root (memory limit)
+    std::atomic_bool m_stop;
+    fs::change_event_id m_evid;
+    std::atomic<fs::change_event_id> m_lastid;
+    
+    poll_state(const fs::path&, const fs::change_config&, bool recursive, fs::error_code&);
+    virtual ~poll_state();
+    PS_DISABLE_COPY(poll_state);
+    PS_DISABLE_MOVE(poll_state);
+    
+    virtual fs::change_event_id last_event_id() const override;
+    
+    // Monitor thread.
+    void run();
+    void wake();
+    fs::change_event_id next_eventid() noexcept {
+        return ++m_evid;
+    }
+    // Checks the directories that are due at the given time, oldest first and within the syscall limit.
+    // The first directory is always checked so a directory larger than the limit can't stall the monitor.
+    void poll(clock_type::time_point, fs::change_notifications&);
+    void check(std::size_t, clock_type::time_point, fs::change_notifications*);
+    // These return true if a change was found.
+    bool check_file(std::size_t, clock_type::time_point, fs::change_notifications*);
+    bool restat(std::size_t, int fd, clock_type::time_point, fs::change_notifications*);
+    bool report(std::size_t, const std::string& name, const dir_snapshot::entry* before, const dir_snapshot::entry* after, clock_type::time_point, fs::change_notifications*);
+    // Returns false with errno set if the directory could not be read, the descriptor is always closed.
+    bool read(int fd, dir_snapshot&);
+    void lost(std::size_t, int err, clock_type::time_point, fs::change_notifications*);
+    void resolve_moves(fs::change_notifications&, std::size_t first);
+    void dispatch(fs::change_notifications&);
+    // Replaces the batch with a rescan of the root once the memory limit is exceeded. Polling continues.
+    void enforce_memory_limit(fs::change_notifications&, std::size_t first);
+    void cancel_root(fs::change_event, fs::change_notifications&);
+    
+    std::size_t add_node(fs::path&&, const dir_snapshot::entry&, std::size_t parent);
+    void remove_node(std::size_t);
+    std::size_t find_node(const fs::path&) const;
+    void schedule(std::size_t, clock_type::time_point);
+};
+
+} // ifilesystem
+} // v1
+} // filesystem
+} // prosoft
+
+#endif // PS_CORE_POLL_MONITOR_INTERNAL_HPP
@@ -0,0 +1,394 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <prosoft/core/config/config.h>
+#include "fsconfig.h"
+
+#if !_WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <windows.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include "filesystem_private.hpp"
+
+namespace {
+
+using namespace prosoft::filesystem;
+
+constexpr auto remove_failed = static_cast<std::uintmax_t>(-1);
+
+#if !_WIN32
+
+inline bool denied(int err) noexcept {
+    return err == EACCES || err == EPERM;
+}
+
+struct closedir_deleter {
+    void operator()(DIR* d) const noexcept {
+        (void)::closedir(d);
+    }
+};
+using unique_dirp = std::unique_ptr<DIR, closedir_deleter>;
+
+// Directories are scanned depth first by a pool of workers. A scan unlinks every non-directory entry and queues the subdirectories.
+// Each directory holds a reference for its scan and one for every subdirectory, whoever drops the last one removes it.
+class tree_remover {
+    struct dir_node {
+        std::shared_ptr<dir_node> parent;
+        ifilesystem::unique_fd fd;
+        path name; // relative to the parent, or the root path
+        std::atomic<size_t> pending;
+        std::atomic<bool> kept; // something below was left in place
+        
+        dir_node(const std::shared_ptr<dir_node>& p, path&& n)
+            : parent(p)
+            , fd()
+            , name(std::move(n))
+            , pending{1}
+            , kept() {}
+    };
+    using node_ptr = std::shared_ptr<dir_node>;
+    
+    const remove_options m_opts;
+    const size_t m_threads;
+    std::vector<node_ptr> m_dirs;
+    std::mutex m_lock;
+    std::condition_variable m_cond;
+    size_t m_busy;
+    std::atomic<bool> m_stop;
+    std::atomic<std::uintmax_t> m_removed;
+    std::mutex m_error_lock;
+    error_code m_error;
+    std::exception_ptr m_exception;
+    
+    bool option(remove_options o) const noexcept {
+        return is_set(m_opts & o);
+    }
+    
+    static int parent_fd(const dir_node& n) noexcept {
+        return n.parent ? n.parent->fd.get() : AT_FDCWD;
+    }
+    
+    void fail(int err) {
+        std::lock_guard<std::mutex> l{m_error_lock};
+        if (!m_error) {
+            m_error.assign(err, std::system_category());
+        }
+        m_stop = true;
+    }
+    
+    void fail(std::exception_ptr e) {
+        std::lock_guard<std::mutex> l{m_error_lock};
+        if (!m_exception) {
+            m_exception = e;
+        }
+        m_stop = true;
+    }
+    
+    // Returns true if the mode changed and the operation is worth retrying.
+    bool make_writable(int fd) noexcept {
+        struct stat sb;
+        return option(remove_options::make_writable)
+            && 0 == ::fstat(fd, &sb)
+            && (sb.st_mode & S_IRWXU) != S_IRWXU
+            && 0 == ::fchmod(fd, (sb.st_mode & 07777) | S_IRWXU);
+    }
+    
+    // Returns false if the walk should stop.
+    bool unlink(dir_node& n, int dirfd, const char* name, int flags) {
+        int rc = ::unlinkat(dirfd, name, flags);
+        if (0 != rc && denied(errno) && make_writable(dirfd)) {
+            rc = ::unlinkat(dirfd, name, flags);
+        }
+        if (0 == rc) {
+            ++m_removed;
+            return true;
+        }
+        const int err = errno;
+        if (err == ENOENT) {
+            return true;
+        }
+        if (denied(err) && option(remove_options::skip_permission_denied)) {
+            n.kept = true;
+            return true;
+        }
+        fail(err);
+        return false;
+    }
+    
+    void release(node_ptr n) {
+        while (n && --n->pending == 0) {
+            n->fd.reset();
+            auto parent = std::move(n->parent);
+            if (n->kept) {
+                if (parent) {
+                    parent->kept = true;
+                }
+            } else if (!m_stop) {
+                dir_node& owner = parent ? *parent : *n;
+                (void)unlink(owner, parent ? parent->fd.get() : AT_FDCWD, n->name.c_str(), AT_REMOVEDIR);
+            }
+            n = std::move(parent);
+        }
+    }
+    
+    void push(node_ptr&& n) {
+        {
+            std::lock_guard<std::mutex> l{m_lock};
+            m_dirs.push_back(std::move(n));
+        }
+        m_cond.notify_one();
+    }
+    
+    void open(dir_node& n) {
+        const int pfd = parent_fd(n);
+        constexpr int flags = O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC;
+        n.fd.reset(::openat(pfd, n.name.c_str(), flags));
+        if (!n.fd && denied(errno) && option(remove_options::make_writable) && 0 == ::fchmodat(pfd, n.name.c_str(), S_IRWXU, 0)) {
+            n.fd.reset(::openat(pfd, n.name.c_str(), flags));
+        }
+    }
+    
+    void scan(const node_ptr& n) {
+        open(*n);
+        if (!n->fd) {
+            const int err = errno;
+            if (err == ENOENT) {
+                return;
+            }
+            if (denied(err) && option(remove_options::skip_permission_denied)) {
+                n->kept = true;
+            } else {
+                fail(err);
+            }
+            return;
+        }
+        
+        // fdopendir() owns its descriptor, the node's is kept for unlinkat().
+        const int dfd = ::dup(n->fd.get());
+        unique_dirp d{dfd >= 0 ? ::fdopendir(dfd) : nullptr};
+        if (!d) {
+            const int err = errno;
+            if (dfd >= 0) {
+                (void)::close(dfd);
+            }
+            fail(err);
+            return;
+        }
+        
+        const int fd = n->fd.get();
+        errno = 0;
+        while (auto ent = ::readdir(d.get())) {
+            if (m_stop) {
+                return;
+            }
+            const char* name = ent->d_name;
+            if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) {
+                continue;
+            }
+            bool dir = ent->d_type == DT_DIR;
+            if (ent->d_type == DT_UNKNOWN) {
+                struct stat sb;
+                dir = 0 == ::fstatat(fd, name, &sb, AT_SYMLINK_NOFOLLOW) && S_ISDIR(sb.st_mode);
+            }
+            if (dir) {
+                ++n->pending;
+                push(std::make_shared<dir_node>(n, path{name}));
+            } else if (!unlink(*n, fd, name, 0)) {
+                return;
+            }
+            errno = 0;
+        }
+        if (errno != 0) {
+            fail(errno);
+        }
+    }
+    
+    void run() {
+        std::unique_lock<std::mutex> l{m_lock};
+        for (;;) {
+            m_cond.wait(l, [this]{ return !m_dirs.empty() || m_busy == 0 || m_stop; });
+            if (m_dirs.empty() || m_stop) {
+                return;
+            }
+            auto n = std::move(m_dirs.back());
+            m_dirs.pop_back();
+            ++m_busy;
+            l.unlock();
+            try {
+                scan(n);
+                release(std::move(n));
+            } catch (...) {
+                fail(std::current_exception());
+            }
+            l.lock();
+            if (--m_busy == 0 && (m_dirs.empty() || m_stop)) {
+                m_cond.notify_all();
+            }
+        }
+    }
+    
+public:
+    explicit tree_remover(const remove_config& cfg)
+        : m_opts(cfg.options)
+        , m_threads(cfg.threads > 0 ? cfg.threads : std::max(std::thread::hardware_concurrency(), 1U))
+        , m_dirs()
+        , m_lock()
+        , m_cond()
+        , m_busy()
+        , m_stop()
+        , m_removed()
+        , m_error_lock()
+        , m_error()
+        , m_exception() {}
+    PS_DISABLE_COPY(tree_remover);
+    
+    std::uintmax_t remove(const path& p, error_code& ec) {
+        m_dirs.push_back(std::make_shared<dir_node>(node_ptr{}, path{p}));
+        std::vector<std::thread> workers;
+        try {
+            for (size_t i = 1; i < m_threads; ++i) {
+                workers.emplace_back([this]{ run(); });
+            }
+        } catch (const std::system_error&) {
+            // Fewer workers, the caller's thread is always one of them.
+        }
+        run();
+        for (auto& t : workers) {
+            t.join();
+        }
+        
+        if (m_exception) {
+            std::rethrow_exception(m_exception);
+        }
+        ec = m_error;
+        return ec ? remove_failed : m_removed.load();
+    }
+};
+
+#else // _WIN32
+
+// Sequential, entries are removed as the iterator returns them in postorder.
+std::uintmax_t remove_tree(const path& p, remove_options opts, error_code& ec) {
+    std::uintmax_t removed{};
+    bool kept = false;
+    auto rm = [&](const path& e) {
+        error_code rec;
+        if (remove(e, rec)) {
+            ++removed;
+            return true;
+        }
+        if (rec.value() == ERROR_ACCESS_DENIED && is_set(opts & remove_options::make_writable)) {
+            const auto attrs = ::GetFileAttributesW(e.c_str());
+            if (attrs != INVALID_FILE_ATTRIBUTES && (attrs & FILE_ATTRIBUTE_READONLY)
+                && ::SetFileAttributesW(e.c_str(), attrs & ~FILE_ATTRIBUTE_READONLY) && remove(e, rec)) {
+                ++removed;
+                return true;
+            }
+        }
+        if (is_set(opts & remove_options::skip_permission_denied)
+            && (rec.value() == ERROR_ACCESS_DENIED || (kept && rec.value() == ERROR_DIR_NOT_EMPTY))) {
+            kept = true;
+            return true;
+        }
+        ec = rec;
+        return false;
+    };
+    
+    auto dopts = directory_options::include_postorder_directories;
+    if (is_set(opts & remove_options::skip_permission_denied)) {
+        dopts |= directory_options::skip_permission_denied;
+    }
+    for (recursive_directory_iterator i{p, dopts, ec}; !ec && i != end(i); i.increment(ec)) {
+        const auto& e = i->path();
+        if ((i.is_postorder() || !i.recursion_pending()) && !rm(e)) {
+            return remove_failed;
+        }
+    }
+    if (ec || !rm(p)) {
+        return remove_failed;
+    }
+    return removed;
+}
+
+#endif // _WIN32
+
+} // anon
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+std::uintmax_t remove_all(const path& p) {
+    return remove_all(p, remove_config{});
+}
+
+std::uintmax_t remove_all(const path& p, error_code& ec) {
+    return remove_all(p, remove_config{}, ec);
+}
+
+std::uintmax_t remove_all(const path& p, const remove_config& cfg) {
+    error_code ec;
+    const auto n = remove_all(p, cfg, ec);
+    PS_THROW_IF(ec.value() != 0, filesystem_error("Could not remove path", p, ec));
+    return n;
+}
+
+std::uintmax_t remove_all(const path& p, const remove_config& cfg, error_code& ec) {
+    const auto st = symlink_status(p, ec);
+    if (ec) {
+        if (st.type() == file_type::not_found) {
+            ec.clear();
+            return 0;
+        }
+        return remove_failed;
+    }
+    if (!is_directory(st)) {
+        return remove(p, ec) ? 1 : remove_failed;
+    }
+#if !_WIN32
+    return tree_remover{cfg}.remove(p, ec);
+#else
+    return remove_tree(p, cfg.options, ec);
+#endif
+}
+
+} // v1
+} // filesystem
+} // prosoft
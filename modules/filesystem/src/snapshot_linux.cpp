@@ -0,0 +1,438 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <fcntl.h>
+#include <linux/fs.h> // FICLONE
+#include <sys/ioctl.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_atomic_file.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_snapshot.hpp>
+#include "copyops_internal.hpp"
+#include "filesystem_private.hpp"
+
+namespace {
+
+using namespace prosoft::filesystem;
+
+constexpr const char* store_name = ".ps_snapshots";
+
+// File times come from the kernel's coarse clock, which may lag the snapshot time by up to a tick.
+constexpr std::int64_t clock_slack = 10000000; // ns
+
+enum delete_flags : unsigned {
+    detach_force = 0xf0f0f0f0U,
+};
+
+std::atomic<unsigned> g_count{0};
+
+// The change time of each inode a snapshot hard linked, read right after linking. Kept beside the snapshot, sorted by inode.
+struct linked_inode {
+    std::uint64_t ino;
+    std::int64_t changed; // ns
+};
+static_assert(sizeof(linked_inode) == 16, "unexpected padding");
+
+inline std::int64_t nanoseconds(const struct timespec& ts) noexcept {
+    return static_cast<std::int64_t>(ts.tv_sec) * 1000000000LL + static_cast<std::int64_t>(ts.tv_nsec);
+}
+
+inline bool denied(int err) noexcept {
+    return err == EACCES || err == EPERM || err == EROFS;
+}
+
+// Clones and links require the store to be on the same filesystem as the source.
+path snapshot_store(const path& from, error_code& ec) {
+    const auto mp = mount_path(from, ec);
+    if (ec) {
+        return {};
+    }
+    
+    const path candidates[] = {mp, from != mp ? from.parent_path() : path{}};
+    for (const auto& c : candidates) {
+        if (c.empty()) {
+            continue;
+        }
+        auto store = c / path{store_name};
+        if (0 == ::mkdir(store.c_str(), 0700) || errno == EEXIST) {
+            ec.clear();
+            return store;
+        }
+        ifilesystem::system_error(ec);
+        if (!denied(ec.value())) {
+            break;
+        }
+    }
+    return {};
+}
+
+// A filesystem either implements cloning or it doesn't, so a pair of empty files is enough to find out.
+bool can_clone(const path& store) {
+    const auto name = std::string{".probe."} + std::to_string(::getpid()) + "." + std::to_string(++g_count);
+    ifilesystem::unique_fd fds[2];
+    for (int i = 0; i < 2; ++i) {
+        const auto p = store / path{name + std::to_string(i)};
+        fds[i].reset(::open(p.c_str(), O_RDWR|O_CREAT|O_EXCL|O_CLOEXEC, 0600));
+        if (!fds[i]) {
+            return false;
+        }
+        ::unlink(p.c_str());
+    }
+    return 0 == ::ioctl(fds[1].get(), FICLONE, fds[0].get());
+}
+
+// The snapshot directory is named for the time it was taken.
+std::int64_t snapshot_time(const snapshot_id& sid) {
+    const auto name = path{sid.m_id}.filename().string();
+    try {
+        return std::stoll(name.substr(0, name.find('.')));
+    } catch (const std::exception&) {
+        return 0;
+    }
+}
+
+path links_file(const path& snapshot) {
+    auto p = snapshot;
+    p.concat(".links");
+    return p;
+}
+
+void write_links(const path& p, std::vector<linked_inode>& links, error_code& ec) {
+    std::sort(links.begin(), links.end(), [](const linked_inode& l, const linked_inode& r) { return l.ino < r.ino; });
+    atomic_file f{p, publish_options::none, ec};
+    if (!ec) {
+        f.write(links.data(), links.size() * sizeof(linked_inode), ec);
+    }
+    if (!ec) {
+        f.commit(ec);
+    }
+}
+
+// A binary search with pread(), a snapshot of a large tree has as many records as files.
+bool find_link(const path& p, std::uint64_t ino, linked_inode& li) {
+    ifilesystem::unique_fd fd{::open(p.c_str(), O_RDONLY|O_CLOEXEC)};
+    struct stat sb;
+    if (!fd || 0 != ::fstat(fd.get(), &sb)) {
+        return false;
+    }
+    std::size_t lo = 0;
+    std::size_t hi = static_cast<std::size_t>(sb.st_size) / sizeof(linked_inode);
+    while (lo < hi) {
+        const auto mid = lo + (hi - lo) / 2;
+        const auto off = static_cast<off_t>(mid * sizeof(linked_inode));
+        if (sizeof(li) != ::pread(fd.get(), &li, sizeof(li), off)) {
+            return false;
+        }
+        if (li.ino == ino) {
+            return true;
+        }
+        if (li.ino < ino) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return false;
+}
+
+// A snapshot's directories may have been copied read-only.
+void remove_snapshot_tree(const path& p, error_code& ec) {
+    remove_all(p, ec);
+    if (!denied(ec.value())) {
+        return;
+    }
+    
+    error_code iec;
+    for (recursive_directory_iterator i{p, directory_options::none, iec}; !iec && i != end(i); i.increment(iec)) {
+        struct stat sb;
+        if (0 == ::lstat(i->path().c_str(), &sb) && S_ISDIR(sb.st_mode)) {
+            ::chmod(i->path().c_str(), (sb.st_mode & 07777) | S_IRWXU); // never a file, those may be links to the originals
+        }
+    }
+    ::chmod(p.c_str(), S_IRWXU);
+    remove_all(p, ec);
+}
+
+} // namespace
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+class snapshot_manager {
+public:
+    static snapshot_id& id(snapshot& snap) {
+        return snap.m_id;
+    }
+};
+
+} // v1
+} // filesystem
+} // prosoft
+
+prosoft::filesystem::v1::snapshot::~snapshot() {
+    std::error_code ec;
+    detach_snapshot(*this, ec);
+    m_flags = detach_force;
+    delete_snapshot(*this, ec);
+}
+
+using snapshot = prosoft::filesystem::v1::snapshot;
+
+snapshot prosoft::filesystem::v1::create_snapshot(const path& p, const snapshot_create_options& opts, std::error_code& ec) {
+    if (p.empty()) {
+        ec = einval();
+        return snapshot{snapshot_id{}};
+    }
+    const auto from = canonical(p, ec);
+    if (ec) {
+        return snapshot{snapshot_id{}};
+    }
+    if (!is_directory(from, ec)) {
+        if (!ec) {
+            ec.assign(ENOTDIR, std::system_category());
+        }
+        return snapshot{snapshot_id{}};
+    }
+    
+    const auto store = snapshot_store(from, ec);
+    if (ec) {
+        return snapshot{snapshot_id{}};
+    }
+    
+    // Taken before anything is copied, so anything modified later is newer.
+    const auto when = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    const auto to = store / path{std::to_string(when) + "." + std::to_string(::getpid()) + "." + std::to_string(++g_count)};
+    auto copts = copy_options::recursive|copy_options::copy_symlinks;
+    const bool link = !can_clone(store);
+    if (link) {
+        copts |= copy_options::create_hard_links;
+    }
+    
+    std::mutex links_lock;
+    std::vector<linked_inode> links;
+    ifilesystem::tree_filter filter{store, true, true, true, nullptr};
+    if (link) {
+        filter.linked = [&links_lock, &links](const struct stat& sb) {
+            std::lock_guard<std::mutex> l{links_lock};
+            links.push_back(linked_inode{static_cast<std::uint64_t>(sb.st_ino), nanoseconds(ifilesystem::change_time(sb))});
+        };
+    }
+    copy_result r;
+    ifilesystem::copy_tree(from, to, copts, copy_config{}, filter, r, ec);
+    if (!ec && link) {
+        write_links(links_file(to), links, ec);
+    }
+    if (ec) {
+        error_code ignore;
+        remove_snapshot_tree(to, ignore);
+        ::unlink(links_file(to).c_str());
+        ::rmdir(store.c_str()); // if empty
+        return snapshot{snapshot_id{}};
+    }
+    
+    auto sid = snapshot_id{to.string()};
+    sid.m_from = from;
+    return snapshot{std::move(sid), opts.m_flags};
+}
+
+void prosoft::filesystem::v1::attach_snapshot(snapshot& snap, const path& mp, std::error_code& ec) {
+    if (snap.id().m_id.empty() || snap.id().m_from.empty() || mp.empty()) {
+        ec.assign(EINVAL, std::system_category());
+        return;
+    }
+    if (!snap.id().m_to.empty()) {
+        ec.assign(EBUSY, std::system_category());
+        return;
+    }
+    
+    const auto& from = snap.id().m_id;
+    const bool created = 0 == ::mkdir(mp.c_str(), 0755);
+    if (!created && errno != EEXIST) {
+        ifilesystem::system_error(ec);
+        return;
+    }
+    if (0 == ::mount(from.c_str(), mp.c_str(), nullptr, MS_BIND|MS_REC, nullptr)) {
+        // A bind mount only becomes read-only when remounted.
+        if (0 == ::mount(nullptr, mp.c_str(), nullptr, MS_BIND|MS_REMOUNT|MS_RDONLY, nullptr)) {
+            ec.clear();
+            snapshot_manager::id(snap).m_to = mp;
+            return;
+        }
+        ifilesystem::system_error(ec);
+        ::umount2(mp.c_str(), MNT_DETACH);
+    } else if (denied(errno) && created) {
+        // Unprivileged, the snapshot is exposed with a symlink instead.
+        ::rmdir(mp.c_str());
+        if (0 == ::symlink(from.c_str(), mp.c_str())) {
+            ec.clear();
+            snapshot_manager::id(snap).m_to = mp;
+        } else {
+            ifilesystem::system_error(ec);
+        }
+        return;
+    } else {
+        ifilesystem::system_error(ec);
+    }
+    if (created) {
+        ::rmdir(mp.c_str());
+    }
+}
+
+void prosoft::filesystem::v1::detach_snapshot(snapshot& snap) {
+    error_code ec;
+    detach_snapshot(snap, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not detach snapshot", ec));
+}
+
+void prosoft::filesystem::v1::detach_snapshot(snapshot& snap, std::error_code& ec) {
+    const auto& mp = snap.id().m_to;
+    if (snap.id().m_id.empty() || mp.empty()) {
+        ec.assign(EINVAL, std::system_category());
+        return;
+    }
+    
+    struct stat sb;
+    if (0 != ::lstat(mp.c_str(), &sb)) {
+        ifilesystem::system_error(ec);
+        return;
+    }
+    if (S_ISLNK(sb.st_mode)) {
+        if (0 != ::unlink(mp.c_str())) {
+            ifilesystem::system_error(ec);
+            return;
+        }
+    } else {
+        if (0 != ::umount2(mp.c_str(), MNT_DETACH)) {
+            ifilesystem::system_error(ec);
+            return;
+        }
+        ::rmdir(mp.c_str());
+    }
+    ec.clear();
+    snapshot_manager::id(snap).m_to.clear();
+}
+
+void prosoft::filesystem::v1::delete_snapshot(snapshot& snap) {
+    error_code ec;
+    delete_snapshot(snap, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not delete snapshot", ec));
+}
+
+void prosoft::filesystem::v1::delete_snapshot(snapshot& snap, std::error_code& ec) {
+    if (snap.id().m_id.empty()) {
+        ec.assign(EINVAL, std::system_category());
+        return;
+    }
+    
+    if (!snap.id().m_to.empty()) {
+        if (snap.reserved() != detach_force) {
+            ec.assign(EBUSY, std::system_category());
+            return;
+        }
+        detach_snapshot(snap, ec);
+        if (ec) {
+            return;
+        }
+    }
+    
+    const path p{snap.id().m_id};
+    remove_snapshot_tree(p, ec);
+    if (!ec) {
+        ::unlink(links_file(p).c_str());
+        ::rmdir(p.parent_path().c_str()); // the store, if this was the last snapshot
+        snapshot_manager::id(snap).m_id.clear();
+    }
+}
+
+prosoft::filesystem::v1::path prosoft::filesystem::v1::snapshot_file(const snapshot& snap, const path& p) {
+    error_code ec;
+    auto sp = snapshot_file(snap, p, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not open snapshot file", p, ec));
+    return sp;
+}
+
+prosoft::filesystem::v1::path prosoft::filesystem::v1::snapshot_file(const snapshot& snap, const path& p, std::error_code& ec) {
+    const auto& sid = snap.id();
+    if (sid.m_id.empty() || sid.m_from.empty() || p.empty() || p.is_absolute()) {
+        ec.assign(EINVAL, std::system_category());
+        return {};
+    }
+    
+    auto sp = path{sid.m_id} / p;
+    struct stat ss;
+    if (0 != ::lstat(sp.c_str(), &ss)) {
+        ifilesystem::system_error(ec);
+        return {};
+    }
+    ec.clear();
+    
+    struct stat os;
+    const auto op = sid.m_from / p;
+    if (!S_ISREG(ss.st_mode) || ss.st_nlink < 2 || 0 != ::lstat(op.c_str(), &os) || os.st_dev != ss.st_dev || os.st_ino != ss.st_ino) {
+        return sp; // not shared with the original
+    }
+    
+    // The modification time can be set back (e.g. by a tool restoring it after a write), the change time can't.
+    const auto modified = nanoseconds(ifilesystem::modify_time(ss));
+    const auto changed = nanoseconds(ifilesystem::change_time(ss));
+    linked_inode li;
+    if (modified > snapshot_time(sid) - clock_slack || (find_link(links_file(path{sid.m_id}), static_cast<std::uint64_t>(ss.st_ino), li) && li.changed != changed)) {
+        ec.assign(ESTALE, std::system_category());
+        return {};
+    }
+    
+    // Copy on open: once the link is replaced, writes to the original no longer reach the snapshot.
+    auto tmp = sp;
+    tmp.concat(".ps_copy." + std::to_string(::getpid()) + "." + std::to_string(++g_count));
+    copy_file_result r;
+    copy_file(sp, tmp, copy_options::none, r, ec);
+    if (!ec) {
+        struct stat as;
+        const struct timespec times[2] = {ifilesystem::access_time(ss), ifilesystem::modify_time(ss)};
+        if (0 != ::lstat(sp.c_str(), &as)) {
+            ifilesystem::system_error(ec);
+        } else if (nanoseconds(ifilesystem::modify_time(as)) != modified || nanoseconds(ifilesystem::change_time(as)) != changed || as.st_size != ss.st_size) {
+            ec.assign(ESTALE, std::system_category()); // written while it was copied
+        } else if (0 != ::chmod(tmp.c_str(), ss.st_mode & 07777) || 0 != ::utimensat(AT_FDCWD, tmp.c_str(), times, 0) || 0 != ::rename(tmp.c_str(), sp.c_str())) {
+            ifilesystem::system_error(ec);
+        }
+    }
+    if (ec) {
+        ::unlink(tmp.c_str());
+        return {};
+    }
+    return sp;
+}
@@ -39,8 +39,19 @@ struct test_state {
     state s;
     
     void add(fs::path p) {
-        fs::change_notification n{std::move(p), fs::path{}, 0, fs::change_event::none, fs::file_type::regular};
-        s.add(&n);
+        fs::change_notifications notes;
+        notes.emplace_back(std::move(p), fs::path{}, 0, fs::change_event::created, fs::file_type::regular);
+        s.add(notes, to_events(fs::ifilesystem::change_iterator_traits::defaults));
+    }
+    
+    void add(fs::change_notifications& notes) {
+        s.add(notes, to_events(fs::ifilesystem::change_iterator_traits::defaults));
+    }
+    
+    fs::path next() {
+        fs::ifilesystem::cache_info cache;
+        prosoft::system::error_code ec;
+        return s.next(cache, ec);
     }
 };
 
@@ -125,4 +136,50 @@ TEST_CASE("change_iterator_internal") {
         paths = ts.s.extract();
         CHECK(paths.empty());
     }
+    
+    WHEN("paths are duplicated") {
+        test_state ts;
+        ts.add(fs::path{PS_TEXT("test")});
+        ts.add(fs::path{PS_TEXT("test2")});
+        ts.add(fs::path{PS_TEXT("test")});
+        
+        auto paths = ts.s.extract();
+        REQUIRE(paths.size() == 2);
+        CHECK(paths[0] == fs::path{PS_TEXT("test")});
+        CHECK(paths[1] == fs::path{PS_TEXT("test2")});
+    }
+    
+    WHEN("iterating and extracting paths") {
+        test_state ts;
+        ts.add(fs::path{PS_TEXT("test")});
+        ts.add(fs::path{PS_TEXT("test2")});
+        CHECK(ts.next() == fs::path{PS_TEXT("test")});
+        
+        // a consumed path may be added again
+        ts.add(fs::path{PS_TEXT("test")});
+        ts.add(fs::path{PS_TEXT("test3")});
+        ts.add(fs::path{PS_TEXT("test2")});
+        
+        auto paths = ts.s.extract();
+        REQUIRE(paths.size() == 3);
+        CHECK(paths[0] == fs::path{PS_TEXT("test2")});
+        CHECK(paths[1] == fs::path{PS_TEXT("test")});
+        CHECK(paths[2] == fs::path{PS_TEXT("test3")});
+        CHECK(ts.next().empty());
+    }
+    
+    WHEN("a batch is canceled") {
+        test_state ts;
+        fs::change_notifications notes;
+        notes.emplace_back(fs::path{PS_TEXT("test")}, fs::path{}, 0, fs::change_event::created, fs::file_type::regular);
+        notes.emplace_back(fs::path{PS_TEXT("root")}, fs::path{}, 0, fs::change_event::rescan_required, fs::file_type::directory);
+        notes.emplace_back(fs::path{PS_TEXT("test2")}, fs::path{}, 0, fs::change_event::created, fs::file_type::regular);
+        ts.add(notes);
+        CHECK(ts.s.done());
+        CHECK_FALSE(ts.s.at_end());
+        
+        CHECK(ts.next() == fs::path{PS_TEXT("test")});
+        CHECK(ts.next().empty());
+        CHECK(ts.s.at_end());
+    }
 }
@@ -0,0 +1,215 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <change_journal_linux_internal.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+#include <fstestutils.hpp>
+
+using namespace prosoft::filesystem;
+using namespace prosoft::filesystem::ifilesystem;
+
+namespace {
+
+constexpr change_event_id start = 90;
+constexpr change_event_id session = 100;
+const std::string uuid{"boot/1"};
+const path root{"/r"};
+
+void add(change_notifications& notes, const char* p, change_event ev, change_event_id evid, const char* np = "") {
+    notes.emplace_back(path{p}, path{np}, evid, ev, file_type::regular);
+}
+
+} // namespace
+
+TEST_CASE("change_journal_linux_internal") {
+    const auto p = temp_directory_path() / process_name("change_journal_test");
+    PS_RAII_REMOVE(p);
+    
+    change_journal writer;
+    error_code ec;
+    writer.open(p, uuid, root, 0, start, ec);
+    REQUIRE(ec.value() == 0);
+    REQUIRE(writer.is_open());
+    REQUIRE(writer.writer());
+    CHECK(writer.first_id() == start);
+    CHECK(file_size(p) > change_journal::min_size);
+    writer.start_session(session);
+    
+    change_notifications notes;
+    add(notes, "/r/a", change_event::created, 110);
+    add(notes, "/r/a", change_event::renamed, 120, "/r/b");
+    writer.append(notes);
+    CHECK(writer.last_id() == 120);
+    notes.clear();
+    
+    change_journal reader;
+    reader.open(p, uuid, root, 0, 0, ec);
+    REQUIRE(ec.value() == 0);
+    REQUIRE(reader.is_open());
+    CHECK_FALSE(reader.writer());
+    
+    WHEN("replaying after the session started") {
+        CHECK(reader.replay(session, 0, root, change_event::all, notes, nullptr));
+        REQUIRE(notes.size() == 2);
+        CHECK(notes[0].path() == path{"/r/a"});
+        CHECK(notes[0].event() == change_event::created);
+        CHECK(notes[0].event_id() == 110);
+        CHECK(notes[0].type() == file_type::regular);
+        CHECK(notes[1].path() == path{"/r/a"});
+        CHECK(notes[1].renamed_to_path() == path{"/r/b"});
+        CHECK(notes[1].event() == change_event::renamed);
+        
+        notes.clear();
+        CHECK(reader.replay(110, 0, root, change_event::all, notes, nullptr));
+        REQUIRE(notes.size() == 1);
+        CHECK(notes[0].event_id() == 120);
+        
+        notes.clear();
+        CHECK(reader.replay(115, 10, root, change_event::all, notes, nullptr));
+        CHECK(notes.size() == 2);
+        
+        notes.clear();
+        CHECK(reader.replay(120, 0, root, change_event::all, notes, nullptr));
+        CHECK(notes.empty());
+    }
+    
+    WHEN("replaying from before the session") {
+        CHECK_FALSE(reader.replay(start + 1, 0, root, change_event::all, notes, nullptr));
+        CHECK_FALSE(reader.replay(start - 1, 0, root, change_event::all, notes, nullptr));
+    }
+    
+    WHEN("the writer reported a rescan") {
+        add(notes, "/r", change_event::rescan_required, 130);
+        writer.append(notes);
+        notes.clear();
+        CHECK_FALSE(reader.replay(120, 0, root, change_event::all, notes, nullptr));
+        notes.clear();
+        CHECK(reader.replay(130, 0, root, change_event::all, notes, nullptr));
+        CHECK(notes.empty());
+    }
+    
+    WHEN("the journal is reopened by a new writer") {
+        writer.close();
+        CHECK_FALSE(writer.is_open());
+        writer.open(p, uuid, root, 0, 200, ec);
+        REQUIRE(ec.value() == 0);
+        REQUIRE(writer.writer());
+        CHECK(writer.first_id() == start); // still valid
+        writer.start_session(210);
+        CHECK_FALSE(reader.replay(120, 0, root, change_event::all, notes, nullptr));
+        notes.clear();
+        CHECK(reader.replay(210, 0, root, change_event::all, notes, nullptr));
+        CHECK(notes.empty());
+    }
+    
+    WHEN("the journal belongs to another uuid") {
+        change_journal other;
+        other.open(p, "boot/2", root, 0, 0, ec);
+        CHECK(ec.value() == EINVAL);
+        CHECK_FALSE(other.is_open());
+        
+        writer.close();
+        other.open(p, "boot/2", root, 0, 300, ec);
+        REQUIRE(ec.value() == 0);
+        REQUIRE(other.writer());
+        CHECK(other.first_id() == 300);
+        CHECK(other.last_id() == 300);
+    }
+    
+    WHEN("replaying for another root or events") {
+        add(notes, "/r/d/1", change_event::created, 130);
+        add(notes, "/r/dd", change_event::removed, 140);
+        add(notes, "/s/1", change_event::renamed, 150, "/r/d/2");
+        writer.append(notes);
+        notes.clear();
+        
+        CHECK(reader.replay(120, 0, path{"/r/d"}, change_event::all, notes, nullptr));
+        REQUIRE(notes.size() == 2);
+        CHECK(notes[0].event_id() == 130);
+        CHECK(notes[1].event_id() == 150);
+        
+        notes.clear();
+        CHECK(reader.replay(120, 0, root, change_event::removed, notes, nullptr));
+        REQUIRE(notes.size() == 1);
+        CHECK(notes[0].event_id() == 140);
+        
+        notes.clear();
+        CHECK_FALSE(reader.replay(120, 0, path{"/"}, change_event::all, notes, nullptr));
+        CHECK_FALSE(reader.replay(120, 0, path{"/s"}, change_event::all, notes, nullptr));
+        CHECK_FALSE(reader.replay(120, 0, path{"/rr"}, change_event::all, notes, nullptr));
+    }
+    
+    WHEN("the writer reported a rescan of part of the root") {
+        add(notes, "/r/d", change_event::rescan, 130);
+        writer.append(notes);
+        notes.clear();
+        CHECK_FALSE(reader.replay(120, 0, path{"/r/d/e"}, change_event::all, notes, nullptr));
+        notes.clear();
+        CHECK(reader.replay(120, 0, root, change_event::all, notes, nullptr));
+        REQUIRE(notes.size() == 1);
+        CHECK(notes[0].event() == change_event::rescan);
+        notes.clear();
+        CHECK(reader.replay(120, 0, path{"/r/e"}, change_event::all, notes, nullptr));
+        CHECK(notes.empty());
+    }
+    
+    WHEN("an event is too large for the journal") {
+        const std::string big(change_journal::min_size, 'a');
+        add(notes, ("/r/" + big).c_str(), change_event::created, 130);
+        writer.append(notes);
+        notes.clear();
+        CHECK(writer.last_id() == 130);
+        CHECK_FALSE(reader.replay(120, 0, root, change_event::all, notes, nullptr));
+        notes.clear();
+        CHECK(reader.replay(130, 0, root, change_event::all, notes, nullptr));
+        CHECK(notes.empty());
+    }
+    
+    WHEN("the journal is reopened for another root") {
+        writer.close();
+        writer.open(p, uuid, path{"/s"}, 0, 200, ec);
+        REQUIRE(ec.value() == 0);
+        REQUIRE(writer.writer());
+        CHECK(writer.first_id() == 200);
+        CHECK_FALSE(reader.replay(session, 0, root, change_event::all, notes, nullptr));
+    }
+    
+    WHEN("the journal is full") {
+        change_event_id evid = 200;
+        for (int i = 0; i < 4000; ++i) {
+            add(notes, "/r/some/longer/path/to/fill/the/journal", change_event::content_modified, ++evid);
+        }
+        writer.append(notes);
+        notes.clear();
+        CHECK(writer.last_id() == evid);
+        CHECK(writer.first_id() > 200);
+        CHECK(reader.first_id() == writer.first_id());
+        CHECK_FALSE(reader.replay(session, 0, root, change_event::all, notes, nullptr));
+        notes.clear();
+        CHECK(reader.replay(evid - 10, 0, root, change_event::all, notes, nullptr));
+        CHECK(notes.size() == 10);
+    }
+}
@@ -0,0 +1,142 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <prosoft/core/config/config_platform.h>
+
+#if !_WIN32
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+
+#include <copyops_internal.hpp>
+#include <filesystem_private.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+#include <fstestutils.hpp>
+
+using namespace prosoft::filesystem;
+using namespace prosoft::filesystem::ifilesystem;
+
+namespace {
+
+constexpr off_t tail_offset = 8 * 1024 * 1024;
+
+std::string contents(int fd) {
+    std::string s;
+    char buf[64 * 1024];
+    for (off_t off = 0;;) {
+        const auto n = ::pread(fd, buf, sizeof(buf), off);
+        if (n <= 0) {
+            break;
+        }
+        s.append(buf, static_cast<size_t>(n));
+        off += n;
+    }
+    return s;
+}
+
+bool sparse(int fd) {
+    struct stat sb;
+    return 0 == ::fstat(fd, &sb) && sb.st_blocks * 512 < sb.st_size;
+}
+
+} // namespace
+
+TEST_CASE("copyops_internal") {
+    const auto from = temp_directory_path() / process_name("copyops1");
+    const auto to = temp_directory_path() / process_name("copyops2");
+    PS_RAII_REMOVE(from);
+    PS_RAII_REMOVE(to);
+    
+    // Data at both ends with a hole between.
+    unique_fd src{::open(from.c_str(), O_RDWR|O_CREAT|O_TRUNC|O_CLOEXEC, 0600)};
+    REQUIRE(src);
+    REQUIRE(5 == ::pwrite(src.get(), "head", 5, 0));
+    REQUIRE(5 == ::pwrite(src.get(), "tail", 5, tail_offset));
+    const file_size_type size = tail_offset + 5;
+    const bool source_sparse = sparse(src.get());
+    const auto expected = contents(src.get());
+    REQUIRE(expected.size() == size);
+    
+    unique_fd dst{::open(to.c_str(), O_RDWR|O_CREAT|O_TRUNC|O_CLOEXEC, 0600)};
+    REQUIRE(dst);
+    
+    copy_file_result r;
+    error_code ec;
+    
+    for (auto s : {copy_strategy::clone, copy_strategy::copy_range, copy_strategy::sendfile, copy_strategy::read_write}) {
+        REQUIRE(0 == ::ftruncate(dst.get(), 0));
+        copy_data(src.get(), dst.get(), size, s, r, ec);
+        REQUIRE(ec.value() == 0);
+        CHECK(contents(dst.get()) == expected);
+        CHECK(r.bytes_cloned + r.bytes_copied + r.bytes_skipped == size);
+        CHECK(static_cast<int>(r.strategy) >= static_cast<int>(s));
+        if (r.strategy != copy_strategy::clone) {
+            CHECK(r.bytes_cloned == 0);
+            if (source_sparse) {
+                CHECK(r.bytes_skipped > 0);
+                CHECK(sparse(dst.get()));
+            }
+        }
+    }
+    CHECK(r.strategy == copy_strategy::read_write);
+    
+    WHEN("the file is empty") {
+        REQUIRE(0 == ::ftruncate(dst.get(), 0));
+        copy_data(src.get(), dst.get(), 0, copy_strategy::clone, r, ec);
+        CHECK(ec.value() == 0);
+        CHECK(r.strategy == copy_strategy::none);
+        CHECK(r.bytes_copied == 0);
+    }
+    
+    WHEN("the file is a single hole") {
+        REQUIRE(0 == ::ftruncate(src.get(), 0));
+        REQUIRE(0 == ::ftruncate(src.get(), 1024 * 1024));
+        REQUIRE(0 == ::ftruncate(dst.get(), 0));
+        copy_data(src.get(), dst.get(), 1024 * 1024, copy_strategy::copy_range, r, ec);
+        CHECK(ec.value() == 0);
+        CHECK(contents(dst.get()) == std::string(1024 * 1024, '\0'));
+        CHECK(r.bytes_copied + r.bytes_skipped == 1024 * 1024);
+    }
+    
+    WHEN("the source is truncated after its size was read") {
+        for (off_t truncated : {off_t{3}, off_t{1024 * 1024}}) {
+            REQUIRE(0 == ::ftruncate(src.get(), truncated));
+            const auto left = contents(src.get());
+            for (auto s : {copy_strategy::copy_range, copy_strategy::sendfile, copy_strategy::read_write}) {
+                REQUIRE(0 == ::ftruncate(dst.get(), 0));
+                copy_data(src.get(), dst.get(), size, s, r, ec);
+                CHECK(ec.value() == 0);
+                CHECK(contents(dst.get()) == left);
+                CHECK(r.bytes_copied + r.bytes_skipped == static_cast<file_size_type>(truncated));
+            }
+        }
+    }
+}
+
+#endif // !_WIN32
@@ -0,0 +1,179 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#if !_WIN32
+#include <sys/stat.h>
+#endif
+
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_atomic_file.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+#include "fsdirent_catch_fix.hpp"
+
+using namespace prosoft;
+using namespace prosoft::filesystem;
+
+#include <fstestutils.hpp>
+
+namespace {
+
+std::string contents(const path& p) {
+    std::ifstream f{p.c_str(), std::ios::binary};
+    return std::string{std::istreambuf_iterator<char>{f}, std::istreambuf_iterator<char>{}};
+}
+
+std::size_t entries(const path& dir) {
+    std::size_t n = 0;
+    for (directory_iterator i{dir}; i != end(i); ++i) {
+        ++n;
+    }
+    return n;
+}
+
+} // anon
+
+TEST_CASE("filesystem_atomic_file") {
+    const auto root = temp_directory_path() / process_name("fs20atomic");
+    create_directory(root);
+    const auto target = root / PS_TEXT("state");
+    error_code ec;
+    
+    WHEN("committing a new file") {
+        atomic_file f{target};
+        f.write("new content");
+        CHECK_FALSE(exists(target, ec));
+        f.commit();
+        CHECK_FALSE(f.is_open());
+        CHECK(contents(target) == "new content");
+        CHECK(entries(root) == 1);
+    }
+    
+    WHEN("replacing a file") {
+        {
+            std::ofstream s{target.c_str(), std::ios::binary};
+            s << "old content";
+        }
+#if !_WIN32
+        REQUIRE(0 == ::chmod(target.c_str(), 0640));
+#endif
+        atomic_file f{target};
+        f.write("new content");
+        CHECK(contents(target) == "old content");
+        f.commit();
+        CHECK(contents(target) == "new content");
+        CHECK(entries(root) == 1);
+#if !_WIN32
+        CHECK(status(target).permissions() == (perms::owner_read|perms::owner_write|perms::group_read));
+#endif
+        
+        WHEN("the target must not exist") {
+            CHECK_THROWS(atomic_file(target, publish_options::no_replace));
+            atomic_file(target, publish_options::no_replace, ec);
+            CHECK(ec.value() != 0);
+        }
+        
+        WHEN("exchanging the content") {
+            atomic_file x{target, publish_options::exchange};
+            x.write("exchanged");
+            x.commit();
+            CHECK(contents(target) == "exchanged");
+            CHECK(entries(root) == 1);
+        }
+    }
+    
+    WHEN("exchanging a missing file") {
+        atomic_file(target, publish_options::exchange, ec);
+        CHECK(ec.value() != 0);
+    }
+    
+    WHEN("content is discarded") {
+        {
+            atomic_file f{target, publish_options::no_replace};
+            f.write("discarded");
+        }
+        CHECK_FALSE(exists(target, ec));
+        CHECK(entries(root) == 0);
+    }
+    
+    WHEN("committing a group") {
+        for (auto mode : {durability_group::sync_mode::per_file, durability_group::sync_mode::per_filesystem, durability_group::sync_mode::automatic}) {
+            durability_group g{mode};
+            for (int i = 0; i < 10; ++i) {
+                atomic_file f{root / path{std::to_string(i)}};
+                f.write(std::to_string(i));
+                g.add(std::move(f));
+            }
+            CHECK(g.size() == 10);
+            CHECK_FALSE(exists(root / PS_TEXT("7"), ec));
+            g.commit();
+            CHECK(g.empty());
+            CHECK(entries(root) == 10);
+            CHECK(contents(root / PS_TEXT("7")) == "7");
+            remove_all(root);
+            create_directory(root);
+        }
+    }
+    
+    WHEN("committing from several threads") {
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&root, t]() {
+                for (int i = 0; i < 16; ++i) {
+                    atomic_file f{root / path{std::to_string(t * 16 + i)}};
+                    f.write("x");
+                    f.commit();
+                }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        CHECK(entries(root) == 64);
+    }
+    
+    WHEN("a group fails") {
+        durability_group g;
+        atomic_file f{root / PS_TEXT("a"), publish_options::no_replace};
+        f.write("a");
+        g.add(std::move(f));
+        create_file(root / PS_TEXT("a")); // published before the group
+        atomic_file f2{root / PS_TEXT("b")};
+        f2.write("b");
+        g.add(std::move(f2));
+        g.commit(ec);
+        CHECK(ec.value() != 0);
+        CHECK(file_size(root / PS_TEXT("a")) == 0);
+        CHECK_FALSE(exists(root / PS_TEXT("b"), ec));
+        CHECK(entries(root) == 1);
+    }
+    
+    CHECK(remove_all(root) > 0);
+}
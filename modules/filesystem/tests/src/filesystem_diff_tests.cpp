@@ -0,0 +1,195 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_diff.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+#include "fsdirent_catch_fix.hpp"
+
+using namespace prosoft;
+using namespace prosoft::filesystem;
+
+#include <fstestutils.hpp>
+
+namespace {
+
+void write(const path& p, const std::string& s) {
+    std::ofstream f{p.c_str(), std::ios::binary};
+    f << s;
+}
+
+using change = std::tuple<diff_kind, path, path>;
+
+// Directory times depend on the timer granularity, only files are compared.
+std::vector<change> file_changes(const std::vector<diff_record>& records) {
+    std::vector<change> v;
+    for (const auto& r : records) {
+        if (r.before.type != file_type::directory && r.after.type != file_type::directory) {
+            v.emplace_back(r.kind, r.path, r.old_path);
+        }
+    }
+    std::sort(v.begin(), v.end());
+    return v;
+}
+
+template <class Before>
+std::vector<diff_record> run(const Before& before, const path& after, const diff_config& cfg) {
+    std::vector<diff_record> records;
+    diff(before, after, cfg, [&records](diff_record& r) {
+        records.push_back(std::move(r));
+    });
+    return records;
+}
+
+} // anon
+
+TEST_CASE("filesystem_diff") {
+    const auto root = temp_directory_path() / process_name("fs_diff_test");
+    remove_all(root);
+    const auto tree = root / PS_TEXT("tree");
+    const auto file = root / PS_TEXT("tree.manifest");
+    REQUIRE(create_directories(tree / PS_TEXT("d") / PS_TEXT("e")));
+    REQUIRE(create_directories(tree / PS_TEXT("f")));
+    REQUIRE(create_directories(tree / PS_TEXT("h")));
+    write(tree / PS_TEXT("a"), "1");
+    write(tree / PS_TEXT("d") / PS_TEXT("b"), "22");
+    write(tree / PS_TEXT("d") / PS_TEXT("e") / PS_TEXT("c"), "333");
+    write(tree / PS_TEXT("f") / PS_TEXT("g"), "4444");
+    write(tree / PS_TEXT("h") / PS_TEXT("x"), "55555");
+    
+    {
+        manifest_writer w{file, tree};
+        w.append_tree(tree);
+        w.commit();
+    }
+    const manifest m{file};
+    
+    SECTION("unchanged") {
+        CHECK(run(m, tree, diff_config{}).empty());
+        CHECK(run(m, tree, diff_config{diff_options::compare_metadata, 1}).empty());
+        CHECK(run(tree, tree, diff_config{}).empty());
+    }
+    
+    SECTION("manifest") {
+        write(tree / PS_TEXT("a"), "changed");
+        write(tree / PS_TEXT("d") / PS_TEXT("new"), "");
+        remove(tree / PS_TEXT("f") / PS_TEXT("g"));
+        rename(tree / PS_TEXT("h") / PS_TEXT("x"), tree / PS_TEXT("d") / PS_TEXT("y"));
+        
+        const auto d = path{"d"};
+        const std::vector<change> renamed{
+            change{diff_kind::added, d / PS_TEXT("new"), path{}},
+            change{diff_kind::removed, path{"f"} / PS_TEXT("g"), path{}},
+            change{diff_kind::modified, path{"a"}, path{}},
+            change{diff_kind::renamed, d / PS_TEXT("y"), path{"h"} / PS_TEXT("x")},
+        };
+        for (diff_config::count_type threads : {1U, 4U}) {
+            CHECK(file_changes(run(m, tree, diff_config{diff_options::detect_renames, threads})) == renamed);
+        }
+        
+        const std::vector<change> unmatched{
+            change{diff_kind::added, d / PS_TEXT("new"), path{}},
+            change{diff_kind::added, d / PS_TEXT("y"), path{}},
+            change{diff_kind::removed, path{"f"} / PS_TEXT("g"), path{}},
+            change{diff_kind::removed, path{"h"} / PS_TEXT("x"), path{}},
+            change{diff_kind::modified, path{"a"}, path{}},
+        };
+        auto records = run(m, tree, diff_config{diff_options::none, 2});
+        CHECK(file_changes(records) == unmatched);
+        for (const auto& r : records) {
+            if (r.path == path{"a"}) {
+                CHECK(r.before.size == 1);
+                CHECK(r.after.size == 7);
+            }
+        }
+    }
+    
+    SECTION("prune") {
+        write(tree / PS_TEXT("d") / PS_TEXT("e") / PS_TEXT("c"), "modified in place");
+        CHECK(run(m, tree, diff_config{diff_options::prune_unchanged_directories}).empty());
+        CHECK(file_changes(run(m, tree, diff_config{})) == std::vector<change>{change{diff_kind::modified, path{"d"} / PS_TEXT("e") / PS_TEXT("c"), path{}}});
+    }
+    
+    SECTION("trees") {
+        const auto other = root / PS_TEXT("other");
+        copy(tree, other, copy_options::recursive);
+        CHECK(file_changes(run(tree, other, diff_config{diff_options::none})).empty());
+        
+        write(other / PS_TEXT("a"), "changed");
+        remove_all(other / PS_TEXT("d"));
+        write(other / PS_TEXT("d"), "now a file");
+        const auto d = path{"d"};
+        const std::vector<change> expected{
+            change{diff_kind::removed, d / PS_TEXT("b"), path{}},
+            change{diff_kind::removed, d / PS_TEXT("e") / PS_TEXT("c"), path{}},
+            change{diff_kind::modified, path{"a"}, path{}},
+        };
+        const auto records = run(tree, other, diff_config{diff_options::none, 3});
+        CHECK(file_changes(records) == expected);
+        CHECK(std::count_if(records.begin(), records.end(), [&d](const diff_record& r) {
+            return r.kind == diff_kind::modified && r.path == d && r.after.type == file_type::regular;
+        }) == 1);
+    }
+    
+    SECTION("errors") {
+        error_code ec;
+        diff(m, root / PS_TEXT("missing"), diff_config{}, [](diff_record&) {}, ec);
+        CHECK(ec);
+        
+        const auto unsorted = root / PS_TEXT("unsorted.manifest");
+        {
+            manifest_writer w{unsorted, tree};
+            for (recursive_directory_iterator i{tree}; i != end(i); ++i) {
+                w.append(i);
+            }
+            manifest_record r;
+            r.name = path{"0"};
+            w.append(r);
+            w.commit();
+        }
+        diff(manifest{unsorted}, tree, diff_config{}, [](diff_record&) {}, ec);
+        CHECK(ec);
+        
+        write(tree / PS_TEXT("a"), "changed");
+        CHECK_THROWS_AS(diff(m, tree, diff_config{}, [](diff_record&) { throw std::runtime_error{"stop"}; }), std::runtime_error);
+        
+        // From a subtree task below the top-level directories.
+        write(tree / PS_TEXT("d") / PS_TEXT("e") / PS_TEXT("c"), "changed");
+        CHECK_THROWS_AS(diff(m, tree, diff_config{diff_options::none, 4}, [](diff_record& r) {
+            if (r.path == path{"d"} / PS_TEXT("e") / PS_TEXT("c")) {
+                throw std::runtime_error{"stop"};
+            }
+        }), std::runtime_error);
+    }
+    
+    CHECK(remove_all(root) > 0);
+}
@@ -0,0 +1,172 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#if !_WIN32
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_duplicates.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+#include "fsdirent_catch_fix.hpp"
+
+using namespace prosoft;
+using namespace prosoft::filesystem;
+
+#include <fstestutils.hpp>
+
+namespace {
+
+void write(const path& p, std::string s) {
+    std::ofstream f{p.c_str(), std::ios::binary};
+    f << s;
+}
+
+std::string pattern(std::size_t n) {
+    std::string s(n, '\0');
+    for (std::size_t i = 0; i < n; ++i) {
+        s[i] = static_cast<char>(i * 7);
+    }
+    return s;
+}
+
+std::vector<std::vector<path>> sorted(std::vector<duplicate_group> groups) {
+    std::vector<std::vector<path>> v;
+    for (auto& g : groups) {
+        std::sort(g.paths.begin(), g.paths.end());
+        v.push_back(std::move(g.paths));
+    }
+    std::sort(v.begin(), v.end());
+    return v;
+}
+
+} // anon
+
+TEST_CASE("filesystem_duplicates") {
+    const auto root = temp_directory_path() / process_name("fs_duplicates_test");
+    remove_all(root);
+    REQUIRE(create_directory(root));
+    REQUIRE(create_directory(root / PS_TEXT("sub")));
+    
+    const auto big = pattern(100000);
+    auto middle = big;
+    middle[50000] ^= 1; // same size and edges
+    
+    const auto a1 = root / PS_TEXT("a1");
+    const auto a2 = root / PS_TEXT("sub") / PS_TEXT("a2");
+    const auto c1 = root / PS_TEXT("c1");
+    const auto c2 = root / PS_TEXT("sub") / PS_TEXT("c2");
+    write(a1, big);
+    write(a2, big);
+    write(root / PS_TEXT("b"), middle);
+    write(c1, "small");
+    write(c2, "small");
+    write(root / PS_TEXT("d"), "other");
+    create_file(root / PS_TEXT("e1"));
+    create_file(root / PS_TEXT("e2"));
+#if !_WIN32
+    REQUIRE(0 == ::link(a1.c_str(), (root / PS_TEXT("a3")).c_str()));
+    create_symlink(c1, root / PS_TEXT("sub") / PS_TEXT("c3"));
+#endif
+    const std::vector<std::vector<path>> expected{{a1, a2}, {c1, c2}};
+    
+    SECTION("hash") {
+        std::vector<duplicate_group> groups;
+        duplicate_finder f{duplicate_config{}, [&groups](duplicate_group& g) {
+            groups.push_back(std::move(g));
+        }};
+        for (recursive_directory_iterator i{root}; i != end(i); ++i) {
+            f.push(*i);
+        }
+        f.finish();
+        
+        REQUIRE(groups.size() == 2);
+        for (const auto& g : groups) {
+            CHECK(g.digest.size() == 32); // sha256, including the small files confirmed by their edges
+        }
+        CHECK(sorted(groups) == expected);
+        
+        const auto& stats = f.statistics();
+        CHECK(stats.edge_hashed == 6); // a, b, c, d
+        CHECK(stats.confirmed == 3); // a, b
+        CHECK(stats.groups == 2);
+        CHECK(stats.bytes_read < 4 * big.size());
+#if !_WIN32
+        CHECK(stats.files == 7); // not the empty files
+        CHECK(stats.hardlinks == 1);
+#endif
+    }
+    
+    SECTION("byte compare") {
+        duplicate_config cfg{duplicate_options::byte_compare};
+        cfg.threads_per_device = 1;
+        const auto groups = find_duplicates(root, cfg);
+        REQUIRE(groups.size() == 2);
+        for (const auto& g : groups) {
+            CHECK(g.digest.empty());
+        }
+        CHECK(sorted(groups) == expected);
+    }
+    
+    SECTION("options") {
+        duplicate_config cfg{duplicate_options::none, hash_algorithm::sha256};
+        cfg.min_size = 0;
+        CHECK(find_duplicates(root, cfg).size() == 3); // empty files
+        
+        cfg.min_size = 6;
+        CHECK(sorted(find_duplicates(root, cfg)) == std::vector<std::vector<path>>{{a1, a2}});
+        
+        cfg.min_size = 1;
+        cfg.edge_size = 1024 * 1024; // whole files
+        CHECK(sorted(find_duplicates(root, cfg)) == expected);
+    }
+    
+    SECTION("visitor exception") {
+        int calls = 0;
+        duplicate_finder f{duplicate_config{}, [&calls](duplicate_group&) {
+            ++calls;
+            throw std::runtime_error{"stop"};
+        }};
+        for (recursive_directory_iterator i{root}; i != end(i); ++i) {
+            f.push(*i);
+        }
+        CHECK_THROWS_AS(f.finish(), std::runtime_error);
+        CHECK(calls == 1);
+    }
+    
+    SECTION("errors") {
+        error_code ec;
+        CHECK(find_duplicates(root / PS_TEXT("missing"), duplicate_config{}, ec).empty());
+        CHECK(ec);
+        CHECK_THROWS_AS(find_duplicates(root / PS_TEXT("missing")), filesystem_error);
+    }
+    
+    CHECK(remove_all(root) > 0);
+}
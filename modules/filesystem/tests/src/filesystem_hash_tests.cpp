@@ -0,0 +1,161 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <fstream>
+#include <map>
+#include <string>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_hash.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+#include "fsdirent_catch_fix.hpp"
+
+using namespace prosoft;
+using namespace prosoft::filesystem;
+
+#include <fstestutils.hpp>
+
+namespace {
+
+void write_pattern(const path& p, std::size_t n) {
+    std::ofstream f{p.c_str(), std::ios::binary};
+    for (std::size_t i = 0; i < n; ++i) {
+        f.put(static_cast<char>((i * 31) ^ (i >> 9)));
+    }
+}
+
+} // anon
+
+TEST_CASE("filesystem_hash") {
+    const auto root = temp_directory_path() / process_name("fs_hash_test");
+    remove_all(root);
+    REQUIRE(create_directory(root));
+    
+    constexpr std::size_t size = 1024 * 1024 + 123;
+    const auto big = root / PS_TEXT("big");
+    write_pattern(big, size);
+    
+    SECTION("flat") {
+        hash_config cfg{hash_algorithm::sha256};
+        cfg.chunk_size = 0;
+        error_code ec;
+        const auto d = hash_file(big, cfg, ec);
+        CHECK_FALSE(ec);
+        CHECK(d.size() == 32);
+        
+        cfg.chunk_size = size; // not larger than a chunk
+        CHECK(hash_file(big, cfg) == d);
+        
+        cfg.buffer_size = 4096;
+        CHECK(hash_file(big, cfg) == d);
+        
+        cfg.mmap_threshold = 1;
+        CHECK(hash_file(big, cfg) == d);
+        
+        CHECK(hash_file(big, hash_config{hash_algorithm::xxh64}) != d);
+    }
+    
+    SECTION("tree") {
+        hash_config cfg{hash_algorithm::xxh64, 1};
+        cfg.chunk_size = 64 * 1024;
+        cfg.buffer_size = 16 * 1024;
+        error_code ec;
+        hash_statistics stats;
+        const auto d = hash_file(big, cfg, stats, ec);
+        CHECK_FALSE(ec);
+        CHECK(stats.workers.size() == 1);
+        CHECK(stats.bytes() == size);
+        
+        for (hash_config::count_type t : {2U, 4U, 7U}) {
+            cfg.threads = t;
+            CHECK(hash_file(big, cfg, stats, ec) == d);
+            CHECK(stats.workers.size() == t);
+            CHECK(stats.bytes() == size);
+        }
+        
+        cfg.mmap_threshold = 1;
+        CHECK(hash_file(big, cfg) == d);
+        
+        cfg.chunk_size = 0;
+        CHECK(hash_file(big, cfg) != d);
+        cfg.chunk_size = 128 * 1024;
+        CHECK(hash_file(big, cfg) != d);
+    }
+    
+    SECTION("errors") {
+        error_code ec;
+        CHECK(hash_file(root / PS_TEXT("missing"), hash_config{}, ec).empty());
+        CHECK(ec);
+        ec.clear();
+        CHECK(hash_file(root, hash_config{}, ec).empty());
+        CHECK(ec);
+        CHECK_THROWS_AS(hash_file(root / PS_TEXT("missing")), filesystem_error);
+    }
+    
+    SECTION("pipeline") {
+        REQUIRE(create_directory(root / PS_TEXT("sub")));
+        std::map<path, file_digest> expected;
+        hash_config cfg{hash_algorithm::murmur3_128, 3};
+        cfg.chunk_size = 256 * 1024;
+        expected[big] = hash_file(big, cfg);
+        for (int i = 0; i < 20; ++i) {
+            const auto p = root / PS_TEXT("sub") / path{std::to_string(i)};
+            write_pattern(p, std::size_t(i) * 1000);
+            expected[p] = hash_file(p, cfg);
+        }
+        
+        std::map<path, file_digest> seen;
+        hash_pipeline hp{cfg, [&seen](hash_record& r) {
+            CHECK_FALSE(r.error);
+            seen[r.path] = r.digest;
+        }};
+        for (recursive_directory_iterator i{root}; i != end(i); ++i) {
+            hp.push(*i);
+        }
+        hp.finish();
+        CHECK(seen == expected);
+        CHECK(hp.statistics().bytes() > size);
+        CHECK(hp.statistics().elapsed.count() > 0);
+    }
+    
+    SECTION("pipeline exception") {
+        for (int i = 0; i < 10; ++i) {
+            create_file(root / path{std::to_string(i)});
+        }
+        int calls = 0;
+        hash_pipeline hp{hash_config{}, [&calls](hash_record&) {
+            ++calls;
+            throw std::runtime_error{"stop"};
+        }};
+        for (directory_iterator i{root}; i != end(i); ++i) {
+            hp.push(*i);
+        }
+        CHECK_THROWS_AS(hp.finish(), std::runtime_error);
+        CHECK(calls == 1);
+    }
+    
+    CHECK(remove_all(root) > 0);
+}
@@ -23,6 +23,11 @@
 // (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
 // SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <algorithm>
+#include <limits>
+#include <tuple>
+#include <vector>
+
 #include <prosoft/core/modules/filesystem//filesystem.hpp>
 
 #include <catch2/catch_template_test_macros.hpp>
@@ -34,6 +39,38 @@ using namespace prosoft::filesystem;
 
 #include <fstestutils.hpp>
 
+namespace {
+
+std::vector<path> sorted_listing(const path& root, directory_options opts, ifilesystem::iterator_config&& cfg) {
+    std::vector<path> l;
+    for (recursive_directory_iterator i{root, opts, std::move(cfg)}; i != end(i); ++i) {
+        l.emplace_back(i->path());
+    }
+    std::sort(l.begin(), l.end());
+    return l;
+}
+
+std::vector<path> sorted_listing(const path& root, directory_options opts = recursive_directory_iterator::default_options()) {
+    return sorted_listing(root, opts, ifilesystem::iterator_config{});
+}
+
+// Preorder with siblings in byte order of their UTF-8 names.
+void sorted_tree(const path& dir, std::vector<path>& l) {
+    std::vector<std::pair<std::string, path>> children;
+    for (directory_iterator i{dir}; i != end(i); ++i) {
+        children.emplace_back(i->path().filename().u8string().str(), i->path());
+    }
+    std::sort(children.begin(), children.end());
+    for (const auto& c : children) {
+        l.push_back(c.second);
+        if (is_directory(symlink_status(c.second))) {
+            sorted_tree(c.second, l);
+        }
+    }
+}
+
+} // anon
+
 TEST_CASE("filesystem_iterator") {
     WHEN("reserved options are set") {
         CHECK(make_public(directory_options::reserved_state_mask) == directory_options::none);
@@ -208,6 +245,91 @@ TEST_CASE("filesystem_iterator") {
                     CHECK(linkFound);
                 }
                 
+                AND_WHEN("relative traversal is enabled") {
+                    constexpr auto opts = recursive_directory_iterator::default_options()|directory_options::follow_directory_symlink;
+                    ifilesystem::iterator_config cfg;
+                    cfg.relative_traversal = true;
+                    const auto l = sorted_listing(root, opts, std::move(cfg));
+                    CHECK(l.size() == sorted_listing(root, opts).size());
+                    CHECK(std::find(l.begin(), l.end(), lnk) != l.end());
+                    // Once via the dir and once via the link, which is not resolved.
+                    CHECK(std::count(l.begin(), l.end(), canonical(f)) == 1);
+                    CHECK(std::count(l.begin(), l.end(), lnk / f.filename()) == 1);
+                    
+                    cfg = ifilesystem::iterator_config{};
+                    cfg.relative_traversal = true;
+                    cfg.bulk_read_size = ifilesystem::iterator_config::default_bulk_read_size();
+                    CHECK(sorted_listing(root, opts, std::move(cfg)) == l);
+                }
+                
+                AND_WHEN("visited directories are skipped") {
+                    const auto loop = dir / PS_TEXT("loop"); // 1/loop -> root
+                    REQUIRE(0 == symlink(root.c_str(), loop.c_str()));
+                    PS_RAII_REMOVE(loop);
+                    
+                    auto walk = [&](bool rel) {
+                        constexpr auto opts = recursive_directory_iterator::default_options()|directory_options::follow_directory_symlink;
+                        auto stats = std::make_shared<ifilesystem::iterator_config::statistics_type>();
+                        ifilesystem::iterator_config cfg;
+                        cfg.skip_visited_directories = true;
+                        cfg.relative_traversal = rel;
+                        cfg.statistics = stats;
+                        std::vector<path> l, visited;
+                        for (recursive_directory_iterator i{root, opts, std::move(cfg)}; i != end(i); ++i) {
+                            l.emplace_back(i->path());
+                            if (i.is_visited_directory()) {
+                                CHECK_FALSE(i.recursion_pending());
+                                visited.emplace_back(i->path());
+                            }
+                        }
+                        CHECK(stats->visited_dirs_skipped == visited.size());
+                        std::sort(l.begin(), l.end());
+                        return std::make_pair(l, visited);
+                    };
+                    
+                    for (bool rel : {false, true}) {
+                        const auto r = walk(rel);
+                        const auto& l = r.first;
+                        const auto& v = r.second;
+                        // 1 is entered either directly or through lnk, but never both. The loop is reported as visited once.
+                        const auto lnkloop = lnk / loop.filename();
+                        CHECK(std::count(l.begin(), l.end(), f) + std::count(l.begin(), l.end(), lnk / f.filename()) == 1);
+                        CHECK(std::count(l.begin(), l.end(), loop) + std::count(l.begin(), l.end(), lnkloop) == 1);
+                        CHECK(std::count(v.begin(), v.end(), loop) + std::count(v.begin(), v.end(), lnkloop) == 1);
+                        CHECK(v.size() == 2);
+                    }
+
+                    // A skipped dir still gets its postorder event, and the position can be serialized.
+                    for (bool rel : {false, true}) {
+                        constexpr auto opts = recursive_directory_iterator::default_options()|directory_options::follow_directory_symlink|directory_options::include_postorder_directories;
+                        auto config = [rel]() {
+                            ifilesystem::iterator_config cfg;
+                            cfg.skip_visited_directories = true;
+                            cfg.relative_traversal = rel;
+                            return cfg;
+                        };
+                        std::vector<path> visited, postorder;
+                        for (recursive_directory_iterator i{root, opts, config()}; i != end(i); ++i) {
+                            CHECK_FALSE(i->path().empty());
+                            if (i.is_postorder()) {
+                                postorder.emplace_back(i->path());
+                            } else if (i.is_visited_directory()) {
+                                visited.emplace_back(i->path());
+                                auto cfg = config();
+                                cfg.serialize_data = serialize(i);
+                                error_code ec;
+                                recursive_directory_iterator rest{root, opts, std::move(cfg), ec};
+                                CHECK_FALSE(ec);
+                                CHECK(rest != end(rest));
+                            }
+                        }
+                        REQUIRE(visited.size() == 2);
+                        for (const auto& p : visited) {
+                            CHECK(std::count(postorder.begin(), postorder.end(), p) == 1);
+                        }
+                    }
+                }
+                
                 AND_WHEN("follow dir symlink is enabled") {
                     recursive_directory_iterator i{root, recursive_directory_iterator::default_options()|directory_options::follow_directory_symlink};
                     bool linkFound{};
@@ -254,6 +376,23 @@ TEST_CASE("filesystem_iterator") {
                     CHECK(mountFound);
                 }
                 
+                AND_WHEN("relative traversal is enabled") {
+                    ifilesystem::iterator_config cfg;
+                    cfg.relative_traversal = true;
+                    recursive_directory_iterator i{path{"/"}, opts, std::move(cfg)};
+                    bool mountFound{};
+                    for (auto& e : i) {
+                        if (e.path().filename().native() == mount) {
+                            CHECK_FALSE(i.recursion_pending());
+                            mountFound = true;
+                            break;
+                        } else if (i.recursion_pending()) {
+                            i.disable_recursion_pending();
+                        }
+                    }
+                    CHECK(mountFound);
+                }
+                
                 AND_WHEN("follow mountpoints is enabled") {
                     recursive_directory_iterator i{path{"/"}, opts|directory_options::follow_mountpoints};
                     bool mountFound{};
@@ -274,6 +413,338 @@ TEST_CASE("filesystem_iterator") {
             }
 #endif
             
+#if __linux__
+            WHEN("bulk reading is enabled") {
+                std::vector<path> files;
+                for (int i = 0; i < 200; ++i) {
+                    files.emplace_back(create_file(dir / path{std::string(64, 'a') + std::to_string(i)}));
+                }
+                
+                auto listing = [&](ifilesystem::iterator_config::buffer_size_type sz) {
+                    ifilesystem::iterator_config cfg;
+                    cfg.bulk_read_size = sz;
+                    return sorted_listing(root, recursive_directory_iterator::default_options(), std::move(cfg));
+                };
+                
+                const auto expected = sorted_listing(root);
+                CHECK(expected.size() == files.size() + 2);
+                // A small buffer forces many reads per dir.
+                CHECK(listing(1024) == expected);
+                CHECK(listing(ifilesystem::iterator_config::default_bulk_read_size()) == expected);
+                
+                for (const auto& f : files) {
+                    remove(f);
+                }
+            }
+#endif
+            
+            WHEN("open dirs are limited") {
+                std::vector<path> created;
+                auto d = dir;
+                for (auto name : {PS_TEXT("a"), PS_TEXT("b"), PS_TEXT("c"), PS_TEXT("d")}) {
+                    created.emplace_back(create_file(d / PS_TEXT("f")));
+                    const auto sibling = d / (path{name} += PS_TEXT("s"));
+                    create_directory(sibling);
+                    created.emplace_back(sibling);
+                    created.emplace_back(create_file(sibling / PS_TEXT("f")));
+                    d /= name;
+                    create_directory(d);
+                    created.emplace_back(d);
+                }
+                
+                using record = std::tuple<path, iterator_depth_type, bool, file_type, file_id_type>;
+                auto walk = [&](ifilesystem::iterator_config&& cfg) {
+                    constexpr auto opts = recursive_directory_iterator::default_options()|directory_options::include_postorder_directories;
+                    std::vector<record> l;
+                    for (recursive_directory_iterator i{root, opts, std::move(cfg)}; i != end(i); ++i) {
+                        // The cached info is read from the entry, whose dir may have been drained by the push.
+                        if (!i.is_postorder()) {
+                            CHECK(i->cached_type() == symlink_status(i->path()).type());
+                            CHECK(i->cached_file_id() == symlink_file_id(i->path()));
+                        }
+                        l.emplace_back(i->path(), i.depth(), i.is_postorder(), i->cached_type(), i->cached_file_id());
+                        if (i.recursion_pending() && i->path().filename().native() == PS_TEXT("bs")) {
+                            i.disable_recursion_pending();
+                        }
+                    }
+                    return l;
+                };
+                
+                auto stats = std::make_shared<ifilesystem::iterator_config::statistics_type>();
+                ifilesystem::iterator_config cfg;
+                cfg.statistics = stats;
+                const auto expected = walk(std::move(cfg));
+                CHECK(stats->open_dirs_peak == 6);
+                CHECK(stats->drained_dirs == 0);
+                
+                for (size_t limit : {1, 2, 5}) {
+                    stats = std::make_shared<ifilesystem::iterator_config::statistics_type>();
+                    cfg = ifilesystem::iterator_config{};
+                    cfg.max_open_dirs = limit;
+                    cfg.statistics = stats;
+                    CHECK(walk(std::move(cfg)) == expected);
+                    CHECK(stats->open_dirs_peak == limit);
+                    CHECK(stats->drained_dirs > 0);
+                }
+                
+                for (size_t bulk : {0, 1024}) {
+                    cfg = ifilesystem::iterator_config{};
+                    cfg.max_open_dirs = 1;
+                    cfg.relative_traversal = true;
+                    cfg.bulk_read_size = bulk;
+                    CHECK(walk(std::move(cfg)) == expected);
+                }
+                
+                std::reverse(created.begin(), created.end());
+                for (const auto& p : created) {
+                    remove(p);
+                }
+            }
+            
+            WHEN("the iteration is resumed") {
+                std::vector<path> created;
+                auto d = dir;
+                for (auto name : {PS_TEXT("a"), PS_TEXT("b"), PS_TEXT("c")}) {
+                    for (auto f : {PS_TEXT("f1"), PS_TEXT("f2"), PS_TEXT("f3")}) {
+                        created.emplace_back(create_file(d / path{f}));
+                    }
+                    d /= name;
+                    create_directory(d);
+                    created.emplace_back(d);
+                }
+                
+                using record = std::tuple<path, iterator_depth_type, bool>;
+                constexpr auto opts = recursive_directory_iterator::default_options()|directory_options::include_postorder_directories;
+                auto config = [](bool bulk, bool relative) {
+                    ifilesystem::iterator_config cfg;
+                    cfg.bulk_read_size = bulk ? 1024 : 0;
+                    cfg.relative_traversal = relative;
+                    return cfg;
+                };
+                auto walk = [&](recursive_directory_iterator& i, size_t limit) {
+                    std::vector<record> l;
+                    for (; i != end(i); ++i) {
+                        l.emplace_back(i->path(), i.depth(), i.is_postorder());
+                        if (l.size() == limit) {
+                            break; // the position is after the last entry returned
+                        }
+                    }
+                    return l;
+                };
+                
+                recursive_directory_iterator all{root, opts};
+                const auto expected = walk(all, std::numeric_limits<size_t>::max());
+                REQUIRE(expected.size() == created.size() + 6); // + "1", "._2" and 4 postorder dirs
+                CHECK(serialize(all).empty());
+                
+                for (auto bulk : {false, true}) {
+                    for (auto relative : {false, true}) {
+                        for (size_t n = 1; n < expected.size(); ++n) {
+                            recursive_directory_iterator first{root, opts, config(bulk, relative)};
+                            auto l = walk(first, n);
+                            REQUIRE(l.size() == n);
+                            auto cfg = config(bulk, relative);
+                            cfg.serialize_data = serialize(first);
+                            CHECK_FALSE(cfg.serialize_data.empty());
+                            
+                            recursive_directory_iterator rest{root, opts, std::move(cfg)};
+                            if (n < expected.size() - 1) { // the root has no postorder event, so the last position is the end
+                                REQUIRE(rest != end(rest));
+                                CHECK(rest.depth() == std::get<1>(expected[n]));
+                            }
+                            const auto more = walk(rest, std::numeric_limits<size_t>::max());
+                            l.insert(l.end(), more.begin(), more.end());
+                            CHECK(l == expected);
+                        }
+                    }
+                }
+                
+                ifilesystem::iterator_config cfg;
+                recursive_directory_iterator i{root, opts};
+                cfg.serialize_data = serialize(i);
+                error_code ec;
+                recursive_directory_iterator other{dir, opts, std::move(cfg), ec};
+                CHECK(ec.value() == EINVAL);
+                
+                cfg = ifilesystem::iterator_config{};
+                cfg.serialize_data = serialize(i).substr(0, 6);
+                CHECK_THROWS(recursive_directory_iterator{root, opts, std::move(cfg)});
+                
+                std::reverse(created.begin(), created.end());
+                for (const auto& p : created) {
+                    remove(p);
+                }
+            }
+            
+            WHEN("sorting is enabled") {
+                std::vector<path> created;
+                auto d = dir;
+                for (auto name : {PS_TEXT("m"), PS_TEXT("B"), PS_TEXT("b")}) {
+                    for (auto f : {PS_TEXT("z"), PS_TEXT("a0"), PS_TEXT("_"), PS_TEXT("a"), PS_TEXT("\xC3\xA9"), PS_TEXT("Z")}) {
+                        created.emplace_back(create_file(d / path{f}));
+                    }
+                    d /= name;
+                    create_directory(d);
+                    created.emplace_back(d);
+                }
+                for (int i = 150; i > 0; --i) { // more than sorted_dir::max_runs
+                    created.emplace_back(create_file(dir / path{std::string{"f"} + std::to_string(i)}));
+                }
+                
+                std::vector<path> expected{dir};
+                sorted_tree(dir, expected);
+                REQUIRE(expected.size() == created.size() + 2); // + "1" and "._2"
+                
+                auto listing = [&](ifilesystem::iterator_config&& cfg) {
+                    std::vector<path> l;
+                    cfg.sorted = true;
+                    for (recursive_directory_iterator i{root, recursive_directory_iterator::default_options(), std::move(cfg)}; i != end(i); ++i) {
+                        l.push_back(i->path());
+                    }
+                    return l;
+                };
+                
+                auto stats = std::make_shared<ifilesystem::iterator_config::statistics_type>();
+                ifilesystem::iterator_config cfg;
+                cfg.statistics = stats;
+                CHECK(listing(std::move(cfg)) == expected);
+                CHECK(stats->sorted_runs_spilled == 0);
+                
+                for (ifilesystem::iterator_config::buffer_size_type sz : {1, 512}) {
+                    stats = std::make_shared<ifilesystem::iterator_config::statistics_type>();
+                    cfg = ifilesystem::iterator_config{};
+                    cfg.sort_buffer_size = sz;
+                    cfg.statistics = stats;
+                    CHECK(listing(std::move(cfg)) == expected);
+                    CHECK(stats->sorted_runs_spilled > 0);
+                }
+                
+                cfg = ifilesystem::iterator_config{};
+                cfg.sort_buffer_size = 1;
+                cfg.max_open_dirs = 1;
+                cfg.relative_traversal = true;
+                CHECK(listing(std::move(cfg)) == expected);
+                
+                // Runs are unnamed and count as open.
+                const auto spill = temp_directory_path() / PS_TEXT("ps_sorted_spill");
+                create_directory(spill);
+                stats = std::make_shared<ifilesystem::iterator_config::statistics_type>();
+                cfg = ifilesystem::iterator_config{};
+                cfg.sort_buffer_size = 1;
+                cfg.sort_directory = spill;
+                cfg.statistics = stats;
+                CHECK(listing(std::move(cfg)) == expected);
+                CHECK(stats->open_dirs_peak > 5); // the deepest dir
+                CHECK(stats->open_dirs_peak < 5 + 64); // ancestors keep one run
+                CHECK(directory_iterator{spill} == end(directory_iterator{spill}));
+                remove(spill);
+                
+                cfg = ifilesystem::iterator_config{};
+                cfg.sort_buffer_size = 1;
+                cfg.sort_directory = dir / PS_TEXT("missing");
+                CHECK(listing(std::move(cfg)).size() < expected.size());
+                
+#if __linux__
+                cfg = ifilesystem::iterator_config{};
+                cfg.bulk_read_size = 1024;
+                CHECK(listing(std::move(cfg)) == expected);
+#endif
+                
+                for (size_t n : {size_t{1}, size_t{5}, size_t{9}, size_t{20}, size_t{100}}) {
+                    auto first_cfg = ifilesystem::iterator_config{};
+                    first_cfg.sorted = true;
+                    recursive_directory_iterator first{root, recursive_directory_iterator::default_options(), std::move(first_cfg)};
+                    std::vector<path> l;
+                    for (; first != end(first); ++first) {
+                        l.push_back(first->path());
+                        if (l.size() == n) {
+                            break;
+                        }
+                    }
+                    cfg = ifilesystem::iterator_config{};
+                    cfg.sort_buffer_size = 512;
+                    cfg.serialize_data = serialize(first);
+                    const auto rest = listing(std::move(cfg));
+                    l.insert(l.end(), rest.begin(), rest.end());
+                    CHECK(l == expected);
+                }
+                
+                std::reverse(created.begin(), created.end());
+                for (const auto& p : created) {
+                    remove(p);
+                }
+            }
+            
+            WHEN("name filters are set") {
+                std::vector<path> created;
+                auto add_dir = [&](const path& d) {
+                    create_directory(d);
+                    created.emplace_back(d);
+                    return d;
+                };
+                const auto cache = add_dir(dir / PS_TEXT("cache"));
+                const auto sub = add_dir(dir / PS_TEXT("sub"));
+                for (const auto& f : {dir / PS_TEXT("a.o"), dir / PS_TEXT("b.cpp"), cache / PS_TEXT("x.cpp"), sub / PS_TEXT("c.cpp"), sub / PS_TEXT("d.o")}) {
+                    created.emplace_back(create_file(f));
+                }
+                
+                auto filtered = [&](ifilesystem::iterator_config&& cfg) {
+                    cfg.exclude.emplace_back(PS_TEXT("*.o"));
+                    cfg.exclude.emplace_back(PS_TEXT("cache"));
+                    cfg.include.emplace_back(PS_TEXT("*.cpp"));
+                    return sorted_listing(root, recursive_directory_iterator::default_options(), std::move(cfg));
+                };
+                
+                const auto l = filtered(ifilesystem::iterator_config{});
+                auto has = [&l](const path& p) { return std::find(l.begin(), l.end(), p) != l.end(); };
+                CHECK(has(dir / PS_TEXT("b.cpp")));
+                CHECK(has(sub));
+                CHECK(has(sub / PS_TEXT("c.cpp")));
+                CHECK_FALSE(has(dir / PS_TEXT("a.o")));
+                CHECK_FALSE(has(cache));
+                CHECK_FALSE(has(cache / PS_TEXT("x.cpp"))); // excluded dirs are not descended
+                CHECK_FALSE(has(sub / PS_TEXT("d.o")));
+                for (const auto& p : l) {
+                    CHECK((is_directory(p) || p.extension().native() == PS_TEXT(".cpp")));
+                }
+                
+                ifilesystem::iterator_config cfg;
+                cfg.relative_traversal = true;
+                cfg.bulk_read_size = ifilesystem::iterator_config::default_bulk_read_size();
+                CHECK(filtered(std::move(cfg)) == l);
+                
+                std::reverse(created.begin(), created.end());
+                for (const auto& p : created) {
+                    remove(p);
+                }
+            }
+            
+#if !_WIN32
+            WHEN("file ids are cached") {
+                auto check_ids = [&](ifilesystem::iterator_config&& cfg) {
+                    size_t n = 0;
+                    for (recursive_directory_iterator i{root, recursive_directory_iterator::default_options(), std::move(cfg)}; i != end(i); ++i, ++n) {
+                        const auto fid = i->cached_file_id();
+                        CHECK(fid.valid());
+                        CHECK(fid == symlink_file_id(i->path()));
+                        CHECK(i->file_id() == fid);
+                    }
+                    CHECK(n > 0);
+                };
+                check_ids(ifilesystem::iterator_config{});
+                ifilesystem::iterator_config cfg;
+                cfg.relative_traversal = true;
+                cfg.max_open_dirs = 1;
+                check_ids(std::move(cfg));
+                
+                directory_entry e{root};
+                e.refresh();
+                CHECK_FALSE(e.cached_file_id().valid()); // fetched on demand
+                CHECK(e.file_id() == symlink_file_id(root));
+                CHECK(e.cached_file_id().valid());
+            }
+#endif
+            
             WHEN("skip hidden is enabled") {
                 recursive_directory_iterator i{root, recursive_directory_iterator::default_options()|directory_options::skip_hidden_descendants};
                 CHECK(i.depth() == 0);
@@ -407,6 +878,50 @@ TEST_CASE("filesystem_iterator") {
     }
 }
 
+TEST_CASE("name_filter") {
+    using ifilesystem::name_filter;
+    using string_type = name_filter::string_type;
+    auto match = [](const string_type& glob, const string_type& name) {
+        return name_filter{glob}(name);
+    };
+    
+    WHEN("the pattern is simple") {
+        CHECK(match(PS_TEXT("abc"), PS_TEXT("abc")));
+        CHECK_FALSE(match(PS_TEXT("abc"), PS_TEXT("abcd")));
+        CHECK(match(PS_TEXT("ab*"), PS_TEXT("abcd")));
+        CHECK(match(PS_TEXT("ab*"), PS_TEXT("ab")));
+        CHECK_FALSE(match(PS_TEXT("ab*"), PS_TEXT("a")));
+        CHECK(match(PS_TEXT("*.o"), PS_TEXT("x.o")));
+        CHECK(match(PS_TEXT("*.o"), PS_TEXT(".o")));
+        CHECK_FALSE(match(PS_TEXT("*.o"), PS_TEXT("x.oo")));
+        CHECK(match(PS_TEXT("*tmp*"), PS_TEXT("a.tmp.b")));
+        CHECK_FALSE(match(PS_TEXT("*tmp*"), PS_TEXT("a.tm.p")));
+        CHECK(match(PS_TEXT("*"), PS_TEXT("")));
+        CHECK(match(PS_TEXT("**"), PS_TEXT("abc")));
+    }
+    
+    WHEN("the pattern is a glob") {
+        CHECK(match(PS_TEXT("a*b*c"), PS_TEXT("aXbYbZc")));
+        CHECK_FALSE(match(PS_TEXT("a*b*c"), PS_TEXT("aXbYbZ")));
+        CHECK(match(PS_TEXT("?.txt"), PS_TEXT("a.txt")));
+        CHECK_FALSE(match(PS_TEXT("?.txt"), PS_TEXT("ab.txt")));
+        CHECK(match(PS_TEXT("[a-c]x"), PS_TEXT("bx")));
+        CHECK_FALSE(match(PS_TEXT("[a-c]x"), PS_TEXT("dx")));
+        CHECK(match(PS_TEXT("[!a-c]x"), PS_TEXT("dx")));
+        CHECK(match(PS_TEXT("[]]"), PS_TEXT("]")));
+        CHECK(match(PS_TEXT("[a"), PS_TEXT("[a"))); // unterminated set is a literal
+        CHECK(match(PS_TEXT("\\*"), PS_TEXT("*")));
+        CHECK_FALSE(match(PS_TEXT("\\*"), PS_TEXT("a")));
+        CHECK(match(PS_TEXT("*.[ch]"), PS_TEXT("file.h")));
+    }
+    
+    WHEN("the filter is a predicate") {
+        name_filter f{[](const name_filter::char_type* s, size_t n) { return n > 0 && s[n - 1] == '~'; }};
+        CHECK(f(PS_TEXT("backup~")));
+        CHECK_FALSE(f(PS_TEXT("backup")));
+    }
+}
+
 TEMPLATE_TEST_CASE("iterator common", "", directory_iterator, recursive_directory_iterator) {
     using iterator_type = TestType;
 
@@ -0,0 +1,267 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_manifest.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+#include "fsdirent_catch_fix.hpp"
+
+using namespace prosoft;
+using namespace prosoft::filesystem;
+
+#include <fstestutils.hpp>
+
+namespace {
+
+void write(const path& p, const std::string& s) {
+    std::ofstream f{p.c_str(), std::ios::binary};
+    f << s;
+}
+
+manifest_record record(const char* name, iterator_depth_type depth, file_type type = file_type::regular) {
+    manifest_record r;
+    r.name = path{name};
+    r.depth = depth;
+    r.type = type;
+    return r;
+}
+
+} // anon
+
+TEST_CASE("filesystem_manifest") {
+    const auto root = temp_directory_path() / process_name("fs_manifest_test");
+    remove_all(root);
+    const auto tree = root / PS_TEXT("tree");
+    const auto file = root / PS_TEXT("tree.manifest");
+    REQUIRE(create_directories(tree / PS_TEXT("d") / PS_TEXT("e")));
+    write(tree / PS_TEXT("a"), "hello");
+    write(tree / PS_TEXT("d") / PS_TEXT("b"), "world!");
+    write(tree / PS_TEXT("d") / PS_TEXT("e") / PS_TEXT("c"), "");
+#if !_WIN32
+    create_symlink(PS_TEXT("a"), tree / PS_TEXT("l"));
+#endif
+    
+    SECTION("tree") {
+        manifest_config cfg{manifest_options::digests};
+        cfg.block_entries = 2;
+        manifest_writer w{file, tree, cfg};
+        for (recursive_directory_iterator i{tree, directory_options::include_postorder_directories}; i != end(i); ++i) {
+            w.append(i);
+        }
+#if !_WIN32
+        CHECK(w.size() == 6);
+#else
+        CHECK(w.size() == 5);
+#endif
+        error_code ec;
+        CHECK_FALSE(exists(file, ec));
+        w.commit();
+        
+        const manifest m{file};
+        CHECK(m.root() == tree);
+        CHECK(m.size() == w.size());
+        CHECK(m.has_digests());
+        CHECK(m.digest_algorithm() == hash_algorithm::xxh64);
+        
+        recursive_directory_iterator expected{tree};
+        std::size_t n = 0;
+        for (manifest_iterator i{m}; i != end(i); ++i, ++expected, ++n) {
+            REQUIRE(expected != end(expected));
+            CHECK(i->path() == expected->path());
+            CHECK(i.depth() == expected.depth());
+            
+            // cached
+            CHECK(i->cached_type() == expected->symlink_status().type());
+            CHECK(i->cached_file_id() == expected->file_id());
+            CHECK(i->cached_size() == i.record().size);
+            CHECK(i->last_write_time() == last_write_time(expected->path()));
+            
+            const auto& r = i.record();
+            CHECK(r.name == expected->path().filename());
+            CHECK(r.permissions == symlink_status(expected->path()).permissions());
+            if (r.type == file_type::regular) {
+                CHECK(r.size == file_size(expected->path()));
+                CHECK(r.digest == hash_file(expected->path()));
+            } else {
+                CHECK(r.digest.empty());
+            }
+#if !_WIN32
+            CHECK(r.metadata_modified != times::make_invalid());
+#endif
+        }
+        CHECK(expected == end(expected));
+        CHECK(n == m.size());
+    }
+    
+    SECTION("sorted tree") {
+        for (auto name : {"z", "m", "b0", "b", "B"}) {
+            create_file(tree / PS_TEXT("d") / PS_TEXT("e") / path{name});
+        }
+        manifest_writer w{file, tree};
+        w.append_tree(tree);
+        CHECK(w.sorted());
+        w.commit();
+        
+        const manifest m{file};
+        CHECK(m.sorted());
+        std::vector<path> paths;
+        for (manifest_iterator i{m}; i != end(i); ++i) {
+            paths.push_back(i->path());
+        }
+        const auto d = tree / PS_TEXT("d");
+        const auto e = d / PS_TEXT("e");
+        std::vector<path> expected{tree / PS_TEXT("a"), d, d / PS_TEXT("b"), e,
+            e / PS_TEXT("B"), e / PS_TEXT("b"), e / PS_TEXT("b0"), e / PS_TEXT("c"), e / PS_TEXT("m"), e / PS_TEXT("z")};
+#if !_WIN32
+        expected.push_back(tree / PS_TEXT("l"));
+#endif
+        CHECK(paths == expected);
+    }
+    
+    SECTION("records") {
+        {
+            manifest_writer w{file, path{}};
+            w.append(record("dir", 0, file_type::directory));
+            for (auto name : {"file001", "file002", "file010", "f", "file010.txt"}) {
+                w.append(record(name, 1));
+            }
+            w.append(record("sub", 1, file_type::directory));
+            w.append(record("x", 2));
+            w.append(record("last", 0));
+            
+            error_code ec;
+            w.append(record("too deep", 2), ec);
+            CHECK(ec);
+            w.append(record("", 0), ec);
+            CHECK(ec);
+            CHECK_FALSE(w.sorted()); // "f" after "file010"
+            w.commit();
+        }
+        
+        const manifest m{file};
+        CHECK(m.root().empty());
+        CHECK_FALSE(m.has_digests());
+        CHECK_FALSE(m.sorted());
+        std::vector<path> paths;
+        for (auto& e : manifest_iterator{m}) {
+            paths.push_back(e.path());
+        }
+        const auto dir = path{"dir"};
+        const std::vector<path> expected{dir, dir / PS_TEXT("file001"), dir / PS_TEXT("file002"), dir / PS_TEXT("file010"),
+            dir / PS_TEXT("f"), dir / PS_TEXT("file010.txt"), dir / PS_TEXT("sub"), dir / PS_TEXT("sub") / PS_TEXT("x"), path{"last"}};
+        CHECK(paths == expected);
+    }
+    
+    SECTION("skipping descendants") {
+        manifest_config cfg;
+        cfg.block_entries = 3; // skips cross blocks and start mid block
+        {
+            manifest_writer w{file, path{}, cfg};
+            w.append(record("a", 0, file_type::directory));
+            w.append(record("b", 1, file_type::directory));
+            w.append(record("c", 2));
+            w.append(record("d", 2));
+            w.append(record("e", 1));
+            w.append(record("f", 1, file_type::directory));
+            w.append(record("g", 2));
+            w.append(record("ab", 0));
+            w.append(record("abc", 0, file_type::directory));
+            w.append(record("x", 1));
+            w.commit();
+        }
+        
+        const manifest m{file};
+        manifest_iterator i{m};
+        CHECK(i->path() == path{"a"});
+        i.skip_descendants();
+        CHECK(i->path() == path{"ab"});
+        
+        i = manifest_iterator{m};
+        ++i;
+        CHECK(i->path() == path{"a/b"});
+        i.skip_descendants();
+        CHECK(i->path() == path{"a/e"});
+        i.skip_descendants(); // no descendants
+        CHECK(i->path() == path{"a/f"});
+        i.skip_descendants();
+        CHECK(i->path() == path{"ab"});
+        CHECK(i.record().name == path{"ab"}); // front coded after "g"
+        ++i;
+        CHECK(i->path() == path{"abc"});
+        i.skip_descendants();
+        CHECK(i == end(i));
+    }
+    
+    SECTION("empty") {
+        manifest_writer w{file, tree};
+        w.commit();
+        const manifest m{file};
+        CHECK(m.empty());
+        CHECK(manifest_iterator{m} == end(manifest_iterator{}));
+    }
+    
+    SECTION("discard") {
+        {
+            manifest_writer w{file, tree};
+            w.append(record("a", 0));
+        }
+        error_code ec;
+        CHECK_FALSE(exists(file, ec));
+    }
+    
+    SECTION("invalid") {
+        error_code ec;
+        manifest m{file, ec};
+        CHECK(ec);
+        
+        write(file, std::string(64, 'x'));
+        m = manifest{file, ec};
+        CHECK(ec);
+        CHECK(m.empty());
+        CHECK_THROWS_AS(manifest{file}, filesystem_error);
+        
+        {
+            manifest_writer w{file, tree};
+            w.append(record("a", 0));
+            w.commit();
+        }
+        std::string contents;
+        {
+            std::ifstream f{file.c_str(), std::ios::binary};
+            contents.assign(std::istreambuf_iterator<char>{f}, std::istreambuf_iterator<char>{});
+        }
+        contents[contents.size() - 1] ^= 1; // footer magic
+        write(file, contents);
+        m = manifest{file, ec};
+        CHECK(ec);
+    }
+    
+    CHECK(remove_all(root) > 0);
+}
@@ -0,0 +1,179 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_parallel_walk.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+#include "fsdirent_catch_fix.hpp"
+
+using namespace prosoft;
+using namespace prosoft::filesystem;
+
+#include <fstestutils.hpp>
+
+namespace {
+
+std::vector<path> iterator_listing(const path& root, directory_options opts = recursive_directory_iterator::default_options()) {
+    std::vector<path> l;
+    for (recursive_directory_iterator i{root, opts}; i != end(i); ++i) {
+        l.emplace_back(i->path());
+    }
+    std::sort(l.begin(), l.end());
+    return l;
+}
+
+} // anon
+
+TEST_CASE("filesystem_parallel_walk") {
+    const auto root = temp_directory_path() / process_name("fs17walk");
+    create_directory(root);
+    REQUIRE(exists(root));
+    
+    std::vector<path> created;
+    for (auto sub : {PS_TEXT("a"), PS_TEXT("b"), PS_TEXT(".c")}) {
+        auto d = root / sub;
+        for (int depth = 0; depth < 3; ++depth) {
+            create_directory(d);
+            created.emplace_back(d);
+            for (int i = 0; i < 20; ++i) {
+                created.emplace_back(create_file(d / path{std::to_string(i)}));
+            }
+            d /= PS_TEXT("d");
+        }
+    }
+    
+    const walk_config cfg{4, 7};
+    
+    WHEN("walking a tree") {
+        std::mutex lock;
+        std::vector<path> l;
+        size_t batches{};
+        parallel_walk(root, recursive_directory_iterator::default_options(), cfg, [&](walk_batch& b) {
+            CHECK(b.entries().size() <= cfg.batch_size);
+            CHECK_FALSE(b.error());
+            std::lock_guard<std::mutex> g{lock};
+            ++batches;
+            for (const auto& e : b.entries()) {
+                CHECK(e.path().parent_path() == b.directory());
+                CHECK(e.cached_type() != file_type::none);
+                l.emplace_back(e.path());
+            }
+        });
+        std::sort(l.begin(), l.end());
+        CHECK(l == iterator_listing(root));
+        CHECK(std::adjacent_find(l.begin(), l.end()) == l.end());
+        CHECK(batches > 9);
+    }
+    
+    WHEN("hidden entries are skipped") {
+        constexpr auto opts = recursive_directory_iterator::default_options()|directory_options::skip_hidden_descendants;
+        std::mutex lock;
+        std::vector<path> l;
+        parallel_walk(root, opts, cfg, [&](walk_batch& b) {
+            std::lock_guard<std::mutex> g{lock};
+            for (const auto& e : b.entries()) {
+                l.emplace_back(e.path());
+            }
+        });
+        std::sort(l.begin(), l.end());
+        CHECK(l == iterator_listing(root, opts));
+    }
+    
+    WHEN("a directory is pruned") {
+        std::mutex lock;
+        std::vector<path> l;
+        parallel_walk(root, recursive_directory_iterator::default_options(), cfg, [&](walk_batch& b) {
+            auto& ents = b.entries();
+            for (size_t i = 0; i < ents.size(); ++i) {
+                if (ents[i].path().filename().native() == PS_TEXT("b")) {
+                    CHECK(b.recursion_pending(i));
+                    b.disable_recursion_pending(i);
+                    CHECK_FALSE(b.recursion_pending(i));
+                }
+            }
+            std::lock_guard<std::mutex> g{lock};
+            for (auto& e : ents) {
+                l.emplace_back(std::move(e).path());
+            }
+        });
+        const auto pruned = root / PS_TEXT("b");
+        CHECK(std::find(l.begin(), l.end(), pruned) != l.end());
+        CHECK(std::none_of(l.begin(), l.end(), [&](const path& p) { return p.parent_path() == pruned; }));
+        CHECK(l.size() == iterator_listing(root).size() - 62);
+    }
+    
+    WHEN("the walk is stopped") {
+        std::atomic<size_t> calls{};
+        parallel_walk(root, recursive_directory_iterator::default_options(), walk_config{1}, [&](walk_batch& b) {
+            ++calls;
+            b.stop();
+        });
+        CHECK(calls == 1);
+    }
+    
+    WHEN("the visitor throws") {
+        CHECK_THROWS_AS(parallel_walk(root, recursive_directory_iterator::default_options(), cfg, [](walk_batch&) {
+            throw std::runtime_error("test");
+        }), std::runtime_error);
+    }
+    
+    WHEN("the root does not exist") {
+        error_code ec;
+        parallel_walk(root / PS_TEXT("x"), directory_options::none, cfg, [](walk_batch&) { CHECK(false); }, ec);
+        CHECK(ec.value() == ENOENT);
+        CHECK_THROWS(parallel_walk(root / PS_TEXT("x"), directory_options::none, cfg, [](walk_batch&) {}));
+    }
+    
+    WHEN("using a queue") {
+        std::vector<path> l;
+        {
+            walk_queue q{root, recursive_directory_iterator::default_options(), cfg, 2};
+            walk_batch b;
+            while (q.pop(b)) {
+                for (const auto& e : b.entries()) {
+                    l.emplace_back(e.path());
+                }
+            }
+            CHECK_FALSE(q.error());
+        }
+        std::sort(l.begin(), l.end());
+        CHECK(l == iterator_listing(root));
+        
+        walk_queue q{root, recursive_directory_iterator::default_options(), cfg, 1};
+        walk_batch b;
+        CHECK(q.pop(b)); // the rest is canceled
+    }
+    
+    std::reverse(created.begin(), created.end());
+    for (const auto& p : created) {
+        remove(p);
+    }
+    remove(root);
+}
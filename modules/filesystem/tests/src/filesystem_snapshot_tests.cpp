@@ -30,14 +30,45 @@
 
 #if __APPLE__
 #include <sys/mount.h>
+#elif __linux__
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <iterator>
 #endif
 
 #include <prosoft/core/modules/system_identity/identity.hpp>
 
 #include <catch2/catch_test_macros.hpp>
+#if __linux__
+#include <fstestutils.hpp>
+#endif
 
 using namespace prosoft::filesystem;
 
+#if __linux__
+namespace {
+
+void write_file(const path& p, const std::string& s) {
+    std::ofstream f{p.c_str(), std::ios::binary|std::ios::trunc};
+    REQUIRE(f);
+    f << s;
+}
+
+std::string read_file(const path& p) {
+    std::ifstream f{p.c_str(), std::ios::binary};
+    return std::string{std::istreambuf_iterator<char>{f}, std::istreambuf_iterator<char>{}};
+}
+
+// Snapshot files sharing data with the original must be older than the snapshot.
+void age_file(const path& p) {
+    struct timespec times[2] = {{::time(nullptr) - 60, 0}, {::time(nullptr) - 60, 0}};
+    REQUIRE(0 == ::utimensat(AT_FDCWD, p.c_str(), times, 0));
+}
+
+} // anon
+#endif
+
 TEST_CASE("filesystem_snapshot") {
     constexpr auto test_id = PS_TEXT("c4775ab0-fb84-11e6-9598-0800200c9a66");
 
@@ -114,6 +145,14 @@ TEST_CASE("filesystem_snapshot") {
         static const auto root = PS_TEXT("C:\\");
         static const auto mount_path = PS_TEXT("S:\\");
         static const auto system_root = PS_TEXT("Windows");
+#elif __linux__
+        const auto root = temp_directory_path() / process_name("snap_tree");
+        const auto mount_path = temp_directory_path() / path{std::string{"snap"}.append(std::to_string(getpid()))};
+        static const auto system_root = "etc";
+        error_code rec;
+        remove_all(root, rec);
+        create_directories(root / path{system_root});
+        create_file(root / path{system_root} / path{"hosts"});
 #else
         // attach_snapshot in macOS uses mount_apfs, which on Big Sur requires explicit
         // volume name ("/System/Volumes/Data" instead of "/"). It also works in 10.15.
@@ -159,7 +198,76 @@ TEST_CASE("filesystem_snapshot") {
         } else {
             std::cerr << "WARNING: failed to create test snapshot\n";
         }
+#if __linux__
+        remove_all(root, ec);
+#endif
     }
+
+#if __linux__
+    WHEN("reading a snapshot after the original is modified") {
+        const auto root = temp_directory_path() / process_name("snap_pit");
+        error_code ec;
+        remove_all(root, ec);
+        create_directories(root / PS_TEXT("d"));
+        const auto opened = path{PS_TEXT("a")};
+        const auto unopened = path{PS_TEXT("d")} / path{PS_TEXT("b")};
+        const auto restored = path{PS_TEXT("e")};
+        write_file(root / opened, "before a");
+        write_file(root / unopened, "before b");
+        write_file(root / restored, "before e");
+        age_file(root / opened);
+        age_file(root / unopened);
+        age_file(root / restored);
+        path links;
+        
+        {
+            auto snap = create_snapshot(root);
+            CHECK_FALSE(exists(root / PS_TEXT(".ps_snapshots"), ec)); // the store is never inside what it holds
+            CHECK_THROWS(snapshot_file(snap, path{}));
+            CHECK_THROWS(snapshot_file(snap, root / opened)); // must be relative
+            CHECK_THROWS(snapshot_file(snap, path{PS_TEXT("missing")}));
+            
+            const auto sa = snapshot_file(snap, opened);
+            CHECK(read_file(sa) == "before a");
+            
+            // Modified in place, as an editor that doesn't save atomically would.
+            write_file(root / opened, "after a");
+            write_file(root / unopened, "after b");
+            CHECK(read_file(sa) == "before a");
+            CHECK(snapshot_file(snap, opened) == sa);
+            
+            const auto sb = path{snap.id().m_id} / unopened;
+            struct stat st;
+            REQUIRE(0 == ::stat(sb.c_str(), &st));
+            if (st.st_nlink > 1) { // linked, so the old data is gone
+                CHECK(read_file(sb) == "after b");
+                snapshot_file(snap, unopened, ec);
+                CHECK(ec.value() == ESTALE);
+            } else { // cloned
+                CHECK(read_file(snapshot_file(snap, unopened)) == "before b");
+            }
+            
+            // Modified with its modification time restored, as some copy tools do.
+            write_file(root / restored, "after e");
+            age_file(root / restored);
+            const auto se = path{snap.id().m_id} / restored;
+            REQUIRE(0 == ::stat(se.c_str(), &st));
+            if (st.st_nlink > 1) {
+                snapshot_file(snap, restored, ec);
+                CHECK(ec.value() == ESTALE);
+            } else {
+                CHECK(read_file(snapshot_file(snap, restored)) == "before e");
+            }
+            
+            write_file(root / PS_TEXT("c"), "new");
+            CHECK_FALSE(exists(path{snap.id().m_id} / PS_TEXT("c"), ec));
+            links = path{snap.id().m_id};
+            links.concat(".links");
+        }
+        CHECK_FALSE(exists(links, ec));
+        remove_all(root, ec);
+    }
+#endif
 }
 
 #endif // PS_HAVE_FILESYSTEM_SNAPSHOT
@@ -25,6 +25,10 @@
 
 #include <prosoft/core/config/config_platform.h>
 
+#if !_WIN32
+#include <sys/stat.h>
+#endif
+
 #include <fstream>
 #include <iosfwd>
 #include <limits>
@@ -250,6 +254,22 @@ TEST_CASE("filesystem") {
         const auto t = now - duration_cast<file_time_type::duration>(seconds(3600));
         CHECK_NOTHROW(last_write_time(p, t));
         CHECK(last_write_time(p) < now);
+#if __linux__
+        CHECK(last_write_time(p) == t); // nsec precision
+        
+        const auto cst = status(p, status_info::all | status_info::cached);
+        CHECK(is_regular_file(cst));
+        CHECK(cst.size() == st.size());
+        CHECK(cst.permissions() == st.permissions());
+        CHECK(cst.owner() == st.owner());
+        CHECK(cst.times().modified() == t);
+        if (cst.times().has_created()) { // fs dependent
+            CHECK(cst.times().created() <= st.times().metadata_modified());
+        }
+        
+        const auto sst = status(p, status_info::size);
+        CHECK(sst.size() == st.size());
+#endif
         
         REQUIRE(remove(p));
     }
@@ -339,6 +359,36 @@ TEST_CASE("filesystem") {
         CHECK_FALSE(equivalent(nop, p, ec));
     }
     
+    WHEN("getting a file id") {
+        const auto p = temp_directory_path();
+        const auto id = file_id(p);
+        CHECK(id.valid());
+        CHECK(id == file_id(p));
+        CHECK(id != file_id(p.parent_path()));
+        CHECK(std::hash<file_id_type>{}(id) == std::hash<file_id_type>{}(file_id(p)));
+        
+        const auto nop = current_path() / uniqueName;
+        error_code ec;
+        CHECK_FALSE(file_id(nop, ec).valid());
+        CHECK(ec.value() != 0);
+        CHECK_THROWS(file_id(nop));
+        CHECK_THROWS(symlink_file_id(nop));
+#if !_WIN32
+        const auto f = create_file(temp_directory_path() / process_name("fileid"));
+        PS_RAII_REMOVE(f);
+        const auto hl = temp_directory_path() / process_name("fileid_hl");
+        REQUIRE(0 == ::link(f.c_str(), hl.c_str()));
+        PS_RAII_REMOVE(hl);
+        const auto sl = temp_directory_path() / process_name("fileid_sl");
+        REQUIRE(0 == ::symlink(f.c_str(), sl.c_str()));
+        PS_RAII_REMOVE(sl);
+        CHECK(file_id(hl) == file_id(f));
+        CHECK(file_id(sl) == file_id(f));
+        CHECK(symlink_file_id(sl) != file_id(f));
+        CHECK(symlink_file_id(f) == file_id(f));
+#endif
+    }
+    
     WHEN("setting the current path") {
         error_code ec;
         const auto p = temp_directory_path();
@@ -861,4 +911,189 @@ TEST_CASE("filesystem") {
         }
 #endif // !_WIN32
     }
+    
+    SECTION("copy file") {
+        const auto from = temp_directory_path() / process_name("fs17copy1");
+        const auto to = temp_directory_path() / process_name("fs17copy2");
+        {
+            std::ofstream f{from.c_str(), std::ios::binary};
+            f << "copy file test";
+        }
+        PS_RAII_REMOVE(from);
+        error_code ec;
+        remove(to, ec);
+        
+        auto contents = [](const path& p) {
+            std::ifstream f{p.c_str(), std::ios::binary};
+            return std::string{std::istreambuf_iterator<char>{f}, std::istreambuf_iterator<char>{}};
+        };
+        
+        WHEN("copying to a non-existant path") {
+            copy_file_result r;
+            CHECK(copy_file(from, to, copy_options::none, r));
+            PS_RAII_REMOVE(to);
+            CHECK(contents(to) == "copy file test");
+            CHECK(r.strategy != copy_strategy::none);
+            CHECK(r.bytes_cloned + r.bytes_copied == file_size(from));
+            CHECK(status(to).permissions() == status(from).permissions());
+        }
+        
+        WHEN("copying to an existing file") {
+            create_file(to);
+            PS_RAII_REMOVE(to);
+            CHECK_THROWS(copy_file(from, to));
+            CHECK_FALSE(copy_file(from, to, ec));
+            CHECK(ec.value() != 0);
+            
+            CHECK_FALSE(copy_file(from, to, copy_options::skip_existing, ec));
+            CHECK(ec.value() == 0);
+            CHECK(file_size(to) == 0);
+            
+            CHECK(copy_file(from, to, copy_options::overwrite_existing));
+            CHECK(contents(to) == "copy file test");
+        }
+        
+        WHEN("updating an existing file") {
+            create_file(to);
+            PS_RAII_REMOVE(to);
+            last_write_time(to, last_write_time(from) + std::chrono::hours{1});
+            CHECK_FALSE(copy_file(from, to, copy_options::update_existing));
+            CHECK(file_size(to) == 0);
+            
+            last_write_time(to, last_write_time(from) - std::chrono::hours{1});
+            CHECK(copy_file(from, to, copy_options::update_existing));
+            CHECK(contents(to) == "copy file test");
+        }
+        
+        WHEN("copying a file to itself") {
+            CHECK_FALSE(copy_file(from, from, copy_options::overwrite_existing, ec));
+            CHECK(ec.value() != 0);
+            CHECK(contents(from) == "copy file test");
+        }
+        
+        WHEN("copying a directory") {
+            CHECK_FALSE(copy_file(temp_directory_path(), to, ec));
+            CHECK(ec.value() != 0);
+            CHECK_FALSE(exists(to, ec));
+        }
+    }
+    
+    SECTION("copy") {
+        const auto from = temp_directory_path() / process_name("fs18copy1");
+        const auto to = temp_directory_path() / process_name("fs18copy2");
+        const auto sub = path{PS_TEXT("sub")};
+        const auto a = path{PS_TEXT("a")};
+        const auto b = sub / PS_TEXT("b");
+        error_code ec;
+        
+        create_directory(from);
+        create_directory(from / sub);
+        for (const auto& f : {a, b}) {
+            std::ofstream s{(from / f).c_str(), std::ios::binary};
+            s << f.native();
+        }
+#if !_WIN32
+        const auto l = path{PS_TEXT("l")};
+        const auto h = path{PS_TEXT("h")};
+        create_symlink(a, from / l);
+        REQUIRE(0 == ::link((from / a).c_str(), (from / h).c_str()));
+        REQUIRE(0 == ::chmod((from / b).c_str(), 0400));
+#endif
+        const auto mtime = last_write_time(from) - std::chrono::hours{1};
+        last_write_time(from / b, mtime);
+        last_write_time(from / sub, mtime);
+        
+        auto contents = [](const path& p) {
+            std::ifstream f{p.c_str(), std::ios::binary};
+            return std::string{std::istreambuf_iterator<char>{f}, std::istreambuf_iterator<char>{}};
+        };
+        
+        WHEN("copying recursively") {
+            copy_result r;
+            copy(from, to, copy_options::recursive|copy_options::copy_symlinks, copy_config{4}, r);
+            CHECK(contents(to / a) == contents(from / a));
+            CHECK(contents(to / b) == contents(from / b));
+            CHECK(r.directories == 2);
+            CHECK(last_write_time(to / b) == mtime);
+            CHECK(last_write_time(to / sub) == mtime);
+#if !_WIN32
+            CHECK(r.files == 2);
+            CHECK(r.symlinks == 1);
+            CHECK(r.hardlinks == 1);
+            CHECK(is_symlink(symlink_status(to / l)));
+            CHECK(file_id(to / a) == file_id(to / h));
+            CHECK(status(to / b).permissions() == perms::owner_read);
+            
+            CHECK_THROWS(copy(from, to, copy_options::recursive|copy_options::copy_symlinks));
+            copy(from, to, copy_options::recursive|copy_options::copy_symlinks|copy_options::skip_existing, copy_config{2}, r);
+            CHECK(r.skipped == 4);
+            CHECK(r.files == 0);
+#endif
+            remove_all(to);
+        }
+        
+        WHEN("copying a single level") {
+            copy(from, to, ec);
+            CHECK(ec.value() == 0);
+            CHECK(contents(to / a) == contents(from / a));
+            CHECK_FALSE(exists(to / sub, ec));
+#if !_WIN32
+            // The link is followed and the copy is not linked to its target.
+            CHECK(is_regular_file(symlink_status(to / l)));
+            CHECK(symlink_file_id(to / l) != file_id(to / a));
+#endif
+            remove_all(to);
+        }
+        
+#if !_WIN32
+        CHECK(remove_all(from) == 6);
+#else
+        CHECK(remove_all(from) == 4);
+#endif
+        CHECK_FALSE(exists(from, ec));
+    }
+    
+    SECTION("remove all") {
+        const auto root = temp_directory_path() / process_name("fs19rmall");
+        const auto sub = root / PS_TEXT("sub");
+        const auto deep = sub / PS_TEXT("deep");
+        error_code ec;
+        create_directory(root);
+        create_directory(sub);
+        create_directory(deep);
+        create_file(root / PS_TEXT("a"));
+        create_file(sub / PS_TEXT("b"));
+        create_file(deep / PS_TEXT("c"));
+        
+        WHEN("removing a tree") {
+            create_directory_symlink(sub, root / PS_TEXT("l"), ec);
+            const std::uintmax_t expected = ec ? 6 : 7;
+            CHECK(remove_all(root, remove_config{remove_options::none, 4}) == expected);
+            CHECK_FALSE(exists(root, ec));
+            CHECK(remove_all(root, ec) == 0);
+            CHECK(ec.value() == 0);
+        }
+        
+        WHEN("removing a single file") {
+            CHECK(remove_all(deep / PS_TEXT("c")) == 1);
+            CHECK(remove_all(root) == 5);
+        }
+        
+#if !_WIN32
+        WHEN("a directory is read-only") {
+            REQUIRE(0 == ::chmod(sub.c_str(), 0500));
+            if (::geteuid() != 0) { // root ignores the mode
+                // Only a and deep/c are removed, b and deep are protected by the read-only directory.
+                CHECK(remove_all(root, remove_config{remove_options::skip_permission_denied}, ec) == 2);
+                CHECK(ec.value() == 0);
+                CHECK(exists(sub / PS_TEXT("b")));
+                
+                CHECK(remove_all(root, ec) == static_cast<std::uintmax_t>(-1));
+                CHECK(ec.value() == EACCES);
+            }
+            CHECK(remove_all(root, remove_config{remove_options::make_writable}) > 0);
+            CHECK_FALSE(exists(root, ec));
+        }
+#endif
+    }
 }
@@ -0,0 +1,161 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_change_monitor.hpp>
+
+#if PS_HAVE_FILESYSTEM_CHANGE_MONITOR
+
+#include <filesystem_private.hpp>
+#include <fsmonitor_private.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+using namespace prosoft::filesystem;
+
+namespace {
+
+void add(change_notifications& notes, const char* p, change_event ev, change_event_id evid, const char* np = "") {
+    notes.emplace_back(path{p}, path{np}, evid, ev, file_type::regular);
+}
+
+} // namespace
+
+TEST_CASE("fsmonitor_internal") {
+    change_notifications notes;
+    const path root{"/r"};
+    
+    WHEN("events for a path are merged") {
+        add(notes, "/r/1", change_event::content_modified, 1);
+        add(notes, "/r/2", change_event::created, 2);
+        add(notes, "/r/1", change_event::metadata_modified, 3);
+        add(notes, "/r/1", change_event::content_modified, 4);
+        change_manager::coalesce(notes, root, 0);
+        REQUIRE(notes.size() == 2);
+        CHECK(notes[0].path() == path{"/r/1"});
+        CHECK(notes[0].event() == change_event::modified);
+        CHECK(notes[0].event_id() == 4);
+        CHECK(notes[1].path() == path{"/r/2"});
+    }
+    
+    WHEN("a path is created and removed") {
+        add(notes, "/r/1", change_event::created, 1);
+        add(notes, "/r/1", change_event::content_modified, 2);
+        add(notes, "/r/1", change_event::content_modified, 3);
+        add(notes, "/r/1", change_event::removed, 4);
+        add(notes, "/r/2", change_event::created, 5);
+        change_manager::coalesce(notes, root, 0);
+        REQUIRE(notes.size() == 1);
+        CHECK(notes[0].path() == path{"/r/2"});
+    }
+    
+    WHEN("a path is removed and created") {
+        add(notes, "/r/1", change_event::removed, 1);
+        add(notes, "/r/1", change_event::created, 2);
+        change_manager::coalesce(notes, root, 0);
+        REQUIRE(notes.size() == 1);
+        CHECK(notes[0].event() == (change_event::removed|change_event::created));
+    }
+    
+    WHEN("a path is created, removed and created again") {
+        add(notes, "/r/1", change_event::created, 1);
+        add(notes, "/r/1", change_event::removed, 2);
+        add(notes, "/r/1", change_event::created, 3);
+        change_manager::coalesce(notes, root, 0);
+        REQUIRE(notes.size() == 1);
+        CHECK(created(notes[0]));
+    }
+    
+    WHEN("a path is renamed") {
+        add(notes, "/r/1", change_event::created, 1);
+        add(notes, "/r/1", change_event::renamed, 2, "/r/2");
+        add(notes, "/r/1", change_event::created, 3);
+        add(notes, "/r/2", change_event::content_modified, 4);
+        change_manager::coalesce(notes, root, 0);
+        CHECK(notes.size() == 4);
+    }
+    
+    WHEN("a subtree is below the threshold") {
+        add(notes, "/r/d/1", change_event::created, 1);
+        add(notes, "/r/d/2", change_event::created, 2);
+        add(notes, "/r/e/1", change_event::created, 3);
+        change_manager::coalesce(notes, root, 2);
+        CHECK(notes.size() == 3);
+    }
+    
+    WHEN("a subtree is above the threshold") {
+        add(notes, "/r/1", change_event::created, 1);
+        add(notes, "/r/d", change_event::created, 2);
+        add(notes, "/r/d/1", change_event::created, 3);
+        add(notes, "/r/d/2", change_event::created, 4);
+        add(notes, "/r/d/3", change_event::created, 5);
+        add(notes, "/r/e/1", change_event::created, 6);
+        change_manager::coalesce(notes, root, 2);
+        REQUIRE(notes.size() == 3);
+        CHECK(notes[0].path() == path{"/r/1"});
+        CHECK(notes[1].path() == path{"/r/d"});
+        CHECK(notes[1].event() == change_event::rescan);
+        CHECK(notes[1].type() == file_type::directory);
+        CHECK(notes[1].event_id() == 5);
+        CHECK(notes[2].path() == path{"/r/e/1"});
+    }
+    
+    WHEN("nested subtrees are above the threshold") {
+        for (auto d : {"/r/d/a/", "/r/d/b/"}) {
+            for (auto f : {"1", "2", "3"}) {
+                add(notes, (std::string{d} + f).c_str(), change_event::created, 1);
+            }
+        }
+        
+        auto nested = notes;
+        change_manager::coalesce(nested, root, 2);
+        REQUIRE(nested.size() == 2); // a and b only count once towards d
+        CHECK(nested[0].path() == path{"/r/d/a"});
+        CHECK(nested[1].path() == path{"/r/d/b"});
+        
+        add(notes, "/r/d/1", change_event::created, 2);
+        change_manager::coalesce(notes, root, 2);
+        REQUIRE(notes.size() == 1);
+        CHECK(notes[0].path() == path{"/r/d"});
+        CHECK(rescan(notes[0]));
+    }
+    
+    WHEN("all events are below the root") {
+        add(notes, "/r/1", change_event::created, 1);
+        add(notes, "/r/2", change_event::created, 2);
+        add(notes, "/r/3", change_event::created, 3);
+        change_manager::coalesce(notes, root, 2);
+        CHECK(notes.size() == 3);
+    }
+    
+    WHEN("computing the memory size of a notification") {
+        add(notes, "/r/1", change_event::created, 1);
+        add(notes, "/r/1", change_event::renamed, 1, "/r/2");
+        CHECK(change_manager::memory_size(notes[0]) > sizeof(change_notification));
+        CHECK(change_manager::memory_size(notes[1]) > change_manager::memory_size(notes[0]));
+    }
+}
+
+#endif // PS_HAVE_FILESYSTEM_CHANGE_MONITOR
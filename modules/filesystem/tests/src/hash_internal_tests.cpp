@@ -0,0 +1,93 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <string>
+
+#include <hash_internal.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+using namespace prosoft::filesystem;
+using namespace prosoft::filesystem::ifilesystem;
+
+namespace {
+
+std::string digest(hash_algorithm a, const std::string& s) {
+    hasher h{a};
+    h.update(s.data(), s.size());
+    return h.finish().to_string();
+}
+
+// Every byte in its own update, to cross the block boundaries.
+std::string digest_bytewise(hash_algorithm a, const std::string& s) {
+    hasher h{a};
+    for (auto c : s) {
+        h.update(&c, 1);
+    }
+    return h.finish().to_string();
+}
+
+} // anon
+
+TEST_CASE("hash_internal") {
+    SECTION("xxh64") {
+        CHECK(digest(hash_algorithm::xxh64, "") == "ef46db3751d8e999");
+        CHECK(digest(hash_algorithm::xxh64, "a") == "d24ec4f1a98c6e5b");
+        CHECK(digest(hash_algorithm::xxh64, "abc") == "44bc2cf5ad770999");
+        CHECK(digest(hash_algorithm::xxh64, "Nobody inspects the spammish repetition") == "fbcea83c8a378bf1");
+        
+        xxh64 h;
+        h.update("abc", 3);
+        CHECK(h.value() == 0x44bc2cf5ad770999ULL);
+    }
+    
+    SECTION("murmur3") {
+        CHECK(digest(hash_algorithm::murmur3_128, "") == "00000000000000000000000000000000");
+        CHECK(digest(hash_algorithm::murmur3_128, "The quick brown fox jumps over the lazy dog") == "6c1b07bc7bbc4be347939ac4a93c437a");
+    }
+    
+    SECTION("sha256") {
+        CHECK(digest(hash_algorithm::sha256, "") == "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+        CHECK(digest(hash_algorithm::sha256, "abc") == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+        CHECK(digest(hash_algorithm::sha256, std::string(1000, 'a')) == "41edece42d63e8d9bf515a9ba6932e1c20cbc9f5a5d134645adb5db1b9737ea3");
+    }
+    
+    SECTION("split updates") {
+        const std::string s(1000, 'x');
+        for (auto a : {hash_algorithm::xxh64, hash_algorithm::murmur3_128, hash_algorithm::sha256}) {
+            CHECK(digest_bytewise(a, s) == digest(a, s));
+            CHECK(digest_bytewise(a, "The quick brown fox jumps over the lazy dog") == digest(a, "The quick brown fox jumps over the lazy dog"));
+        }
+    }
+    
+    SECTION("digest") {
+        hasher h{hash_algorithm::sha256};
+        const auto d = h.finish();
+        CHECK(d.size() == sha256::digest_size);
+        CHECK(d.algorithm() == hash_algorithm::sha256);
+        CHECK(d != hasher{hash_algorithm::xxh64}.finish());
+        CHECK(file_digest{}.empty());
+    }
+}
@@ -0,0 +1,248 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cstring>
+#include <vector>
+
+#include <inotify_monitor_internal.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+namespace fs = prosoft::filesystem::v1;
+
+using namespace prosoft::filesystem;
+
+namespace {
+
+struct event_buffer {
+    std::vector<char> buf;
+    
+    void add(int wd, uint32_t mask, const char* name = nullptr, uint32_t cookie = 0) {
+        const uint32_t len = name ? static_cast<uint32_t>((std::strlen(name) + sizeof(struct inotify_event)) & ~(sizeof(struct inotify_event) - 1)) : 0;
+        struct inotify_event ev{};
+        ev.wd = wd;
+        ev.mask = mask;
+        ev.cookie = cookie;
+        ev.len = len;
+        const auto pos = buf.size();
+        buf.resize(pos + sizeof(ev) + len);
+        std::memcpy(&buf[pos], &ev, sizeof(ev));
+        if (name) {
+            std::strcpy(&buf[pos + sizeof(ev)], name);
+        }
+    }
+    
+    const char* data() const {
+        return buf.data();
+    }
+    
+    size_t size() const {
+        return buf.size();
+    }
+};
+
+} // namespace
+
+TEST_CASE("inotify_monitor_internal") {
+    const fs::path root{PS_TEXT("/root")};
+    const fs::path sub{PS_TEXT("/root/sub")};
+    
+    platform_state state;
+    state.m_root = root;
+    state.m_roottype = fs::file_type::directory;
+    state.m_rootwd = 1;
+    state.m_parentwd = 3;
+    state.m_recursive = true;
+    state.m_watches[1] = root;
+    state.m_watches[2] = sub;
+    
+    fs::change_notifications notes;
+    event_buffer eb;
+    
+    WHEN("converting events") {
+        CHECK(to_event(IN_CREATE) == change_event::created);
+        CHECK(to_event(IN_DELETE) == change_event::removed);
+        CHECK(to_event(IN_MODIFY) == change_event::content_modified);
+        CHECK(to_event(IN_ATTRIB) == change_event::metadata_modified);
+        CHECK(to_event(IN_MOVED_FROM) == change_event::renamed);
+        CHECK(to_event(IN_MOVED_TO) == change_event::renamed);
+        CHECK(to_event(IN_Q_OVERFLOW) == change_event::rescan_required);
+        CHECK(to_event(IN_UNMOUNT) == change_event::rescan);
+        
+        CHECK(to_type(IN_CREATE|IN_ISDIR) == fs::file_type::directory);
+        CHECK(to_type(IN_CREATE) == fs::file_type::none);
+    }
+    
+    WHEN("converting events to a watch mask") {
+        CHECK(to_mask(change_event::created, false) == (IN_CREATE|IN_DELETE_SELF|IN_MOVE_SELF|IN_EXCL_UNLINK));
+        CHECK((to_mask(change_event::content_modified, false) & IN_CREATE) == 0);
+        CHECK((to_mask(change_event::content_modified, true) & (IN_CREATE|IN_MOVED_FROM|IN_MOVED_TO)) == (IN_CREATE|IN_MOVED_FROM|IN_MOVED_TO));
+        CHECK((to_mask(change_event::all, false) & (IN_DELETE|IN_MODIFY|IN_ATTRIB)) == (IN_DELETE|IN_MODIFY|IN_ATTRIB));
+    }
+    
+    WHEN("checking path containment") {
+        CHECK(is_under(sub, root));
+        CHECK(is_under(root, root));
+        CHECK_FALSE(is_under(root, sub));
+        CHECK_FALSE(is_under(fs::path{PS_TEXT("/rootsub")}, root));
+    }
+    
+    WHEN("translating events") {
+        eb.add(2, IN_CREATE, "1");
+        eb.add(1, IN_MODIFY, "2");
+        eb.add(1, IN_MODIFY);
+        state.translate(eb.data(), eb.size(), notes);
+        REQUIRE(notes.size() == 3);
+        CHECK(notes[0].path() == sub / PS_TEXT("1"));
+        CHECK(created(notes[0]));
+        CHECK(notes[1].path() == root / PS_TEXT("2"));
+        CHECK(content_modified(notes[1]));
+        CHECK(notes[2].path() == root);
+        CHECK(notes[0].event_id() < notes[1].event_id());
+        CHECK(notes[1].event_id() < notes[2].event_id());
+    }
+    
+    WHEN("events are for an unknown watch") {
+        eb.add(3, IN_CREATE, "1");
+        state.translate(eb.data(), eb.size(), notes);
+        CHECK(notes.empty());
+    }
+    
+    WHEN("a watch is removed") {
+        eb.add(2, IN_IGNORED);
+        eb.add(2, IN_CREATE, "1");
+        state.translate(eb.data(), eb.size(), notes);
+        CHECK(notes.empty());
+        CHECK(state.m_watches.count(2) == 0);
+    }
+    
+    WHEN("a file is renamed within the tree") {
+        eb.add(1, IN_MOVED_FROM, "1", 42);
+        eb.add(2, IN_MOVED_TO, "2", 42);
+        state.translate(eb.data(), eb.size(), notes);
+        REQUIRE(notes.size() == 2);
+        CHECK(notes[0].event_id() == notes[1].event_id());
+        CHECK(state.m_moves.empty());
+        
+        fs::change_manager::process_renames(notes);
+        REQUIRE(notes.size() == 1);
+        CHECK(renamed(notes[0]));
+        CHECK(notes[0].path() == root / PS_TEXT("1"));
+        CHECK(notes[0].renamed_to_path() == sub / PS_TEXT("2"));
+    }
+    
+    WHEN("a directory is renamed within the tree") {
+        eb.add(1, IN_MOVED_FROM|IN_ISDIR, "sub", 7);
+        eb.add(1, IN_MOVED_TO|IN_ISDIR, "new", 7);
+        eb.add(2, IN_CREATE, "1");
+        state.translate(eb.data(), eb.size(), notes);
+        REQUIRE(notes.size() == 3);
+        CHECK(state.m_watches[2] == root / PS_TEXT("new"));
+        CHECK(notes[2].path() == root / PS_TEXT("new") / PS_TEXT("1"));
+    }
+    
+    WHEN("a file is moved out of the tree") {
+        eb.add(2, IN_MOVED_FROM, "1", 42);
+        state.translate(eb.data(), eb.size(), notes);
+        REQUIRE(notes.size() == 1);
+        CHECK(state.m_moves.size() == 1);
+        
+        state.resolve_moves(notes);
+        REQUIRE(notes.size() == 1);
+        CHECK(notes[0].event() == (change_event::removed|change_event::outside_tree));
+        CHECK(notes[0].path() == sub / PS_TEXT("1"));
+        CHECK(state.m_moves.empty());
+    }
+    
+    WHEN("a file is moved into the tree") {
+        eb.add(2, IN_MOVED_TO, "1", 42);
+        state.translate(eb.data(), eb.size(), notes);
+        REQUIRE(notes.size() == 1);
+        CHECK(notes[0].event() == (change_event::created|change_event::outside_tree));
+    }
+    
+    WHEN("the event queue overflows") {
+        eb.add(-1, IN_Q_OVERFLOW);
+        eb.add(2, IN_CREATE, "1");
+        state.translate(eb.data(), eb.size(), notes);
+        REQUIRE(notes.size() == 1);
+        CHECK(notes[0].event() == change_event::rescan_required);
+        CHECK(notes[0].path() == root);
+        CHECK(state.m_canceled);
+    }
+    
+    WHEN("the root is removed") {
+        eb.add(1, IN_DELETE_SELF);
+        eb.add(1, IN_IGNORED);
+        state.translate(eb.data(), eb.size(), notes);
+        REQUIRE(notes.size() == 1);
+        CHECK(canceled(notes[0]));
+        CHECK(removed(notes[0]));
+        CHECK(state.m_canceled);
+    }
+    
+    WHEN("the root is renamed") {
+        eb.add(3, IN_MOVED_FROM|IN_ISDIR, "other", 6);
+        eb.add(3, IN_MOVED_FROM|IN_ISDIR, "root", 7);
+        eb.add(3, IN_MOVED_TO|IN_ISDIR, "root2", 7);
+        eb.add(1, IN_MOVE_SELF);
+        state.translate(eb.data(), eb.size(), notes);
+        REQUIRE(notes.size() == 1);
+        CHECK(canceled(notes[0]));
+        CHECK(renamed(notes[0]));
+        CHECK_FALSE(rescan(notes[0]));
+        CHECK(notes[0].path() == root);
+        CHECK(notes[0].renamed_to_path() == fs::path{PS_TEXT("/root2")});
+    }
+    
+    WHEN("the root is moved to another directory") {
+        eb.add(3, IN_MOVED_FROM|IN_ISDIR, "root", 7);
+        eb.add(1, IN_MOVE_SELF);
+        state.translate(eb.data(), eb.size(), notes);
+        REQUIRE(notes.size() == 1);
+        CHECK(notes[0].event() == change_event::rescan_required);
+        CHECK(notes[0].renamed_to_path().empty());
+    }
+    
+    WHEN("the root is removed from its parent") {
+        eb.add(3, IN_DELETE|IN_ISDIR, "rootsub");
+        eb.add(3, IN_DELETE|IN_ISDIR, "root");
+        state.translate(eb.data(), eb.size(), notes);
+        REQUIRE(notes.size() == 1);
+        CHECK(canceled(notes[0]));
+        CHECK(removed(notes[0]));
+    }
+    
+    WHEN("a subdirectory is removed") {
+        eb.add(2, IN_DELETE_SELF);
+        eb.add(2, IN_IGNORED);
+        eb.add(1, IN_DELETE|IN_ISDIR, "sub");
+        state.translate(eb.data(), eb.size(), notes);
+        REQUIRE(notes.size() == 1);
+        CHECK(notes[0].event() == change_event::removed);
+        CHECK(notes[0].type() == fs::file_type::directory);
+        CHECK_FALSE(state.m_canceled);
+    }
+}
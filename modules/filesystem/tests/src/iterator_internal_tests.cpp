@@ -109,6 +109,33 @@ struct test_nopen : test_ops {
     }
 };
 
+#if !_WIN32
+// Reports every dir it opens on another device than its entries, as with an unmounted btrfs subvolume.
+struct fake_dev_ops {
+    static native_dir* open(const fs::path& p) {
+        return open_dir(p);
+    }
+    
+    static native_dir* open_at(native_dir* parent, const char* leaf, bool follow) {
+        return open_dir_at(dir_fd(parent), leaf, follow);
+    }
+    
+    static native_dirent* read(native_dir* d) {
+        return read_dir(d);
+    }
+    
+    static int stat(native_dir* d, struct ::stat& sb) {
+        const auto err = ::fstat(dir_fd(d), &sb);
+        sb.st_dev += 1;
+        return err;
+    }
+    
+    static int close(native_dir* d) {
+        return close_dir(d);
+    }
+};
+#endif
+
 template <class T, class... Args>
 std::unique_ptr<T> make_ptr(Args&& ...a) {
     return std::unique_ptr<T>{ new T(std::forward<Args>(a)...) };
@@ -138,6 +165,62 @@ TEST_CASE("filesystem_iterator_internal") {
         CHECK(nullptr == read_dir(nullptr));
     }
     
+#if !_WIN32
+    WHEN("opening a relative dir") {
+        CHECK(nullptr == open_dir_at(-1, "tmp", false));
+        CHECK(EBADF == errno);
+        auto root = open_dir(PS_TEXT("/"));
+        REQUIRE(root);
+        CHECK(nullptr == open_dir_at(dir_fd(root), "", false));
+        if (auto d = open_dir_at(dir_fd(root), "tmp", true)) {
+            CHECK(0 == close_dir(d));
+        } else {
+            CHECK(false);
+        }
+        CHECK(0 == close_dir(root));
+    }
+#endif
+    
+#if PS_FS_HAVE_GETDENTS64
+    WHEN("bulk dir is null") {
+        CHECK(-1 == close_bulk_dir(nullptr));
+        CHECK(nullptr == read_bulk_dir(nullptr));
+        CHECK(nullptr == open_bulk_dir(PS_TEXT(""), 0));
+    }
+    
+    WHEN("reading a bulk dir") {
+        auto d = open_bulk_dir(PS_TEXT("/"), 0);
+        REQUIRE(d);
+        CHECK(d->m_capacity == min_bulk_read_size);
+        bool dotFound{};
+        while (auto e = read_bulk_dir(d)) {
+            CHECK(bulk_name_length(e) == name_length(e));
+            dotFound |= std::string(e->d_name) == ".";
+        }
+        CHECK(0 == errno);
+        CHECK(dotFound);
+        CHECK(0 == close_bulk_dir(d));
+    }
+
+    WHEN("a bulk record is converted to a dirent") {
+        alignas(8) char buf[offsetof(linux_dirent64, d_name) + 16]{};
+        auto r = reinterpret_cast<linux_dirent64*>(buf);
+        r->d_ino = 42;
+        r->d_off = 7;
+        r->d_reclen = sizeof(buf);
+        r->d_type = DT_DIR;
+        std::memcpy(r->d_name, "name", 5);
+        native_dirent cur;
+        auto e = convert_record(cur, r);
+        CHECK(e == &cur);
+        CHECK(42 == e->d_ino);
+        CHECK(7 == e->d_off);
+        CHECK(DT_DIR == e->d_type);
+        CHECK(std::string(e->d_name) == "name");
+        CHECK(4 == bulk_name_length(e));
+    }
+#endif
+    
     WHEN("leaf path contains dot component") {
         CHECK(leaf_is_dot_or_dot_dot(PS_TEXT(".")));
         CHECK(leaf_is_dot_or_dot_dot(PS_TEXT("..")));
@@ -316,4 +399,61 @@ TEST_CASE("filesystem_iterator_internal") {
         CHECK(p.empty());
     }
 #endif
+    
+#if !_WIN32
+    WHEN("a sub-directory is on another device but not mounted") {
+        const auto root = temp_directory_path() / PS_TEXT("ps_fake_dev");
+        const auto sub = root / PS_TEXT("sub");
+        const auto leaf = sub / PS_TEXT("leaf");
+        create_directory(root);
+        create_directory(sub);
+        create_directory(leaf);
+        
+        CHECK_FALSE(is_mountpoint(sub));
+        for (bool relative : {false, true}) {
+            fs::ifilesystem::iterator_config cfg;
+            cfg.relative_traversal = relative;
+            error_code ec;
+            state<fake_dev_ops> s{root, recursive_directory_iterator::default_options(), fake_dev_ops{}, std::move(cfg), ec};
+            REQUIRE(0 == ec.value());
+            std::vector<path> l;
+            for (auto p = s.next(ec); !p.empty(); p = s.next(ec)) {
+                CHECK(0 == ec.value());
+                l.push_back(p);
+            }
+            CHECK(l == (std::vector<path>{sub, leaf}));
+        }
+        
+        remove(leaf);
+        remove(sub);
+        remove(root);
+    }
+#endif
+    
+    WHEN("encoding a checkpoint") {
+        const auto root = temp_directory_path() / PS_TEXT("r");
+        checkpoint_type levels;
+        levels.push_back(checkpoint_level{root, std::string{}, 0, false});
+        levels.push_back(checkpoint_level{root / PS_TEXT("a"), std::string{"x"}, 0x7fffffffffffffffULL, false});
+        levels.push_back(checkpoint_level{temp_directory_path() / PS_TEXT("link"), std::string{"\xff\0y", 3}, 128, false}); // not a child of the previous level
+        levels.push_back(checkpoint_level{temp_directory_path() / PS_TEXT("link") / PS_TEXT("mnt"), std::string{}, 0, true});
+        const auto token = encode_checkpoint(levels);
+        error_code ec;
+        const auto decoded = decode_checkpoint(token, ec);
+        CHECK(0 == ec.value());
+        REQUIRE(decoded.size() == levels.size());
+        for (size_t i = 0; i < levels.size(); ++i) {
+            CHECK(decoded[i].m_path == levels[i].m_path);
+            CHECK(decoded[i].m_last == levels[i].m_last);
+            CHECK(decoded[i].m_offset == levels[i].m_offset);
+            CHECK(decoded[i].m_placeholder == levels[i].m_placeholder);
+        }
+        
+        for (size_t len = 0; len < token.size(); ++len) {
+            CHECK(decode_checkpoint(token.substr(0, len), ec).empty());
+            CHECK(ec.value() == EINVAL);
+        }
+        CHECK(decode_checkpoint(token + "x", ec).empty());
+        CHECK(ec.value() == EINVAL);
+    }
 }
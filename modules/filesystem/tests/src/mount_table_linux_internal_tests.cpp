@@ -0,0 +1,81 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include <mount_table_linux_internal.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+#include <fstestutils.hpp>
+
+using namespace prosoft::filesystem;
+using namespace prosoft::filesystem::ifilesystem;
+
+TEST_CASE("mount_table_linux_internal") {
+    SECTION("parse") {
+        mount_table::mount m;
+        const std::string line{"36 35 98:1 /mnt1 /mnt\\0402 rw,noatime master:1 - ext3 /dev/root rw,errors=continue"};
+        REQUIRE(mount_table::parse(line.data(), line.size(), m));
+        CHECK(m.device == makedev(98, 1));
+        CHECK(m.dir == "/mnt 2");
+
+        const std::string bad{"36 35 x:1 /mnt1 /mnt2"};
+        CHECK_FALSE(mount_table::parse(bad.data(), bad.size(), m));
+        const std::string truncated{"36 35 98:1 /mnt1"};
+        CHECK_FALSE(mount_table::parse(truncated.data(), truncated.size(), m));
+    }
+
+    SECTION("unescape") {
+        const std::string s{"a\\134b\\011c\\04"};
+        CHECK(mount_table::unescape(s.data(), s.size()) == "a\\b\tc\\04");
+    }
+
+    SECTION("lookup") {
+        auto& table = mount_table::shared();
+        REQUIRE(table.valid());
+        struct ::stat sb;
+        REQUIRE(0 == ::stat("/", &sb));
+        error_code ec;
+        const auto mp = table.mount_path(sb.st_dev, ec);
+        CHECK(ec.value() == 0);
+        CHECK(equivalent(mp, "/"));
+        
+        const auto missing = table.mount_path(makedev(0xfff, 0xfffff), ec);
+        CHECK(missing.empty());
+        CHECK(ec.value() == ENOENT);
+    }
+
+    SECTION("is_mountpoint") {
+        CHECK(is_mountpoint("/"));
+        const auto p = temp_directory_path() / process_name("mount_table_test");
+        create_directory(p);
+        PS_RAII_REMOVE(p);
+        error_code ec;
+        CHECK_FALSE(is_mountpoint(p, ec));
+        CHECK(ec.value() == 0);
+        CHECK(mount_path(p) == mount_path(temp_directory_path()));
+    }
+}
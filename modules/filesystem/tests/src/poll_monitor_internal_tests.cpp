@@ -0,0 +1,227 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_change_monitor.hpp>
+
+#if PS_HAVE_FILESYSTEM_CHANGE_MONITOR
+
+#include <chrono>
+
+#include <poll_monitor_internal.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+#include <fstestutils.hpp>
+
+using namespace prosoft;
+using namespace prosoft::filesystem;
+using namespace prosoft::filesystem::ifilesystem;
+
+namespace {
+
+stat_buf make_stat(std::uint64_t ino, off_t size, time_t mtime, mode_t mode = S_IFREG) {
+    stat_buf sb{};
+    sb.st_ino = static_cast<ino_t>(ino);
+    sb.st_size = size;
+    sb.st_mode = mode;
+#if __APPLE__
+    sb.st_mtimespec.tv_sec = mtime;
+    sb.st_ctimespec.tv_sec = mtime;
+#else
+    sb.st_mtim.tv_sec = mtime;
+    sb.st_ctim.tv_sec = mtime;
+#endif
+    return sb;
+}
+
+struct change {
+    std::string name;
+    change_event event;
+};
+
+std::vector<change> changes(const dir_snapshot& before, const dir_snapshot& after) {
+    std::vector<change> v;
+    compare(before, after, [&v](const std::string& name, const dir_snapshot::entry* b, const dir_snapshot::entry* a) {
+        v.push_back(change{name, to_event(b, a)});
+    });
+    return v;
+}
+
+} // namespace
+
+TEST_CASE("poll_monitor_internal") {
+    WHEN("snapshots are compared") {
+        dir_snapshot before;
+        before.add("b", 1, make_stat(2, 10, 100));
+        before.add("a", 1, make_stat(1, 10, 100));
+        before.add("c", 1, make_stat(3, 10, 100));
+        before.add("d", 1, make_stat(4, 0, 100, S_IFDIR));
+        before.add("e", 1, make_stat(5, 0, 100));
+        before.finish();
+        REQUIRE(before.size() == 5);
+        CHECK(before.name(*before.begin()) == "a");
+        
+        dir_snapshot after;
+        after.add("a", 1, make_stat(1, 10, 100)); // unchanged
+        after.add("c", 1, make_stat(3, 20, 200)); // modified
+        after.add("aa", 2, make_stat(6, 0, 100)); // created
+        after.add("d", 1, make_stat(4, 0, 200, S_IFDIR)); // a child changed
+        after.add("e", 1, make_stat(7, 0, 100)); // replaced
+        after.finish();
+        
+        const auto v = changes(before, after);
+        REQUIRE(v.size() == 5);
+        CHECK(v[0].name == "aa");
+        CHECK(v[0].event == change_event::created);
+        CHECK(v[1].name == "b");
+        CHECK(v[1].event == change_event::removed);
+        CHECK(v[2].name == "c");
+        CHECK(v[2].event == change_event::content_modified);
+        CHECK(v[3].name == "d");
+        CHECK(v[3].event == change_event::none);
+        CHECK(v[4].name == "e");
+        CHECK(v[4].event == (change_event::removed|change_event::created));
+        
+        CHECK(changes(before, before).empty());
+    }
+    
+    WHEN("only the change time differs") {
+        dir_snapshot before;
+        before.add("a", 1, make_stat(1, 10, 100));
+        before.finish();
+        auto e = *before.begin();
+        ++e.changed;
+        CHECK(to_event(&*before.begin(), &e) == change_event::metadata_modified);
+    }
+    
+    WHEN("computing the next interval") {
+        using ms = std::chrono::milliseconds;
+        const ms min{10};
+        const ms max{100};
+        CHECK(next_interval(ms{40}, true, min, max) == min);
+        CHECK(next_interval(min, false, min, max) == ms{20});
+        CHECK(next_interval(ms{60}, false, min, max) == max);
+        CHECK(next_interval(max, false, min, max) == max);
+        CHECK(next_interval(ms{1}, false, min, max) == min);
+    }
+    
+    SECTION("polling") {
+        const auto root = canonical(temp_directory_path()) / process_name("fs22poll");
+        remove_all(root);
+        constexpr int dirs = 4;
+        for (int i = 0; i < dirs; ++i) {
+            const auto d = root / path{std::to_string(i)};
+            create_directories(d);
+            create_file(d / PS_TEXT("f"));
+            last_write_time(d, file_time_type::clock::now() - std::chrono::hours{1});
+        }
+        last_write_time(root, file_time_type::clock::now() - std::chrono::hours{1});
+        
+        change_config cfg;
+        cfg.poll_interval = change_config::latency_type{10};
+        cfg.max_poll_interval = change_config::latency_type{1000};
+        const auto later = poll_state::clock_type::now() + std::chrono::hours{1};
+        change_notifications notes;
+        error_code ec;
+        
+        WHEN("nothing changed") {
+            cfg.events = change_event::created|change_event::removed;
+            cfg.poll_syscall_limit = 0;
+            poll_state ps{root, cfg, true, ec};
+            REQUIRE_FALSE(ec);
+            
+            ps.poll(later, notes);
+            CHECK(notes.empty());
+            // The directories are not read again and their entries are not stat'ed without modification events.
+            CHECK(ps.m_syscalls == 2 * (dirs + 1));
+            for (const auto& n : ps.m_nodes) {
+                CHECK(n.interval > cfg.poll_interval);
+            }
+        }
+        
+        WHEN("a directory was modified just before it was read") {
+            const auto d = root / PS_TEXT("0");
+            last_write_time(d, file_time_type::clock::now());
+            cfg.events = change_event::created|change_event::removed;
+            cfg.poll_syscall_limit = 0;
+            poll_state ps{root, cfg, true, ec};
+            REQUIRE_FALSE(ec);
+            const auto idx = ps.find_node(d);
+            REQUIRE(idx != poll_state::npos);
+            CHECK(ps.m_nodes[idx].racy);
+            CHECK_FALSE(ps.m_nodes[0].racy);
+            
+            // A change in the same timestamp tick wouldn't change its times, so it's read again.
+            ps.poll(later, notes);
+            CHECK(notes.empty());
+            CHECK(ps.m_syscalls == 2 * (dirs + 1) + 1);
+            CHECK(ps.m_nodes[idx].due - later == cfg.poll_interval);
+        }
+        
+        WHEN("a file is modified in an unchanged directory") {
+            cfg.poll_syscall_limit = 0;
+            poll_state ps{root, cfg, true, ec};
+            REQUIRE_FALSE(ec);
+            
+            const auto f = root / PS_TEXT("2") / PS_TEXT("f");
+            {
+                std::ofstream stream(f.c_str());
+                stream << "hello world" << std::flush;
+            }
+            ps.poll(later, notes);
+            REQUIRE(notes.size() == 1);
+            CHECK(notes.front().path() == f);
+            CHECK(content_modified(notes.front()));
+        }
+        
+        WHEN("the syscall limit is reached") {
+            cfg.poll_syscall_limit = 4;
+            poll_state ps{root, cfg, true, ec};
+            REQUIRE_FALSE(ec);
+            
+            for (int i = 0; i < dirs; ++i) {
+                create_file(root / path{std::to_string(i)} / PS_TEXT("new"));
+            }
+            
+            // The root and one directory fit in each poll, the remaining directories are deferred.
+            size_t polls = 0;
+            while (notes.size() < dirs && polls < 10) {
+                ps.poll(later, notes);
+                CHECK(ps.m_syscalls <= cfg.poll_syscall_limit + 3); // the first directory always fits
+                ++polls;
+            }
+            CHECK(notes.size() == dirs);
+            CHECK(polls > 1);
+            for (const auto& n : notes) {
+                CHECK(created(n));
+                CHECK(n.path().filename() == path{PS_TEXT("new")});
+            }
+        }
+        
+        remove_all(root);
+    }
+}
+
+#endif // PS_HAVE_FILESYSTEM_CHANGE_MONITOR
@@ -1,10 +1,16 @@
 #include <prosoft/core/modules/filesystem/filesystem.hpp>   // first (required for other includes)
 
 #include <prosoft/core/modules/filesystem/filesystem_acl.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_atomic_file.hpp>
 #include <prosoft/core/modules/filesystem/filesystem_change_iterator.hpp>
 #include <prosoft/core/modules/filesystem/filesystem_change_monitor.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_diff.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_duplicates.hpp>
 #include <prosoft/core/modules/filesystem/filesystem_have_change_monitor.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_hash.hpp>
 #include <prosoft/core/modules/filesystem/filesystem_iterator.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_manifest.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_parallel_walk.hpp>
 #include <prosoft/core/modules/filesystem/filesystem_path.hpp>
 #include <prosoft/core/modules/filesystem/filesystem_primatives.hpp>
 #include <prosoft/core/modules/filesystem/filesystem_snapshot.hpp>